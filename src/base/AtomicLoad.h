@@ -0,0 +1,93 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_ATOMIC_LOAD_H
+#define RG_ATOMIC_LOAD_H
+
+#include <QtGlobal>
+#include <QAtomicPointer>
+#include <QAtomicInt>
+
+namespace Rosegarden
+{
+
+/**
+ * Read an atomic value with acquire ordering, without writing to it.
+ *
+ * Qt 4 has no loadAcquire(), and fetchAndAddAcquire(0) does the job
+ * but is a locked read-modify-write, which makes every reader of a
+ * widely shared value contend for its cache line.  These are for
+ * values that are read far more often than they are written: they
+ * compile to an ordinary load on x86, and to a load and a fence on
+ * weaker machines.
+ */
+
+#if QT_VERSION >= 0x050000
+
+template <typename T>
+inline T *loadAcquire(const QBasicAtomicPointer<T> &p)
+{
+    return p.loadAcquire();
+}
+
+inline int loadAcquire(const QBasicAtomicInt &i)
+{
+    return i.loadAcquire();
+}
+
+#elif defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+
+template <typename T>
+inline T *loadAcquire(const QBasicAtomicPointer<T> &p)
+{
+    return __atomic_load_n(&p._q_value, __ATOMIC_ACQUIRE);
+}
+
+inline int loadAcquire(const QBasicAtomicInt &i)
+{
+    return __atomic_load_n(&i._q_value, __ATOMIC_ACQUIRE);
+}
+
+#else
+
+// A volatile read, then a compiler barrier so that later reads can't
+// be moved ahead of it.  That is enough on x86, whose loads are
+// already acquire loads.
+
+template <typename T>
+inline T *loadAcquire(const QBasicAtomicPointer<T> &p)
+{
+    T *value = p._q_value;
+#ifdef __GNUC__
+    __asm__ __volatile__("" ::: "memory");
+#endif
+    return value;
+}
+
+inline int loadAcquire(const QBasicAtomicInt &i)
+{
+    int value = i._q_value;
+#ifdef __GNUC__
+    __asm__ __volatile__("" ::: "memory");
+#endif
+    return value;
+}
+
+#endif
+
+}
+
+#endif
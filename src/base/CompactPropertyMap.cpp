@@ -0,0 +1,204 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "CompactPropertyMap.h"
+#include "ObjectPool.h"
+
+namespace Rosegarden
+{
+using std::string;
+
+static ObjectPool &
+propertyMapPool()
+{
+    // never deleted, as maps may outlive any static destructor
+    static ObjectPool *pool =
+        new ObjectPool("CompactPropertyMap", sizeof(CompactPropertyMap));
+    return *pool;
+}
+
+void *
+CompactPropertyMap::operator new(size_t size)
+{
+    return propertyMapPool().allocate(size);
+}
+
+void
+CompactPropertyMap::operator delete(void *p, size_t size)
+{
+    propertyMapPool().release(p, size);
+}
+
+size_t
+CompactPropertyMap::trimPool()
+{
+    return propertyMapPool().trim();
+}
+
+CompactPropertyMap::CompactPropertyMap() :
+    m_entries(m_inline),
+    m_count(0),
+    m_capacity(InlineCount)
+{
+    // nothing
+}
+
+CompactPropertyMap::CompactPropertyMap(const CompactPropertyMap &pm) :
+    m_entries(m_inline),
+    m_count(0),
+    m_capacity(InlineCount)
+{
+    if (pm.m_count > InlineCount) {
+        m_entries = new Entry[pm.m_count];
+        m_capacity = pm.m_count;
+    }
+
+    for (int i = 0; i < pm.m_count; ++i) {
+        m_entries[i] = pm.m_entries[i];
+        if (m_entries[i].type == String) {
+            m_entries[i].value.s = new string(*pm.m_entries[i].value.s);
+        }
+    }
+
+    m_count = pm.m_count;
+}
+
+CompactPropertyMap::~CompactPropertyMap()
+{
+    clear();
+    if (m_entries != m_inline) delete[] m_entries;
+}
+
+void
+CompactPropertyMap::clear()
+{
+    for (int i = 0; i < m_count; ++i) release(m_entries[i]);
+    m_count = 0;
+}
+
+void
+CompactPropertyMap::release(Entry &e)
+{
+    if (e.type == String) {
+        delete e.value.s;
+        e.value.s = 0;
+    }
+}
+
+int
+CompactPropertyMap::find(const PropertyName &name) const
+{
+    int value = name.getValue();
+    int lo = 0, hi = m_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int v = m_entries[mid].name.getValue();
+        if (v == value) return mid;
+        if (v < value) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+int
+CompactPropertyMap::makeSlot(const PropertyName &name, PropertyType type)
+{
+    if (m_count == m_capacity) {
+        int capacity = m_capacity * 2;
+        Entry *entries = new Entry[capacity];
+        for (int i = 0; i < m_count; ++i) entries[i] = m_entries[i];
+        if (m_entries != m_inline) delete[] m_entries;
+        m_entries = entries;
+        m_capacity = capacity;
+    }
+
+    int index = m_count;
+    while (index > 0 && name < m_entries[index-1].name) {
+        m_entries[index] = m_entries[index-1];
+        --index;
+    }
+
+    m_entries[index].name = name;
+    m_entries[index].type = type;
+    m_entries[index].value.s = 0;
+    ++m_count;
+
+    return index;
+}
+
+void
+CompactPropertyMap::erase(int index)
+{
+    release(m_entries[index]);
+    for (int i = index + 1; i < m_count; ++i) {
+        m_entries[i-1] = m_entries[i];
+    }
+    --m_count;
+}
+
+int
+CompactPropertyMap::moveTo(int index, CompactPropertyMap &other)
+{
+    Entry &e = m_entries[index];
+    int target = other.makeSlot(e.name, e.type);
+    other.m_entries[target].value = e.value;
+
+    // ownership of any string has passed to the other map
+    e.value.s = 0;
+    e.type = Int;
+    erase(index);
+
+    return target;
+}
+
+string
+CompactPropertyMap::getTypeName(int index) const
+{
+    switch (m_entries[index].type) {
+    case Int: return PropertyDefn<Int>::typeName();
+    case String: return PropertyDefn<String>::typeName();
+    case Bool: return PropertyDefn<Bool>::typeName();
+    case RealTimeT: return PropertyDefn<RealTimeT>::typeName();
+    }
+    return "";
+}
+
+string
+CompactPropertyMap::unparse(int index) const
+{
+    switch (m_entries[index].type) {
+    case Int: return PropertyDefn<Int>::unparse(getData<Int>(index));
+    case String: return PropertyDefn<String>::unparse(getData<String>(index));
+    case Bool: return PropertyDefn<Bool>::unparse(getData<Bool>(index));
+    case RealTimeT:
+        return PropertyDefn<RealTimeT>::unparse(getData<RealTimeT>(index));
+    }
+    return "";
+}
+
+size_t
+CompactPropertyMap::getStorageSize() const
+{
+    size_t s = sizeof(*this);
+    if (m_entries != m_inline) s += m_capacity * sizeof(Entry);
+    for (int i = 0; i < m_count; ++i) {
+        if (m_entries[i].type == String) {
+            s += sizeof(string) + m_entries[i].value.s->size();
+        }
+    }
+    return s;
+}
+
+}
@@ -0,0 +1,166 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_COMPACT_PROPERTY_MAP_H
+#define RG_COMPACT_PROPERTY_MAP_H
+
+#include "Property.h"
+#include "base/PropertyName.h"
+
+#include <string>
+#include <cstddef>
+
+namespace Rosegarden {
+
+/**
+ * CompactPropertyMap is the property store used by Event.
+ *
+ * PropertyMap (still used by Configuration) is a std::map from
+ * PropertyName to a separately allocated PropertyStore, which costs
+ * two heap allocations per property.  Events carry a handful of
+ * properties each and there are a great many events, so instead this
+ * class keeps its entries in an array sorted by the PropertyName's
+ * interned value, and stores Int, Bool and RealTime values directly
+ * in the entry.  Only String values have a separate allocation.  The
+ * first few entries live inside the map object itself, so a typical
+ * event needs no allocation for its properties beyond the map.
+ *
+ * Entries are addressed by index.  An index is only valid until the
+ * next insert or erase on the same map.
+ */
+class CompactPropertyMap
+{
+public:
+    CompactPropertyMap();
+    CompactPropertyMap(const CompactPropertyMap &pm);
+    ~CompactPropertyMap();
+
+    int size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+
+    /// Remove all entries.
+    void clear();
+
+    /// Return the index of the named entry, or -1 if there is none.
+    int find(const PropertyName &name) const;
+
+    const PropertyName &getName(int index) const {
+        return m_entries[index].name;
+    }
+    PropertyType getType(int index) const {
+        return m_entries[index].type;
+    }
+    std::string getTypeName(int index) const;
+
+    /// Return the value at index as a string, as PropertyStore::unparse does
+    std::string unparse(int index) const;
+
+    /**
+     * Return the value at index.  The caller must already have
+     * checked that getType(index) == P.
+     */
+    template <PropertyType P>
+    typename PropertyDefn<P>::basic_type getData(int index) const {
+        typename PropertyDefn<P>::basic_type data;
+        load(m_entries[index].value, data);
+        return data;
+    }
+
+    /**
+     * Set the value at index.  The caller must already have checked
+     * that getType(index) == P.
+     */
+    template <PropertyType P>
+    void setData(int index, typename PropertyDefn<P>::basic_type data) {
+        store(m_entries[index].value, data);
+    }
+
+    /**
+     * Add a new entry, which must not already be present, and return
+     * its index.
+     */
+    template <PropertyType P>
+    int insert(const PropertyName &name,
+               typename PropertyDefn<P>::basic_type data) {
+        int index = makeSlot(name, P);
+        store(m_entries[index].value, data);
+        return index;
+    }
+
+    /// Remove the entry at index.
+    void erase(int index);
+
+    /**
+     * Move the entry at index into another map, which must not
+     * already have an entry of the same name, and return its index
+     * there.  Cheaper than reading and reinserting, for strings.
+     */
+    int moveTo(int index, CompactPropertyMap &other);
+
+    /// Approximate heap and object storage, for debugging
+    size_t getStorageSize() const;
+
+    /// Allocated from an ObjectPool; see Event::trimPools
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+    static size_t trimPool();
+
+private:
+    CompactPropertyMap &operator=(const CompactPropertyMap &); // not provided
+
+    union Value {
+        long i;
+        bool b;
+        struct { int sec; int nsec; } rt;
+        std::string *s;
+    };
+
+    struct Entry {
+        PropertyName name;
+        PropertyType type;
+        Value value;
+    };
+
+    enum { InlineCount = 4 };
+
+    Entry *m_entries;           // either m_inline or a heap array
+    int m_count;
+    int m_capacity;
+    Entry m_inline[InlineCount];
+
+    int makeSlot(const PropertyName &name, PropertyType type);
+    void release(Entry &e);
+
+    static void load(const Value &v, long &data) { data = v.i; }
+    static void load(const Value &v, bool &data) { data = v.b; }
+    static void load(const Value &v, RealTime &data) {
+        data.sec = v.rt.sec; data.nsec = v.rt.nsec;
+    }
+    static void load(const Value &v, std::string &data) { data = *v.s; }
+
+    static void store(Value &v, long data) { v.i = data; }
+    static void store(Value &v, bool data) { v.b = data; }
+    static void store(Value &v, const RealTime &data) {
+        v.rt.sec = data.sec; v.rt.nsec = data.nsec;
+    }
+    static void store(Value &v, const std::string &data) {
+        if (v.s) *v.s = data;
+        else v.s = new std::string(data);
+    }
+};
+
+}
+
+#endif
@@ -202,6 +202,8 @@ Composition::Composition() :
 
 Composition::~Composition()
 {
+    Profiler profiler("Composition::~Composition");
+
     if (!m_observers.empty()) {
         cerr << "Warning: Composition::~Composition() with " << m_observers.size()
              << " observers still extant" << endl;
@@ -218,6 +220,10 @@ Composition::~Composition()
     clear();
     delete m_basicQuantizer;
     delete m_notationQuantizer;
+
+    // Hand back the memory our events were using, except where other
+    // events (in the clipboard or another document) still share it
+    Event::trimPools();
 }
 
 Composition::iterator
@@ -631,6 +637,8 @@ Composition::setEndMarker(const timeT &eM)
 {
     bool shorten = (eM < m_endMarker);
     m_endMarker = eM;
+    // a ramp in the last tempo change runs to the end marker
+    m_tempoTimestampsNeedCalculating = true;
     clearVoiceCaches();
     updateRefreshStatuses();
     notifyEndMarkerChange(shorten);
@@ -659,6 +667,7 @@ Composition::clear()
     m_endMarker = getBarRange(m_defaultNbBars).first;
     m_solo = false;
     m_selectedTrackId = 0;
+    m_tempoTimestampsNeedCalculating = true;
     updateRefreshStatuses();
 }
 
@@ -967,59 +976,7 @@ Composition::removeTimeSignature(int n)
 tempoT
 Composition::getTempoAtTime(timeT t) const
 {
-    ReferenceSegment::iterator i = m_tempoSegment.findNearestTime(t);
-
-    // In negative time, if there's no tempo event actually defined
-    // prior to the point of interest then we use the next one after
-    // it, so long as it's no later than time zero.  This is the only
-    // rational way to deal with count-in bars where the correct
-    // tempo otherwise won't appear until we hit bar zero.  See also
-    // getTimeSignatureAt
-
-    if (i == m_tempoSegment.end()) {
-        if (t < 0) {
-#ifdef DEBUG_TEMPO_STUFF
-            cerr << "Composition: Negative time " << t << " for tempo, using 0" << endl;
-#endif
-            return getTempoAtTime(0);
-        }
-        else return m_defaultTempo;
-    }
-    
-    tempoT tempo = (tempoT)((*i)->get<Int>(TempoProperty));
-
-    if ((*i)->has(TargetTempoProperty)) {
-
-        tempoT target = (tempoT)((*i)->get<Int>(TargetTempoProperty));
-        ReferenceSegment::iterator j = i;
-        ++j;
-
-        if (target > 0 || (target == 0 && j != m_tempoSegment.end())) {
-
-            timeT t0 = (*i)->getAbsoluteTime();
-            timeT t1 = (j != m_tempoSegment.end() ?
-                        (*j)->getAbsoluteTime() : getEndMarker());
-
-            if (t1 < t0) return tempo;
-
-            if (target == 0) {
-                target = (tempoT)((*j)->get<Int>(TempoProperty));
-            }
-
-            // tempo ramps are linear in 1/tempo
-            double s0 = 1.0 / double(tempo);
-            double s1 = 1.0 / double(target);
-            double s = s0 + (t - t0) * ((s1 - s0) / (t1 - t0));
-
-            tempoT result = tempoT((1.0 / s) + 0.01);
-
-#ifdef DEBUG_TEMPO_STUFF
-            cerr << "Composition: Calculated tempo " << result << " at " << t << endl;
-#endif
-
-            return result;
-        }
-    }
+    tempoT tempo = getTempoMap().getTempoAtTime(t);
 
 #ifdef DEBUG_TEMPO_STUFF
     cerr << "Composition: Found tempo " << tempo << " at " << t << endl;
@@ -1178,39 +1135,11 @@ Composition::updateExtremeTempos()
 RealTime
 Composition::getElapsedRealTime(timeT t) const
 {
-    calculateTempoTimestamps();
-
-    ReferenceSegment::iterator i = m_tempoSegment.findNearestTime(t);
-    if (i == m_tempoSegment.end()) {
-        i = m_tempoSegment.begin();
-        if (t >= 0 ||
-            (i == m_tempoSegment.end() || (*i)->getAbsoluteTime() > 0)) {
-            return time2RealTime(t, m_defaultTempo);
-        }
-    }
-
-    RealTime elapsed;
-
-    tempoT target = -1;
-    timeT nextTempoTime = t;
-
-    if (!getTempoTarget(i, target, nextTempoTime)) target = -1;
-
-    if (target > 0) {
-        elapsed = getTempoTimestamp(*i) +
-            time2RealTime(t - (*i)->getAbsoluteTime(),
-                          tempoT((*i)->get<Int>(TempoProperty)),
-                          nextTempoTime - (*i)->getAbsoluteTime(),
-                          target);
-    } else {
-        elapsed = getTempoTimestamp(*i) +
-            time2RealTime(t - (*i)->getAbsoluteTime(),
-                          tempoT((*i)->get<Int>(TempoProperty)));
-    }
+    RealTime elapsed = getTempoMap().getElapsedRealTime(t);
 
 #ifdef DEBUG_TEMPO_STUFF
     cerr << "Composition::getElapsedRealTime: " << t << " -> "
-         << elapsed << " (last tempo change at " << (*i)->getAbsoluteTime() << ")" << endl;
+         << elapsed << endl;
 #endif
 
     return elapsed;
@@ -1219,34 +1148,7 @@ Composition::getElapsedRealTime(timeT t) const
 timeT
 Composition::getElapsedTimeForRealTime(RealTime t) const
 {
-    calculateTempoTimestamps();
-
-    ReferenceSegment::iterator i = m_tempoSegment.findNearestRealTime(t);
-    if (i == m_tempoSegment.end()) {
-        i = m_tempoSegment.begin();
-        if (t >= RealTime::zeroTime ||
-            (i == m_tempoSegment.end() || (*i)->getAbsoluteTime() > 0)) {
-            return realTime2Time(t, m_defaultTempo);
-        }
-    }
-
-    timeT elapsed;
-
-    tempoT target = -1;
-    timeT nextTempoTime = 0;
-    if (!getTempoTarget(i, target, nextTempoTime)) target = -1;
-
-    if (target > 0) {
-        elapsed = (*i)->getAbsoluteTime() +
-            realTime2Time(t - getTempoTimestamp(*i),
-                          (tempoT)((*i)->get<Int>(TempoProperty)),
-                          nextTempoTime - (*i)->getAbsoluteTime(),
-                          target);
-    } else {
-        elapsed = (*i)->getAbsoluteTime() +
-            realTime2Time(t - getTempoTimestamp(*i),
-                          (tempoT)((*i)->get<Int>(TempoProperty)));
-    }
+    timeT elapsed = getTempoMap().getElapsedTimeForRealTime(t);
 
 #ifdef DEBUG_TEMPO_STUFF
     static int doError = true;
@@ -1257,235 +1159,54 @@ Composition::getElapsedTimeForRealTime(RealTime t) const
         doError = true;
         cerr << "getElapsedTimeForRealTime: " << t << " -> "
              << elapsed << " (error " << (cfReal - t)
-             << " or " << (cfTimeT - elapsed) << ", tempo "
-             << (*i)->getAbsoluteTime() << ":"
-             << (tempoT)((*i)->get<Int>(TempoProperty)) << ")" << endl;
+             << " or " << (cfTimeT - elapsed) << ")" << endl;
     }
 #endif
     return elapsed;
 }
 
+const TempoMap &
+Composition::getTempoMap() const
+{
+    calculateTempoTimestamps();
+    return m_tempoMap;
+}
+
 void
 Composition::calculateTempoTimestamps() const
 {
     if (!m_tempoTimestampsNeedCalculating) return;
 
-    timeT lastTimeT = 0;
-    RealTime lastRealTime;
-
-    tempoT tempo = m_defaultTempo;
-    tempoT target = -1;
+    Profiler profiler("Composition::calculateTempoTimestamps");
 
-#ifdef DEBUG_TEMPO_STUFF
-    cerr << "Composition::calculateTempoTimestamps: Tempo events are:" << endl;
-#endif
+    std::vector<TempoMap::Change> changes;
+    changes.reserve(m_tempoSegment.size());
 
     for (ReferenceSegment::iterator i = m_tempoSegment.begin();
          i != m_tempoSegment.end(); ++i) {
 
-        RealTime myTime;
-
-        if (target > 0) {
-            myTime = lastRealTime +
-                time2RealTime((*i)->getAbsoluteTime() - lastTimeT, tempo,
-                              (*i)->getAbsoluteTime() - lastTimeT, target);
-        } else {
-            myTime = lastRealTime +
-                time2RealTime((*i)->getAbsoluteTime() - lastTimeT, tempo);
-        }
-
-        setTempoTimestamp(*i, myTime);
-
-#ifdef DEBUG_TEMPO_STUFF
-        (*i)->dump(cerr);
-#endif
-
-        lastRealTime = myTime;
-        lastTimeT = (*i)->getAbsoluteTime();
-        tempo = tempoT((*i)->get<Int>(TempoProperty));
-
-        target = -1;
-        timeT nextTempoTime = 0;
-        if (!getTempoTarget(i, target, nextTempoTime)) target = -1;
-    }
-
-    m_tempoTimestampsNeedCalculating = false;
-}
-
-#ifdef DEBUG_TEMPO_STUFF
-static int DEBUG_silence_recursive_tempo_printout = 0;
-#endif
-
-RealTime
-Composition::time2RealTime(timeT t, tempoT tempo) const
-{
-    static timeT cdur = Note(Note::Crotchet).getDuration();
-
-    double dt = (double(t) * 100000 * 60) / (double(tempo) * cdur);
-
-    int sec = int(dt);
-    int nsec = int((dt - sec) * 1000000000);
-   
-    RealTime rt(sec, nsec);
-
-#ifdef DEBUG_TEMPO_STUFF
-    if (!DEBUG_silence_recursive_tempo_printout) {
-        cerr << "Composition::time2RealTime: t " << t << ", sec " << sec << ", nsec "
-             << nsec << ", tempo " << tempo
-             << ", cdur " << cdur << ", dt " << dt << ", rt " << rt << endl;
-        DEBUG_silence_recursive_tempo_printout = 1;
-        timeT ct = realTime2Time(rt, tempo);
-        timeT et = t - ct;
-        RealTime ert = time2RealTime(et, tempo);
-        cerr << "cf. realTime2Time(" << rt << ") -> " << ct << " [err " << et << " (" << ert << "?)]" << endl;
-        DEBUG_silence_recursive_tempo_printout=0;
-    }
-#endif
-
-    return rt;
-}
-
-RealTime
-Composition::time2RealTime(timeT time, tempoT tempo,
-                           timeT targetTime, tempoT targetTempo) const
-{
-    static timeT cdur = Note(Note::Crotchet).getDuration();
-
-    // The real time elapsed at musical time t, in seconds, during a
-    // smooth tempo change from "tempo" at musical time zero to
-    // "targetTempo" at musical time "targetTime", is
-    // 
-    //           2 
-    //     at + t (b - a)
-    //          ---------
-    //             2n
-    // where
-    // 
-    // a is the initial tempo in seconds per tick
-    // b is the target tempo in seconds per tick
-    // n is targetTime in ticks
-
-    if (targetTime == 0 || targetTempo == tempo) {
-        return time2RealTime(time, targetTempo);
-    }
-
-    double a = (100000 * 60) / (double(tempo) * cdur);
-    double b = (100000 * 60) / (double(targetTempo) * cdur);
-    double t = time;
-    double n = targetTime;
-    double result = (a * t) + (t * t * (b - a)) / (2 * n);
-
-    int sec = int(result);
-    int nsec = int((result - sec) * 1000000000);
-   
-    RealTime rt(sec, nsec);
-
-#ifdef DEBUG_TEMPO_STUFF
-    if (!DEBUG_silence_recursive_tempo_printout) {
-        cerr << "Composition::time2RealTime[2]: time " << time << ", tempo "
-             << tempo << ", targetTime " << targetTime << ", targetTempo "
-             << targetTempo << ": rt " << rt << endl;
-        DEBUG_silence_recursive_tempo_printout = 1;
-//        RealTime nextRt = time2RealTime(targetTime, tempo, targetTime, targetTempo);
-        timeT ct = realTime2Time(rt, tempo, targetTime, targetTempo);
-        cerr << "cf. realTime2Time: rt " << rt << " -> " << ct << endl;
-        DEBUG_silence_recursive_tempo_printout=0;
-    }
-#endif
-
-    return rt;
-}
-
-timeT
-Composition::realTime2Time(RealTime rt, tempoT tempo) const
-{
-    static timeT cdur = Note(Note::Crotchet).getDuration();
-
-    double tsec = (double(rt.sec) * cdur) * (tempo / (60.0 * 100000.0));
-    double tnsec = (double(rt.nsec) * cdur) * (tempo / 100000.0);
-
-    double dt = tsec + (tnsec / 60000000000.0);
-    timeT t = (timeT)(dt + (dt < 0 ? -1e-6 : 1e-6));
+        tempoT target = -1;
+        timeT targetTime = 0;
+        if (!getTempoTarget(i, target, targetTime)) target = -1;
 
-#ifdef DEBUG_TEMPO_STUFF
-    if (!DEBUG_silence_recursive_tempo_printout) {
-        cerr << "Composition::realTime2Time: rt.sec " << rt.sec << ", rt.nsec "
-             << rt.nsec << ", tempo " << tempo
-             << ", cdur " << cdur << ", tsec " << tsec << ", tnsec " << tnsec << ", dt " << dt << ", t " << t << endl;
-        DEBUG_silence_recursive_tempo_printout = 1;
-        RealTime crt = time2RealTime(t, tempo);
-        RealTime ert = rt - crt;
-        timeT et = realTime2Time(ert, tempo);
-        cerr << "cf. time2RealTime(" << t << ") -> " << crt << " [err " << ert << " (" << et << "?)]" << endl;
-        DEBUG_silence_recursive_tempo_printout = 0;
+        changes.push_back(TempoMap::Change
+                          ((*i)->getAbsoluteTime(),
+                           tempoT((*i)->get<Int>(TempoProperty)),
+                           target, targetTime));
     }
-#endif
 
-    return t;
-}
+    m_tempoMap = TempoMap(m_defaultTempo, changes);
 
-timeT
-Composition::realTime2Time(RealTime rt, tempoT tempo,
-                           timeT targetTime, tempoT targetTempo) const
-{
-    static timeT cdur = Note(Note::Crotchet).getDuration();
-
-    // Inverse of the expression in time2RealTime above.
-    // 
-    // The musical time elapsed at real time t, in ticks, during a
-    // smooth tempo change from "tempo" at real time zero to
-    // "targetTempo" at real time "targetTime", is
-    // 
-    //          2na (+/-) sqrt((2nb)^2 + 8(b-a)tn)
-    //       -  ----------------------------------
-    //                       2(b-a)
-    // where
-    // 
-    // a is the initial tempo in seconds per tick
-    // b is the target tempo in seconds per tick
-    // n is target real time in ticks
-
-    if (targetTempo == tempo) return realTime2Time(rt, tempo);
-
-    double a = (100000 * 60) / (double(tempo) * cdur);
-    double b = (100000 * 60) / (double(targetTempo) * cdur);
-    double t = double(rt.sec) + double(rt.nsec) / 1e9;
-    double n = targetTime;
-
-    double term1 = 2.0 * n * a;
-    double term2 = (2.0 * n * a) * (2.0 * n * a) + 8 * (b - a) * t * n;
-
-    if (term2 < 0) { 
-        // We're screwed, but at least let's not crash
-        std::cerr << "ERROR: Composition::realTime2Time: term2 < 0 (it's " << term2 << ")" << std::endl;
+    // The tempo events carry their real times too, for
+    // ReferenceSegment::findRealTime()
+    for (int n = 0; n < m_tempoMap.getChangeCount(); ++n) {
+        setTempoTimestamp(m_tempoSegment[n], m_tempoMap.getChange(n).m_realTime);
 #ifdef DEBUG_TEMPO_STUFF
-        std::cerr << "rt = " << rt << ", tempo = " << tempo << ", targetTime = " << targetTime << ", targetTempo = " << targetTempo << std::endl;
-        std::cerr << "n = " << n << ", b = " << b << ", a = " << a << ", t = " << t <<std::endl;
-        std::cerr << "that's sqrt( (" << ((2.0*n*a*2.0*n*a)) << ") + "
-                  << (8*(b-a)*t*n) << " )" << endl;
-
-        std::cerr << "so our original expression was " << rt << " = "
-                  << a << "t + (t^2 * (" << b << " - " << a << ")) / " << 2*n << std::endl;
+        m_tempoSegment[n]->dump(cerr);
 #endif
-
-        return realTime2Time(rt, tempo);
     }
 
-    double term3 = sqrt(term2);
-
-    // We only want the positive root
-    if (term3 > 0) term3 = -term3;
-
-    double result = - (term1 + term3) / (2 * (b - a));
-
-#ifdef DEBUG_TEMPO_STUFF
-    std::cerr << "Composition::realTime2Time:" <<endl;
-    std::cerr << "n = " << n << ", b = " << b << ", a = " << a << ", t = " << t <<std::endl;
-    std::cerr << "+/-sqrt(term2) = " << term3 << std::endl;
-    std::cerr << "result = " << result << endl;
-#endif
-
-    return long(result + 0.1);
+    m_tempoTimestampsNeedCalculating = false;
 }
 
 // @param A RealTime
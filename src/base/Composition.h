@@ -20,6 +20,7 @@
 #include "FastVector.h"
 
 #include "RealTime.h"
+#include "TempoMap.h"
 #include "base/Segment.h"
 #include "Track.h"
 #include "Configuration.h"
@@ -38,13 +39,6 @@
 
 namespace Rosegarden 
 {
-// We store tempo in quarter-notes per minute * 10^5 (hundred
-// thousandths of a quarter-note per minute).  This means the maximum
-// tempo in a 32-bit integer is about 21400 qpm.  We use a signed int
-// for compatibility with the Event integer type -- but note that we
-// use 0 (rather than -1) to indicate "tempo not set", by convention
-// (though see usage of target tempo in e.g. addTempoAtTime).
-typedef int tempoT;
 
 class Quantizer;
 class BasicQuantizer;
@@ -586,7 +580,10 @@ public:
      * Set a default tempo for the composition.  This will be
      * overridden by any tempo events encountered during playback.
      */
-    void setCompositionDefaultTempo(tempoT tempo) { m_defaultTempo = tempo; }
+    void setCompositionDefaultTempo(tempoT tempo) {
+        m_defaultTempo = tempo;
+        m_tempoTimestampsNeedCalculating = true;
+    }
     tempoT getCompositionDefaultTempo() const { return m_defaultTempo; }
 
     /**
@@ -691,6 +688,16 @@ public:
         else         return getElapsedRealTime(t0) - getElapsedRealTime(t1);
     }
 
+    /**
+     * Return the precalculated tempo map that the above use.  Code
+     * converting many times at once (when mapping a segment for
+     * playback, for instance) can save repeated lookups by calling
+     * TempoMap::getElapsedRealTimes() on it directly.  The reference
+     * is only good until the tempos, default tempo or end marker next
+     * change.
+     */
+    const TempoMap &getTempoMap() const;
+
     static tempoT
         timeRatioToTempo(RealTime &realTime,
                          timeT beatTime, tempoT rampTo);
@@ -1020,15 +1027,10 @@ protected:
     mutable bool m_barPositionsNeedCalculating;
     ReferenceSegment::iterator getTimeSignatureAtAux(timeT t) const;
 
-    /// affects m_tempoSegment
+    /// affects m_tempoSegment and m_tempoMap
     void calculateTempoTimestamps() const;
     mutable bool m_tempoTimestampsNeedCalculating;
-    RealTime time2RealTime(timeT time, tempoT tempo) const;
-    RealTime time2RealTime(timeT time, tempoT tempo,
-                           timeT targetTempoTime, tempoT targetTempo) const;
-    timeT realTime2Time(RealTime rtime, tempoT tempo) const;
-    timeT realTime2Time(RealTime rtime, tempoT tempo,
-                        timeT targetTempoTime, tempoT targetTempo) const;
+    mutable TempoMap m_tempoMap;
     bool getTempoTarget(ReferenceSegment::const_iterator i,
                         tempoT &target,
                         timeT &targetTime) const;
@@ -20,8 +20,9 @@
 #include "XmlExportable.h"
 #include "NotationTypes.h"
 #include "BaseProperties.h"
+#include "ObjectPool.h"
+#include "Profiler.h"
 
-#include <sstream>
 
 namespace Rosegarden 
 {
@@ -44,26 +45,41 @@ Event::EventData::EventData(const std::string &type, timeT absoluteTime,
     // empty
 }
 
-Event::EventData::EventData(const std::string &type, timeT absoluteTime,
+Event::EventData::EventData(const EventTypeName &type, timeT absoluteTime,
+			    timeT duration, short subOrdering) :
+    m_refCount(1),
+    m_type(type),
+    m_absoluteTime(absoluteTime),
+    m_duration(duration),
+    m_subOrdering(subOrdering),
+    m_properties(0)
+{
+    // empty
+}
+
+Event::EventData::EventData(const EventTypeName &type, timeT absoluteTime,
 			    timeT duration, short subOrdering,
-			    const PropertyMap *properties) :
+			    const CompactPropertyMap *properties) :
     m_refCount(1),
     m_type(type),
     m_absoluteTime(absoluteTime),
     m_duration(duration),
     m_subOrdering(subOrdering),
-    m_properties(properties ? new PropertyMap(*properties) : 0)
+    m_properties(properties ? new CompactPropertyMap(*properties) : 0)
 {
     // empty
 }
 
 Event::EventData *Event::EventData::unshare()
 {
-    --m_refCount;
-
+    // Copy before letting go, as another instance may be letting go
+    // at the same time, and then whichever of us goes last must
+    // delete this
     EventData *newData = new EventData
 	(m_type, m_absoluteTime, m_duration, m_subOrdering, m_properties);
 
+    if (!m_refCount.deref()) delete this;
+
     return newData;
 }
 
@@ -72,54 +88,105 @@ Event::EventData::~EventData()
     if (m_properties) delete m_properties;
 }
 
+// The pools are never deleted, as events may outlive any static
+// destructor
+
+static ObjectPool &
+eventPool()
+{
+    static ObjectPool *pool = new ObjectPool("Event", sizeof(Event));
+    return *pool;
+}
+
+static ObjectPool &
+eventDataPool(size_t size)
+{
+    // EventData is private to Event, so its size comes from the caller
+    static ObjectPool *pool = new ObjectPool("Event::EventData", size);
+    return *pool;
+}
+
+void *
+Event::EventData::operator new(size_t size)
+{
+    return eventDataPool(sizeof(EventData)).allocate(size);
+}
+
+void
+Event::EventData::operator delete(void *p, size_t size)
+{
+    eventDataPool(sizeof(EventData)).release(p, size);
+}
+
+void *
+Event::operator new(size_t size)
+{
+    return eventPool().allocate(size);
+}
+
+void
+Event::operator delete(void *p, size_t size)
+{
+    eventPool().release(p, size);
+}
+
+void
+Event::trimPools()
+{
+    Profiler profiler("Event::trimPools");
+    eventPool().trim();
+    eventDataPool(sizeof(EventData)).trim();
+    CompactPropertyMap::trimPool();
+}
+
 timeT
 Event::EventData::getNotationTime() const
 {
     if (!m_properties) return m_absoluteTime;
-    PropertyMap::const_iterator i = m_properties->find(NotationTime);
-    if (i == m_properties->end()) return m_absoluteTime;
-    else return static_cast<PropertyStore<Int> *>(i->second)->getData();
+    int i = m_properties->find(NotationTime);
+    if (i < 0) return m_absoluteTime;
+    else return m_properties->getData<Int>(i);
 }
 
 timeT
 Event::EventData::getNotationDuration() const
 {
     if (!m_properties) return m_duration;
-    PropertyMap::const_iterator i = m_properties->find(NotationDuration);
-    if (i == m_properties->end()) return m_duration;
-    else return static_cast<PropertyStore<Int> *>(i->second)->getData();
+    int i = m_properties->find(NotationDuration);
+    if (i < 0) return m_duration;
+    else return m_properties->getData<Int>(i);
 }
 
 void
 Event::EventData::setTime(const PropertyName &name, timeT t, timeT deft)
 {
-    if (!m_properties) m_properties = new PropertyMap();
-    PropertyMap::iterator i = m_properties->find(name);
+    if (t == deft && !m_properties) return;
+    if (!m_properties) m_properties = new CompactPropertyMap();
+    int i = m_properties->find(name);
 
     if (t != deft) {
-	if (i == m_properties->end()) {
-	    m_properties->insert(PropertyPair(name, new PropertyStore<Int>(t)));
+	if (i < 0) {
+	    m_properties->insert<Int>(name, t);
 	} else {
-	    static_cast<PropertyStore<Int> *>(i->second)->setData(t);
+	    m_properties->setData<Int>(i, t);
 	}
-    } else if (i != m_properties->end()) {
-	delete i->second;
+    } else if (i >= 0) {
 	m_properties->erase(i);
     }
 }
 
-PropertyMap *
-Event::find(const PropertyName &name, PropertyMap::iterator &i)
+CompactPropertyMap *
+Event::find(const PropertyName &name, int &i)
 {
-    PropertyMap *map = m_data->m_properties;
+    CompactPropertyMap *map = m_data->m_properties;
 
-    if (!map || ((i = map->find(name)) == map->end())) {
+    if (!map || ((i = map->find(name)) < 0)) {
 
 	map = m_nonPersistentProperties;
 	if (!map) return 0;
 
 	i = map->find(name);
-	if (i == map->end()) return 0;
+	if (i < 0) return 0;
     }
 
     return map;
@@ -132,8 +199,8 @@ Event::has(const PropertyName &name) const
     ++m_hasCount;
 #endif
 
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    int i;
+    const CompactPropertyMap *map = find(name, i);
     if (map) return true;
     else return false;
 }
@@ -146,10 +213,9 @@ Event::unset(const PropertyName &name)
 #endif
 
     unshare();
-    PropertyMap::iterator i;
-    PropertyMap *map = find(name, i);
+    int i;
+    CompactPropertyMap *map = find(name, i);
     if (map) {
-	delete i->second;
 	map->erase(i);
     }
 }
@@ -159,10 +225,10 @@ PropertyType
 Event::getPropertyType(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    int i;
+    const CompactPropertyMap *map = find(name, i);
     if (map) {
-        return i->second->getType();
+        return map->getType(i);
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -173,10 +239,10 @@ string
 Event::getPropertyTypeAsString(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    int i;
+    const CompactPropertyMap *map = find(name, i);
     if (map) {
-        return i->second->getTypeName();
+        return map->getTypeName(i);
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -187,10 +253,10 @@ string
 Event::getAsString(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    int i;
+    const CompactPropertyMap *map = find(name, i);
     if (map) {
-        return i->second->unparse();
+        return map->unparse(i);
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -211,12 +277,96 @@ Event::toXmlString()
 string
 Event::toXmlString(timeT expectedTime)
 {
-    std::stringstream out;
+    string out;
+    appendXmlString(out, expectedTime);
+    return out;
+}
+
+static void
+appendNumber(string &out, long n)
+{
+    char buffer[24];
+    int length = sprintf(buffer, "%ld", n);
+    out.append(buffer, length);
+}
+
+// Most names and values need no escaping, so check for that before
+// going to XmlExportable::encode
+
+static void
+appendEncoded(string &out, const string &s)
+{
+    for (size_t i = 0; i < s.length(); ++i) {
+        unsigned char c = s[i];
+        if (c < 0x20 || c >= 0x80 ||
+            c == '<' || c == '>' || c == '&' || c == '"' || c == '\'') {
+            out += XmlExportable::encode(s);
+            return;
+        }
+    }
+    out += s;
+}
+
+static const char *
+getXmlTypeName(PropertyType type)
+{
+    // the lower-case form of PropertyDefn<type>::typeName()
+    switch (type) {
+    case Int: return "int";
+    case String: return "string";
+    case Bool: return "bool";
+    case RealTimeT: return "realtimet";
+    }
+    return "";
+}
+
+static void
+appendProperties(string &out, const char *element,
+                 const CompactPropertyMap *map, bool skipViewLocal)
+{
+    for (int i = 0; i < map->size(); ++i) {
+
+        const string &name = map->getName(i).getName();
+
+        // View-local properties are assumed to have "::" in their
+        // name somewhere
+        if (skipViewLocal && name.find("::") != string::npos) continue;
+
+        PropertyType type = map->getType(i);
+
+        out += '<';
+        out += element;
+        out += " name=\"";
+        appendEncoded(out, name);
+        out += "\" ";
+        out += getXmlTypeName(type);
+        out += "=\"";
+
+        switch (type) {
+        case Int:
+            appendNumber(out, map->getData<Int>(i));
+            break;
+        case Bool:
+            out += (map->getData<Bool>(i) ? "true" : "false");
+            break;
+        default:
+            appendEncoded(out, map->unparse(i));
+            break;
+        }
+
+        out += "\"/>";
+    }
+}
 
-    out << "<event";
+void
+Event::appendXmlString(string &out, timeT expectedTime) const
+{
+    out += "<event";
     
     if (getType().length() != 0) {
-	out << " type=\"" << getType() << "\"";
+        out += " type=\"";
+        out += getType();
+        out += "\"";
     }
 
     // Check for zero note durations and fix it (fixing in setters and
@@ -224,7 +374,7 @@ Event::toXmlString(timeT expectedTime)
     // and many events are indeed 0 duration events.
     timeT duration = getDuration();
     
-    if (isa(Note::EventType) &&
+    if (isa(Note::TypeName) &&
         duration < 1 &&
         !has(BaseProperties::IS_GRACE_NOTE)) {
 
@@ -232,65 +382,44 @@ Event::toXmlString(timeT expectedTime)
     }
     
     if (duration != 0) {
-	out << " duration=\"" << duration << "\"";
+        out += " duration=\"";
+        appendNumber(out, duration);
+        out += "\"";
     }
 
     if (getSubOrdering() != 0) {
-	out << " subordering=\"" << getSubOrdering() << "\"";
+        out += " subordering=\"";
+        appendNumber(out, getSubOrdering());
+        out += "\"";
     }
 
     if (expectedTime == 0) {
-	out << " absoluteTime=\"" << getAbsoluteTime() << "\"";
+        out += " absoluteTime=\"";
+        appendNumber(out, getAbsoluteTime());
+        out += "\"";
     } else if (getAbsoluteTime() != expectedTime) {
-	out << " timeOffset=\"" << (getAbsoluteTime() - expectedTime) << "\"";
+        out += " timeOffset=\"";
+        appendNumber(out, getAbsoluteTime() - expectedTime);
+        out += "\"";
     }
 
-    out << ">";
+    out += ">";
 
     // Save all persistent properties as <property> elements
 
-    PropertyNames propertyNames(getPersistentPropertyNames());
-    for (PropertyNames::const_iterator i = propertyNames.begin();
-         i != propertyNames.end(); ++i) {
-
-    out << "<property name=\""
-	    << XmlExportable::encode(i->getName()) << "\" ";
-	string type = getPropertyTypeAsString(*i);
-	for (size_t j = 0; j < type.size(); ++j) {
-	    type[j] = (isupper(type[j]) ? tolower(type[j]) : type[j]);
-	}
-
-	out << type << "=\""
-	    << XmlExportable::encode(getAsString(*i))
-	    << "\"/>";
+    if (m_data->m_properties) {
+        appendProperties(out, "property", m_data->m_properties, false);
     }
 
     // Save non-persistent properties (the persistence applies to
     // copying events, not load/save) as <nproperty> elements
-    // unless they're view-local.  View-local properties are
-    // assumed to have "::" in their name somewhere.
-
-    propertyNames = getNonPersistentPropertyNames();
-    for (PropertyNames::const_iterator i = propertyNames.begin();
-         i != propertyNames.end(); ++i) {
+    // unless they're view-local.
 
-	std::string s(i->getName());
-	if (s.find("::") != std::string::npos) continue;
-
-    out << "<nproperty name=\""
-	    << XmlExportable::encode(s) << "\" ";
-	string type = getPropertyTypeAsString(*i);
-	for (size_t j = 0; j < type.size(); ++j) {
-	    type[j] = (isupper(type[j]) ? tolower(type[j]) : type[j]);
-	}
-	out << type << "=\""
-	    << XmlExportable::encode(getAsString(*i))
-	    << "\"/>";
+    if (m_nonPersistentProperties) {
+        appendProperties(out, "nproperty", m_nonPersistentProperties, true);
     }
   
-    out << "</event>";
-
-    return out.str();
+    out += "</event>";
 }
 
 
@@ -298,7 +427,7 @@ Event::toXmlString(timeT expectedTime)
 void
 Event::dump(ostream& out) const
 {
-    out << "Event type : " << m_data->m_type.c_str() << '\n';
+    out << "Event type : " << m_data->m_type.getName().c_str() << '\n';
 
     out << "\tAbsolute Time : " << m_data->m_absoluteTime
 	<< "\n\tDuration : " << m_data->m_duration
@@ -306,18 +435,18 @@ Event::dump(ostream& out) const
         << "\n\tPersistent properties : \n";
 
     if (m_data->m_properties) {
-	for (PropertyMap::const_iterator i = m_data->m_properties->begin();
-	     i != m_data->m_properties->end(); ++i) {
-	    out << "\t\t" << i->first.getName() << " [" << i->first.getValue() << "] \t" << *(i->second) << "\n";
+        const CompactPropertyMap *map = m_data->m_properties;
+	for (int i = 0; i < map->size(); ++i) {
+	    out << "\t\t" << map->getName(i).getName() << " [" << map->getName(i).getValue() << "] \t" << map->getTypeName(i) << " - " << map->unparse(i) << "\n";
 	}
     }
 
     if (m_nonPersistentProperties) {
 	out << "\n\tNon-persistent properties : \n";
 
-	for (PropertyMap::const_iterator i = m_nonPersistentProperties->begin();
-	     i != m_nonPersistentProperties->end(); ++i) {
-	    out << "\t\t" << i->first.getName() << " [" << i->first.getValue() << "] \t" << *(i->second) << '\n';
+        const CompactPropertyMap *map = m_nonPersistentProperties;
+	for (int i = 0; i < map->size(); ++i) {
+	    out << "\t\t" << map->getName(i).getName() << " [" << map->getName(i).getValue() << "] \t" << map->getTypeName(i) << " - " << map->unparse(i) << '\n';
 	}
     }
 
@@ -374,15 +503,13 @@ Event::getPropertyNames() const
 {
     PropertyNames v;
     if (m_data->m_properties) {
-	for (PropertyMap::const_iterator i = m_data->m_properties->begin();
-	     i != m_data->m_properties->end(); ++i) {
-	    v.push_back(i->first);
+	for (int i = 0; i < m_data->m_properties->size(); ++i) {
+	    v.push_back(m_data->m_properties->getName(i));
 	}
     }
     if (m_nonPersistentProperties) {
-	for (PropertyMap::const_iterator i = m_nonPersistentProperties->begin();
-	     i != m_nonPersistentProperties->end(); ++i) {
-	    v.push_back(i->first);
+	for (int i = 0; i < m_nonPersistentProperties->size(); ++i) {
+	    v.push_back(m_nonPersistentProperties->getName(i));
 	}
     }
     return v;
@@ -393,9 +520,8 @@ Event::getPersistentPropertyNames() const
 {
     PropertyNames v;
     if (m_data->m_properties) {
-	for (PropertyMap::const_iterator i = m_data->m_properties->begin();
-	     i != m_data->m_properties->end(); ++i) {
-	    v.push_back(i->first);
+	for (int i = 0; i < m_data->m_properties->size(); ++i) {
+	    v.push_back(m_data->m_properties->getName(i));
 	}
     }
     return v;
@@ -406,14 +532,24 @@ Event::getNonPersistentPropertyNames() const
 {
     PropertyNames v;
     if (m_nonPersistentProperties) {
-	for (PropertyMap::const_iterator i = m_nonPersistentProperties->begin();
-	     i != m_nonPersistentProperties->end(); ++i) {
-	    v.push_back(i->first);
+	for (int i = 0; i < m_nonPersistentProperties->size(); ++i) {
+	    v.push_back(m_nonPersistentProperties->getName(i));
 	}
     }
     return v;
 }
 
+Event *
+Event::copyWithNonPersistentProperties() const
+{
+    Event *e = new Event(*this);
+    if (m_nonPersistentProperties) {
+        e->m_nonPersistentProperties =
+            new CompactPropertyMap(*m_nonPersistentProperties);
+    }
+    return e;
+}
+
 void
 Event::clearNonPersistentProperties()
 {
@@ -434,20 +570,12 @@ Event::unsafeChangeTime(timeT offset)
 size_t
 Event::getStorageSize() const
 {
-    size_t s = sizeof(Event) + sizeof(EventData) + m_data->m_type.size();
+    size_t s = sizeof(Event) + sizeof(EventData);
     if (m_data->m_properties) {
-	for (PropertyMap::const_iterator i = m_data->m_properties->begin();
-	     i != m_data->m_properties->end(); ++i) {
-	    s += sizeof(i->first);
-	    s += i->second->getStorageSize();
-	}
+        s += m_data->m_properties->getStorageSize();
     }
     if (m_nonPersistentProperties) {
-	for (PropertyMap::const_iterator i = m_nonPersistentProperties->begin();
-	     i != m_nonPersistentProperties->end(); ++i) {
-	    s += sizeof(i->first);
-	    s += i->second->getStorageSize();
-	}
+        s += m_nonPersistentProperties->getStorageSize();
     }
     return s;
 }
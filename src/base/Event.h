@@ -17,9 +17,12 @@
 #ifndef RG_EVENT_H
 #define RG_EVENT_H
 
-#include "PropertyMap.h"
+#include "CompactPropertyMap.h"
+#include "EventTypeName.h"
 #include "Exception.h"
 
+#include <QAtomicInt>
+
 #include <string>
 #include <vector>
 #ifndef NDEBUG
@@ -99,6 +102,15 @@ public:
         setNotationDuration(notationDuration);
     }
 
+    /**
+     * As above, but with an already-interned type, which saves a
+     * lookup when creating many events of the same type.
+     */
+    Event(const EventTypeName &type,
+          timeT absoluteTime, timeT duration = 0, short subOrdering = 0) :
+        m_data(new EventData(type, absoluteTime, duration, subOrdering)),
+        m_nonPersistentProperties(0) { }
+
     Event(const Event &e) :
         m_nonPersistentProperties(0) { share(e); }
 
@@ -169,6 +181,14 @@ public:
                          getNotationDuration());
     }
 
+    /**
+     * Return a copy sharing this event's data, as the copy
+     * constructor makes, but with a copy of the non-persistent
+     * properties as well.  Like any copy, it is unaffected by later
+     * changes to this event.
+     */
+    Event *copyWithNonPersistentProperties() const;
+
     Event &operator=(const Event &e) {
         if (&e != this) { lose(); share(e); }
         return *this;
@@ -184,12 +204,24 @@ public:
      * Returns the type of the Event (usually a Note, an Accidental, a
      * Key ... see NotationTypes.h for more examples)
      */
-    const std::string &getType() const    { return  m_data->m_type; }
+    const std::string &getType() const    { return  m_data->m_type.getName(); }
+
+    /**
+     * Returns the interned type of the Event
+     */
+    const EventTypeName &getTypeName() const { return m_data->m_type; }
 
     /**
      * Tests if the Event is of the type in parameter
      */
-    bool  isa(const std::string &t) const { return (m_data->m_type == t); }
+    bool  isa(const std::string &t) const { return (getType() == t); }
+
+    /**
+     * Tests if the Event is of the type in parameter.  This is an
+     * integer comparison, so prefer it (e.g. isa(Note::TypeName))
+     * in code that examines every event in a segment.
+     */
+    bool  isa(const EventTypeName &t) const { return (m_data->m_type == t); }
     timeT getAbsoluteTime() const    { return m_data->m_absoluteTime; }
     timeT getDuration()     const    { return m_data->m_duration; }
     short getSubOrdering()  const    { return m_data->m_subOrdering; }
@@ -366,6 +398,16 @@ public:
     // approximate, for debugging and inspection purposes
     size_t getStorageSize() const;
 
+    /**
+     * Return true if this event and e are shallow copies of one
+     * another that still share their persistent data.  Changing
+     * either one unshares it, so if this is true neither has been
+     * changed since the copy was made.  The converse does not hold:
+     * setting any property unshares the data, even a non-persistent
+     * one or a property set to the value it already had.
+     */
+    bool sharesDataWith(const Event &e) const { return m_data == e.m_data; }
+
     /**
      * Get the XML string representing the object.
      */
@@ -379,6 +421,13 @@ public:
      */
     std::string toXmlString(timeT expectedTime);
 
+    /**
+     * Append the XML that toXmlString(expectedTime) would return to
+     * the end of \a out.  For writing out many events into one
+     * buffer, without making a new string for each.
+     */
+    void appendXmlString(std::string &out, timeT expectedTime) const;
+
 #ifndef NDEBUG
     void dump(std::ostream&) const;
 #else
@@ -386,14 +435,29 @@ public:
 #endif
     static void dumpStats(std::ostream&);
 
+    /**
+     * Events, their shared data and their property maps are allocated
+     * from ObjectPools rather than individually from the heap.
+     */
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+
+    /**
+     * Return any pool memory no longer used by events to the system.
+     * Called when a Composition is destroyed.
+     */
+    static void trimPools();
+
 protected:
     // these are for subclasses such as XmlStorableEvent
 
     Event() :
-        m_data(new EventData("", 0, 0, 0)),
+        m_data(new EventData(EventTypeName::EmptyEventTypeName, 0, 0, 0)),
         m_nonPersistentProperties(0) { }
 
-    void setType(const std::string &t) { unshare(); m_data->m_type = t; }
+    void setType(const std::string &t) {
+        unshare(); m_data->m_type = EventTypeName(t);
+    }
     void setAbsoluteTime(timeT t)      { unshare(); m_data->m_absoluteTime = t; }
     void setDuration(timeT d)          { unshare(); m_data->m_duration = d; }
     void setSubOrdering(short o)       { unshare(); m_data->m_subOrdering = o; }
@@ -407,19 +471,25 @@ private:
     {
         EventData(const std::string &type,
                   timeT absoluteTime, timeT duration, short subOrdering);
-        EventData(const std::string &type,
+        EventData(const EventTypeName &type,
+                  timeT absoluteTime, timeT duration, short subOrdering);
+        EventData(const EventTypeName &type,
                   timeT absoluteTime, timeT duration, short subOrdering,
-                  const PropertyMap *properties);
+                  const CompactPropertyMap *properties);
         EventData *unshare();
         ~EventData();
-        unsigned int m_refCount;
+        static void *operator new(size_t size);
+        static void operator delete(void *p, size_t size);
+        // Atomic, as copies of an event in different segments may be
+        // modified at once by notation layout threads
+        QAtomicInt m_refCount;
 
-        std::string m_type;
+        EventTypeName m_type;
         timeT m_absoluteTime;
         timeT m_duration;
         short m_subOrdering;
 
-        PropertyMap *m_properties;
+        CompactPropertyMap *m_properties;
 
         // These are properties because we don't care so much about
         // raw speed in get/set, but we do care about storage size for
@@ -442,11 +512,11 @@ private:
     };
 
     EventData *m_data;
-    PropertyMap *m_nonPersistentProperties; // Unique to an instance
+    CompactPropertyMap *m_nonPersistentProperties; // Unique to an instance
 
     void share(const Event &e) {
         m_data = e.m_data;
-        m_data->m_refCount++;
+        m_data->m_refCount.ref();
     }
 
     bool unshare() { // returns true if unshare was necessary
@@ -459,27 +529,24 @@ private:
     }
 
     void lose() {
-        if (--m_data->m_refCount == 0) delete m_data;
+        if (!m_data->m_refCount.deref()) delete m_data;
         delete m_nonPersistentProperties;
         m_nonPersistentProperties = 0;
     }
 
-    // returned iterator (in i) only valid if return map value is non-zero
-    PropertyMap *find(const PropertyName &name, PropertyMap::iterator &i);
+    // returned index (in i) only valid if return map value is non-zero
+    CompactPropertyMap *find(const PropertyName &name, int &i);
 
-    const PropertyMap *find(const PropertyName &name,
-                            PropertyMap::const_iterator &i) const {
-        PropertyMap::iterator j;
-        PropertyMap *map = const_cast<Event *>(this)->find(name, j);
-        i = j;
-        return map;
+    const CompactPropertyMap *find(const PropertyName &name, int &i) const {
+        return const_cast<Event *>(this)->find(name, i);
     }
 
-    PropertyMap::iterator insert(const PropertyPair &pair, bool persistent) {
-        PropertyMap **map =
+    // the persistent or non-persistent map, created if necessary
+    CompactPropertyMap *getMap(bool persistent) {
+        CompactPropertyMap **map =
             (persistent ? &m_data->m_properties : &m_nonPersistentProperties);
-        if (!*map) *map = new PropertyMap();
-        return (*map)->insert(pair).first;
+        if (!*map) *map = new CompactPropertyMap();
+        return *map;
     }
 
 #ifndef NDEBUG
@@ -501,21 +568,20 @@ Event::get(const PropertyName &name, typename PropertyDefn<P>::basic_type &val)
     ++m_getCount;
 #endif
 
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    int i;
+    const CompactPropertyMap *map = find(name, i);
 
     if (map) {
 
-        PropertyStoreBase *sb = i->second;
-        if (sb->getType() == P) {
-            val = (static_cast<PropertyStore<P> *>(sb))->getData();
+        if (map->getType(i) == P) {
+            val = map->getData<P>(i);
             return true;
         }
         else {
 #ifndef NDEBUG
             std::cerr << "Event::get() Error: Attempt to get property \"" << name
                  << "\" as " << PropertyDefn<P>::typeName() <<", actual type is "
-                 << sb->getTypeName() << std::endl;
+                 << map->getTypeName(i) << std::endl;
 #endif
             return false;
         }
@@ -535,17 +601,16 @@ Event::get(const PropertyName &name) const
     ++m_getCount;
 #endif
 
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    int i;
+    const CompactPropertyMap *map = find(name, i);
 
     if (map) {
 
-        PropertyStoreBase *sb = i->second;
-        if (sb->getType() == P)
-            return (static_cast<PropertyStore<P> *>(sb))->getData();
+        if (map->getType(i) == P)
+            return map->getData<P>(i);
         else {
             throw BadType(name.getName(),
-                          PropertyDefn<P>::typeName(), sb->getTypeName(),
+                          PropertyDefn<P>::typeName(), map->getTypeName(i),
                           __FILE__, __LINE__);
         }
 
@@ -565,8 +630,8 @@ bool
 Event::isPersistent(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    int i;
+    const CompactPropertyMap *map = find(name, i);
 
     if (map) {
         return (map == m_data->m_properties);
@@ -582,12 +647,14 @@ Event::setPersistence(const PropertyName &name, bool persistent)
     // throw (NoData)
 {
     unshare();
-    PropertyMap::iterator i;
-    PropertyMap *map = find(name, i);
+    int i;
+    CompactPropertyMap *map = find(name, i);
 
     if (map) {
-        insert(*i, persistent);
-        map->erase(i);
+        bool persistentBefore = (map == m_data->m_properties);
+        if (persistentBefore != persistent) {
+            map->moveTo(i, *getMap(persistent));
+        }
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -604,31 +671,28 @@ Event::set(const PropertyName &name, typename PropertyDefn<P>::basic_type value,
     ++m_setCount;
 #endif
 
-    // this is a little slow, could bear improvement
-
     unshare();
-    PropertyMap::iterator i;
-    PropertyMap *map = find(name, i);
+    int i;
+    CompactPropertyMap *map = find(name, i);
 
     if (map) {
         bool persistentBefore = (map == m_data->m_properties);
         if (persistentBefore != persistent) {
-            i = insert(*i, persistent);
-            map->erase(name);
+            CompactPropertyMap *target = getMap(persistent);
+            i = map->moveTo(i, *target);
+            map = target;
         }
 
-        PropertyStoreBase *sb = i->second;
-        if (sb->getType() == P) {
-            (static_cast<PropertyStore<P> *>(sb))->setData(value);
+        if (map->getType(i) == P) {
+            map->setData<P>(i, value);
         } else {
             throw BadType(name.getName(),
-                          PropertyDefn<P>::typeName(), sb->getTypeName(),
+                          PropertyDefn<P>::typeName(), map->getTypeName(i),
                           __FILE__, __LINE__);
         }
 
     } else {
-        PropertyStoreBase *p = new PropertyStore<P>(value);
-        insert(PropertyPair(name, p), persistent);
+        getMap(persistent)->insert<P>(name, value);
     }
 }
 
@@ -648,24 +712,21 @@ Event::setMaybe(const PropertyName &name, typename PropertyDefn<P>::basic_type v
 #endif
 
     unshare();
-    PropertyMap::iterator i;
-    PropertyMap *map = find(name, i);
+    int i;
+    CompactPropertyMap *map = find(name, i);
 
     if (map) {
         if (map == m_data->m_properties) return; // persistent, so ignore it
 
-        PropertyStoreBase *sb = i->second;
-
-        if (sb->getType() == P) {
-            (static_cast<PropertyStore<P> *>(sb))->setData(value);
+        if (map->getType(i) == P) {
+            map->setData<P>(i, value);
         } else {
             throw BadType(name.getName(),
-                          PropertyDefn<P>::typeName(), sb->getTypeName(),
+                          PropertyDefn<P>::typeName(), map->getTypeName(i),
                           __FILE__, __LINE__);
         }
     } else {
-        PropertyStoreBase *p = new PropertyStore<P>(value);
-        insert(PropertyPair(name, p), false);
+        getMap(false)->insert<P>(name, value);
     }
 }
 
@@ -0,0 +1,98 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/EventTypeName.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace Rosegarden 
+{
+using std::string;
+
+// Initialised statically rather than by a constructor, as types are
+// interned during static initialisation and a constructor run later
+// would lose them
+EventTypeName::intern_map *EventTypeName::m_interns = 0;
+QBasicAtomicPointer<EventTypeName::name_vector> EventTypeName::m_names =
+    Q_BASIC_ATOMIC_INITIALIZER(0);
+
+// Types may be interned from more than one thread.  The mutex is made
+// on first use, as EventTypeNames are interned during static
+// initialisation.
+
+static QMutex &
+internMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
+
+void EventTypeName::init()
+{
+    // Value 0 is always the empty type, which is what a
+    // default-constructed EventTypeName refers to, and intern makes
+    // it first
+    (void)intern(string());
+}
+
+int EventTypeName::intern(const string &s)
+{
+    QMutexLocker locker(&internMutex());
+
+    // Only ever changed with the mutex held, so we can read it plainly
+    name_vector *names = m_names;
+
+    if (!m_interns) {
+        m_interns = new intern_map;
+        names = new name_vector;
+        intern_map::iterator i =
+            m_interns->insert(intern_pair(string(), 0)).first;
+        names->push_back(&i->first);
+        m_names.fetchAndStoreRelease(names);
+    }
+
+    intern_map::iterator i(m_interns->find(s));
+    
+    if (i != m_interns->end()) {
+        return i->second;
+    } else {
+        int nv = int(names->size());
+        i = m_interns->insert(intern_pair(s, nv)).first;
+
+        // getName() reads the table without locking, so a table that
+        // may be in use is never reallocated: when it is full we copy
+        // it into a bigger one and publish that.  The old one is
+        // leaked on purpose, as a reader may still be looking at it
+        // and we can't tell when it has finished.  There are only a
+        // few dozen types, so this rarely happens at all.
+        if (names->size() == names->capacity()) {
+            name_vector *bigger = new name_vector;
+            bigger->reserve(names->capacity() * 2 + 16);
+            bigger->insert(bigger->end(), names->begin(), names->end());
+            names = bigger;
+            m_names.fetchAndStoreRelease(names);
+        }
+
+        // map nodes are never moved, so the key's address is stable
+        names->push_back(&i->first);
+        return nv;
+    }
+}
+
+const EventTypeName EventTypeName::EmptyEventTypeName("");
+
+}
@@ -0,0 +1,118 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_EVENT_TYPE_NAME_H
+#define RG_EVENT_TYPE_NAME_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <iostream>
+
+#include <QAtomicPointer>
+
+#include "AtomicLoad.h"
+
+namespace Rosegarden 
+{
+
+/**
+
+  An EventTypeName is the type of an Event ("note", "clefchange" and
+  so on) interned into a small integer, in the same way as
+  PropertyName interns property names.  Two EventTypeNames compare
+  equal exactly when their strings do, but the comparison is a
+  single integer compare, and the string itself is stored once
+  rather than once per Event.
+
+  Each of the event type classes in NotationTypes and MidiTypes has a
+  TypeName constant alongside its EventType string, so hot loops can
+  write
+
+    if (e->isa(Note::TypeName)) ...
+
+  instead of comparing strings.  Event::isa(const std::string &) is
+  still available and behaves as before.
+
+  The constructors are explicit so that passing a string literal to
+  an overloaded function (such as the Event constructors) picks the
+  std::string overload, as it always has.
+
+  As with PropertyName, the integer values are assigned on demand and
+  must not be persisted.
+
+*/
+
+class EventTypeName
+{
+public:
+    EventTypeName() : m_value(0) { if (!m_interns) init(); }
+    explicit EventTypeName(const char *cs) { std::string s(cs); m_value = intern(s); }
+    explicit EventTypeName(const std::string &s) : m_value(intern(s)) { }
+    EventTypeName(const EventTypeName &t) : m_value(t.m_value) { }
+    ~EventTypeName() { }
+
+    EventTypeName &operator=(const EventTypeName &t) {
+        m_value = t.m_value;
+        return *this;
+    }
+
+    bool operator==(const EventTypeName &t) const {
+        return m_value == t.m_value;
+    }
+    bool operator!=(const EventTypeName &t) const {
+        return m_value != t.m_value;
+    }
+    bool operator< (const EventTypeName &t) const {
+        return m_value <  t.m_value;
+    }
+
+    /**
+     * Return the type string.  The reference remains valid for the
+     * lifetime of the program.  This does not lock, but may be called
+     * from any thread that got the EventTypeName from the one that
+     * interned it.
+     */
+    const std::string &getName() const {
+        return *(*loadAcquire(m_names))[m_value];
+    }
+
+    int getValue() const { return m_value; }
+
+    static const EventTypeName EmptyEventTypeName;
+
+private:
+    typedef std::map<std::string, int> intern_map;
+    typedef intern_map::value_type intern_pair;
+    typedef std::vector<const std::string *> name_vector;
+
+    static intern_map *m_interns;
+    static QBasicAtomicPointer<name_vector> m_names;
+
+    int m_value;
+
+    static void init();
+    static int intern(const std::string &s);
+};
+
+inline std::ostream& operator<<(std::ostream &out, const EventTypeName &t) {
+    out << t.getName();
+    return out;
+}
+
+}
+
+#endif
@@ -33,6 +33,7 @@ static MidiByte getByte(const Event &e, const PropertyName &name) {
 //////////////////////////////////////////////////////////////////////
 
 const std::string PitchBend::EventType = "pitchbend";
+const EventTypeName PitchBend::TypeName(PitchBend::EventType);
 const int PitchBend::EventSubOrdering = -5;
 
 const PropertyName PitchBend::MSB = "msb";
@@ -73,6 +74,7 @@ PitchBend::getAsEvent(timeT absoluteTime) const
 //////////////////////////////////////////////////////////////////////
 
 const std::string Controller::EventType = "controller";
+const EventTypeName Controller::TypeName(Controller::EventType);
 const int Controller::EventSubOrdering = -5;
 
 const PropertyName Controller::NUMBER = "number";
@@ -113,6 +115,7 @@ Controller::getAsEvent(timeT absoluteTime) const
 //////////////////////////////////////////////////////////////////////
 
 const std::string KeyPressure::EventType = "keypressure";
+const EventTypeName KeyPressure::TypeName(KeyPressure::EventType);
 const int KeyPressure::EventSubOrdering = -5;
 
 const PropertyName KeyPressure::PITCH = "pitch";
@@ -153,6 +156,7 @@ KeyPressure::getAsEvent(timeT absoluteTime) const
 //////////////////////////////////////////////////////////////////////
 
 const std::string ChannelPressure::EventType = "channelpressure";
+const EventTypeName ChannelPressure::TypeName(ChannelPressure::EventType);
 const int ChannelPressure::EventSubOrdering = -5;
 
 const PropertyName ChannelPressure::PRESSURE = "pressure";
@@ -188,6 +192,7 @@ ChannelPressure::getAsEvent(timeT absoluteTime) const
 //////////////////////////////////////////////////////////////////////
 
 const std::string ProgramChange::EventType = "programchange";
+const EventTypeName ProgramChange::TypeName(ProgramChange::EventType);
 const int ProgramChange::EventSubOrdering = -5;
 
 const PropertyName ProgramChange::PROGRAM = "program";
@@ -223,6 +228,7 @@ ProgramChange::getAsEvent(timeT absoluteTime) const
 //////////////////////////////////////////////////////////////////////
 
 const std::string SystemExclusive::EventType = "systemexclusive";
+const EventTypeName SystemExclusive::TypeName(SystemExclusive::EventType);
 const int SystemExclusive::EventSubOrdering = -5;
 
 const PropertyName SystemExclusive::DATABLOCK = "datablock";
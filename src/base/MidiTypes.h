@@ -46,6 +46,7 @@ class PitchBend
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
 
     static const PropertyName MSB;
@@ -74,6 +75,7 @@ class Controller
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
 
     static const PropertyName NUMBER;  // controller number
@@ -105,6 +107,7 @@ class KeyPressure
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
 
     static const PropertyName PITCH;
@@ -133,6 +136,7 @@ class ChannelPressure
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
 
     static const PropertyName PRESSURE;
@@ -158,6 +162,7 @@ class ProgramChange
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
 
     static const PropertyName PROGRAM;
@@ -183,6 +188,7 @@ class SystemExclusive
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
 
     struct BadEncoding : public Exception {
@@ -542,8 +542,8 @@ NotationQuantizer::Impl::quantizeDurationProvisional(Segment *, Segment::iterato
 void
 NotationQuantizer::Impl::quantizeDuration(Segment *s, Chord &c) const
 {
-    static int totalFracCount = 0;
-    static float totalFrac = 0;
+    int totalFracCount = 0;
+    float totalFrac = 0;
 
     Profiler profiler("NotationQuantizer::Impl::quantizeDuration");
 
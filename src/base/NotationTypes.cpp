@@ -280,6 +280,7 @@ using namespace Marks;
 //////////////////////////////////////////////////////////////////////
 
 const string Clef::EventType = "clefchange";
+const EventTypeName Clef::TypeName(Clef::EventType);
 const int Clef::EventSubOrdering = -250;
 const PropertyName Clef::ClefPropertyName = "clef";
 const PropertyName Clef::OctaveOffsetPropertyName = "octaveoffset";
@@ -433,6 +434,7 @@ Event *Clef::getAsEvent(timeT absoluteTime) const
 Key::KeyDetailMap Key::m_keyDetailMap = Key::KeyDetailMap();
 
 const string Key::EventType = "keychange";
+const EventTypeName Key::TypeName(Key::EventType);
 const int Key::EventSubOrdering = -200;
 const PropertyName Key::KeyPropertyName = "key";
 const Key Key::DefaultKey = Key("C major");
@@ -737,6 +739,7 @@ Key::KeyDetails& Key::KeyDetails::operator=(const Key::KeyDetails &d)
 //////////////////////////////////////////////////////////////////////
 
 const std::string Indication::EventType = "indication";
+const EventTypeName Indication::TypeName(Indication::EventType);
 const int Indication::EventSubOrdering = -50;
 const PropertyName Indication::IndicationTypePropertyName = "indicationtype";
 //const PropertyName Indication::IndicationDurationPropertyName = "indicationduration";
@@ -826,6 +829,7 @@ Indication::isValid(const std::string &s) const
 //////////////////////////////////////////////////////////////////////
 
 const std::string Text::EventType = "text";
+const EventTypeName Text::TypeName(Text::EventType);
 const int Text::EventSubOrdering = -70;
 const PropertyName Text::TextPropertyName = "text";
 const PropertyName Text::TextTypePropertyName = "type";
@@ -1843,7 +1847,9 @@ Pitch Pitch::transpose(const Key &key, int pitchDelta, int heightDelta)
 //////////////////////////////////////////////////////////////////////
 
 const string Note::EventType = "note";
+const EventTypeName Note::TypeName(Note::EventType);
 const string Note::EventRestType = "rest";
+const EventTypeName Note::RestTypeName(Note::EventRestType);
 const int Note::EventRestSubOrdering = 10;
 
 const timeT Note::m_shortestTime = basePPQ / 16;
@@ -1916,6 +1922,7 @@ Event *Note::getAsRestEvent(timeT absoluteTime) const
 //////////////////////////////////////////////////////////////////////
 
 const string TimeSignature::EventType = "timesignature";
+const EventTypeName TimeSignature::TypeName(TimeSignature::EventType);
 const int TimeSignature::EventSubOrdering = -150;
 const PropertyName TimeSignature::NumeratorPropertyName = "numerator";
 const PropertyName TimeSignature::DenominatorPropertyName = "denominator";
@@ -2455,6 +2462,7 @@ AccidentalTable::newClef(const Clef &clef)
 //////////////////////////////////////////////////////////////////////
 
 const std::string Symbol::EventType = "symbol";
+const EventTypeName Symbol::TypeName(Symbol::EventType);
 const int Symbol::EventSubOrdering = -70;
 const PropertyName Symbol::SymbolTypePropertyName = "type";
 
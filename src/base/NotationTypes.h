@@ -264,6 +264,7 @@ class Clef
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
     static const PropertyName ClefPropertyName;
     static const PropertyName OctaveOffsetPropertyName;
@@ -386,6 +387,7 @@ class Key
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
     static const PropertyName KeyPropertyName;
     static const Key DefaultKey;
@@ -618,6 +620,7 @@ class Indication
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
     static const PropertyName IndicationTypePropertyName;
     typedef Exception BadIndicationName;
@@ -686,6 +689,7 @@ class Text
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
     static const PropertyName TextPropertyName;
     static const PropertyName TextTypePropertyName;
@@ -1037,6 +1041,8 @@ class Note
 public:
     static const std::string EventType;
     static const std::string EventRestType;
+    static const EventTypeName TypeName;
+    static const EventTypeName RestTypeName;
     static const int EventRestSubOrdering;
 
     typedef int Type; // not an enum, too much arithmetic at stake
@@ -1269,6 +1275,7 @@ private:
         /* throw (Event::NoData, Event::BadType, BadTimeSignature) */;
 
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
     static const PropertyName NumeratorPropertyName;
     static const PropertyName DenominatorPropertyName;
@@ -1382,6 +1389,7 @@ class Symbol
 {
 public:
     static const std::string EventType;
+    static const EventTypeName TypeName;
     static const int EventSubOrdering;
     static const PropertyName SymbolTypePropertyName;
 
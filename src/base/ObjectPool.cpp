@@ -0,0 +1,187 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ObjectPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <new>
+
+namespace Rosegarden
+{
+
+static const size_t ChunkBytes = 16384;
+
+ObjectPool::ObjectPool(const char *name, size_t objectSize) :
+    m_name(name),
+    m_requestSize(objectSize),
+    m_objectSize(objectSize),
+    m_free(0),
+    m_allocations(0),
+    m_live(0),
+    m_reserved(0),
+    m_passedThrough(0)
+{
+    // Round up so that every slot is suitably aligned for the
+    // pointers and longs our objects contain, and can hold a Slot
+    const size_t align = sizeof(double) > sizeof(void *) ?
+        sizeof(double) : sizeof(void *);
+    size_t size = (objectSize + align - 1) / align * align;
+    if (size < sizeof(Slot)) size = sizeof(Slot);
+    m_objectSize = size;
+
+    m_chunkObjects = ChunkBytes / m_objectSize;
+    if (m_chunkObjects < 16) m_chunkObjects = 16;
+
+    m_allocationsId = std::string(name) + " pool: allocations";
+    m_liveId = std::string(name) + " pool: live objects";
+    m_reservedId = std::string(name) + " pool: bytes reserved";
+    m_passedThroughId = std::string(name) + " pool: passed through";
+
+    Profiles *profiles = Profiles::getInstance();
+    profiles->addCounter(m_allocationsId.c_str(), &m_allocations);
+    profiles->addCounter(m_liveId.c_str(), &m_live);
+    profiles->addCounter(m_reservedId.c_str(), &m_reserved);
+    profiles->addCounter(m_passedThroughId.c_str(), &m_passedThrough);
+}
+
+ObjectPool::~ObjectPool()
+{
+    // Only reached if the pool is not a program-lifetime one, in
+    // which case its objects are assumed to have gone already
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+        ::operator delete(m_chunks[i]);
+    }
+}
+
+void *
+ObjectPool::allocate(size_t size)
+{
+#ifndef RG_NO_OBJECT_POOL
+    if (size == m_requestSize) {
+        QMutexLocker locker(&m_mutex);
+        if (!m_free) addChunk();
+        Slot *slot = m_free;
+        m_free = slot->next;
+        ++m_allocations;
+        ++m_live;
+        return slot;
+    }
+#endif
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_passedThrough;
+    }
+    return ::operator new(size);
+}
+
+void
+ObjectPool::release(void *p, size_t size)
+{
+    if (!p) return;
+#ifndef RG_NO_OBJECT_POOL
+    if (size == m_requestSize) {
+        QMutexLocker locker(&m_mutex);
+        Slot *slot = static_cast<Slot *>(p);
+        slot->next = m_free;
+        m_free = slot;
+        --m_live;
+        return;
+    }
+#endif
+    ::operator delete(p);
+}
+
+void
+ObjectPool::addChunk()
+{
+    char *chunk = static_cast<char *>(::operator new(m_objectSize *
+                                                     m_chunkObjects));
+
+    // Thread the new slots onto the free list in address order, so
+    // that objects allocated together end up adjacent in memory
+    for (size_t i = m_chunkObjects; i > 0; ) {
+        --i;
+        Slot *slot = reinterpret_cast<Slot *>(chunk + i * m_objectSize);
+        slot->next = m_free;
+        m_free = slot;
+    }
+
+    m_chunks.insert(std::upper_bound(m_chunks.begin(), m_chunks.end(), chunk),
+                    chunk);
+    m_reserved += m_objectSize * m_chunkObjects;
+}
+
+size_t
+ObjectPool::trim()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_chunks.empty()) return 0;
+
+    size_t chunkBytes = m_objectSize * m_chunkObjects;
+    std::vector<size_t> freeCounts(m_chunks.size(), 0);
+
+    if (m_live > 0) {
+        // Count the free slots in each chunk
+        for (Slot *slot = m_free; slot; slot = slot->next) {
+            char *p = reinterpret_cast<char *>(slot);
+            std::vector<char *>::iterator i =
+                std::upper_bound(m_chunks.begin(), m_chunks.end(), p);
+            --i;
+            ++freeCounts[i - m_chunks.begin()];
+        }
+    } else {
+        std::fill(freeCounts.begin(), freeCounts.end(), m_chunkObjects);
+    }
+
+    std::vector<char *> kept;
+    std::vector<char *> unused;
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+        if (freeCounts[i] == m_chunkObjects) unused.push_back(m_chunks[i]);
+        else kept.push_back(m_chunks[i]);
+    }
+
+    if (unused.empty()) return 0;
+
+    if (kept.empty()) {
+        m_free = 0;
+    } else {
+        // Rebuild the free list without the slots in unused chunks
+        Slot *head = 0;
+        Slot **tail = &head;
+        for (Slot *slot = m_free; slot; slot = slot->next) {
+            char *p = reinterpret_cast<char *>(slot);
+            std::vector<char *>::iterator i =
+                std::upper_bound(unused.begin(), unused.end(), p);
+            if (i != unused.begin() && p < *(i-1) + chunkBytes) continue;
+            *tail = slot;
+            tail = &slot->next;
+        }
+        *tail = 0;
+        m_free = head;
+    }
+
+    for (size_t i = 0; i < unused.size(); ++i) {
+        ::operator delete(unused[i]);
+    }
+
+    m_chunks = kept;
+    size_t released = unused.size() * chunkBytes;
+    m_reserved -= released;
+    return released;
+}
+
+}
@@ -0,0 +1,119 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_OBJECT_POOL_H
+#define RG_OBJECT_POOL_H
+
+#include <QMutex>
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace Rosegarden
+{
+
+/**
+ * ObjectPool is a slab allocator for small objects of a single size.
+ * It hands out slots from large chunks and keeps released slots on a
+ * free list for reuse, so that creating and destroying many objects
+ * of the same class (Events in particular, which editing commands
+ * copy and discard by the thousand) costs a pointer swap rather than
+ * a trip through malloc.
+ *
+ * A class opts in by defining its own operator new and delete to call
+ * allocate() and release() on a pool of its own.  Requests for any
+ * size other than the pool's object size (from a larger subclass, for
+ * instance) are passed through to the global operator new.
+ *
+ * Chunks are only returned to the system by trim(), which frees any
+ * chunk none of whose slots is in use.  This is called when a
+ * Composition is destroyed.
+ *
+ * Each pool is guarded by a mutex of its own, so threads allocating
+ * different classes don't contend, but all threads allocating from the
+ * same pool (Events, say) take turns.  This is cheap while one thread
+ * does nearly all of the allocation, as the GUI thread does; there are
+ * no per-thread free lists for heavier multi-threaded use.
+ *
+ * The counters are registered with Profiles and so appear in its
+ * dump.  Building with RG_NO_OBJECT_POOL defined makes every pool
+ * pass straight through to the global allocator, which is useful
+ * when looking for memory errors with valgrind.
+ */
+class ObjectPool
+{
+public:
+    /**
+     * Create a pool for objects of the given size.  The name is used
+     * to label the pool's counters and must remain valid for the
+     * lifetime of the pool.  Pools are expected to live for the
+     * duration of the program.
+     */
+    ObjectPool(const char *name, size_t objectSize);
+    ~ObjectPool();
+
+    void *allocate(size_t size);
+    void release(void *p, size_t size);
+
+    /**
+     * Free any chunks that have no live objects in them.  Return the
+     * number of bytes returned to the system.
+     */
+    size_t trim();
+
+    const char *getName() const { return m_name; }
+
+    /// Number of objects currently allocated from this pool
+    long getLiveCount() const { return m_live; }
+
+    /// Total number of allocations served from this pool
+    long getAllocationCount() const { return m_allocations; }
+
+    /// Number of bytes currently held in chunks, used or not
+    long getReservedBytes() const { return m_reserved; }
+
+private:
+    ObjectPool(const ObjectPool &);
+    ObjectPool &operator=(const ObjectPool &);
+
+    struct Slot {
+        Slot *next;
+    };
+
+    void addChunk();
+
+    QMutex m_mutex;
+    const char *m_name;
+    size_t m_requestSize;       // object size as requested by callers
+    size_t m_objectSize;        // slot size, rounded up for alignment
+    size_t m_chunkObjects;
+    std::vector<char *> m_chunks; // sorted by address
+    Slot *m_free;
+
+    long m_allocations;
+    long m_live;
+    long m_reserved;
+    long m_passedThrough;
+
+    std::string m_allocationsId;
+    std::string m_liveId;
+    std::string m_reservedId;
+    std::string m_passedThroughId;
+};
+
+}
+
+#endif
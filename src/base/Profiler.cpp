@@ -31,9 +31,12 @@ using std::endl;
 namespace Rosegarden {
 
 Profiles* Profiles::m_instance = 0;
+QMutex Profiles::m_instanceMutex;
 
 Profiles* Profiles::getInstance()
 {
+    QMutexLocker locker(&m_instanceMutex);
+
     if (!m_instance) m_instance = new Profiles();
     
     return m_instance;
@@ -57,6 +60,9 @@ void Profiles::accumulate(
 )
 {
 #ifndef NO_TIMING    
+    // Profile points may be passed on any thread
+    QMutexLocker locker(&m_mutex);
+
     ProfilePair &pair(m_profiles[id]);
     ++pair.first;
     pair.second.first += time;
@@ -76,10 +82,18 @@ void Profiles::accumulate(
 #endif
 }
 
+void Profiles::addCounter(const char *id, const long *counter)
+{
+    QMutexLocker locker(&m_mutex);
+    m_counters[id] = counter;
+}
+
 void Profiles::dump() const
 {
 #ifndef NO_TIMING
 
+    QMutexLocker locker(&m_mutex);
+
     fprintf(stderr, "Profiling points:\n");
 
     fprintf(stderr, "\nBy name:\n");
@@ -170,6 +184,14 @@ void Profiles::dump() const
         fprintf(stderr, "%-40s  %d\n", i->second, i->first);
     }
 
+    if (!m_counters.empty()) {
+        fprintf(stderr, "\nCounters:\n");
+        for (CounterMap::const_iterator i = m_counters.begin();
+             i != m_counters.end(); ++i) {
+            fprintf(stderr, "%-40s  %ld\n", i->first, *i->second);
+        }
+    }
+
 #endif
 }
 
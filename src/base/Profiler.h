@@ -24,6 +24,8 @@
 
 #include "RealTime.h"
 
+#include <QMutex>
+
 //#define NO_TIMING 1
 
 //#define WANT_TIMING 1
@@ -54,6 +56,15 @@ public:
     void accumulate(const char* id, clock_t time, RealTime rt);
     void dump() const;
 
+    /**
+     * Register a counter to be reported, with its value at the time,
+     * whenever the profiles are dumped.  The id and the counter must
+     * remain valid for the rest of the run.  This is for counts that
+     * are too frequently updated to go through accumulate(), such as
+     * allocator statistics.
+     */
+    void addCounter(const char *id, const long *counter);
+
 protected:
     Profiles();
 
@@ -66,7 +77,13 @@ protected:
     LastCallMap m_lastCalls;
     WorstCallMap m_worstCalls;
 
+    typedef std::map<const char *, const long *> CounterMap;
+    CounterMap m_counters;
+
+    mutable QMutex m_mutex;
+
     static Profiles* m_instance;
+    static QMutex m_instanceMutex;
 };
 
 #ifndef NO_TIMING
@@ -38,7 +38,7 @@ PropertyDefn<Int>::parse(string s)
 string
 PropertyDefn<Int>::unparse(PropertyDefn<Int>::basic_type i)
 {
-    static char buffer[20]; sprintf(buffer, "%ld", i);
+    char buffer[24]; sprintf(buffer, "%ld", i);
     return buffer;
 }
 
@@ -96,7 +96,7 @@ PropertyDefn<RealTimeT>::parse(string s)
 string
 PropertyDefn<RealTimeT>::unparse(PropertyDefn<RealTimeT>::basic_type i)
 {
-    static char buffer[256]; sprintf(buffer, "%d/%d", i.sec, i.nsec);
+    char buffer[32]; sprintf(buffer, "%d/%d", i.sec, i.nsec);
     return buffer;
 }
 
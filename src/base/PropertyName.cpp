@@ -19,22 +19,50 @@
 
 #include "base/PropertyName.h"
 #include "base/Exception.h"
+#include "base/AtomicLoad.h"
 
 #include <QtGlobal>
+#include <QMutex>
+#include <QMutexLocker>
 
 namespace Rosegarden 
 {
 using std::string;
 
+// These are initialised statically rather than by constructors, as
+// PropertyNames are interned during static initialisation and a
+// constructor run later would lose them
 PropertyName::intern_map *PropertyName::m_interns = 0;
-PropertyName::intern_reverse_map *PropertyName::m_internsReversed = 0;
-int PropertyName::m_nextValue = 0;
+QBasicAtomicPointer<PropertyName::name_vector> PropertyName::m_names =
+    Q_BASIC_ATOMIC_INITIALIZER(0);
+QBasicAtomicInt PropertyName::m_nameCount = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+// Names may be interned from more than one thread.  The mutex is made
+// on first use, as PropertyNames are interned during static
+// initialisation.  Looking up a name is much more common, and takes
+// no lock: see intern() for how the table of names is kept safe.
+
+static QMutex &
+internMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
 
 int PropertyName::intern(const string &s)
 {
+    QMutexLocker locker(&internMutex());
+
+    // Only ever changed with the mutex held, so we can read it plainly
+    name_vector *names = m_names;
+
     if (!m_interns) {
         m_interns = new intern_map;
-        m_internsReversed = new intern_reverse_map;
+        names = new name_vector;
+        // values start at 1, leaving 0 unused
+        names->push_back(0);
+        m_names.fetchAndStoreRelease(names);
+        m_nameCount.fetchAndStoreRelease(1);
     }
 
     intern_map::iterator i(m_interns->find(s));
@@ -42,31 +70,54 @@ int PropertyName::intern(const string &s)
     if (i != m_interns->end()) {
         return i->second;
     } else {
-        int nv = ++m_nextValue;
-        m_interns->insert(intern_pair(s, nv));
-        m_internsReversed->insert(intern_reverse_pair(nv, s));
+        int nv = int(names->size());
+        i = m_interns->insert(intern_pair(s, nv)).first;
+
+        // getName() reads the table without locking, so a table that
+        // may be in use is never reallocated: when it is full we copy
+        // it into a bigger one and publish that.  The old one is
+        // leaked on purpose, as a reader may still be looking at it
+        // and we can't tell when it has finished.  The tables only
+        // hold pointers and grow geometrically, so little is lost.
+        if (names->size() == names->capacity()) {
+            name_vector *bigger = new name_vector;
+            bigger->reserve(names->capacity() * 2 + 64);
+            bigger->insert(bigger->end(), names->begin(), names->end());
+            names = bigger;
+            m_names.fetchAndStoreRelease(names);
+        }
+
+        // map nodes are never moved, so the key's address is stable.
+        // The count is published after the entry, and the size of the
+        // vector is never read by getName(), as push_back changes it.
+        names->push_back(&i->first);
+        m_nameCount.fetchAndStoreRelease(nv + 1);
         return nv;
     }
 }
 
-string PropertyName::getName() const
+const string &PropertyName::getName() const
 {
-    intern_reverse_map::iterator i(m_internsReversed->find(m_value));
-    if (i != m_internsReversed->end()) return i->second;
+    // The count is read first: any table published by then has at
+    // least that many entries.
+    int count = loadAcquire(m_nameCount);
+    const name_vector *names = loadAcquire(m_names);
+
+    if (names && m_value > 0 && m_value < count) {
+        return *(*names)[m_value];
+    }
 
     // dump some informative data, even if we aren't in debug mode,
     // because this really shouldn't be happening
     std::cerr << "ERROR: PropertyName::getName: value corrupted!\n";
     std::cerr << "PropertyName's internal value is " << m_value << std::endl;
-    std::cerr << "Reverse interns are ";
-    i = m_internsReversed->begin();
-    if (i == m_internsReversed->end()) std::cerr << "(none)";
-    else while (i != m_internsReversed->end()) {
-	if (i != m_internsReversed->begin()) {
+    std::cerr << "Interned names are ";
+    if (!names || count < 2) std::cerr << "(none)";
+    else for (int i = 1; i < count; ++i) {
+	if (i > 1) {
 	    std::cerr << ", ";
 	}
-	std::cerr << i->first << "=" << i->second;
-	++i;
+	std::cerr << i << "=" << *(*names)[i];
     }
     std::cerr << std::endl;
 
@@ -19,8 +19,12 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <iostream>
 
+#include <QAtomicPointer>
+#include <QAtomicInt>
+
 namespace Rosegarden 
 {
 
@@ -102,7 +106,7 @@ public:
         return getName().c_str();
     }
 
-    std::string getName() const /* throw (CorruptedValue) */;
+    const std::string &getName() const /* throw (CorruptedValue) */;
 
     int getValue() const { return m_value; }
 
@@ -112,12 +116,11 @@ private:
     typedef std::map<std::string, int> intern_map;
     typedef intern_map::value_type intern_pair;
 
-    typedef std::map<int, std::string> intern_reverse_map;
-    typedef intern_reverse_map::value_type intern_reverse_pair;
+    typedef std::vector<const std::string *> name_vector;
 
     static intern_map *m_interns;
-    static intern_reverse_map *m_internsReversed;
-    static int m_nextValue;
+    static QBasicAtomicPointer<name_vector> m_names;
+    static QBasicAtomicInt m_nameCount;
 
     int m_value;
 
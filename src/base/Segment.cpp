@@ -24,6 +24,7 @@
 #include "gui/general/GUIPalette.h"
 
 #include <QtGlobal>
+#include <QAtomicInt>
 
 #include <iostream>
 #include <algorithm>
@@ -42,7 +43,9 @@ using std::string;
 
 //#define DEBUG_NORMALIZE_RESTS 1
 
-static int g_runtimeSegmentId = 0;
+// Segments may be made on more than one thread, as by the batch
+// converter
+static QAtomicInt g_runtimeSegmentId(0);
 
 Segment::Segment(SegmentType segmentType, timeT startTime) :
     EventContainer(),
@@ -71,7 +74,7 @@ Segment::Segment(SegmentType segmentType, timeT startTime) :
     m_notifyResizeLocked(false),
     m_memoStart(0),
     m_memoEndMarkerTime(0),
-    m_runtimeSegmentId(g_runtimeSegmentId++),
+    m_runtimeSegmentId(g_runtimeSegmentId.fetchAndAddRelaxed(1)),
     m_snapGridSize(-1),
     m_viewFeatures(0),
     m_autoFade(false),
@@ -116,7 +119,7 @@ Segment::Segment(const Segment &segment):
     m_notifyResizeLocked(false),  // To copy a segment while notifications
     m_memoStart(0),               // are locked doesn't sound as a good
     m_memoEndMarkerTime(0),       // idea.
-    m_runtimeSegmentId(g_runtimeSegmentId++),
+    m_runtimeSegmentId(g_runtimeSegmentId.fetchAndAddRelaxed(1)),
     m_snapGridSize(-1),
     m_viewFeatures(0),
     m_autoFade(segment.isAutoFading()),
@@ -640,22 +643,24 @@ Segment::erase(iterator from, iterator to)
     if (from != end()) startTime = (*from)->getAbsoluteTime();
     if (to != end()) endTime = (*to)->getAbsoluteTime() + (*to)->getDuration();
 
-    // Not very efficient, but without an observer event for
-    // multiple erase we can't do any better.
+    // Note the events first, so that the container can drop the whole
+    // range in one erase rather than closing up after each event.
+    // Observers are then told about each event, as there is no
+    // observer call for multiple erase, and it is deleted only once
+    // they have seen it go, as with the single erase above.
 
-    for (Segment::iterator i = from; i != to; ) {
-
-        Segment::iterator j(i);
-        ++j;
+    FastVector<Event *> events;
+    for (Segment::iterator i = from; i != to; ++i) {
+        Q_CHECK_PTR(*i);
+        events.push_back(*i);
+    }
 
-        Event *e = *i;
-        Q_CHECK_PTR(e);
+    EventContainer::erase(from, to);
 
-        EventContainer::erase(i);
+    for (int i = 0; i < int(events.size()); ++i) {
+        Event *e = events[i];
         notifyRemove(e);
         delete e;
-
-        i = j;
     }
 
     if (startTime == m_startTime && begin() != end()) {
@@ -746,6 +751,17 @@ int Segment::getNextId() const
     return m_id++;
 }
 
+size_t
+Segment::getStorageSize() const
+{
+    size_t s = sizeof(Segment);
+    for (const_iterator i = begin(); i != end(); ++i) {
+        // and a node in the multiset
+        s += (*i)->getStorageSize() + 4 * sizeof(void *);
+    }
+    return s;
+}
+
 
 void
 Segment::fillWithRests(timeT endTime)
@@ -1764,6 +1780,14 @@ AllEventsChanged(const Segment *s)
 EventContainer::iterator
 EventContainer::findEventOfType(EventContainer::iterator i,
                                 const std::string &type)
+{
+    // Intern once, so the scan compares integers rather than strings
+    return findEventOfType(i, EventTypeName(type));
+}
+
+EventContainer::iterator
+EventContainer::findEventOfType(EventContainer::iterator i,
+                                const EventTypeName &type)
 {
     for (; i != end(); ++i) {
         Event *e = *i;
@@ -27,6 +27,9 @@
 #include "RefreshStatus.h"
 #include "RealTime.h"
 #include "MidiProgram.h"
+#ifdef RG_FLAT_EVENT_CONTAINER
+#include "SortedEventVector.h"
+#endif
 
 #include <QColor>
 
@@ -61,11 +64,22 @@ class BasicCommand;
  * EventContainer is a precursor to Segment, used in code that needs
  * to store events but doesn't need all the ancillary data and
  * behaviors that Segment provides.
+ *
+ * By default the events are held in a std::multiset.  If
+ * RG_FLAT_EVENT_CONTAINER is defined at build time, they are held in
+ * a SortedEventVector instead, which is friendlier to the cache when
+ * iterating over large segments.  Iterators stay valid across insert
+ * and erase in the same way with both.  See SortedEventVector.h.
  **/
+#ifdef RG_FLAT_EVENT_CONTAINER
+class EventContainer : public SortedEventVector
+#else
 class EventContainer : public std::multiset<Event*, Event::EventCmp>
+#endif
 {
  public:
     iterator findEventOfType(iterator i, const std::string &type);
+    iterator findEventOfType(iterator i, const EventTypeName &type);
 };
 
 /// Container of Event objects.
@@ -405,6 +419,9 @@ public:
     /// Clear the segment.
     void clear() { erase(begin(), end()); }
 
+    /// Approximate memory used by the segment and its events, in bytes
+    size_t getStorageSize() const;
+
     /**
      * Looks up an Event and if it finds it, erases it.
      * @return true if the event was found and erased, false otherwise.
@@ -129,9 +129,9 @@ SegmentNotationHelper::setNotationProperties(timeT startTime, timeT endTime)
 	    }
 	}
 
-	if ((*i)->isa(Note::EventType) || (*i)->isa(Note::EventRestType)) {
+	if ((*i)->isa(Note::TypeName) || (*i)->isa(Note::RestTypeName)) {
 
-	    if ((*i)->isa(Note::EventType)) {
+	    if ((*i)->isa(Note::TypeName)) {
 /*!!!		
 		if ((*i)->has(IS_GRACE_NOTE) &&
 		    (*i)->get<Bool>(IS_GRACE_NOTE)) {
@@ -171,7 +171,7 @@ SegmentNotationHelper::getNextAdjacentNote(iterator i,
 {
     iterator j(i);
     if (!isBeforeEndMarker(i)) return i;
-    if (!(*i)->isa(Note::EventType)) return end();
+    if (!(*i)->isa(Note::TypeName)) return end();
 
     timeT iEnd = getNotationEndTime(*i);
     long ip = 0, jp = 0;
@@ -179,7 +179,7 @@ SegmentNotationHelper::getNextAdjacentNote(iterator i,
 
     while (true) {
 	if (!isBeforeEndMarker(j) || !isBeforeEndMarker(++j)) return end();
-	if (!(*j)->isa(Note::EventType)) continue;
+	if (!(*j)->isa(Note::TypeName)) continue;
 
 	timeT jStart = (*j)->getNotationAbsoluteTime();
 	if (jStart > iEnd) return end();
@@ -201,7 +201,7 @@ SegmentNotationHelper::getPreviousAdjacentNote(iterator i,
 { 
     iterator j(i);
     if (!isBeforeEndMarker(i)) return i;
-    if (!(*i)->isa(Note::EventType)) return end();
+    if (!(*i)->isa(Note::TypeName)) return end();
 
     timeT iStart = (*i)->getNotationAbsoluteTime();
     timeT iEnd   = getNotationEndTime(*i);
@@ -210,7 +210,7 @@ SegmentNotationHelper::getPreviousAdjacentNote(iterator i,
 
     while (true) {
 	if (j == begin()) return end(); else --j;
-	if (!(*j)->isa(Note::EventType)) continue;
+	if (!(*j)->isa(Note::TypeName)) continue;
 	if ((*j)->getAbsoluteTime() < rangeStart) return end();
 
 	timeT jEnd = getNotationEndTime(*j);
@@ -318,7 +318,7 @@ SegmentNotationHelper::noteIsInChord(Event *note)
     
     for (iterator j = i; j != end(); ++j) { // not isBeforeEndMarker, unnecessary here
 	if (j == i) continue;
-	if ((*j)->isa(Note::EventType)) {
+	if ((*j)->isa(Note::TypeName)) {
 	    timeT tj = (*j)->getNotationAbsoluteTime();
 	    if (tj == t) return true;
 	    else if (tj > t) break;
@@ -328,7 +328,7 @@ SegmentNotationHelper::noteIsInChord(Event *note)
     for (iterator j = i; ; ) {
 	if (j == begin()) break;
 	--j;
-	if ((*j)->isa(Note::EventType)) {
+	if ((*j)->isa(Note::TypeName)) {
 	    timeT tj = (*j)->getNotationAbsoluteTime();
 	    if (tj == t) return true;
 	    else if (tj < t) break;
@@ -343,7 +343,7 @@ SegmentNotationHelper::noteIsInChord(Event *note)
 
     int noteCount = 0;
     for (iterator i = first; i != second; ++i) {
-	if ((*i)->isa(Note::EventType)) ++noteCount;
+	if ((*i)->isa(Note::TypeName)) ++noteCount;
     }
 
     return noteCount > 1;
@@ -509,8 +509,8 @@ SegmentNotationHelper::splitIntoTie(iterator &from, iterator to,
     //
     for (iterator i = from; i != to; ++i) {
 
-	if (!(*i)->isa(Note::EventType) &&
-	    !(*i)->isa(Note::EventRestType)) continue;
+	if (!(*i)->isa(Note::TypeName) &&
+	    !(*i)->isa(Note::RestTypeName)) continue;
 
 	if ((*i)->getAbsoluteTime() != baseTime) {
 	    // no way to really cope with an error, because at this
@@ -544,7 +544,7 @@ SegmentNotationHelper::splitIntoTie(iterator &from, iterator to,
 
 	// we only want to tie Note events:
 
-	if (eva->isa(Note::EventType)) {
+	if (eva->isa(Note::TypeName)) {
 
 	    // if the first event was already tied forward, the
 	    // second one will now be marked as tied forward
@@ -650,7 +650,7 @@ SegmentNotationHelper::makeThisNoteViable(iterator noteItr, bool splitAtBars)
 
     Segment::iterator i = noteItr;
 
-    if (!(*i)->isa(Note::EventType) && !(*i)->isa(Note::EventRestType)) {
+    if (!(*i)->isa(Note::TypeName) && !(*i)->isa(Note::RestTypeName)) {
         return *noteItr;
     }
 
@@ -839,7 +839,7 @@ SegmentNotationHelper::insertNote(Event *modelEvent)
     if (i != end() &&
 	(*i)->getAbsoluteTime() < absoluteTime &&
 	(*i)->getAbsoluteTime() + (*i)->getDuration() > absoluteTime &&
-	(*i)->isa(Note::EventRestType)) {
+	(*i)->isa(Note::RestTypeName)) {
 	i = splitIntoTie(i, absoluteTime - (*i)->getAbsoluteTime());
     }
 
@@ -891,7 +891,7 @@ SegmentNotationHelper::collapseRestsForInsert(iterator i,
     // collapse at most once, then recurse
 
     if (!segment().isBeforeEndMarker(i) ||
-	!(*i)->isa(Note::EventRestType)) return i;
+	!(*i)->isa(Note::RestTypeName)) return i;
 
     timeT d = (*i)->getDuration();
     iterator j = findContiguousNext(i); // won't return itr after end marker
@@ -931,7 +931,7 @@ SegmentNotationHelper::insertSomething(iterator i, int duration,
 
     while (i != end() &&
 	   ((*i)->getDuration() == 0 ||
-	    !((*i)->isa(Note::EventType) || (*i)->isa(Note::EventRestType))))
+	    !((*i)->isa(Note::TypeName) || (*i)->isa(Note::RestTypeName))))
 	++i;
 
     if (i == end()) {
@@ -964,7 +964,7 @@ SegmentNotationHelper::insertSomething(iterator i, int duration,
         // 2. If the new note or rest is shorter than an existing one,
         // split the existing one and chord or replace the first part.
 
-	if ((*i)->isa(Note::EventType)) {
+	if ((*i)->isa(Note::TypeName)) {
 
 	    if (!isSplitValid(duration, existingDuration - duration)) {
 
@@ -978,7 +978,7 @@ SegmentNotationHelper::insertSomething(iterator i, int duration,
 //		cerr << "Good split, splitting old event" << endl;
 		splitIntoTie(i, duration);
 	    }
-	} else if ((*i)->isa(Note::EventRestType)) {
+	} else if ((*i)->isa(Note::RestTypeName)) {
 
 //	    cerr << "Found rest, splitting" << endl;
 	    iterator last = splitIntoTie(i, duration);
@@ -1005,10 +1005,10 @@ SegmentNotationHelper::insertSomething(iterator i, int duration,
 	// special case: existing event is a rest, and it's at the end
 	// of the segment
 
-	if ((*i)->isa(Note::EventRestType)) {
+	if ((*i)->isa(Note::RestTypeName)) {
 	    iterator j;
 	    for (j = i; j != end(); ++j) {
-		if ((*j)->isa(Note::EventType)) break;
+		if ((*j)->isa(Note::TypeName)) break;
 	    }
 	    if (j == end()) needToSplit = false;
 	}
@@ -1028,7 +1028,7 @@ SegmentNotationHelper::insertSomething(iterator i, int duration,
 	    i = insertSingleSomething
 		(i, existingDuration, modelEvent, tiedBack);
 
-	    if (modelEvent->isa(Note::EventType))
+	    if (modelEvent->isa(Note::TypeName))
 		(*i)->set<Bool>(TIED_FORWARD, true);
 	    
 	    timeT insertedTime = (*i)->getAbsoluteTime();
@@ -1061,8 +1061,8 @@ SegmentNotationHelper::insertSingleSomething(iterator i, int duration,
     } else {
 	time = (*i)->getAbsoluteTime();
 	notationTime = (*i)->getNotationAbsoluteTime();
-	if (modelEvent->isa(Note::EventRestType) ||
-	    (*i)->isa(Note::EventRestType)) eraseI = true;
+	if (modelEvent->isa(Note::RestTypeName) ||
+	    (*i)->isa(Note::RestTypeName)) eraseI = true;
     }
 
     Event *e = new Event(*modelEvent, time, effectiveDuration,
@@ -1073,7 +1073,7 @@ SegmentNotationHelper::insertSingleSomething(iterator i, int duration,
 	setInsertedNoteGroup(e, i);
     }
 
-    if (tiedBack && e->isa(Note::EventType)) {
+    if (tiedBack && e->isa(Note::TypeName)) {
         e->set<Bool>(TIED_BACKWARD, true);
     }
 
@@ -1105,15 +1105,15 @@ SegmentNotationHelper::setInsertedNoteGroup(Event *e, iterator i)
     e->unset(BEAMED_GROUP_TYPE);
 
     while (isBeforeEndMarker(i) &&
-	   (!((*i)->isa(Note::EventRestType)) ||
+	   (!((*i)->isa(Note::RestTypeName)) ||
 	    (*i)->has(BEAMED_GROUP_TUPLET_BASE)) &&
 	   (*i)->getNotationAbsoluteTime() == e->getAbsoluteTime()) {
 
 	if ((*i)->has(BEAMED_GROUP_ID)) {
 
 	    string type = (*i)->get<String>(BEAMED_GROUP_TYPE);
-	    if (type != GROUP_TYPE_TUPLED && !(*i)->isa(Note::EventType)) {
-		if ((*i)->isa(Note::EventRestType)) return;
+	    if (type != GROUP_TYPE_TUPLED && !(*i)->isa(Note::TypeName)) {
+		if ((*i)->isa(Note::RestTypeName)) return;
 		else {
 		    ++i;
 		    continue;
@@ -1290,8 +1290,8 @@ SegmentNotationHelper::deleteEvent(Event *e, bool collapseRest)
 {
     bool res = true;
 
-    if (e->isa(Note::EventType)) deleteNote(e, collapseRest);
-    else if (e->isa(Note::EventRestType)) res = deleteRest(e);
+    if (e->isa(Note::TypeName)) deleteNote(e, collapseRest);
+    else if (e->isa(Note::RestTypeName)) res = deleteRest(e);
     else {
         // just plain delete
         iterator i = segment().findSingle(e);
@@ -1307,10 +1307,10 @@ SegmentNotationHelper::hasEffectiveDuration(iterator i)
 {
     bool hasDuration = ((*i)->getDuration() > 0);
 
-    if ((*i)->isa(Note::EventType)) {
+    if ((*i)->isa(Note::TypeName)) {
 	iterator i0(i);
 	if (++i0 != end() &&
-	    (*i0)->isa(Note::EventType) &&
+	    (*i0)->isa(Note::TypeName) &&
 	    (*i0)->getNotationAbsoluteTime() == 
 	     (*i)->getNotationAbsoluteTime()) {
 	    // we're in a chord or something
@@ -1375,7 +1375,7 @@ SegmentNotationHelper::makeBeamedGroupAux(iterator from, iterator to,
 	// between beamed quavers -- in which case marking it as
 	// beamed will ensure that it gets re-stemmed appropriately
 
-	if ((*i)->isa(Note::EventType) &&
+	if ((*i)->isa(Note::TypeName) &&
 	    (*i)->getNotationDuration() >= Note(Note::Crotchet).getDuration()) {
 //	    std::cerr << "too long" <<std::endl;
 	    if (!beamedSomething) continue;
@@ -1426,7 +1426,7 @@ SegmentNotationHelper::makeTupletGroup(timeT t, int untupled, int tupled,
 	timeT offset = (*i)->getNotationAbsoluteTime() - notationTime;
 	timeT duration = (*i)->getNotationDuration();
 
-	if ((*i)->isa(Note::EventRestType) &&
+	if ((*i)->isa(Note::RestTypeName) &&
 	    ((offset + duration) > (untupled * unit))) {
 	    fillWithRestsTo = std::max(fillWithRestsTo,
 				       notationTime + offset + duration);
@@ -1684,7 +1684,7 @@ SegmentNotationHelper::autoBeamBar(iterator from, iterator to,
 		if (!hasEffectiveDuration(j)) continue;
                 timeT jdur = (*j)->getNotationDuration();
 
-		if ((*j)->isa(Note::EventType)) {
+		if ((*j)->isa(Note::TypeName)) {
 		    if (jdur < crotchet) ++beamable;
 		    if (jdur >= semiquaver) ++longerThanDemi;
 		}
@@ -1717,10 +1717,10 @@ SegmentNotationHelper::autoBeamBar(iterator from, iterator to,
 		if ((count > maximum)
 		    || (longerThanDemi > 4)
 		    || (++jnext == to)     
-		    || ((*j    )->isa(Note::EventType) &&
-			(*jnext)->isa(Note::EventType) &&
+		    || ((*j    )->isa(Note::TypeName) &&
+			(*jnext)->isa(Note::TypeName) &&
 			(*jnext)->getNotationDuration() > jdur)
-		    || ((*jnext)->isa(Note::EventRestType))) {
+		    || ((*jnext)->isa(Note::RestTypeName))) {
 
 		    if (k != end() && beamable >= 2) {
 
@@ -1777,7 +1777,7 @@ SegmentNotationHelper::guessClef(iterator from, iterator to)
     Key key;
 
     for (iterator i = from; i != to; ++i) {
-        if ((*i)->isa(Note::EventType)) {
+        if ((*i)->isa(Note::TypeName)) {
 //!!!            NotationDisplayPitch p((*i)->get<Int>(PITCH), clef, key);
 	    try {
 		Pitch p(**i);
@@ -1838,7 +1838,7 @@ SegmentNotationHelper::removeRests(timeT time, timeT &duration, bool testOnly)
     //
     while ((eventTime < finalTime) && (to != end())) {
 
-        if (!(*to)->isa(Note::EventRestType)) {
+        if (!(*to)->isa(Note::RestTypeName)) {
             // a non-rest was found
 	    duration = (*to)->getAbsoluteTime() - time;
             return false;
@@ -1919,7 +1919,7 @@ SegmentNotationHelper::reorganizeRests(timeT startTime, timeT endTime,
 
     for (iterator i = ia; i != ib; ++i) {
 
-	if ((*i)->isa(Note::EventRestType)) {
+	if ((*i)->isa(Note::RestTypeName)) {
 
 	    timeT startTime = (*i)->getAbsoluteTime();
 	    timeT duration = 0;
@@ -1927,7 +1927,7 @@ SegmentNotationHelper::reorganizeRests(timeT startTime, timeT endTime,
 
 	    for ( ; j != ib; ++j) {
 
-		if ((*j)->isa(Note::EventRestType)) {
+		if ((*j)->isa(Note::RestTypeName)) {
 		    duration += (*j)->getDuration();
 		    erasable.push_back(j);
 		} else break;
@@ -2080,7 +2080,7 @@ SegmentNotationHelper::deCounterpoint(timeT startTime, timeT endTime)
 	std::cerr << "SegmentNotationHelper::deCounterpoint: event at " << (*i)->getAbsoluteTime() << " notation " << (*i)->getNotationAbsoluteTime() << ", duration " << (*i)->getNotationDuration() << ", type " << (*i)->getType() << std::endl;
 #endif	    
 
-	if (!(*i)->isa(Note::EventType)) { ++i; continue; }
+	if (!(*i)->isa(Note::TypeName)) { ++i; continue; }
 
 	timeT ti = (*i)->getNotationAbsoluteTime();
 	timeT di = (*i)->getNotationDuration();
@@ -2093,7 +2093,7 @@ SegmentNotationHelper::deCounterpoint(timeT startTime, timeT endTime)
 	// note) has a different duration
 	Segment::iterator k = i;
 	while (segment().isBeforeEndMarker(k)) {
-	    if ((*k)->isa(Note::EventType)) {
+	    if ((*k)->isa(Note::TypeName)) {
 #ifdef DEBUG_DECOUNTERPOINT
 		std::cerr<<"abstime "<<(*k)->getAbsoluteTime()<< std::endl;
 #endif	    
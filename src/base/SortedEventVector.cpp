@@ -0,0 +1,416 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "SortedEventVector.h"
+
+#include <algorithm>
+
+namespace Rosegarden
+{
+
+SortedEventVector::SortedEventVector(const SortedEventVector &v) :
+    m_size(0),
+    m_version(0)
+{
+    for (iterator i = v.begin(); i != v.end(); ++i) {
+        insertBefore(Position(0, 0), *i);
+    }
+}
+
+SortedEventVector &
+SortedEventVector::operator=(const SortedEventVector &v)
+{
+    if (&v != this) {
+        clear();
+        for (iterator i = v.begin(); i != v.end(); ++i) {
+            insertBefore(Position(0, 0), *i);
+        }
+    }
+    return *this;
+}
+
+bool
+SortedEventVector::operator==(const SortedEventVector &v) const
+{
+    return m_size == v.m_size && std::equal(begin(), end(), v.begin());
+}
+
+void
+SortedEventVector::next(const_iterator &i) const
+{
+    i.refresh();
+    if (!i.m_c) return;
+
+    if (i.m_pos + 1 < i.m_c->count) {
+        ++i.m_pos;
+    } else if (size_t(i.m_c->index + 1) < m_chunks.size()) {
+        i.m_chunk = i.m_c->index + 1;
+        i.m_c = m_chunks[i.m_chunk];
+        i.m_pos = 0;
+    } else {
+        i.m_c = 0;
+        i.m_chunk = 0;
+        i.m_pos = 0;
+        i.m_e = 0;
+        return;
+    }
+
+    i.m_e = i.m_c->events[i.m_pos];
+}
+
+void
+SortedEventVector::previous(const_iterator &i) const
+{
+    i.refresh();
+
+    if (!i.m_c) {
+        // from end()
+        if (m_chunks.empty()) return;
+        i.m_c = m_chunks.back();
+        i.m_chunk = i.m_c->index;
+        i.m_pos = i.m_c->count - 1;
+    } else if (i.m_pos > 0) {
+        --i.m_pos;
+    } else if (i.m_c->index > 0) {
+        i.m_chunk = i.m_c->index - 1;
+        i.m_c = m_chunks[i.m_chunk];
+        i.m_pos = i.m_c->count - 1;
+    } else {
+        return;
+    }
+
+    i.m_e = i.m_c->events[i.m_pos];
+}
+
+void
+SortedEventVector::relocate(const const_iterator &i) const
+{
+    i.m_version = m_version;
+
+    if (!i.m_e) {
+        i.m_c = 0;
+        i.m_chunk = 0;
+        i.m_pos = 0;
+        return;
+    }
+
+    // The chunk may have gone, so look it up by index rather than
+    // through m_c.  Most changes made while iterating are at or next
+    // to the iterator, which leaves its event where it was or moves
+    // it by one.
+    if (size_t(i.m_chunk) < m_chunks.size()) {
+        Chunk *c = m_chunks[i.m_chunk];
+        for (int pos = i.m_pos - 1; pos <= i.m_pos + 1; ++pos) {
+            if (pos >= 0 && pos < c->count && c->events[pos] == i.m_e) {
+                i.m_c = c;
+                i.m_pos = pos;
+                return;
+            }
+        }
+    }
+
+    // Otherwise search for it, and then for the same event among any
+    // equivalent ones
+    Position p = lowerBound(i.m_e);
+    while (p.c && !(*i.m_e < *p.c->events[p.pos])) {
+        if (p.c->events[p.pos] == i.m_e) {
+            i.m_c = p.c;
+            i.m_chunk = p.c->index;
+            i.m_pos = p.pos;
+            return;
+        }
+        if (++p.pos == p.c->count) {
+            size_t index = p.c->index + 1;
+            p = Position(index < m_chunks.size() ? m_chunks[index] : 0, 0);
+        }
+    }
+
+    // The event has been erased, which leaves the iterator invalid as
+    // it would be with std::multiset
+    i.m_c = 0;
+    i.m_chunk = 0;
+    i.m_pos = 0;
+}
+
+SortedEventVector::Position
+SortedEventVector::lowerBound(const Event *e) const
+{
+    // first chunk whose last event does not compare less than e
+    size_t lo = 0, hi = m_chunks.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        Chunk *c = m_chunks[mid];
+        if (*c->events[c->count - 1] < *e) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == m_chunks.size()) return Position(0, 0);
+
+    // then the first event in it that does not compare less than e
+    Chunk *c = m_chunks[lo];
+    int l = 0, h = c->count - 1;
+    while (l < h) {
+        int mid = l + (h - l) / 2;
+        if (*c->events[mid] < *e) l = mid + 1;
+        else h = mid;
+    }
+    return Position(c, l);
+}
+
+SortedEventVector::Position
+SortedEventVector::upperBound(const Event *e) const
+{
+    // first chunk whose last event compares greater than e
+    size_t lo = 0, hi = m_chunks.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        Chunk *c = m_chunks[mid];
+        if (*e < *c->events[c->count - 1]) hi = mid;
+        else lo = mid + 1;
+    }
+    if (lo == m_chunks.size()) return Position(0, 0);
+
+    // then the first event in it that compares greater than e
+    Chunk *c = m_chunks[lo];
+    int l = 0, h = c->count - 1;
+    while (l < h) {
+        int mid = l + (h - l) / 2;
+        if (*e < *c->events[mid]) h = mid;
+        else l = mid + 1;
+    }
+    return Position(c, l);
+}
+
+void
+SortedEventVector::renumberChunks(size_t from)
+{
+    for (size_t i = from; i < m_chunks.size(); ++i) {
+        m_chunks[i]->index = int(i);
+    }
+}
+
+SortedEventVector::Position
+SortedEventVector::insertBefore(Position p, Event *e)
+{
+    Chunk *c = p.c;
+    int pos = p.pos;
+
+    if (!c) {
+        if (m_chunks.empty()) {
+            c = new Chunk;
+            c->count = 0;
+            c->index = 0;
+            m_chunks.push_back(c);
+        } else {
+            c = m_chunks.back();
+        }
+        pos = c->count;
+    }
+
+    if (c->count == ChunkSize) {
+
+        Chunk *d = new Chunk;
+
+        if (pos == ChunkSize) {
+            // Appending to a full chunk, as when loading: start a
+            // new one rather than leaving two half-empty ones
+            d->count = 0;
+        } else {
+            // Split the chunk, moving its upper half into the new one
+            const int half = ChunkSize / 2;
+            d->count = ChunkSize - half;
+            std::copy(c->events + half, c->events + ChunkSize, d->events);
+            c->count = half;
+        }
+
+        m_chunks.insert(m_chunks.begin() + c->index + 1, d);
+        renumberChunks(c->index + 1);
+
+        if (pos >= c->count) {
+            pos -= c->count;
+            c = d;
+        }
+    }
+
+    std::copy_backward(c->events + pos, c->events + c->count,
+                       c->events + c->count + 1);
+    c->events[pos] = e;
+    ++c->count;
+    ++m_size;
+    ++m_version;
+
+    return Position(c, pos);
+}
+
+SortedEventVector::iterator
+SortedEventVector::insert(Event *e)
+{
+    // Appending is by far the most common case when loading or
+    // recording, so check for it before searching
+    Position p(0, 0);
+
+    if (!m_chunks.empty()) {
+        Chunk *last = m_chunks.back();
+        if (*e < *last->events[last->count - 1]) p = upperBound(e);
+    }
+
+    p = insertBefore(p, e);
+    return iterator(this, p.c, p.pos);
+}
+
+SortedEventVector::iterator
+SortedEventVector::insert(iterator hint, Event *e)
+{
+    if (hint.m_v == this) {
+
+        hint.refresh();
+
+        Event *before = 0;
+        if (!hint.m_c) {
+            if (!m_chunks.empty()) {
+                Chunk *last = m_chunks.back();
+                before = last->events[last->count - 1];
+            }
+        } else if (hint.m_pos > 0) {
+            before = hint.m_c->events[hint.m_pos - 1];
+        } else if (hint.m_c->index > 0) {
+            Chunk *prior = m_chunks[hint.m_c->index - 1];
+            before = prior->events[prior->count - 1];
+        }
+
+        if ((!hint.m_e || !(*hint.m_e < *e)) && (!before || !(*e < *before))) {
+            Position p = insertBefore(Position(hint.m_c, hint.m_pos), e);
+            return iterator(this, p.c, p.pos);
+        }
+    }
+
+    return insert(e);
+}
+
+void
+SortedEventVector::eraseAt(Position p)
+{
+    Chunk *c = p.c;
+
+    std::copy(c->events + p.pos + 1, c->events + c->count,
+              c->events + p.pos);
+    --c->count;
+    --m_size;
+    ++m_version;
+
+    if (c->count == 0) {
+        int index = c->index;
+        m_chunks.erase(m_chunks.begin() + index);
+        renumberChunks(index);
+        delete c;
+        return;
+    }
+
+    // Fold a nearly empty chunk into its successor's space, so that
+    // erasing most of a segment doesn't leave it spread thinly over
+    // many chunks
+    if (c->count < ChunkSize / 4 && size_t(c->index + 1) < m_chunks.size()) {
+        Chunk *d = m_chunks[c->index + 1];
+        if (c->count + d->count <= ChunkSize) {
+            std::copy(d->events, d->events + d->count,
+                      c->events + c->count);
+            c->count += d->count;
+            int index = d->index;
+            m_chunks.erase(m_chunks.begin() + index);
+            renumberChunks(index);
+            delete d;
+        }
+    }
+}
+
+void
+SortedEventVector::erase(iterator i)
+{
+    if (i.m_v != this || !i.m_e) return;
+    i.refresh();
+    if (i.m_c) eraseAt(Position(i.m_c, i.m_pos));
+}
+
+void
+SortedEventVector::erase(iterator from, iterator to)
+{
+    // Each iterator finds its event again after the one before it
+    // has gone, so this is safe
+    while (from != to) erase(from++);
+}
+
+SortedEventVector::size_type
+SortedEventVector::erase(Event *const &e)
+{
+    size_type n = 0;
+    Position p = lowerBound(e);
+    while (p.c && !(*e < *p.c->events[p.pos])) {
+        // Erasing may remove or merge the chunk, so find the next
+        // equivalent event again from scratch
+        eraseAt(p);
+        ++n;
+        p = lowerBound(e);
+    }
+    return n;
+}
+
+void
+SortedEventVector::clear()
+{
+    for (size_t i = 0; i < m_chunks.size(); ++i) delete m_chunks[i];
+    m_chunks.clear();
+    m_size = 0;
+    ++m_version;
+}
+
+void
+SortedEventVector::swap(SortedEventVector &v)
+{
+    m_chunks.swap(v.m_chunks);
+    std::swap(m_size, v.m_size);
+    ++m_version;
+    ++v.m_version;
+}
+
+SortedEventVector::iterator
+SortedEventVector::lower_bound(Event *const &e) const
+{
+    Position p = lowerBound(e);
+    return iterator(this, p.c, p.pos);
+}
+
+SortedEventVector::iterator
+SortedEventVector::upper_bound(Event *const &e) const
+{
+    Position p = upperBound(e);
+    return iterator(this, p.c, p.pos);
+}
+
+SortedEventVector::iterator
+SortedEventVector::find(Event *const &e) const
+{
+    Position p = lowerBound(e);
+    if (p.c && !(*e < *p.c->events[p.pos])) return iterator(this, p.c, p.pos);
+    return end();
+}
+
+SortedEventVector::size_type
+SortedEventVector::count(Event *const &e) const
+{
+    size_type n = 0;
+    for (iterator i = lower_bound(e), j = upper_bound(e); i != j; ++i) ++n;
+    return n;
+}
+
+}
@@ -0,0 +1,243 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_SORTED_EVENT_VECTOR_H
+#define RG_SORTED_EVENT_VECTOR_H
+
+#include "Event.h"
+
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace Rosegarden
+{
+
+/**
+ * SortedEventVector is a sorted store of Event pointers with an
+ * interface matching the subset of std::multiset<Event *,
+ * Event::EventCmp> that EventContainer and Segment rely on.
+ *
+ * The event pointers are held in order in a sequence of small
+ * fixed-size chunks, each an array of pointers, so iterating mostly
+ * walks along short arrays rather than chasing tree nodes, and
+ * lookups are binary searches, first over the chunks and then within
+ * one.  Inserting or erasing only moves the entries of a single chunk.
+ *
+ * An iterator is a chunk and an index in it, together with the event
+ * it refers to and the container's version number at the time it
+ * last found it.  Every insert and erase bumps the version, and an
+ * iterator that finds the version has changed looks its event up
+ * again (by its time and then its address) before going on.  So, as
+ * with std::multiset, inserting never invalidates an iterator, and
+ * erasing only invalidates iterators to the erased event.  Idioms
+ * such as erase(i++), or keeping the next iterator across an erase,
+ * work the same with either backend; they cost a lookup per step only
+ * while the container is being changed under them.
+ *
+ * As with the multiset, an event's time and sub-ordering must not be
+ * changed while it is in the container.  An event that is in the
+ * container more than once is found again at its first entry.
+ *
+ * Equivalent events (same time and sub-ordering) keep insertion
+ * order, as they do in the std::multiset implementation we use.
+ */
+class SortedEventVector
+{
+public:
+    typedef Event *key_type;
+    typedef Event *value_type;
+    typedef Event::EventCmp key_compare;
+    typedef Event::EventCmp value_compare;
+    typedef long size_type;
+    typedef long difference_type;
+    typedef Event *const &reference;
+    typedef Event *const &const_reference;
+
+private:
+    enum { ChunkSize = 64 };
+
+    struct Chunk {
+        Event *events[ChunkSize];
+        int count;
+        int index;      // index in m_chunks
+    };
+
+public:
+    /**
+     * As with std::set, the elements are keys and may not be changed
+     * in place, so iterator and const_iterator are the same type.
+     */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef Event *value_type;
+        typedef long difference_type;
+        typedef Event *const *pointer;
+        typedef Event *const &reference;
+
+        const_iterator() :
+            m_v(0), m_c(0), m_chunk(0), m_pos(0), m_e(0), m_version(0) { }
+
+        reference operator*() const {
+            refresh(); return m_c->events[m_pos];
+        }
+        pointer operator->() const {
+            refresh(); return &m_c->events[m_pos];
+        }
+
+        const_iterator &operator++() { m_v->next(*this); return *this; }
+        const_iterator operator++(int) {
+            const_iterator i(*this); m_v->next(*this); return i;
+        }
+        const_iterator &operator--() { m_v->previous(*this); return *this; }
+        const_iterator operator--(int) {
+            const_iterator i(*this); m_v->previous(*this); return i;
+        }
+
+        // The event identifies the position, so no lookup is needed
+        bool operator==(const const_iterator &i) const {
+            return m_v == i.m_v && m_e == i.m_e;
+        }
+        bool operator!=(const const_iterator &i) const {
+            return m_v != i.m_v || m_e != i.m_e;
+        }
+
+    private:
+        friend class SortedEventVector;
+
+        const_iterator(const SortedEventVector *v, Chunk *c, int pos) :
+            m_v(v), m_c(c), m_chunk(c ? c->index : 0), m_pos(pos),
+            m_e(c ? c->events[pos] : 0), m_version(v->m_version) { }
+
+        void refresh() const {
+            if (m_version != m_v->m_version) m_v->relocate(*this);
+        }
+
+        const SortedEventVector *m_v;
+        mutable Chunk *m_c;             // 0 for end()
+        mutable int m_chunk;            // index of m_c in m_chunks
+        mutable int m_pos;
+        Event *m_e;                     // 0 for end()
+        mutable unsigned long m_version;
+    };
+
+    typedef const_iterator iterator;
+
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef const_reverse_iterator reverse_iterator;
+
+    SortedEventVector() : m_size(0), m_version(0) { }
+    SortedEventVector(const SortedEventVector &v);
+    ~SortedEventVector() { clear(); }
+
+    SortedEventVector &operator=(const SortedEventVector &v);
+
+    /// True if both hold the same event pointers in the same order
+    bool operator==(const SortedEventVector &v) const;
+    bool operator!=(const SortedEventVector &v) const { return !(*this == v); }
+
+    iterator begin() const {
+        return iterator(this, m_chunks.empty() ? 0 : m_chunks[0], 0);
+    }
+    iterator end() const { return iterator(this, 0, 0); }
+
+    reverse_iterator rbegin() const { return reverse_iterator(end()); }
+    reverse_iterator rend() const { return reverse_iterator(begin()); }
+
+    size_type size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    key_compare key_comp() const { return key_compare(); }
+    value_compare value_comp() const { return value_compare(); }
+
+    /**
+     * Insert an event after any events that compare equivalent to it,
+     * as std::multiset does, and return its position.
+     */
+    iterator insert(Event *e);
+
+    /**
+     * Insert an event using the given position as a hint.  As with
+     * std::multiset since C++11, the event goes immediately before
+     * the hint if it may be placed there, which includes when it is
+     * equivalent to the hinted event or the one before it, and
+     * otherwise where insert(e) would put it.
+     */
+    iterator insert(iterator hint, Event *e);
+
+    template <class InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        while (first != last) { insert(end(), *first); ++first; }
+    }
+
+    void erase(iterator i);
+    void erase(iterator from, iterator to);
+    size_type erase(Event *const &e);
+    void clear();
+
+    /**
+     * Exchange contents with another container.  Unlike with
+     * std::multiset, iterators do not follow their events across.
+     */
+    void swap(SortedEventVector &v);
+
+    iterator find(Event *const &e) const;
+
+    size_type count(Event *const &e) const;
+
+    iterator lower_bound(Event *const &e) const;
+    iterator upper_bound(Event *const &e) const;
+
+    std::pair<iterator, iterator> equal_range(Event *const &e) const {
+        return std::pair<iterator, iterator>(lower_bound(e), upper_bound(e));
+    }
+
+private:
+    /// A chunk and an index in it, or a null chunk for the end
+    struct Position {
+        Position(Chunk *c_, int pos_) : c(c_), pos(pos_) { }
+        Chunk *c;
+        int pos;
+    };
+
+    void next(const_iterator &i) const;
+    void previous(const_iterator &i) const;
+
+    /// Find the iterator's event again after the container has changed
+    void relocate(const const_iterator &i) const;
+
+    /// Position of the first event not less than e
+    Position lowerBound(const Event *e) const;
+
+    /// Position of the first event greater than e
+    Position upperBound(const Event *e) const;
+
+    /// Insert e before the given position
+    Position insertBefore(Position p, Event *e);
+
+    void eraseAt(Position p);
+
+    void renumberChunks(size_t from);
+
+    std::vector<Chunk *> m_chunks; // in order, none of them empty
+    size_type m_size;
+    unsigned long m_version;       // bumped by every insert and erase
+};
+
+}
+
+#endif
@@ -0,0 +1,355 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "TempoMap.h"
+#include "NotationTypes.h"
+
+#include <iostream>
+#include <cmath>
+
+//#define DEBUG_TEMPO_STUFF 1
+
+namespace Rosegarden
+{
+
+using std::cerr;
+using std::endl;
+
+TempoMap::TempoMap(tempoT defaultTempo) :
+    m_defaultTempo(defaultTempo)
+{
+}
+
+TempoMap::TempoMap(tempoT defaultTempo, const std::vector<Change> &changes) :
+    m_defaultTempo(defaultTempo),
+    m_changes(changes)
+{
+    timeT lastTimeT = 0;
+    RealTime lastRealTime;
+
+    tempoT tempo = m_defaultTempo;
+    tempoT target = -1;
+
+    for (size_t i = 0; i < m_changes.size(); ++i) {
+
+        Change &c = m_changes[i];
+        RealTime myTime;
+
+        if (target > 0) {
+            myTime = lastRealTime +
+                time2RealTime(c.m_time - lastTimeT, tempo,
+                              c.m_time - lastTimeT, target);
+        } else {
+            myTime = lastRealTime +
+                time2RealTime(c.m_time - lastTimeT, tempo);
+        }
+
+        c.m_realTime = myTime;
+
+#ifdef DEBUG_TEMPO_STUFF
+        cerr << "TempoMap: change " << i << " at " << c.m_time
+             << " (" << myTime << "): tempo " << c.m_tempo
+             << ", target " << c.m_target << " at " << c.m_targetTime << endl;
+#endif
+
+        lastRealTime = myTime;
+        lastTimeT = c.m_time;
+        tempo = c.m_tempo;
+        target = c.m_target;
+    }
+}
+
+int
+TempoMap::getChangeNumberAt(timeT t) const
+{
+    // first change after t
+    int lo = 0, hi = int(m_changes.size());
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (m_changes[mid].m_time <= t) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+tempoT
+TempoMap::getTempoAtTime(timeT t) const
+{
+    int n = getChangeNumberAt(t);
+
+    // In negative time, if there's no tempo event actually defined
+    // prior to the point of interest then we use the next one after
+    // it, so long as it's no later than time zero.  See
+    // Composition::getTempoAtTime
+
+    if (n < 0) {
+        if (t < 0) return getTempoAtTime(0);
+        else return m_defaultTempo;
+    }
+
+    const Change &c = m_changes[n];
+
+    if (c.m_target > 0) {
+
+        timeT t0 = c.m_time;
+        timeT t1 = c.m_targetTime;
+
+        if (t1 <= t0) return c.m_tempo;
+
+        // tempo ramps are linear in 1/tempo
+        double s0 = 1.0 / double(c.m_tempo);
+        double s1 = 1.0 / double(c.m_target);
+        double s = s0 + (t - t0) * ((s1 - s0) / (t1 - t0));
+
+        return tempoT((1.0 / s) + 0.01);
+    }
+
+    return c.m_tempo;
+}
+
+RealTime
+TempoMap::getElapsedRealTime(timeT t) const
+{
+    return getElapsedRealTimeFrom(getChangeNumberAt(t), t);
+}
+
+RealTime
+TempoMap::getElapsedRealTimeFrom(int n, timeT t) const
+{
+    if (n < 0) {
+        if (t >= 0 || m_changes.empty() || m_changes[0].m_time > 0) {
+            return time2RealTime(t, m_defaultTempo);
+        }
+        n = 0;
+    }
+
+    const Change &c = m_changes[n];
+
+    if (c.m_target > 0) {
+        return c.m_realTime +
+            time2RealTime(t - c.m_time, c.m_tempo,
+                          c.m_targetTime - c.m_time, c.m_target);
+    } else {
+        return c.m_realTime + time2RealTime(t - c.m_time, c.m_tempo);
+    }
+}
+
+void
+TempoMap::getElapsedRealTimes(const std::vector<timeT> &times,
+                              std::vector<RealTime> &realTimes) const
+{
+    realTimes.resize(times.size());
+
+    const int count = int(m_changes.size());
+    int n = -1;
+    timeT last = 0;
+
+    for (size_t i = 0; i < times.size(); ++i) {
+
+        timeT t = times[i];
+
+        if (i == 0 || t < last) {
+            // first time, or out of order: look it up from scratch
+            n = getChangeNumberAt(t);
+        } else {
+            while (n + 1 < count && m_changes[n + 1].m_time <= t) ++n;
+        }
+
+        realTimes[i] = getElapsedRealTimeFrom(n, t);
+        last = t;
+    }
+}
+
+timeT
+TempoMap::getElapsedTimeForRealTime(RealTime t) const
+{
+    // last change at or before t
+    int lo = 0, hi = int(m_changes.size());
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (m_changes[mid].m_realTime <= t) lo = mid + 1;
+        else hi = mid;
+    }
+    int n = lo - 1;
+
+    if (n < 0) {
+        if (t >= RealTime::zeroTime ||
+            m_changes.empty() || m_changes[0].m_time > 0) {
+            return realTime2Time(t, m_defaultTempo);
+        }
+        n = 0;
+    }
+
+    const Change &c = m_changes[n];
+
+    if (c.m_target > 0) {
+        return c.m_time +
+            realTime2Time(t - c.m_realTime, c.m_tempo,
+                          c.m_targetTime - c.m_time, c.m_target);
+    } else {
+        return c.m_time + realTime2Time(t - c.m_realTime, c.m_tempo);
+    }
+}
+
+RealTime
+TempoMap::time2RealTime(timeT t, tempoT tempo)
+{
+    static timeT cdur = Note(Note::Crotchet).getDuration();
+
+    double dt = (double(t) * 100000 * 60) / (double(tempo) * cdur);
+
+    int sec = int(dt);
+    int nsec = int((dt - sec) * 1000000000);
+
+    RealTime rt(sec, nsec);
+
+#ifdef DEBUG_TEMPO_STUFF
+    cerr << "TempoMap::time2RealTime: t " << t << ", sec " << sec << ", nsec "
+         << nsec << ", tempo " << tempo
+         << ", cdur " << cdur << ", dt " << dt << ", rt " << rt << endl;
+#endif
+
+    return rt;
+}
+
+RealTime
+TempoMap::time2RealTime(timeT time, tempoT tempo,
+                        timeT targetTime, tempoT targetTempo)
+{
+    static timeT cdur = Note(Note::Crotchet).getDuration();
+
+    // The real time elapsed at musical time t, in seconds, during a
+    // smooth tempo change from "tempo" at musical time zero to
+    // "targetTempo" at musical time "targetTime", is
+    //
+    //           2
+    //     at + t (b - a)
+    //          ---------
+    //             2n
+    // where
+    //
+    // a is the initial tempo in seconds per tick
+    // b is the target tempo in seconds per tick
+    // n is targetTime in ticks
+
+    if (targetTime == 0 || targetTempo == tempo) {
+        return time2RealTime(time, targetTempo);
+    }
+
+    double a = (100000 * 60) / (double(tempo) * cdur);
+    double b = (100000 * 60) / (double(targetTempo) * cdur);
+    double t = time;
+    double n = targetTime;
+    double result = (a * t) + (t * t * (b - a)) / (2 * n);
+
+    int sec = int(result);
+    int nsec = int((result - sec) * 1000000000);
+
+    RealTime rt(sec, nsec);
+
+#ifdef DEBUG_TEMPO_STUFF
+    cerr << "TempoMap::time2RealTime[2]: time " << time << ", tempo "
+         << tempo << ", targetTime " << targetTime << ", targetTempo "
+         << targetTempo << ": rt " << rt << endl;
+#endif
+
+    return rt;
+}
+
+timeT
+TempoMap::realTime2Time(RealTime rt, tempoT tempo)
+{
+    static timeT cdur = Note(Note::Crotchet).getDuration();
+
+    double tsec = (double(rt.sec) * cdur) * (tempo / (60.0 * 100000.0));
+    double tnsec = (double(rt.nsec) * cdur) * (tempo / 100000.0);
+
+    double dt = tsec + (tnsec / 60000000000.0);
+    timeT t = (timeT)(dt + (dt < 0 ? -1e-6 : 1e-6));
+
+#ifdef DEBUG_TEMPO_STUFF
+    cerr << "TempoMap::realTime2Time: rt.sec " << rt.sec << ", rt.nsec "
+         << rt.nsec << ", tempo " << tempo
+         << ", cdur " << cdur << ", tsec " << tsec << ", tnsec " << tnsec << ", dt " << dt << ", t " << t << endl;
+#endif
+
+    return t;
+}
+
+timeT
+TempoMap::realTime2Time(RealTime rt, tempoT tempo,
+                        timeT targetTime, tempoT targetTempo)
+{
+    static timeT cdur = Note(Note::Crotchet).getDuration();
+
+    // Inverse of the expression in time2RealTime above.
+    //
+    // The musical time elapsed at real time t, in ticks, during a
+    // smooth tempo change from "tempo" at real time zero to
+    // "targetTempo" at real time "targetTime", is
+    //
+    //          2na (+/-) sqrt((2nb)^2 + 8(b-a)tn)
+    //       -  ----------------------------------
+    //                       2(b-a)
+    // where
+    //
+    // a is the initial tempo in seconds per tick
+    // b is the target tempo in seconds per tick
+    // n is target real time in ticks
+
+    if (targetTempo == tempo) return realTime2Time(rt, tempo);
+
+    double a = (100000 * 60) / (double(tempo) * cdur);
+    double b = (100000 * 60) / (double(targetTempo) * cdur);
+    double t = double(rt.sec) + double(rt.nsec) / 1e9;
+    double n = targetTime;
+
+    double term1 = 2.0 * n * a;
+    double term2 = (2.0 * n * a) * (2.0 * n * a) + 8 * (b - a) * t * n;
+
+    if (term2 < 0) {
+        // We're screwed, but at least let's not crash
+        std::cerr << "ERROR: TempoMap::realTime2Time: term2 < 0 (it's " << term2 << ")" << std::endl;
+#ifdef DEBUG_TEMPO_STUFF
+        std::cerr << "rt = " << rt << ", tempo = " << tempo << ", targetTime = " << targetTime << ", targetTempo = " << targetTempo << std::endl;
+        std::cerr << "n = " << n << ", b = " << b << ", a = " << a << ", t = " << t <<std::endl;
+        std::cerr << "that's sqrt( (" << ((2.0*n*a*2.0*n*a)) << ") + "
+                  << (8*(b-a)*t*n) << " )" << endl;
+
+        std::cerr << "so our original expression was " << rt << " = "
+                  << a << "t + (t^2 * (" << b << " - " << a << ")) / " << 2*n << std::endl;
+#endif
+
+        return realTime2Time(rt, tempo);
+    }
+
+    double term3 = sqrt(term2);
+
+    // We only want the positive root
+    if (term3 > 0) term3 = -term3;
+
+    double result = - (term1 + term3) / (2 * (b - a));
+
+#ifdef DEBUG_TEMPO_STUFF
+    std::cerr << "TempoMap::realTime2Time:" <<endl;
+    std::cerr << "n = " << n << ", b = " << b << ", a = " << a << ", t = " << t <<std::endl;
+    std::cerr << "+/-sqrt(term2) = " << term3 << std::endl;
+    std::cerr << "result = " << result << endl;
+#endif
+
+    return long(result + 0.1);
+}
+
+}
@@ -0,0 +1,122 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_TEMPO_MAP_H
+#define RG_TEMPO_MAP_H
+
+#include "base/Event.h"
+#include "RealTime.h"
+
+#include <vector>
+
+namespace Rosegarden
+{
+
+// We store tempo in quarter-notes per minute * 10^5 (hundred
+// thousandths of a quarter-note per minute).  This means the maximum
+// tempo in a 32-bit integer is about 21400 qpm.  We use a signed int
+// for compatibility with the Event integer type -- but note that we
+// use 0 (rather than -1) to indicate "tempo not set", by convention
+// (though see usage of target tempo in e.g. addTempoAtTime).
+typedef int tempoT;
+
+/**
+ * TempoMap is a precalculated, read-only record of the tempo changes
+ * in a Composition, for converting between musical and real time.
+ *
+ * The changes are held in a flat array sorted by time, each with the
+ * real time at which it falls and the details of any ramp that starts
+ * there, so a conversion is a binary search and a little arithmetic.
+ * Composition builds one whenever its tempos change and uses it for
+ * getElapsedRealTime() and friends; code that makes a great many
+ * conversions can get it from Composition::getTempoMap() and use it
+ * directly.  The reference is only valid until the next change to
+ * the Composition's tempos, default tempo or end marker.
+ */
+class TempoMap
+{
+public:
+    /// A tempo change as it is given to the constructor.
+    struct Change
+    {
+        Change(timeT time, tempoT tempo, tempoT target, timeT targetTime) :
+            m_time(time), m_tempo(tempo),
+            m_target(target), m_targetTime(targetTime) { }
+
+        timeT m_time;
+        tempoT m_tempo;
+
+        /// Tempo reached at m_targetTime if this change ramps, else -1
+        tempoT m_target;
+        timeT m_targetTime;
+
+        /// Filled in by TempoMap
+        RealTime m_realTime;
+    };
+
+    /// A map with no tempo changes, in which the default tempo applies.
+    TempoMap(tempoT defaultTempo = 12000000);
+
+    /// Construct from changes sorted by time, no two at the same time.
+    TempoMap(tempoT defaultTempo, const std::vector<Change> &changes);
+
+    tempoT getDefaultTempo() const { return m_defaultTempo; }
+
+    int getChangeCount() const { return int(m_changes.size()); }
+    const Change &getChange(int n) const { return m_changes[n]; }
+
+    /**
+     * Return the index of the last tempo change at or before time t,
+     * or -1 if there is none.
+     */
+    int getChangeNumberAt(timeT t) const;
+
+    /// See Composition::getTempoAtTime().
+    tempoT getTempoAtTime(timeT t) const;
+
+    /// See Composition::getElapsedRealTime().
+    RealTime getElapsedRealTime(timeT t) const;
+
+    /// See Composition::getElapsedTimeForRealTime().
+    timeT getElapsedTimeForRealTime(RealTime t) const;
+
+    /**
+     * Convert each of times to real time, writing the results into
+     * realTimes (which is resized to match).  If times are sorted, as
+     * the times of events in a segment are, this takes a single
+     * linear pass through the tempo changes rather than a search for
+     * each one.  Unsorted times give correct results, just more
+     * slowly.
+     */
+    void getElapsedRealTimes(const std::vector<timeT> &times,
+                             std::vector<RealTime> &realTimes) const;
+
+private:
+    RealTime getElapsedRealTimeFrom(int n, timeT t) const;
+
+    static RealTime time2RealTime(timeT time, tempoT tempo);
+    static RealTime time2RealTime(timeT time, tempoT tempo,
+                                  timeT targetTempoTime, tempoT targetTempo);
+    static timeT realTime2Time(RealTime rtime, tempoT tempo);
+    static timeT realTime2Time(RealTime rtime, tempoT tempo,
+                               timeT targetTempoTime, tempoT targetTempo);
+
+    tempoT m_defaultTempo;
+    std::vector<Change> m_changes;
+};
+
+}
+
+#endif
@@ -17,6 +17,9 @@
 #include <cstdlib>
 #include <cstring>
 
+#include <QMutex>
+#include <QMutexLocker>
+
 namespace Rosegarden
 {
 
@@ -25,6 +28,11 @@ static std::string multibyte;
 
 std::string XmlExportable::encode(const std::string &s0)
 {
+    // The buffers are shared, and documents may be written from a
+    // thread other than the GUI one (see AutoSaveThread)
+    static QMutex mutex;
+    QMutexLocker locker(&mutex);
+
     static char *buffer = 0;
     static size_t bufsiz = 0;
     size_t buflen = 0;
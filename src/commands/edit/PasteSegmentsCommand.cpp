@@ -59,6 +59,18 @@ PasteSegmentsCommand::~PasteSegmentsCommand()
     delete m_clipboard;
 }
 
+size_t
+PasteSegmentsCommand::getMemoryUse() const
+{
+    size_t bytes = sizeof(*this);
+    if (m_detached) {
+        for (size_t i = 0; i < m_addedSegments.size(); ++i) {
+            bytes += m_addedSegments[i]->getStorageSize();
+        }
+    }
+    return bytes;
+}
+
 void
 PasteSegmentsCommand::execute()
 {
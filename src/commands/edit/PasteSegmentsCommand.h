@@ -56,6 +56,7 @@ public:
 
     virtual void execute();
     virtual void unexecute();
+    virtual size_t getMemoryUse() const;
 
 protected:
     Composition *m_composition;
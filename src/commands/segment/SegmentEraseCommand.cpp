@@ -72,6 +72,13 @@ SegmentEraseCommand::~SegmentEraseCommand()
     }
 }
 
+size_t
+SegmentEraseCommand::getMemoryUse() const
+{
+    // The segment is only ours while it is out of the composition
+    return sizeof(*this) + (m_detached ? m_segment->getStorageSize() : 0);
+}
+
 void
 SegmentEraseCommand::execute()
 {
@@ -50,6 +50,7 @@ public:
 
     virtual void execute();
     virtual void unexecute();
+    virtual size_t getMemoryUse() const;
     
 private:
     Composition *m_composition;
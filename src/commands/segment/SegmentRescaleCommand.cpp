@@ -70,6 +70,14 @@ SegmentRescaleCommand::~SegmentRescaleCommand()
     }
 }
 
+size_t
+SegmentRescaleCommand::getMemoryUse() const
+{
+    // whichever segment is out of the composition
+    const Segment *detached = (m_detached ? m_segment : m_newSegment);
+    return sizeof(*this) + (detached ? detached->getStorageSize() : 0);
+}
+
 timeT
 SegmentRescaleCommand::rescale(timeT t)
 {
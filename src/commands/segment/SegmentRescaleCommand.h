@@ -49,6 +49,7 @@ public:
 
     virtual void execute();
     virtual void unexecute();
+    virtual size_t getMemoryUse() const;
     
     static QString getGlobalName() { return tr("Stretch or S&quash..."); }
 
@@ -0,0 +1,89 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "AutoSaveThread.h"
+#include "DocumentSnapshot.h"
+
+#include "misc/Debug.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+
+namespace Rosegarden
+{
+
+AutoSaveThread::AutoSaveThread(DocumentSnapshot *snapshot, QString fileName,
+                               QObject *parent) :
+    QThread(parent),
+    m_snapshot(snapshot),
+    m_fileName(fileName),
+    m_done(0),
+    m_ok(false)
+{
+}
+
+AutoSaveThread::~AutoSaveThread()
+{
+    wait();
+    delete m_snapshot;
+}
+
+void
+AutoSaveThread::run()
+{
+    save();
+
+    // ordered, so that the result is seen before m_done is
+    m_done.fetchAndStoreOrdered(1);
+}
+
+void
+AutoSaveThread::save()
+{
+    // As RosegardenDocument::saveDocument, write to a temporary file
+    // and only then replace the old one
+
+    QTemporaryFile temp(m_fileName + ".");
+    temp.setAutoRemove(false);
+
+    if (!temp.open()) {
+        m_errorMessage = QObject::tr("Could not create temporary file in directory of '%1': %2").arg(m_fileName).arg(temp.errorString());
+        return;
+    }
+
+    QString tempFileName = temp.fileName();
+    temp.close();
+
+    if (!m_snapshot->writeToFile(tempFileName, m_errorMessage)) {
+        QFile::remove(tempFileName);
+        return;
+    }
+
+    QDir dir(QFileInfo(tempFileName).dir());
+    if (dir.exists(m_fileName)) dir.remove(m_fileName);
+    if (!dir.rename(tempFileName, m_fileName)) {
+        m_errorMessage = QObject::tr("Failed to rename temporary output file '%1' to desired output file '%2'").arg(tempFileName).arg(m_fileName);
+        QFile::remove(tempFileName);
+        return;
+    }
+
+    RG_DEBUG << "AutoSaveThread: saved " << m_fileName << endl;
+
+    m_ok = true;
+}
+
+}
@@ -0,0 +1,73 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_AUTOSAVETHREAD_H
+#define RG_AUTOSAVETHREAD_H
+
+#include <QAtomicInt>
+#include <QString>
+#include <QThread>
+
+namespace Rosegarden
+{
+
+class DocumentSnapshot;
+
+/**
+ * Writes a DocumentSnapshot to a file in the background, so that
+ * autosaving doesn't hold up the GUI.  The file is written to a
+ * temporary file alongside it and renamed into place when complete,
+ * so that a crash during the save cannot destroy the previous one.
+ *
+ * The thread takes ownership of the snapshot.  Connect to finished()
+ * to hear when the save is done, then check isOK() and delete the
+ * thread, which deletes the snapshot.
+ */
+class AutoSaveThread : public QThread
+{
+public:
+    AutoSaveThread(DocumentSnapshot *snapshot, QString fileName,
+                   QObject *parent = 0);
+    virtual ~AutoSaveThread();
+
+    QString getFileName() const { return m_fileName; }
+
+    /**
+     * Return true once the save has been written, or has failed.
+     * This becomes true before finished() is emitted, whereas
+     * isFinished() may only do so a little after.
+     */
+    bool isDone() const { return m_done != 0; }
+
+    /// Only valid once isDone()
+    bool isOK() const { return m_ok; }
+
+    /// Only valid once isDone()
+    QString getErrorMessage() const { return m_errorMessage; }
+
+protected:
+    virtual void run();
+    void save();
+
+    DocumentSnapshot *m_snapshot;
+    QString m_fileName;
+    QAtomicInt m_done; // set by the thread, read from the GUI thread
+    bool m_ok;
+    QString m_errorMessage;
+};
+
+}
+
+#endif
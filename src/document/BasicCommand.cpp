@@ -21,8 +21,13 @@
 #include "BasicCommand.h"
 
 #include "base/Segment.h"
+#include "base/RealTime.h"
 #include "misc/Debug.h"
 #include <QString>
+#include <QDataStream>
+
+#include <iostream>
+#include <set>
 
 
 namespace Rosegarden
@@ -34,15 +39,11 @@ BasicCommand::BasicCommand(const QString &name, Segment &segment,
     m_startTime(calculateStartTime(start, segment)),
     m_endTime(calculateEndTime(end, segment)),
     m_segment(segment),
-    m_savedEvents(segment.getType(), m_startTime),
-    m_doBruteForceRedo(false),
+    m_logged(false),
+    m_doBruteForceRedo(bruteForceRedo),
     m_redoEvents(0)
 {
     if (m_endTime == m_startTime) ++m_endTime;
-
-    if (bruteForceRedo) {
-        m_redoEvents = new Segment(segment.getType(), m_startTime);
-    }
 }
 
 // Variant ctor to be used when events to insert are known when
@@ -54,7 +55,7 @@ BasicCommand::BasicCommand(const QString &name,
     m_startTime(calculateStartTime(redoEvents->getStartTime(), *redoEvents)),
     m_endTime(calculateEndTime(redoEvents->getEndTime(), *redoEvents)),
     m_segment(segment),
-    m_savedEvents(segment.getType(), m_startTime),
+    m_logged(false),
     m_doBruteForceRedo(true),
     m_redoEvents(redoEvents)
 {
@@ -64,7 +65,8 @@ BasicCommand::BasicCommand(const QString &name,
 
 BasicCommand::~BasicCommand()
 {
-    m_savedEvents.clear();
+    clearBefore();
+    clearLog();
     if (m_redoEvents) m_redoEvents->clear();
     delete m_redoEvents;
 }
@@ -109,21 +111,114 @@ Rosegarden::timeT BasicCommand::getRelayoutEndTime()
     return getEndTime();
 }
 
+size_t
+BasicCommand::getMemoryUse() const
+{
+    size_t bytes = sizeof(BasicCommand);
+
+    // Counting each event's data in full, though much of it is
+    // likely to be shared with the events in the segment
+    for (size_t i = 0; i < m_removed.size(); ++i) {
+        bytes += sizeof(Event *) + m_removed[i]->getStorageSize();
+    }
+    for (size_t i = 0; i < m_added.size(); ++i) {
+        bytes += sizeof(Event *) + m_added[i]->getStorageSize();
+    }
+
+    if (m_redoEvents) {
+        for (Segment::const_iterator i = m_redoEvents->begin();
+             i != m_redoEvents->end(); ++i) {
+            bytes += (*i)->getStorageSize();
+        }
+    }
+
+    return bytes;
+}
+
 void
 BasicCommand::beginExecute()
 {
-    copyTo(&m_savedEvents);
+    // left over if modifySegment threw last time
+    clearBefore();
+
+    Segment::iterator from = m_segment.findTime(m_startTime);
+    Segment::iterator to   = m_segment.findTime(m_endTime);
+
+    for (Segment::iterator i = from; i != m_segment.end() && i != to; ++i) {
+        m_before.push_back(std::pair<Event *, Event *>(*i, new Event(**i)));
+    }
+}
+
+void
+BasicCommand::endExecute()
+{
+    Segment::iterator from = m_segment.findTime(m_startTime);
+    Segment::iterator to   = m_segment.findTime(m_endTime);
+
+    std::set<Event *> after;
+    for (Segment::iterator i = from; i != m_segment.end() && i != to; ++i) {
+        after.insert(*i);
+    }
+
+    // An event that is still there and still shares its data with the
+    // copy made before is unchanged.  Any other was taken out, or
+    // modified, which is the same as far as the log is concerned.
+    // (It may only have had a property set to the value it had, or a
+    // non-persistent one set, either of which also unshares it; then
+    // it is logged as taken out and put back, which does no harm.)
+    // The events before may have been deleted, so only those found in
+    // the segment are looked at.
+
+    for (size_t i = 0; i < m_before.size(); ++i) {
+        Event *event = m_before[i].first;
+        Event *copy = m_before[i].second;
+        std::set<Event *>::iterator j = after.find(event);
+        if (j != after.end() && event->sharesDataWith(*copy)) {
+            after.erase(j);
+            delete copy;
+        } else {
+            m_removed.push_back(copy);
+        }
+    }
+
+    // the copies are now either deleted or in the log
+    m_before.clear();
+
+    // What's left was put in, and is logged in segment order
+    for (Segment::iterator i = from; i != m_segment.end() && i != to; ++i) {
+        if (after.find(*i) != after.end()) {
+            m_added.push_back(new Event(**i));
+        }
+    }
+
+    m_logged = true;
+
+    RG_DEBUG << "BasicCommand(" << getName() << ")::endExecute: "
+             << m_removed.size() << " events removed, " << m_added.size()
+             << " added, " << getMemoryUse() << " bytes" << endl;
 }
 
 void
 BasicCommand::execute()
 {
-    beginExecute();
+    if (m_logged && m_doBruteForceRedo) {
+
+        replay(m_removed, m_added);
 
-    if (!m_doBruteForceRedo) {
-        modifySegment();
     } else {
-        copyFrom(m_redoEvents);
+
+        clearLog();
+        beginExecute();
+
+        if (!m_redoEvents) {
+            modifySegment();
+        } else {
+            copyFrom(m_redoEvents);
+            delete m_redoEvents;
+            m_redoEvents = 0;
+        }
+
+        endExecute();
     }
 
     m_segment.updateRefreshStatuses(getStartTime(), getRelayoutEndTime());
@@ -136,38 +231,264 @@ BasicCommand::execute()
 void
 BasicCommand::unexecute()
 {
-    if (m_redoEvents) {
-        copyTo(m_redoEvents);
-        m_doBruteForceRedo = true;
-    }
-
-    copyFrom(&m_savedEvents);
+    replay(m_added, m_removed);
 
     m_segment.updateRefreshStatuses(getStartTime(), getRelayoutEndTime());
     m_segment.signalChanged(getStartTime(), getRelayoutEndTime());
 }
-    
+
 void
-BasicCommand::copyTo(Rosegarden::Segment *events)
+BasicCommand::replay(const EventLog &takeOut, const EventLog &putIn)
 {
-    RG_DEBUG << "BasicCommand(" << getName() << ")::copyTo: " << &m_segment << 
-        " to " << events << ", range (" << m_startTime << "," << m_endTime << 
-        ")" << endl;
+    RG_DEBUG << "BasicCommand(" << getName() << ")::replay: taking out "
+             << takeOut.size() << " events and putting in " << putIn.size()
+             << endl;
+
+    for (size_t i = 0; i < takeOut.size(); ++i) {
+
+        const Event *logged = takeOut[i];
+        timeT t = logged->getAbsoluteTime();
+        Segment::iterator found = m_segment.end();
+
+        // The event in the segment may be a copy of the logged one
+        // still sharing its data, but often won't be: setting even a
+        // non-persistent property unshares it, as layout does after
+        // every edit, and restore() shares nothing.  So look for one
+        // with the same content, and only if there is none (something
+        // has changed it outside of any command) settle for one like
+        // it.  Taking out another note of a chord, say, would leave
+        // the wrong notes behind.
+
+        for (Segment::iterator j = m_segment.findTime(t);
+             j != m_segment.end() && (*j)->getAbsoluteTime() == t; ++j) {
+            if ((*j)->sharesDataWith(*logged) || sameContent(**j, *logged)) {
+                found = j;
+                break;
+            }
+            if (found == m_segment.end() &&
+                (*j)->getType() == logged->getType() &&
+                (*j)->getDuration() == logged->getDuration() &&
+                (*j)->getSubOrdering() == logged->getSubOrdering()) {
+                found = j;
+            }
+        }
+
+        if (found != m_segment.end()) {
+            m_segment.erase(found);
+        } else {
+            std::cerr << "WARNING: BasicCommand("
+                      << getName().toLocal8Bit().data() << ")::replay: "
+                      << "event of type " << logged->getType() << " at "
+                      << t << " is not in the segment" << std::endl;
+        }
+    }
 
-    Segment::iterator from = m_segment.findTime(m_startTime);
-    Segment::iterator to   = m_segment.findTime(m_endTime);
+    for (size_t i = 0; i < putIn.size(); ++i) {
+        m_segment.insert(new Event(*putIn[i]));
+    }
+}
 
-    for (Segment::iterator i = from; i != m_segment.end() && i != to; ++i) {
+bool
+BasicCommand::sameContent(const Event &a, const Event &b)
+{
+    if (a.getType() != b.getType() ||
+        a.getAbsoluteTime() != b.getAbsoluteTime() ||
+        a.getDuration() != b.getDuration() ||
+        a.getSubOrdering() != b.getSubOrdering()) return false;
+
+    Event::PropertyNames names = a.getPersistentPropertyNames();
+    if (names.size() != b.getPersistentPropertyNames().size()) return false;
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!b.has(names[i]) ||
+            a.getPropertyType(names[i]) != b.getPropertyType(names[i]) ||
+            a.getAsString(names[i]) != b.getAsString(names[i])) return false;
+    }
 
-        RG_DEBUG << "Found event of type " << (*i)->getType()
-                 << " and duration " << (*i)->getDuration()
-                 << "at time "  << (*i)->getAbsoluteTime()
-                 << endl;
+    return true;
+}
+
+namespace
+{
+
+// The spilled form of an event: its type, times and persistent
+// properties, each with its type and value
+
+void
+writeEvent(QDataStream &out, const Event &e)
+{
+    out << QByteArray(e.getType().c_str())
+        << qint64(e.getAbsoluteTime()) << qint64(e.getDuration())
+        << qint16(e.getSubOrdering());
+
+    Event::PropertyNames names = e.getPersistentPropertyNames();
+    out << quint32(names.size());
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        const PropertyName &name = names[i];
+        PropertyType type = e.getPropertyType(name);
+        out << QByteArray(name.getName().c_str()) << quint8(type);
+        switch (type) {
+        case Int:
+            out << qint64(e.get<Int>(name));
+            break;
+        case String: {
+            std::string v = e.get<String>(name);
+            out << QByteArray(v.data(), int(v.size()));
+            break;
+        }
+        case Bool:
+            out << quint8(e.get<Bool>(name) ? 1 : 0);
+            break;
+        case RealTimeT: {
+            RealTime rt = e.get<RealTimeT>(name);
+            out << qint32(rt.sec) << qint32(rt.nsec);
+            break;
+        }
+        }
+    }
+}
 
-       events->insert(new Event(**i));
+Event *
+readEvent(QDataStream &in)
+{
+    QByteArray type;
+    qint64 time = 0, duration = 0;
+    qint16 subOrdering = 0;
+    quint32 count = 0;
+
+    in >> type >> time >> duration >> subOrdering >> count;
+    if (in.status() != QDataStream::Ok) return 0;
+
+    Event *e = new Event(type.data(), time, duration, subOrdering);
+
+    for (quint32 i = 0; i < count; ++i) {
+        QByteArray name;
+        quint8 propertyType = 0;
+        in >> name >> propertyType;
+        PropertyName pn(name.data());
+        switch (propertyType) {
+        case Int: {
+            qint64 v = 0;
+            in >> v;
+            e->set<Int>(pn, long(v));
+            break;
+        }
+        case String: {
+            QByteArray v;
+            in >> v;
+            e->set<String>(pn, std::string(v.data(), v.size()));
+            break;
+        }
+        case Bool: {
+            quint8 v = 0;
+            in >> v;
+            e->set<Bool>(pn, v != 0);
+            break;
+        }
+        case RealTimeT: {
+            qint32 sec = 0, nsec = 0;
+            in >> sec >> nsec;
+            e->set<RealTimeT>(pn, RealTime(sec, nsec));
+            break;
+        }
+        default:
+            in.setStatus(QDataStream::ReadCorruptData);
+            break;
+        }
+        if (in.status() != QDataStream::Ok) {
+            delete e;
+            return 0;
+        }
     }
+
+    return e;
 }
-   
+
+bool
+readLog(QDataStream &in, std::vector<Event *> &log)
+{
+    quint32 count = 0;
+    in >> count;
+    if (in.status() != QDataStream::Ok) return false;
+
+    for (quint32 i = 0; i < count; ++i) {
+        Event *e = readEvent(in);
+        if (!e) return false;
+        log.push_back(e);
+    }
+
+    return true;
+}
+
+}
+
+bool
+BasicCommand::spill(QByteArray &data)
+{
+    if (!m_logged || m_redoEvents || !m_before.empty()) return false;
+
+    QDataStream out(&data, QIODevice::WriteOnly);
+
+    out << quint32(m_removed.size());
+    for (size_t i = 0; i < m_removed.size(); ++i) {
+        writeEvent(out, *m_removed[i]);
+    }
+    out << quint32(m_added.size());
+    for (size_t i = 0; i < m_added.size(); ++i) {
+        writeEvent(out, *m_added[i]);
+    }
+
+    if (out.status() != QDataStream::Ok) return false;
+
+    // keeping m_logged, as the log is still there as far as execute()
+    // is concerned, and will be by the time it's needed
+    for (size_t i = 0; i < m_removed.size(); ++i) delete m_removed[i];
+    for (size_t i = 0; i < m_added.size(); ++i) delete m_added[i];
+    m_removed.clear();
+    m_added.clear();
+
+    return true;
+}
+
+bool
+BasicCommand::restore(const QByteArray &data)
+{
+    QDataStream in(data);
+
+    EventLog removed, added;
+
+    if (!readLog(in, removed) || !readLog(in, added)) {
+        for (size_t i = 0; i < removed.size(); ++i) delete removed[i];
+        for (size_t i = 0; i < added.size(); ++i) delete added[i];
+        return false;
+    }
+
+    clearLog();
+    m_removed = removed;
+    m_added = added;
+    m_logged = true;
+
+    return true;
+}
+
+void
+BasicCommand::clearBefore()
+{
+    for (size_t i = 0; i < m_before.size(); ++i) delete m_before[i].second;
+    m_before.clear();
+}
+
+void
+BasicCommand::clearLog()
+{
+    for (size_t i = 0; i < m_removed.size(); ++i) delete m_removed[i];
+    for (size_t i = 0; i < m_added.size(); ++i) delete m_added[i];
+    m_removed.clear();
+    m_added.clear();
+    m_logged = false;
+}
+
 void
 BasicCommand::copyFrom(Rosegarden::Segment *events)
 {
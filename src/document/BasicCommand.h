@@ -24,6 +24,8 @@
 #include "base/Event.h"
 #include "misc/Debug.h"
 
+#include <vector>
+
 class QString;
 
 namespace Rosegarden
@@ -35,9 +37,15 @@ class CommandArgumentQuerier; // forward declaration useful for some subclasses
 /**
  * BasicCommand is an abstract subclass of Command that manages undo,
  * redo and notification of changes within a contiguous region of a
- * single Rosegarden Segment, by brute force.  When a subclass
- * of BasicCommand executes, it stores a copy of the events that are
- * modified by the command, ready to be restored verbatim on undo.
+ * single Rosegarden Segment.  When a subclass of BasicCommand
+ * executes, BasicCommand compares the region before and after the
+ * subclass's modifySegment() and keeps a log of the events it took
+ * out and those it put in, an event it modified counting as both.
+ * Undo takes out the ones put in and puts back the ones taken out.
+ *
+ * The events in the log are shallow copies, sharing their data with
+ * the events in the segment where they can, so a command that changes
+ * a few events in a long region costs only those few.
  */
 
 class BasicCommand : public NamedCommand
@@ -57,6 +65,20 @@ public:
     /// events selected after command; 0 if no change / no meaningful selection
     virtual EventSelection *getSubsequentSelection() { return 0; }
 
+    /// Number of events taken out of and put into the segment
+    size_t getRemovedCount() const { return m_removed.size(); }
+    size_t getAddedCount() const { return m_added.size(); }
+
+    virtual size_t getMemoryUse() const;
+
+    /**
+     * Write the log to data and delete it.  The events are written
+     * with their persistent properties only.  Refused if there is no
+     * log yet or the command still has events to copy in.
+     */
+    virtual bool spill(QByteArray &data);
+    virtual bool restore(const QByteArray &data);
+
 protected:
     /**
      * You should pass "bruteForceRedoRequired = true" if your
@@ -65,11 +87,11 @@ protected:
      * events to modify, in which case it won't work when
      * replayed for redo because the pointers may no longer be
      * valid.  In which case, BasicCommand will implement redo
-     * much like undo, and will only call your modifySegment 
-     * the very first time the command object is executed.
+     * much like undo, from its log, and will only call your
+     * modifySegment the very first time the command object is
+     * executed.
      *
-     * It is always safe to pass bruteForceRedoRequired true,
-     * it's just normally a waste of memory.
+     * It is always safe to pass bruteForceRedoRequired true.
      */
     BasicCommand(const QString &name,
                  Segment &segment,
@@ -84,10 +106,23 @@ protected:
 
     virtual void modifySegment() = 0;
 
+    /**
+     * Note the events in the region, before it is modified.  The
+     * log of changes is made from these after modifySegment.
+     */
     virtual void beginExecute();
 
 private:
-    void copyTo(Segment *);
+    typedef std::vector<Event *> EventLog;
+
+    void endExecute();
+    void replay(const EventLog &takeOut, const EventLog &putIn);
+    void clearBefore();
+    void clearLog();
+
+    /// True if a and b have the same type, times and persistent properties
+    static bool sameContent(const Event &a, const Event &b);
+
     void copyFrom(Segment *);
 
     timeT calculateStartTime(timeT given, Segment &segment);
@@ -97,7 +132,16 @@ private:
     timeT m_endTime;
 
     Segment &m_segment;
-    Segment m_savedEvents;
+
+    // The region as it was before modifySegment: each event in the
+    // segment, and a shallow copy of it.  Only kept during execute.
+    std::vector<std::pair<Event *, Event *> > m_before;
+
+    // Shallow copies of the events taken out of the segment by the
+    // command, and of those put in
+    EventLog m_removed;
+    EventLog m_added;
+    bool m_logged;
 
     bool m_doBruteForceRedo;
     Segment *m_redoEvents;
@@ -17,6 +17,8 @@
 
 #include "Command.h"
 
+#include <QDataStream>
+
 namespace Rosegarden
 {
 
@@ -74,6 +76,66 @@ MacroCommand::unexecute()
     }
 }
 
+size_t
+MacroCommand::getMemoryUse() const
+{
+    size_t bytes = sizeof(MacroCommand);
+    for (size_t i = 0; i < m_commands.size(); ++i) {
+	bytes += m_commands[i]->getMemoryUse();
+    }
+    return bytes;
+}
+
+// Each command that can spill is spilled, and the others keep their
+// state: the data is a flag for each command saying whether it was
+// spilled, followed by what it wrote if so
+
+bool
+MacroCommand::spill(QByteArray &data)
+{
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << quint32(m_commands.size());
+
+    bool spilled = false;
+
+    for (size_t i = 0; i < m_commands.size(); ++i) {
+	QByteArray commandData;
+	if (m_commands[i]->spill(commandData)) {
+	    out << quint8(1) << commandData;
+	    spilled = true;
+	} else {
+	    out << quint8(0);
+	}
+    }
+
+    return spilled;
+}
+
+bool
+MacroCommand::restore(const QByteArray &data)
+{
+    QDataStream in(data);
+    quint32 count = 0;
+    in >> count;
+    if (count != m_commands.size()) return false;
+
+    bool ok = true;
+
+    for (size_t i = 0; i < m_commands.size(); ++i) {
+	quint8 spilled = 0;
+	in >> spilled;
+	if (!spilled) continue;
+	QByteArray commandData;
+	in >> commandData;
+	if (in.status() != QDataStream::Ok ||
+	    !m_commands[i]->restore(commandData)) {
+	    ok = false;
+	}
+    }
+
+    return ok;
+}
+
 QString
 MacroCommand::getName() const
 {
@@ -25,9 +25,11 @@
 #ifndef RG_COMMAND_H
 #define RG_COMMAND_H
 
+#include <QByteArray>
 #include <QString>
 
 #include <vector>
+#include <cstddef>
 
 namespace Rosegarden
 {
@@ -41,6 +43,27 @@ public:
     virtual void execute() = 0;
     virtual void unexecute() = 0;
     virtual QString getName() const = 0;
+
+    /**
+     * Return roughly how much memory the command holds on to for undo
+     * and redo, in bytes, or zero if it doesn't know.
+     */
+    virtual size_t getMemoryUse() const { return 0; }
+
+    /**
+     * Write the state the command holds for undo to data and let go
+     * of it, so that it can be kept out of memory until needed.
+     * Returns false, keeping the state, if the command can't do this
+     * (as by default).  Called only when the command has been
+     * executed; it is then restored before it is unexecuted.
+     */
+    virtual bool spill(QByteArray &/* data */) { return false; }
+
+    /**
+     * Take back the state written by spill().  Returns false if it
+     * can't, in which case the command can no longer be undone.
+     */
+    virtual bool restore(const QByteArray &/* data */) { return false; }
     
     bool getUpdateLinks() const { return m_updateLinks; }
     void setUpdateLinks(bool update) { m_updateLinks = update; }
@@ -77,6 +100,10 @@ public:
 
     virtual QString getName() const;
     virtual void setName(QString name);
+
+    virtual size_t getMemoryUse() const;
+    virtual bool spill(QByteArray &data);
+    virtual bool restore(const QByteArray &data);
     
     virtual const std::vector<Command *>& getCommands() { return m_commands; }
 
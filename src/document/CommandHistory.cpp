@@ -19,13 +19,17 @@
 #include "CommandHistory.h"
 
 #include "Command.h"
+#include "base/Profiler.h"
 
+#include <QApplication>
 #include <QRegExp>
 #include <QMenu>
 #include <QToolBar>
 #include <QString>
 #include <QTimer>
 #include <QAction>
+#include <QDir>
+#include <QTemporaryFile>
 
 #include <iostream>
 
@@ -45,7 +49,12 @@ CommandHistory::CommandHistory() :
     m_executeCompound(false),
     m_currentBundle(0),
     m_bundleTimer(0),
-    m_bundleTimeout(5000)
+    m_bundleTimeout(5000),
+    m_memoryLimit(256 * 1024 * 1024),
+    m_memoryUse(0),
+    m_spillEnabled(true),
+    m_spillFile(0),
+    m_spilledBytes(0)
 {
     m_undoAction = new QAction(QIcon(":/icons/undo.png"), tr("&Undo"), this);
     m_undoAction->setObjectName("edit_undo");
@@ -57,10 +66,17 @@ CommandHistory::CommandHistory() :
     m_undoMenuAction->setObjectName("edit_toolbar_undo");
     connect(m_undoMenuAction, SIGNAL(triggered()), this, SLOT(undo()));
     
-    m_undoMenu = new QMenu(tr("&Undo"));
-    m_undoMenuAction->setMenu(m_undoMenu);
-    connect(m_undoMenu, SIGNAL(triggered(QAction *)),
-	    this, SLOT(undoActivated(QAction*)));
+    // Menus are widgets, which can't be made without a GUI (as when
+    // converting files from the command line)
+    bool gui = (QApplication::type() != QApplication::Tty);
+
+    m_undoMenu = 0;
+    if (gui) {
+        m_undoMenu = new QMenu(tr("&Undo"));
+        m_undoMenuAction->setMenu(m_undoMenu);
+        connect(m_undoMenu, SIGNAL(triggered(QAction *)),
+                this, SLOT(undoActivated(QAction*)));
+    }
 
     m_redoAction = new QAction(QIcon(":/icons/redo.png"), tr("Re&do"), this);
     m_redoAction->setObjectName("edit_redo");
@@ -72,10 +88,13 @@ CommandHistory::CommandHistory() :
     m_redoMenuAction->setObjectName("edit_toolbar_redo");
     connect(m_redoMenuAction, SIGNAL(triggered()), this, SLOT(redo()));
 
-    m_redoMenu = new QMenu(tr("Re&do"));
-    m_redoMenuAction->setMenu(m_redoMenu);
-    connect(m_redoMenu, SIGNAL(triggered(QAction *)),
-	    this, SLOT(redoActivated(QAction*)));
+    m_redoMenu = 0;
+    if (gui) {
+        m_redoMenu = new QMenu(tr("Re&do"));
+        m_redoMenuAction->setMenu(m_redoMenu);
+        connect(m_redoMenu, SIGNAL(triggered(QAction *)),
+                this, SLOT(redoActivated(QAction*)));
+    }
 }
 
 CommandHistory::~CommandHistory()
@@ -86,6 +105,7 @@ CommandHistory::~CommandHistory()
 
     delete m_undoMenu;
     delete m_redoMenu;
+    delete m_spillFile;
 }
 
 CommandHistory *
@@ -106,6 +126,7 @@ CommandHistory::clear()
     clearStack(m_undoStack);
     clearStack(m_redoStack);
     updateActions();
+    memoryUseUpdated();
 }
 
 void
@@ -168,13 +189,19 @@ CommandHistory::addCommand(Command *command, bool execute, bool bundle)
     // can we reach savedAt?
     if ((int)m_undoStack.size() < m_savedAt) m_savedAt = -1; // nope
 
-    m_undoStack.push(command);
+    m_undoStack.push_back(command);
     clipCommands();
     
     if (execute) {
 	command->execute();
     }
 
+    updateMemoryUse(command);
+
+#ifdef DEBUG_COMMAND_HISTORY
+    std::cerr << "CommandHistory::addCommand: " << command->getName().toLocal8Bit().data() << " keeps " << m_commandMemory[command] << " bytes for undo, " << m_memoryUse << " in all" << std::endl;
+#endif
+
     // Emit even if we aren't executing the command, because
     // someone must have executed it for this to make any sense
     emit updateLinkedSegments(command);
@@ -182,6 +209,7 @@ CommandHistory::addCommand(Command *command, bool execute, bool bundle)
     emit commandExecuted(command);
 
     updateActions();
+    memoryUseUpdated();
 }
 
 void
@@ -224,6 +252,7 @@ CommandHistory::addToBundle(Command *command, bool execute)
 
     if (execute) command->execute();
     m_currentBundle->addCommand(command);
+    updateMemoryUse(m_currentBundle);
 
     // Emit even if we aren't executing the command, because
     // someone must have executed it for this to make any sense
@@ -232,6 +261,7 @@ CommandHistory::addToBundle(Command *command, bool execute)
     emit commandExecuted(command);
 
     updateActions();
+    memoryUseUpdated();
 
     delete m_bundleTimer;
     m_bundleTimer = new QTimer(this);
@@ -327,23 +357,43 @@ CommandHistory::undo()
 {
     if (m_undoStack.empty()) return;
 
+    Profiler profiler("CommandHistory::undo");
+
 #ifdef DEBUG_COMMAND_HISTORY
     std::cerr << "CommandHistory::undo()" << std::endl;
 #endif
 
     closeBundle();
 
-    Command *command = m_undoStack.top();
+    Command *command = m_undoStack.back();
+
+    if (m_spilled.find(command) != m_spilled.end() &&
+        !restoreCommand(command)) {
+        // Without its state the command can't be undone, nor can
+        // anything before it
+        std::cerr << "WARNING: CommandHistory::undo: failed to restore "
+                  << "spilled command \""
+                  << command->getName().toLocal8Bit().data()
+                  << "\", discarding undo history" << std::endl;
+        m_savedAt = -1;
+        clearStack(m_undoStack);
+        updateActions();
+        memoryUseUpdated();
+        return;
+    }
+
     command->unexecute();
     emit updateLinkedSegments(command);
     emit commandExecuted();
     emit commandUnexecuted(command);
 
-    m_redoStack.push(command);
-    m_undoStack.pop();
+    m_redoStack.push_back(command);
+    m_undoStack.pop_back();
+    updateMemoryUse(command);
 
     clipCommands();
     updateActions();
+    memoryUseUpdated();
 
     if ((int)m_undoStack.size() == m_savedAt) emit documentRestored();
 }
@@ -353,23 +403,27 @@ CommandHistory::redo()
 {
     if (m_redoStack.empty()) return;
 
+    Profiler profiler("CommandHistory::redo");
+
 #ifdef DEBUG_COMMAND_HISTORY
     std::cerr << "CommandHistory::redo()" << std::endl;
 #endif
 
     closeBundle();
 
-    Command *command = m_redoStack.top();
+    Command *command = m_redoStack.back();
     command->execute();
     emit updateLinkedSegments(command);
     emit commandExecuted();
     emit commandExecuted(command);
 
-    m_undoStack.push(command);
-    m_redoStack.pop();
-    // no need to clip
+    m_undoStack.push_back(command);
+    m_redoStack.pop_back();
+    updateMemoryUse(command);
+    // no need to clip by count
 
     updateActions();
+    memoryUseUpdated();
 
     if ((int)m_undoStack.size() == m_savedAt) emit documentRestored();
 }
@@ -392,6 +446,22 @@ CommandHistory::setRedoLimit(int limit)
     }
 }
 
+void
+CommandHistory::setMemoryLimit(size_t bytes)
+{
+    m_memoryLimit = bytes;
+    memoryUseUpdated();
+    updateActions();
+}
+
+void
+CommandHistory::setSpillEnabled(bool enabled)
+{
+    m_spillEnabled = enabled;
+    memoryUseUpdated();
+    updateActions();
+}
+
 void
 CommandHistory::setMenuLimit(int limit)
 {
@@ -426,42 +496,196 @@ CommandHistory::clipCommands()
 void
 CommandHistory::clipStack(CommandStack &stack, int limit)
 {
-    int i;
-
-    if ((int)stack.size() > limit) {
+    // the oldest commands are at the front
+    while ((int)stack.size() > limit) {
+	deleteCommand(stack.front());
+	stack.pop_front();
+    }
+}
 
-	CommandStack tempStack;
+void
+CommandHistory::clearStack(CommandStack &stack)
+{
+    while (!stack.empty()) {
+	deleteCommand(stack.back());
+	stack.pop_back();
+    }
+}
 
-	for (i = 0; i < limit; ++i) {
+void
+CommandHistory::deleteCommand(Command *command)
+{
+    // Not safe to call getName() on a command about to be deleted
 #ifdef DEBUG_COMMAND_HISTORY
-	    Command *command = stack.top();
-	    std::cerr << "CommandHistory::clipStack: Saving recent command: " << command->getName().toLocal8Bit().data() << " at " << command << std::endl;
+    std::cerr << "CommandHistory::deleteCommand: About to delete command " << command << std::endl;
 #endif
-	    tempStack.push(stack.top());
-	    stack.pop();
-	}
+    forgetMemoryUse(command);
+    delete command;
+}
 
-	clearStack(stack);
+void
+CommandHistory::updateMemoryUse(Command *command)
+{
+    size_t &bytes = m_commandMemory[command];
+    m_memoryUse -= bytes;
+    bytes = command->getMemoryUse();
+    m_memoryUse += bytes;
+}
 
-	for (i = 0; i < m_undoLimit; ++i) {
-	    stack.push(tempStack.top());
-	    tempStack.pop();
-	}
+void
+CommandHistory::forgetMemoryUse(Command *command)
+{
+    std::map<Command *, size_t>::iterator i = m_commandMemory.find(command);
+    if (i != m_commandMemory.end()) {
+        m_memoryUse -= i->second;
+        m_commandMemory.erase(i);
+    }
+
+    std::map<Command *, SpillRecord>::iterator j = m_spilled.find(command);
+    if (j != m_spilled.end()) {
+        m_spilledBytes -= j->second.size;
+        m_spilled.erase(j);
+    }
+
+    // Nothing left in the file that's wanted, so start it again
+    if (m_spilled.empty() && m_spillFile) {
+        m_spillFile->resize(0);
     }
 }
 
 void
-CommandHistory::clearStack(CommandStack &stack)
+CommandHistory::memoryUseUpdated()
 {
-    while (!stack.empty()) {
-	Command *command = stack.top();
-	// Not safe to call getName() on a command about to be deleted
+    enforceMemoryLimit();
+    emit memoryUseChanged(qint64(m_memoryUse), qint64(m_spilledBytes));
+}
+
+void
+CommandHistory::enforceMemoryLimit()
+{
+    if (m_memoryLimit == 0 || m_memoryUse <= m_memoryLimit) return;
+
 #ifdef DEBUG_COMMAND_HISTORY
-	std::cerr << "CommandHistory::clearStack: About to delete command " << command << std::endl;
+    std::cerr << "CommandHistory::enforceMemoryLimit: " << m_memoryUse
+              << " bytes in use, limit is " << m_memoryLimit << std::endl;
 #endif
-	delete command;
-	stack.pop();
+
+    // Spill the oldest commands first.  The most recent is left alone,
+    // as it's the one most likely to be undone, and it may be the open
+    // bundle.
+
+    if (m_spillEnabled) {
+        for (size_t i = 0; i + 1 < m_undoStack.size(); ++i) {
+            if (m_memoryUse <= m_memoryLimit) break;
+            if (!m_spillEnabled) break; // a spill has failed
+            Command *command = m_undoStack[i];
+            if (command == m_currentBundle) continue;
+            if (m_spilled.find(command) != m_spilled.end()) continue;
+            if (spillCommand(command)) updateMemoryUse(command);
+        }
+    }
+
+    // Then discard whatever is furthest from the present, from either
+    // stack.  Undo history goes first, as the redo stack is emptied
+    // as soon as anything new is done anyway.
+
+    while (m_memoryUse > m_memoryLimit && m_undoStack.size() > 1) {
+        deleteCommand(m_undoStack.front());
+        m_undoStack.pop_front();
+        --m_savedAt; // a negative value can never be reached again
+    }
+
+    while (m_memoryUse > m_memoryLimit && !m_redoStack.empty()) {
+        deleteCommand(m_redoStack.front());
+        m_redoStack.pop_front();
+    }
+}
+
+bool
+CommandHistory::spillCommand(Command *command)
+{
+    if (!m_spillFile) {
+        m_spillFile = new QTemporaryFile
+            (QDir::tempPath() + "/rosegarden-undo-XXXXXX", this);
+        if (!m_spillFile->open()) {
+            std::cerr << "WARNING: CommandHistory::spillCommand: failed to "
+                      << "open temporary file, not spilling undo history"
+                      << std::endl;
+            delete m_spillFile;
+            m_spillFile = 0;
+            m_spillEnabled = false;
+            return false;
+        }
     }
+
+    QByteArray data;
+    if (!command->spill(data)) return false;
+
+    QByteArray compressed = qCompress(data);
+
+    SpillRecord record;
+    record.offset = m_spillFile->size();
+    record.size = compressed.size();
+
+    if (!m_spillFile->seek(record.offset) ||
+        m_spillFile->write(compressed) != record.size) {
+
+        std::cerr << "WARNING: CommandHistory::spillCommand: failed to "
+                  << "write temporary file ("
+                  << m_spillFile->errorString().toLocal8Bit().data()
+                  << "), not spilling undo history" << std::endl;
+        m_spillEnabled = false;
+        m_spillFile->resize(record.offset);
+
+        // The command has let go of its state, but we still have it
+        // here, so give it straight back and keep it in memory
+        if (command->restore(data)) return false;
+
+        // Should never happen, but if it does, the command can't be
+        // undone.  It is recorded as spilled with nothing to restore,
+        // so that undo fails cleanly rather than doing the wrong thing.
+        std::cerr << "WARNING: CommandHistory::spillCommand: failed to "
+                  << "restore command \""
+                  << command->getName().toLocal8Bit().data()
+                  << "\" after failed spill, it can no longer be undone"
+                  << std::endl;
+        record.size = 0;
+    }
+
+    m_spilled[command] = record;
+    m_spilledBytes += record.size;
+
+#ifdef DEBUG_COMMAND_HISTORY
+    std::cerr << "CommandHistory::spillCommand: " << command->getName().toLocal8Bit().data() << ": " << data.size() << " bytes, " << compressed.size() << " compressed" << std::endl;
+#endif
+
+    return true;
+}
+
+bool
+CommandHistory::restoreCommand(Command *command)
+{
+    std::map<Command *, SpillRecord>::iterator i = m_spilled.find(command);
+    if (i == m_spilled.end()) return true;
+
+    SpillRecord record = i->second;
+    m_spilledBytes -= record.size;
+    m_spilled.erase(i);
+
+    if (record.size == 0 || !m_spillFile->seek(record.offset)) return false;
+
+    QByteArray compressed = m_spillFile->read(record.size);
+    if (compressed.size() != record.size) return false;
+
+    QByteArray data = qUncompress(compressed);
+    if (data.isEmpty()) return false;
+
+    bool ok = command->restore(data);
+    updateMemoryUse(command);
+
+    if (m_spilled.empty()) m_spillFile->resize(0);
+
+    return ok;
 }
 
 void
@@ -509,7 +733,7 @@ CommandHistory::updateActions()
 	QAction *action(undo ? m_undoAction : m_redoAction);
 	QAction *menuAction(undo ? m_undoMenuAction : m_redoMenuAction);
 	QMenu *menu(undo ? m_undoMenu : m_redoMenu);
-	CommandStack &stack(undo ? m_undoStack : m_redoStack);
+	const CommandStack &stack(undo ? m_undoStack : m_redoStack);
 
 	if (stack.empty()) {
 
@@ -527,7 +751,7 @@ CommandHistory::updateActions()
 	    action->setEnabled(true);
 	    menuAction->setEnabled(true);
 
-	    QString commandName = stack.top()->getName();
+	    QString commandName = stack.back()->getName();
 	    commandName.replace(QRegExp("&"), "");
 
 	    QString text = (undo ? tr("&Undo %1") : tr("Re&do %1"))
@@ -538,16 +762,16 @@ CommandHistory::updateActions()
 	    menuAction->setText(text);
 	}
 
+	if (!menu) continue;
+
 	menu->clear();
 
-	CommandStack tempStack;
 	int j = 0;
 
-	while (j < m_menuLimit && !stack.empty()) {
+	for (CommandStack::const_reverse_iterator i = stack.rbegin();
+	     j < m_menuLimit && i != stack.rend(); ++i) {
 
-	    Command *command = stack.top();
-	    tempStack.push(command);
-	    stack.pop();
+	    Command *command = *i;
 
 	    QString commandName = command->getName();
 	    commandName.replace(QRegExp("&"), "");
@@ -559,11 +783,6 @@ CommandHistory::updateActions()
 	    QAction *action = menu->addAction(text);
 	    m_actionCounts[action] = j++;
 	}
-
-	while (!tempStack.empty()) {
-	    stack.push(tempStack.top());
-	    tempStack.pop();
-	}
     }
 }
 
@@ -21,7 +21,7 @@
 #include <QObject>
 #include <QString>
 
-#include <stack>
+#include <deque>
 #include <set>
 #include <map>
 
@@ -29,6 +29,7 @@ class QAction;
 class QMenu;
 class QToolBar;
 class QTimer;
+class QTemporaryFile;
 
 namespace Rosegarden 
 {
@@ -46,6 +47,13 @@ class ActionFileClient;
  * and Redo menu or toolbar with the same command history, and it
  * keeps them all up-to-date at once.  This makes it effective in
  * systems where multiple views may be editing the same data.
+ *
+ * As well as the limits on the number of commands, the history can
+ * be given a limit on the memory its commands use for undo, as
+ * reported by Command::getMemoryUse().  When it is over the limit,
+ * it first asks the oldest commands on the undo stack to spill their
+ * state, which it compresses into a temporary file and gives back to
+ * them when they are undone, and then discards the oldest commands.
  */
 
 class CommandHistory : public QObject
@@ -107,6 +115,24 @@ public:
 
     /// Set the maximum number of items in the redo history.
     void setRedoLimit(int limit);
+
+    /// Return the memory the history may use for undo, in bytes, 0 for no limit.
+    size_t getMemoryLimit() const { return m_memoryLimit; }
+
+    /// Set the memory the history may use for undo, in bytes, 0 for no limit.
+    void setMemoryLimit(size_t bytes);
+
+    /// Return whether old commands are spilled to disk before being discarded.
+    bool getSpillEnabled() const { return m_spillEnabled; }
+
+    /// Set whether old commands are spilled to disk before being discarded.
+    void setSpillEnabled(bool enabled);
+
+    /// Return the memory the commands in the history are using, in bytes.
+    size_t getMemoryUse() const { return m_memoryUse; }
+
+    /// Return the size of the compressed state spilled to disk, in bytes.
+    size_t getSpilledBytes() const { return m_spilledBytes; }
     
     /// Return the maximum number of items visible in undo and redo menus.
     int getMenuLimit() const { return m_menuLimit; }
@@ -188,6 +214,12 @@ signals:
      */
     void documentRestored();
 
+    /**
+     * Emitted when the memory used by the history, or the size of
+     * what it has spilled to disk, has changed.
+     */
+    void memoryUseChanged(qint64 inMemory, qint64 onDisk);
+
 
 protected:
     CommandHistory();
@@ -202,7 +234,8 @@ protected:
 
     std::map<QAction *, int> m_actionCounts;
 
-    typedef std::stack<Command *> CommandStack;
+    // The top of each stack is at the back
+    typedef std::deque<Command *> CommandStack;
     CommandStack m_undoStack;
     CommandStack m_redoStack;
 
@@ -228,6 +261,27 @@ protected:
 
     void clipStack(CommandStack &stack, int limit);
     void clearStack(CommandStack &stack);
+    void deleteCommand(Command *command);
+
+    size_t m_memoryLimit;
+    size_t m_memoryUse;
+    std::map<Command *, size_t> m_commandMemory;
+
+    struct SpillRecord {
+        qint64 offset;
+        qint64 size;
+    };
+    bool m_spillEnabled;
+    QTemporaryFile *m_spillFile;
+    std::map<Command *, SpillRecord> m_spilled;
+    size_t m_spilledBytes;
+
+    void updateMemoryUse(Command *command);
+    void forgetMemoryUse(Command *command);
+    void memoryUseUpdated();
+    void enforceMemoryLimit();
+    bool spillCommand(Command *command);
+    bool restoreCommand(Command *command);
 };
 
 }
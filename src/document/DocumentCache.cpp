@@ -0,0 +1,620 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "DocumentCache.h"
+#include "DocumentSnapshot.h"
+
+#include "base/BaseProperties.h"
+#include "base/NotationTypes.h"
+#include "misc/Debug.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QObject>
+#include <QTemporaryFile>
+#include <QTime>
+
+#include <map>
+#include <string>
+#include <cstring>
+#include <zlib.h>
+
+namespace Rosegarden
+{
+
+// The file starts with a fixed header, all in native byte order:
+//
+//   char[8]  magic "RGFASTLD"
+//   quint32  byte order mark, 0x01020304
+//   quint32  format version
+//   quint64  size of the .rg file the cache was written with
+//   quint32  crc32 of that .rg file
+//   quint32  crc32 of the payload (everything after the header)
+//   quint64  size of the payload
+//   quint64  offset within the payload of the index
+//
+// The payload is the event blocks, one after another, each
+//
+//   quint32  event count
+//   quint32  size in bytes of the events that follow
+//   events, each
+//     quint32  index into the type table
+//     qint64   absolute time
+//     qint64   duration
+//     qint16   subordering
+//     quint16  property count
+//     properties, each
+//       quint32  index into the property name table
+//       quint8   PropertyType
+//       quint8   1 if persistent, 0 if not
+//       value: qint64 for Int, quint8 for Bool, or for String a
+//              quint32 byte count and the bytes
+//
+// followed by the index, which is
+//
+//   quint32  block count
+//   quint32  skeleton size, and the skeleton XML in UTF-8
+//   quint32  type count, and for each a quint32 size and the name
+//   quint32  property name count, and each name likewise
+//
+// The index comes last so that the blocks can be written out as they
+// are encoded, with the names gathered along the way.
+
+static const char cacheMagic[8] = { 'R', 'G', 'F', 'A', 'S', 'T', 'L', 'D' };
+static const quint32 cacheByteOrder = 0x01020304;
+static const quint32 cacheVersion = 1;
+static const size_t headerSize = 48;
+
+namespace
+{
+
+template <typename T>
+void put(std::string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void putString(std::string &out, const std::string &s)
+{
+    put<quint32>(out, quint32(s.size()));
+    out += s;
+}
+
+// Reads values from the mapped cache, checking every read against the
+// end of the data; once a read has failed, all later ones return 0
+
+class Reader
+{
+public:
+    Reader(const uchar *data, size_t size) :
+        m_p(data), m_end(data + size), m_ok(true) { }
+
+    template <typename T>
+    T get() {
+        T value = 0;
+        const uchar *p = skip(sizeof(T));
+        if (p) memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    const uchar *skip(size_t n) {
+        if (!m_ok || size_t(m_end - m_p) < n) {
+            m_ok = false;
+            return 0;
+        }
+        const uchar *p = m_p;
+        m_p += n;
+        return p;
+    }
+
+    std::string getString() {
+        quint32 n = get<quint32>();
+        const uchar *p = skip(n);
+        if (!p) return std::string();
+        return std::string(reinterpret_cast<const char *>(p), n);
+    }
+
+    void fail() { m_ok = false; }
+
+    bool isOK() const { return m_ok; }
+    bool atEnd() const { return m_p == m_end; }
+
+private:
+    const uchar *m_p;
+    const uchar *m_end;
+    bool m_ok;
+};
+
+quint32 crc32Of(quint32 crc, const uchar *data, qint64 size)
+{
+    // zlib takes a 32-bit length
+    while (size > 0) {
+        uInt n = uInt(size > (1 << 30) ? (1 << 30) : size);
+        crc = crc32(crc, data, n);
+        data += n;
+        size -= n;
+    }
+    return crc;
+}
+
+// Assigns each event type or property name an index in the cache's
+// tables the first time it is seen
+
+class NameTable
+{
+public:
+    quint32 getIndex(int value, const std::string &name) {
+        std::map<int, quint32>::iterator i = m_indices.find(value);
+        if (i != m_indices.end()) return i->second;
+        quint32 index = quint32(m_names.size());
+        m_indices[value] = index;
+        m_names.push_back(name);
+        return index;
+    }
+
+    void write(std::string &out) const {
+        put<quint32>(out, quint32(m_names.size()));
+        for (size_t i = 0; i < m_names.size(); ++i) putString(out, m_names[i]);
+    }
+
+private:
+    std::map<int, quint32> m_indices;
+    std::vector<std::string> m_names;
+};
+
+// Append one property, returning false if it is of a kind that is not
+// saved: the XML loader ignores RealTimeT properties, and view-local
+// properties ("::" in their names) are not saved at all
+
+bool appendProperty(std::string &out, const Event &event,
+                    const PropertyName &name, bool persistent,
+                    NameTable &names)
+{
+    PropertyType type = event.getPropertyType(name);
+    if (type == RealTimeT) return false;
+
+    std::string nameString = name.getName();
+    if (!persistent && nameString.find("::") != std::string::npos) {
+        return false;
+    }
+
+    put<quint32>(out, names.getIndex(name.getValue(), nameString));
+    put<quint8>(out, quint8(type));
+    put<quint8>(out, persistent ? 1 : 0);
+
+    switch (type) {
+    case Int:
+        put<qint64>(out, qint64(event.get<Int>(name)));
+        break;
+    case Bool:
+        put<quint8>(out, event.get<Bool>(name) ? 1 : 0);
+        break;
+    default:
+        putString(out, event.get<String>(name));
+        break;
+    }
+
+    return true;
+}
+
+void appendEvent(std::string &out, const Event &event,
+                 NameTable &types, NameTable &names)
+{
+    const EventTypeName &type = event.getTypeName();
+    put<quint32>(out, types.getIndex(type.getValue(), type.getName()));
+
+    // The same zero-duration fix as Event::appendXmlString makes, so
+    // that loading from the cache gives just what loading the XML would
+    timeT duration = event.getDuration();
+    if (event.isa(Note::TypeName) &&
+        duration < 1 &&
+        !event.has(BaseProperties::IS_GRACE_NOTE)) {
+        duration = 1;
+    }
+
+    put<qint64>(out, qint64(event.getAbsoluteTime()));
+    put<qint64>(out, qint64(duration));
+    put<qint16>(out, qint16(event.getSubOrdering()));
+
+    size_t countAt = out.size();
+    put<quint16>(out, 0);
+    quint16 count = 0;
+
+    Event::PropertyNames persistent = event.getPersistentPropertyNames();
+    for (size_t i = 0; i < persistent.size(); ++i) {
+        if (appendProperty(out, event, persistent[i], true, names)) ++count;
+    }
+
+    Event::PropertyNames transient = event.getNonPersistentPropertyNames();
+    for (size_t i = 0; i < transient.size(); ++i) {
+        if (appendProperty(out, event, transient[i], false, names)) ++count;
+    }
+
+    memcpy(&out[countAt], &count, sizeof(count));
+}
+
+}
+
+DocumentCache::DocumentCache() :
+    m_data(0),
+    m_size(0),
+    m_skeleton(0),
+    m_skeletonSize(0),
+    m_eventCount(0)
+{
+}
+
+DocumentCache::~DocumentCache()
+{
+    close();
+}
+
+QString
+DocumentCache::getCacheFileName(const QString &documentFileName)
+{
+    QFileInfo info(documentFileName);
+    return info.absoluteDir().filePath("." + info.fileName() + ".cache");
+}
+
+bool
+DocumentCache::checksumFile(const QString &fileName,
+                            quint64 &size, quint32 &crc)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    size = 0;
+    crc = crc32(0L, Z_NULL, 0);
+
+    static const int bufferSize = 256 * 1024;
+    std::vector<char> buffer(bufferSize);
+
+    while (true) {
+        qint64 n = file.read(&buffer[0], bufferSize);
+        if (n < 0) return false;
+        if (n == 0) break;
+        crc = crc32(crc, reinterpret_cast<const Bytef *>(&buffer[0]), uInt(n));
+        size += n;
+    }
+
+    return true;
+}
+
+bool
+DocumentCache::write(const QString &fileName,
+                     const QString &documentFileName,
+                     const DocumentSnapshot &snapshot,
+                     QString &errMsg)
+{
+    QTime timer;
+    timer.start();
+
+    quint64 documentSize = 0;
+    quint32 documentCrc = 0;
+    if (!checksumFile(documentFileName, documentSize, documentCrc)) {
+        errMsg = QObject::tr("Could not read file '%1'").arg(documentFileName);
+        return false;
+    }
+
+    // As RosegardenDocument::saveDocument, write to a temporary file
+    // and only then replace the old one
+
+    QTemporaryFile temp(fileName + ".");
+    temp.setAutoRemove(false);
+
+    if (!temp.open()) {
+        errMsg = QObject::tr("Could not create temporary file in directory of '%1': %2").arg(fileName).arg(temp.errorString());
+        return false;
+    }
+
+    QString tempFileName = temp.fileName();
+    bool okay = true;
+
+    // The header is filled in at the end, when the payload is known
+
+    std::string out(headerSize, '\0');
+    okay = (temp.write(out.data(), out.size()) == qint64(out.size()));
+
+    NameTable types, names;
+    std::string skeleton;
+    quint32 blockCount = 0;
+    quint32 payloadCrc = crc32(0L, Z_NULL, 0);
+    quint64 payloadSize = 0;
+
+    for (size_t i = 0; i < snapshot.getBlockCount() && okay; ++i) {
+
+        QByteArray text = snapshot.getBlockText(i).toUtf8();
+        skeleton.append(text.data(), text.size());
+
+        const std::vector<Event *> &events = snapshot.getBlockEvents(i);
+        if (events.empty()) continue;
+
+        skeleton += "<eventcache block=\"";
+        skeleton += QByteArray::number(blockCount).data();
+        skeleton += "\"/>\n";
+        ++blockCount;
+
+        out.clear();
+        put<quint32>(out, quint32(events.size()));
+        put<quint32>(out, 0);
+        for (size_t j = 0; j < events.size(); ++j) {
+            appendEvent(out, *events[j], types, names);
+        }
+        quint32 size = quint32(out.size() - 2 * sizeof(quint32));
+        memcpy(&out[sizeof(quint32)], &size, sizeof(size));
+
+        payloadCrc = crc32Of(payloadCrc, (const uchar *)out.data(), out.size());
+        payloadSize += out.size();
+        okay = (temp.write(out.data(), out.size()) == qint64(out.size()));
+    }
+
+    quint64 indexOffset = payloadSize;
+
+    if (okay) {
+        out.clear();
+        put<quint32>(out, blockCount);
+        putString(out, skeleton);
+        types.write(out);
+        names.write(out);
+
+        payloadCrc = crc32Of(payloadCrc, (const uchar *)out.data(), out.size());
+        payloadSize += out.size();
+        okay = (temp.write(out.data(), out.size()) == qint64(out.size()));
+    }
+
+    if (okay) {
+        out.clear();
+        out.append(cacheMagic, sizeof(cacheMagic));
+        put<quint32>(out, cacheByteOrder);
+        put<quint32>(out, cacheVersion);
+        put<quint64>(out, documentSize);
+        put<quint32>(out, documentCrc);
+        put<quint32>(out, payloadCrc);
+        put<quint64>(out, payloadSize);
+        put<quint64>(out, indexOffset);
+
+        okay = (temp.seek(0) &&
+                temp.write(out.data(), out.size()) == qint64(out.size()) &&
+                temp.flush());
+    }
+
+    temp.close();
+
+    if (!okay) {
+        errMsg = QObject::tr("Error while writing on '%1'").arg(tempFileName);
+        QFile::remove(tempFileName);
+        return false;
+    }
+
+    QDir dir(QFileInfo(tempFileName).dir());
+    if (dir.exists(fileName)) dir.remove(fileName);
+    if (!dir.rename(tempFileName, fileName)) {
+        errMsg = QObject::tr("Failed to rename temporary output file '%1' to desired output file '%2'").arg(tempFileName).arg(fileName);
+        QFile::remove(tempFileName);
+        return false;
+    }
+
+    RG_DEBUG << "DocumentCache::write: wrote " << snapshot.getEventCount()
+             << " events to " << fileName << " in " << timer.elapsed()
+             << " ms" << endl;
+
+    return true;
+}
+
+bool
+DocumentCache::open(const QString &documentFileName)
+{
+    close();
+
+    QString fileName = getCacheFileName(documentFileName);
+    if (!QFileInfo(fileName).exists()) return false;
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) return false;
+
+    m_size = m_file.size();
+    if (m_size < qint64(headerSize)) {
+        close();
+        return false;
+    }
+
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        RG_DEBUG << "DocumentCache::open: failed to map " << fileName << endl;
+        close();
+        return false;
+    }
+
+    Reader header(m_data, headerSize);
+    const uchar *magic = header.skip(sizeof(cacheMagic));
+    quint32 byteOrder = header.get<quint32>();
+    quint32 version = header.get<quint32>();
+    quint64 documentSize = header.get<quint64>();
+    quint32 documentCrc = header.get<quint32>();
+    quint32 payloadCrc = header.get<quint32>();
+    quint64 payloadSize = header.get<quint64>();
+    quint64 indexOffset = header.get<quint64>();
+
+    if (memcmp(magic, cacheMagic, sizeof(cacheMagic)) ||
+        byteOrder != cacheByteOrder ||
+        version != cacheVersion ||
+        payloadSize != quint64(m_size) - headerSize ||
+        indexOffset > payloadSize) {
+        RG_DEBUG << "DocumentCache::open: " << fileName
+                 << " is not a usable cache" << endl;
+        close();
+        return false;
+    }
+
+    // The cache is only any good if the document is just as it was
+    // when the cache was written
+    quint64 actualSize = 0;
+    quint32 actualCrc = 0;
+    if (!checksumFile(documentFileName, actualSize, actualCrc) ||
+        actualSize != documentSize || actualCrc != documentCrc) {
+        RG_DEBUG << "DocumentCache::open: " << fileName
+                 << " does not match the document" << endl;
+        close();
+        return false;
+    }
+
+    const uchar *payload = m_data + headerSize;
+    if (crc32Of(crc32(0L, Z_NULL, 0), payload, payloadSize) != payloadCrc) {
+        RG_DEBUG << "DocumentCache::open: " << fileName
+                 << " is damaged" << endl;
+        close();
+        return false;
+    }
+
+    if (!readTables()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool
+DocumentCache::readTables()
+{
+    const uchar *payload = m_data + headerSize;
+    quint64 indexOffset = 0;
+    memcpy(&indexOffset, m_data + headerSize - sizeof(indexOffset),
+           sizeof(indexOffset));
+
+    Reader index(payload + indexOffset, m_size - headerSize - indexOffset);
+
+    quint32 blockCount = index.get<quint32>();
+
+    quint32 skeletonSize = index.get<quint32>();
+    m_skeleton = reinterpret_cast<const char *>(index.skip(skeletonSize));
+    m_skeletonSize = int(skeletonSize);
+
+    quint32 typeCount = index.get<quint32>();
+    for (quint32 i = 0; i < typeCount && index.isOK(); ++i) {
+        m_types.push_back(EventTypeName(index.getString()));
+    }
+
+    quint32 nameCount = index.get<quint32>();
+    for (quint32 i = 0; i < nameCount && index.isOK(); ++i) {
+        m_names.push_back(PropertyName(index.getString()));
+    }
+
+    if (!index.isOK() || !index.atEnd()) return false;
+
+    Reader blocks(payload, indexOffset);
+
+    for (quint32 i = 0; i < blockCount && blocks.isOK(); ++i) {
+        Block block;
+        block.eventCount = blocks.get<quint32>();
+        block.size = blocks.get<quint32>();
+        block.data = blocks.skip(block.size);
+        m_blocks.push_back(block);
+        m_eventCount += block.eventCount;
+    }
+
+    return blocks.isOK() && blocks.atEnd();
+}
+
+void
+DocumentCache::close()
+{
+    if (m_data) m_file.unmap(const_cast<uchar *>(m_data));
+    m_file.close();
+
+    m_data = 0;
+    m_size = 0;
+    m_skeleton = 0;
+    m_skeletonSize = 0;
+    m_blocks.clear();
+    m_types.clear();
+    m_names.clear();
+    m_eventCount = 0;
+}
+
+QByteArray
+DocumentCache::getSkeleton() const
+{
+    if (!m_skeleton) return QByteArray();
+    return QByteArray::fromRawData(m_skeleton, m_skeletonSize);
+}
+
+bool
+DocumentCache::readEvents(int blockNo, std::vector<Event *> &events) const
+{
+    if (blockNo < 0 || size_t(blockNo) >= m_blocks.size()) return false;
+
+    const Block &block = m_blocks[blockNo];
+    Reader in(block.data, block.size);
+
+    size_t first = events.size();
+    events.reserve(first + block.eventCount);
+
+    for (quint32 i = 0; i < block.eventCount; ++i) {
+
+        quint32 type = in.get<quint32>();
+        timeT absoluteTime = in.get<qint64>();
+        timeT duration = in.get<qint64>();
+        short subOrdering = in.get<qint16>();
+        quint16 count = in.get<quint16>();
+
+        if (!in.isOK() || type >= m_types.size()) break;
+
+        Event *event =
+            new Event(m_types[type], absoluteTime, duration, subOrdering);
+        events.push_back(event);
+
+        for (quint16 j = 0; j < count; ++j) {
+
+            quint32 name = in.get<quint32>();
+            quint8 propertyType = in.get<quint8>();
+            bool persistent = (in.get<quint8>() != 0);
+
+            if (!in.isOK() || name >= m_names.size()) break;
+
+            switch (propertyType) {
+            case Int:
+                event->set<Int>(m_names[name], long(in.get<qint64>()),
+                                persistent);
+                break;
+            case Bool:
+                event->set<Bool>(m_names[name], in.get<quint8>() != 0,
+                                 persistent);
+                break;
+            case String:
+                event->set<String>(m_names[name], in.getString(),
+                                   persistent);
+                break;
+            default:
+                in.fail();
+                break;
+            }
+        }
+
+        if (!in.isOK()) break;
+    }
+
+    if (!in.isOK() || !in.atEnd() || events.size() - first != block.eventCount) {
+        RG_DEBUG << "DocumentCache::readEvents: block " << blockNo
+                 << " is damaged" << endl;
+        for (size_t i = first; i < events.size(); ++i) delete events[i];
+        events.resize(first);
+        return false;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,130 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_DOCUMENTCACHE_H
+#define RG_DOCUMENTCACHE_H
+
+#include "base/Event.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include <vector>
+
+namespace Rosegarden
+{
+
+class DocumentSnapshot;
+
+/**
+ * A binary copy of a saved document, kept in a hidden file beside it,
+ * from which the document can be loaded much faster than by parsing
+ * its XML.
+ *
+ * The cache holds the document's XML without the segments' events
+ * (which is small, and still goes through RoseXmlHandler), and the
+ * events themselves in binary, with their types and property names
+ * stored once each in tables at the end.  In place of each
+ * segment's events the XML has an <eventcache block="n"/> element,
+ * for which RoseXmlHandler reads the events from the cache.
+ *
+ * The cache records the size and checksum of the .rg file it was
+ * written alongside, and is only used if the .rg file still matches
+ * it, so a stale or damaged cache is simply ignored and the document
+ * loaded from the .rg as usual.  It is written in the machine's own
+ * byte order, and ignored on a machine with a different one.
+ */
+class DocumentCache
+{
+public:
+    DocumentCache();
+    ~DocumentCache();
+
+    /// Return the name of the cache file for the given document
+    static QString getCacheFileName(const QString &documentFileName);
+
+    /**
+     * Write a cache to the given file for a document that has just
+     * been saved from the same snapshot to documentFileName.  (The
+     * document may be saved under a temporary name and renamed
+     * afterwards, so fileName need not be the cache file name for
+     * documentFileName.)  Returns false and sets errMsg on failure.
+     */
+    static bool write(const QString &fileName,
+                      const QString &documentFileName,
+                      const DocumentSnapshot &snapshot,
+                      QString &errMsg);
+
+    /**
+     * Map the cache for the given document, returning false if there
+     * is none, or if it is damaged or does not match the document.
+     */
+    bool open(const QString &documentFileName);
+
+    /// Unmap the cache.  This is done on destruction too.
+    void close();
+
+    bool isOpen() const { return m_data != 0; }
+
+    /**
+     * Return the document's XML, without its events.  The array
+     * refers to the mapped cache, and is only valid while it is open.
+     */
+    QByteArray getSkeleton() const;
+
+    /**
+     * Create the events of the given block, appending them to events.
+     * The caller takes ownership of them.  Returns false if there is
+     * no such block.
+     */
+    bool readEvents(int block, std::vector<Event *> &events) const;
+
+    /// Return the total number of events in the cache
+    size_t getEventCount() const { return m_eventCount; }
+
+private:
+    DocumentCache(const DocumentCache &);
+    DocumentCache &operator=(const DocumentCache &);
+
+    static bool checksumFile(const QString &fileName,
+                             quint64 &size, quint32 &crc);
+
+    bool readTables();
+
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+
+    const char *m_skeleton;
+    int m_skeletonSize;
+
+    struct Block
+    {
+        const uchar *data;
+        quint32 size;
+        quint32 eventCount;
+    };
+    std::vector<Block> m_blocks;
+
+    std::vector<EventTypeName> m_types;
+    std::vector<PropertyName> m_names;
+
+    size_t m_eventCount;
+};
+
+}
+
+#endif
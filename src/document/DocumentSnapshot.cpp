@@ -0,0 +1,210 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "DocumentSnapshot.h"
+#include "GzipDevice.h"
+
+#include "base/Profiler.h"
+#include "base/Segment.h"
+#include "misc/Debug.h"
+
+#include <QObject>
+#include <QTime>
+
+#include <string>
+
+namespace Rosegarden
+{
+
+DocumentSnapshot::DocumentSnapshot(bool copyEvents) :
+    m_copyEvents(copyEvents),
+    m_eventCount(0)
+{
+    m_blocks.push_back(new Block);
+    m_blocks.back()->startTime = 0;
+    m_stream.setString(&m_blocks.back()->text);
+}
+
+DocumentSnapshot::~DocumentSnapshot()
+{
+    m_stream.setString(0);
+
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        if (m_copyEvents) {
+            std::vector<Event *> &events = m_blocks[i]->events;
+            for (size_t j = 0; j < events.size(); ++j) delete events[j];
+        }
+        delete m_blocks[i];
+    }
+}
+
+void
+DocumentSnapshot::addEvents(const Segment &segment)
+{
+    Block *block = m_blocks.back();
+
+    block->startTime = segment.getStartTime();
+    block->events.reserve(segment.size());
+
+    for (Segment::const_iterator i = segment.begin();
+         i != segment.end(); ++i) {
+        if (m_copyEvents) {
+            block->events.push_back((*i)->copyWithNonPersistentProperties());
+        } else {
+            block->events.push_back(*i);
+        }
+    }
+
+    m_eventCount += block->events.size();
+
+    // and carry on with the text in a new block (a QTextStream on a
+    // string writes straight to it, so there is nothing to flush)
+    m_blocks.push_back(new Block);
+    m_blocks.back()->startTime = 0;
+    m_stream.setString(&m_blocks.back()->text);
+}
+
+// Send text that is already UTF-8 straight to the stream's device,
+// without converting it to a QString and back
+
+static void
+writeUtf8(QTextStream &outStream, std::string &text)
+{
+    if (text.empty()) return;
+
+    QIODevice *device = outStream.device();
+
+    if (device) {
+        outStream.flush(); // anything written through the stream first
+        if (device->write(text.data(), text.size()) != qint64(text.size())) {
+            outStream.setStatus(QTextStream::WriteFailed);
+        }
+    } else {
+        outStream << QString::fromUtf8(text.data(), int(text.size()));
+    }
+
+    text.clear();
+}
+
+void
+DocumentSnapshot::writeEvents(QTextStream &outStream, const Block &block)
+{
+    const std::vector<Event *> &events = block.events;
+    if (events.empty()) return;
+
+    // The events make up nearly all of a document, so we build them
+    // up in one buffer, reused throughout, and send that out whenever
+    // it gets big
+    static const size_t bufferSize = 64 * 1024;
+    std::string xml;
+    xml.reserve(bufferSize + 4096);
+
+    bool inChord = false;
+    timeT chordStart = 0, chordDuration = 0;
+    timeT expectedTime = block.startTime;
+
+    for (size_t i = 0; i < events.size(); ++i) {
+
+        const Event *event = events[i];
+        timeT absTime = event->getAbsoluteTime();
+
+        const Event *next = (i + 1 < events.size() ? events[i + 1] : 0);
+
+        if (next &&
+                next->getAbsoluteTime() == absTime &&
+                event->getDuration() != 0 &&
+                !inChord) {
+            xml += "<chord>\n";
+            inChord = true;
+            chordStart = absTime;
+            chordDuration = 0;
+        }
+
+        if (inChord && event->getDuration() > 0)
+            if (chordDuration == 0 || event->getDuration() < chordDuration)
+                chordDuration = event->getDuration();
+
+        xml += '\t';
+        event->appendXmlString(xml, expectedTime);
+        xml += '\n';
+
+        if (next &&
+                next->getAbsoluteTime() != absTime &&
+                inChord) {
+            xml += "</chord>\n";
+            inChord = false;
+            expectedTime = chordStart + chordDuration;
+        } else if (inChord) {
+            expectedTime = absTime;
+        } else {
+            expectedTime = absTime + event->getDuration();
+        }
+
+        if (xml.size() >= bufferSize) {
+            writeUtf8(outStream, xml);
+        }
+    }
+
+    if (inChord) {
+        xml += "</chord>\n";
+    }
+
+    writeUtf8(outStream, xml);
+}
+
+bool
+DocumentSnapshot::writeToFile(const QString &fileName, QString &errMsg)
+{
+    Profiler profiler("DocumentSnapshot::writeToFile");
+
+    QTime timer;
+    timer.start();
+
+    // Compress straight into the file as we go, rather than building
+    // the whole document up as one string first
+    GzipDevice file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        errMsg = QObject::tr("Could not open file '%1' for writing")
+            .arg(fileName);
+        return false;
+    }
+
+    QTextStream outStream(&file);
+    outStream.setCodec("UTF-8");
+
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        outStream << m_blocks[i]->text;
+        writeEvents(outStream, *m_blocks[i]);
+    }
+
+    outStream.flush();
+    bool okay = (outStream.status() == QTextStream::Ok);
+    file.close();
+
+    if (!okay || file.hasWriteError()) {
+        errMsg = QObject::tr("Error while writing on '%1'").arg(fileName);
+        return false;
+    }
+
+    int msec = timer.elapsed();
+    double mb = double(file.getUncompressedBytes()) / (1024.0 * 1024.0);
+    RG_DEBUG << "DocumentSnapshot::writeToFile: wrote " << mb << " MB ("
+             << m_eventCount << " events) in " << msec << " ms ("
+             << (msec > 0 ? mb * 1000.0 / msec : 0.0) << " MB/s)" << endl;
+
+    return true;
+}
+
+}
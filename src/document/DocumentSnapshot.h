@@ -0,0 +1,117 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_DOCUMENTSNAPSHOT_H
+#define RG_DOCUMENTSNAPSHOT_H
+
+#include "base/Event.h"
+
+#include <QString>
+#include <QTextStream>
+
+#include <vector>
+
+namespace Rosegarden
+{
+
+class Segment;
+
+/**
+ * The content of a document as it is to be saved: the XML text of
+ * everything but the segments' events, with the events themselves
+ * kept as a list per segment to be written out in between.  Most of a
+ * big document is events, and writing them out is most of the time
+ * taken to save it.
+ *
+ * RosegardenDocument fills in a snapshot on the GUI thread and then
+ * writes it out with writeToFile.  When copyEvents is set, the
+ * snapshot keeps its own copies of the events, which share their
+ * data with the originals until either is changed (see Event), so
+ * taking one is cheap, and the snapshot may then be written from
+ * another thread while the document goes on being edited.  Without
+ * it the snapshot only refers to the segments' events, and the
+ * document must not change until it has been written.
+ *
+ * Filling in a snapshot reads the segments, so it must be done on
+ * the GUI thread, where the document is edited, with nothing else
+ * changing it meanwhile.  Once filled in, a copying snapshot is
+ * independent of the document: the events' shared data is reference
+ * counted atomically and copied by whichever side changes it first,
+ * so the snapshot may be written out and deleted on any one thread.
+ */
+class DocumentSnapshot
+{
+public:
+    DocumentSnapshot(bool copyEvents);
+    ~DocumentSnapshot();
+
+    /**
+     * Return the stream to write the document's text to, up to the
+     * next set of events.
+     */
+    QTextStream &getStream() { return m_stream; }
+
+    /**
+     * Add the events of an internal segment here.  They are written
+     * out after the text written so far, and before any written to
+     * the stream from now on.
+     */
+    void addEvents(const Segment &segment);
+
+    /// Return the total number of events added
+    size_t getEventCount() const { return m_eventCount; }
+
+    /**
+     * The snapshot as a sequence of blocks, each some text followed
+     * by the events (if any) of one segment.  For DocumentCache,
+     * which stores the two separately.
+     */
+    size_t getBlockCount() const { return m_blocks.size(); }
+    const QString &getBlockText(size_t block) const {
+        return m_blocks[block]->text;
+    }
+    const std::vector<Event *> &getBlockEvents(size_t block) const {
+        return m_blocks[block]->events;
+    }
+
+    /**
+     * Compress the whole document into the given file, returning
+     * false and setting errMsg if it cannot be written.  This may be
+     * called from any thread.
+     */
+    bool writeToFile(const QString &fileName, QString &errMsg);
+
+private:
+    DocumentSnapshot(const DocumentSnapshot &);
+    DocumentSnapshot &operator=(const DocumentSnapshot &);
+
+    struct Block
+    {
+        QString text;                // written before the events
+        std::vector<Event *> events; // copies or not, as m_copyEvents
+        timeT startTime;
+    };
+
+    void writeEvents(QTextStream &out, const Block &block);
+
+    bool m_copyEvents;
+    std::vector<Block *> m_blocks;
+    QTextStream m_stream;
+    size_t m_eventCount;
+};
+
+}
+
+#endif
@@ -0,0 +1,188 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+ 
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+ 
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "GzipDevice.h"
+
+#include <QFileInfo>
+
+namespace Rosegarden
+{
+
+GzipDevice::GzipDevice(const QString &fileName) :
+    m_fileName(fileName),
+    m_file(0),
+    m_fileSize(0),
+    m_complete(false),
+    m_readError(false),
+    m_writeError(false),
+    m_uncompressedBytes(0)
+{
+}
+
+GzipDevice::~GzipDevice()
+{
+    close();
+}
+
+bool
+GzipDevice::open(OpenMode mode)
+{
+    if (isOpen()) return false;
+
+    bool writing = ((mode & ReadWrite) == WriteOnly);
+
+    if ((mode & ReadWrite) != ReadOnly && !writing) {
+        setErrorString(QObject::tr("Compressed files cannot be read and "
+                                   "written at once"));
+        return false;
+    }
+
+    m_file = gzopen(m_fileName.toLocal8Bit().data(), writing ? "wb" : "rb");
+    if (!m_file) {
+        setErrorString(QObject::tr("Could not open file \"%1\"")
+                       .arg(m_fileName));
+        return false;
+    }
+
+    // zlib's default 8K buffer means a lot of small reads from (or
+    // writes to) the file for a big document
+    gzbuffer(m_file, 128 * 1024);
+
+    m_fileSize = (writing ? 0 : QFileInfo(m_fileName).size());
+    m_complete = false;
+    m_readError = false;
+    m_writeError = false;
+    m_uncompressedBytes = 0;
+
+    return QIODevice::open(mode);
+}
+
+void
+GzipDevice::close()
+{
+    if (!m_file) return;
+
+    bool writing = ((openMode() & ReadWrite) == WriteOnly);
+
+    QIODevice::close();
+
+    // gzclose() flushes what zlib still holds, so a full disc may
+    // only show up here
+    int result = gzclose(m_file);
+    m_file = 0;
+
+    if (writing && result != Z_OK && !m_writeError) {
+        setErrorString(QObject::tr("Error writing compressed file \"%1\"")
+                       .arg(m_fileName));
+        m_writeError = true;
+    }
+}
+
+bool
+GzipDevice::atEnd() const
+{
+    return m_complete && QIODevice::atEnd();
+}
+
+int
+GzipDevice::getPercentRead() const
+{
+    if (!m_file || m_fileSize <= 0) return 0;
+    if (m_complete) return 100;
+
+    // gzoffset is the position in the compressed file
+    qint64 offset = gzoffset(m_file);
+    if (offset >= m_fileSize) return 100;
+    return int((offset * 100) / m_fileSize);
+}
+
+qint64
+GzipDevice::readData(char *data, qint64 maxSize)
+{
+    if (!m_file || m_complete || m_readError) return 0;
+
+    const qint64 chunk = 1024 * 1024 * 1024; // gzread takes an unsigned
+    if (maxSize > chunk) maxSize = chunk;
+
+    int got = gzread(m_file, data, unsigned(maxSize));
+
+    if (got < 0) {
+        int err = 0;
+        const char *message = gzerror(m_file, &err);
+        setErrorString(QObject::tr("Error reading compressed file \"%1\": %2")
+                       .arg(m_fileName).arg(message));
+        m_readError = true;
+        return -1;
+    }
+
+    if (got == 0) {
+        // A truncated file reaches the end of its input too, but
+        // leaves Z_BUF_ERROR behind rather than a clean stream end
+        int err = Z_OK;
+        const char *message = gzerror(m_file, &err);
+        if (err != Z_OK && err != Z_STREAM_END) {
+            setErrorString(QObject::tr("Error reading compressed file \"%1\": %2")
+                           .arg(m_fileName).arg(message));
+            m_readError = true;
+            return -1;
+        }
+        if (gzeof(m_file)) {
+            m_complete = true;
+        } else {
+            setErrorString(QObject::tr("Could not read file \"%1\"")
+                           .arg(m_fileName));
+            m_readError = true;
+            return -1;
+        }
+    }
+
+    m_uncompressedBytes += got;
+    return got;
+}
+
+qint64
+GzipDevice::writeData(const char *data, qint64 maxSize)
+{
+    if (!m_file || m_writeError) return -1;
+
+    const qint64 chunk = 1024 * 1024 * 1024; // gzwrite takes an unsigned
+    qint64 written = 0;
+
+    while (written < maxSize) {
+
+        qint64 n = maxSize - written;
+        if (n > chunk) n = chunk;
+
+        int put = gzwrite(m_file, data + written, unsigned(n));
+
+        if (put <= 0) {
+            int err = 0;
+            const char *message = gzerror(m_file, &err);
+            setErrorString(QObject::tr("Error writing compressed file \"%1\": %2")
+                           .arg(m_fileName).arg(message));
+            m_writeError = true;
+            return -1;
+        }
+
+        written += put;
+    }
+
+    m_uncompressedBytes += written;
+    return written;
+}
+
+}
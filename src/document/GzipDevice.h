@@ -0,0 +1,98 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+ 
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+ 
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_GZIPDEVICE_H
+#define RG_GZIPDEVICE_H
+
+#include <QIODevice>
+#include <QString>
+
+#include <zlib.h>
+
+namespace Rosegarden
+{
+
+/**
+ * A sequential QIODevice that decompresses a gzip file as it is read,
+ * or compresses one as it is written, so that a document can be
+ * parsed straight from the file (e.g. through a QXmlInputSource) or
+ * saved straight into it (through a QTextStream) without holding the
+ * whole of the uncompressed text in memory.  Files that are not
+ * compressed are read as they are, as gzread() does.
+ */
+class GzipDevice : public QIODevice
+{
+public:
+    GzipDevice(const QString &fileName);
+    virtual ~GzipDevice();
+
+    /// QIODevice::ReadOnly or QIODevice::WriteOnly, not both.
+    virtual bool open(OpenMode mode);
+    virtual void close();
+
+    virtual bool isSequential() const { return true; }
+    virtual bool atEnd() const;
+
+    /**
+     * Return how far through the file we have read, as a percentage
+     * of its size on disc.
+     */
+    int getPercentRead() const;
+
+    /**
+     * Return true if the whole file has been read without error.
+     * A truncated or corrupt file will fail this test even if the
+     * data read from it so far looked reasonable.
+     */
+    bool isComplete() const { return m_complete; }
+
+    /**
+     * Return true if reading failed because the file is truncated or
+     * corrupt.  errorString() then says why.
+     */
+    bool hasReadError() const { return m_readError; }
+
+    /**
+     * Return true if anything written could not be compressed and
+     * written to the file, including when closing it.  errorString()
+     * then says why.  Check this after close() when writing.
+     */
+    bool hasWriteError() const { return m_writeError; }
+
+    /**
+     * Return the number of uncompressed bytes read or written since
+     * the file was opened.
+     */
+    qint64 getUncompressedBytes() const { return m_uncompressedBytes; }
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    QString m_fileName;
+    gzFile m_file;
+    qint64 m_fileSize;
+    bool m_complete;
+    bool m_readError;
+    bool m_writeError;
+    qint64 m_uncompressedBytes;
+};
+
+}
+
+#endif
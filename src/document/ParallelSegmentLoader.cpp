@@ -0,0 +1,517 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[ParallelSegmentLoader]"
+
+#include "ParallelSegmentLoader.h"
+#include "XmlStorableEvent.h"
+
+#include "base/BaseProperties.h"
+#include "misc/Debug.h"
+#include "misc/Strings.h"
+
+#include <QBuffer>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <QXmlDefaultHandler>
+#include <QXmlInputSource>
+#include <QXmlSimpleReader>
+
+#include <cstring>
+
+namespace Rosegarden
+{
+
+using namespace BaseProperties;
+
+// Segments with fewer events than this are left to RoseXmlHandler, as
+// they aren't worth handing to another thread
+static const int minimumEvents = 200;
+
+namespace
+{
+
+// A tag, or other markup, found by scanning the document's text
+
+struct Tag
+{
+    enum Kind { Element, Markup, Subset };
+
+    Kind kind;
+    int begin;       // offset of the '<'
+    int end;         // offset just past the '>'
+    int nameBegin;
+    int nameLength;
+    bool closing;    // </name>
+    bool empty;      // <name/>
+};
+
+int find(const char *data, int size, int from, const char *s)
+{
+    int n = int(strlen(s));
+    for (int i = from; i + n <= size; ++i) {
+        if (data[i] == s[0] && !strncmp(data + i, s, n)) return i;
+    }
+    return -1;
+}
+
+bool startsWith(const char *data, int size, int at, const char *s)
+{
+    int n = int(strlen(s));
+    return at + n <= size && !strncmp(data + at, s, n);
+}
+
+bool isNameChar(char c)
+{
+    return !(c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+             c == '>' || c == '/');
+}
+
+// Find the next tag at or after from, returning false if there is
+// none or it is not terminated.  Comments, CDATA sections, processing
+// instructions and declarations are returned as Markup, except for a
+// DOCTYPE with an internal subset, which may declare entities and so
+// is returned as Subset.
+
+bool nextTag(const char *data, int size, int from, Tag &tag)
+{
+    const char *lt = (const char *)memchr(data + from, '<', size - from);
+    if (!lt) return false;
+
+    int i = int(lt - data);
+    tag.begin = i;
+    tag.kind = Tag::Markup;
+    tag.nameBegin = tag.nameLength = 0;
+    tag.closing = tag.empty = false;
+
+    int end = -1;
+
+    if (startsWith(data, size, i, "<!--")) {
+        end = find(data, size, i + 4, "-->");
+        if (end >= 0) end += 3;
+    } else if (startsWith(data, size, i, "<![CDATA[")) {
+        end = find(data, size, i + 9, "]]>");
+        if (end >= 0) end += 3;
+    } else if (startsWith(data, size, i, "<?")) {
+        end = find(data, size, i + 2, "?>");
+        if (end >= 0) end += 2;
+    } else if (startsWith(data, size, i, "<!")) {
+        for (int j = i + 2; j < size; ++j) {
+            if (data[j] == '[') tag.kind = Tag::Subset;
+            if (data[j] == '>' && (tag.kind != Tag::Subset || data[j-1] == ']')) {
+                end = j + 1;
+                break;
+            }
+        }
+    } else {
+        tag.kind = Tag::Element;
+        int j = i + 1;
+        if (j < size && data[j] == '/') {
+            tag.closing = true;
+            ++j;
+        }
+        tag.nameBegin = j;
+        while (j < size && isNameChar(data[j])) ++j;
+        tag.nameLength = j - tag.nameBegin;
+
+        // attribute values may contain '>'
+        char quote = 0;
+        for (; j < size; ++j) {
+            char c = data[j];
+            if (quote) {
+                if (c == quote) quote = 0;
+            } else if (c == '"' || c == '\'') {
+                quote = c;
+            } else if (c == '>') {
+                end = j + 1;
+                tag.empty = (data[j-1] == '/');
+                break;
+            }
+        }
+    }
+
+    if (end < 0) return false;
+    tag.end = end;
+    return true;
+}
+
+// Element names are compared without regard to case, as
+// RoseXmlHandler does
+
+bool isNamed(const char *data, const Tag &tag, const char *name)
+{
+    int n = int(strlen(name));
+    return tag.kind == Tag::Element && tag.nameLength == n &&
+        !qstrnicmp(data + tag.nameBegin, name, n);
+}
+
+// Scan the events starting at from, just after a segment's start tag,
+// and return the offset just past the last of them that can be parsed
+// apart from the rest of the document: up to the first element that
+// is not an event, chord or event property, or that is out of place.
+// The run only ever ends between whole events and chords.
+
+int scanEvents(const char *data, int size, int from, int &eventCount)
+{
+    int runEnd = from;
+    bool inEvent = false;
+    bool inChord = false;
+    int events = 0;
+
+    eventCount = 0;
+
+    Tag tag;
+    while (nextTag(data, size, from, tag)) {
+
+        if (isNamed(data, tag, "event")) {
+            if (tag.closing) {
+                if (!inEvent) break;
+                inEvent = false;
+            } else {
+                if (inEvent) break;
+                inEvent = !tag.empty;
+                ++events;
+            }
+        } else if (isNamed(data, tag, "property") ||
+                   isNamed(data, tag, "nproperty")) {
+            if (!inEvent) break;
+        } else if (isNamed(data, tag, "chord")) {
+            if (inEvent) break;
+            if (tag.closing) {
+                if (!inChord) break;
+                inChord = false;
+            } else if (!tag.empty) {
+                if (inChord) break;
+                inChord = true;
+            }
+        } else {
+            break;
+        }
+
+        from = tag.end;
+
+        if (!inEvent && !inChord) {
+            runEnd = from;
+            eventCount = events;
+        }
+    }
+
+    return runEnd;
+}
+
+// Builds the events of one block, as RoseXmlHandler would
+
+class SegmentEventHandler : public QXmlDefaultHandler
+{
+public:
+    SegmentEventHandler() :
+        m_event(0),
+        m_time(0),
+        m_chordDuration(0),
+        m_inChord(false),
+        m_grouped(false)
+    { }
+
+    virtual ~SegmentEventHandler() {
+        delete m_event;
+        for (size_t i = 0; i < m_events.size(); ++i) delete m_events[i];
+    }
+
+    virtual bool startElement(const QString &, const QString &,
+                              const QString &qName,
+                              const QXmlAttributes &atts);
+
+    virtual bool endElement(const QString &, const QString &,
+                            const QString &qName);
+
+    virtual bool fatalError(const QXmlParseException &exception) {
+        m_errorString = QString("%1 at line %2, column %3 of segment events")
+            .arg(exception.message())
+            .arg(exception.lineNumber())
+            .arg(exception.columnNumber());
+        return QXmlDefaultHandler::fatalError(exception);
+    }
+
+    virtual QString errorString() const { return m_errorString; }
+
+    std::vector<Event *> m_events;
+    std::vector<ParallelSegmentLoader::GroupedEvent> m_groupedEvents;
+    XmlStorableEvent *m_event;
+    timeT m_time;
+    timeT m_chordDuration;
+    bool m_inChord;
+    bool m_grouped;
+    QString m_errorString;
+};
+
+bool
+SegmentEventHandler::startElement(const QString &, const QString &,
+                                  const QString &qName,
+                                  const QXmlAttributes &atts)
+{
+    QString lcName = qName.toLower();
+
+    if (lcName == "event") {
+
+        m_event = new XmlStorableEvent(atts, m_time);
+
+        // Group ids from old-style attributes are remapped later, on
+        // the segment itself
+        m_grouped = m_event->has(BEAMED_GROUP_ID);
+        if (m_grouped) {
+            ParallelSegmentLoader::GroupedEvent grouped;
+            grouped.index = m_events.size();
+            grouped.storedId = m_event->get<Int>(BEAMED_GROUP_ID);
+            grouped.keep = false;
+            m_groupedEvents.push_back(grouped);
+        }
+
+        timeT duration = m_event->getDuration();
+
+        if (!m_inChord) {
+            m_time = m_event->getAbsoluteTime() + duration;
+        } else if (duration != 0) {
+            if (m_chordDuration == 0 || duration < m_chordDuration) {
+                m_chordDuration = duration;
+            }
+        }
+
+    } else if (lcName == "property" || lcName == "nproperty") {
+
+        if (m_event) {
+            m_event->setPropertyFromAttributes(atts, lcName == "property");
+            if (m_grouped &&
+                PropertyName(qstrtostr(atts.value("name"))) ==
+                BEAMED_GROUP_ID) {
+                m_groupedEvents.back().keep = true;
+            }
+        }
+
+    } else if (lcName == "chord") {
+
+        m_inChord = true;
+
+    } else if (lcName == "segment") {
+
+        QString startIdxStr = atts.value("start");
+        if (!startIdxStr.isEmpty()) {
+            m_time = startIdxStr.toInt();
+        }
+    }
+
+    return true;
+}
+
+bool
+SegmentEventHandler::endElement(const QString &, const QString &,
+                                const QString &qName)
+{
+    QString lcName = qName.toLower();
+
+    if (lcName == "event") {
+
+        if (m_event) {
+            m_events.push_back(m_event);
+            m_event = 0;
+        }
+
+    } else if (lcName == "chord") {
+
+        m_time += m_chordDuration;
+        m_inChord = false;
+        m_chordDuration = 0;
+    }
+
+    return true;
+}
+
+class ParseTask : public QRunnable
+{
+public:
+    ParseTask(ParallelSegmentLoader *loader, int block) :
+        m_loader(loader), m_block(block) { }
+
+    virtual void run() { m_loader->parseBlock(m_block); }
+
+private:
+    ParallelSegmentLoader *m_loader;
+    int m_block;
+};
+
+}
+
+ParallelSegmentLoader::ParallelSegmentLoader()
+{
+}
+
+ParallelSegmentLoader::~ParallelSegmentLoader()
+{
+    m_pool.waitForDone();
+
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        std::vector<Event *> &events = m_blocks[i]->events;
+        for (size_t j = 0; j < events.size(); ++j) delete events[j];
+        delete m_blocks[i];
+    }
+}
+
+int
+ParallelSegmentLoader::start(const QByteArray &document)
+{
+    m_document = document;
+    m_skeleton.clear();
+
+    const char *data = m_document.constData();
+    int size = m_document.size();
+
+    // The pieces are parsed as UTF-8, so anything else is left whole
+    Tag tag;
+    if (nextTag(data, size, 0, tag) && startsWith(data, size, tag.begin, "<?xml")) {
+        int encoding = find(data, tag.end, tag.begin, "encoding=");
+        if (encoding >= 0 &&
+            qstrnicmp(data + encoding + 10, "utf-8", 5) != 0) {
+            m_skeleton = m_document;
+            return 0;
+        }
+    }
+
+    int from = 0, copied = 0;
+
+    while (nextTag(data, size, from, tag)) {
+
+        from = tag.end;
+
+        if (tag.kind == Tag::Subset) {
+            // entity declarations could be used anywhere; give up
+            for (size_t i = 0; i < m_blocks.size(); ++i) delete m_blocks[i];
+            m_blocks.clear();
+            m_skeleton = m_document;
+            return 0;
+        }
+
+        if (tag.closing || tag.empty || !isNamed(data, tag, "segment")) {
+            continue;
+        }
+
+        int eventCount = 0;
+        int end = scanEvents(data, size, tag.end, eventCount);
+        if (eventCount < minimumEvents) continue;
+
+        Block *block = new Block;
+        block->begin = tag.begin;
+        block->end = end;
+        block->done = false;
+        block->taken = false;
+        block->endTime = 0;
+
+        m_skeleton.append(data + copied, tag.end - copied);
+        m_skeleton.append("<parsedevents block=\"");
+        m_skeleton.append(QByteArray::number(int(m_blocks.size())));
+        m_skeleton.append("\"/>");
+        copied = from = end;
+
+        m_blocks.push_back(block);
+    }
+
+    m_skeleton.append(data + copied, size - copied);
+
+    RG_DEBUG << "ParallelSegmentLoader::start: " << m_blocks.size()
+             << " blocks of events, skeleton of " << m_skeleton.size()
+             << " bytes, on " << QThread::idealThreadCount() << " threads"
+             << endl;
+
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        m_pool.start(new ParseTask(this, int(i)));
+    }
+
+    return int(m_blocks.size());
+}
+
+void
+ParallelSegmentLoader::parseBlock(int blockNo)
+{
+    Block *block = m_blocks[blockNo];
+
+    // The segment's start tag (for its start time), its events, and
+    // an end tag to make a document of it
+    QByteArray xml(m_document.constData() + block->begin,
+                   block->end - block->begin);
+    xml.append("</segment>");
+
+    QBuffer buffer(&xml);
+    buffer.open(QIODevice::ReadOnly);
+
+    QXmlInputSource source(&buffer);
+    SegmentEventHandler handler;
+    QXmlSimpleReader reader;
+    reader.setContentHandler(&handler);
+    reader.setErrorHandler(&handler);
+
+    bool ok = reader.parse(source);
+
+    QMutexLocker locker(&m_mutex);
+
+    if (ok) {
+        block->events.swap(handler.m_events);
+        block->groupedEvents.swap(handler.m_groupedEvents);
+        block->endTime = handler.m_time;
+    } else {
+        block->errMsg = handler.errorString();
+        if (block->errMsg.isEmpty()) {
+            block->errMsg = "Failed to parse segment events";
+        }
+    }
+
+    block->done = true;
+    m_condition.wakeAll();
+}
+
+bool
+ParallelSegmentLoader::takeEvents(int blockNo,
+                                  std::vector<Event *> &events,
+                                  std::vector<GroupedEvent> &groupedEvents,
+                                  timeT &endTime,
+                                  QString &errMsg)
+{
+    if (blockNo < 0 || size_t(blockNo) >= m_blocks.size()) {
+        errMsg = "No such block of parsed events";
+        return false;
+    }
+
+    Block *block = m_blocks[blockNo];
+
+    QMutexLocker locker(&m_mutex);
+
+    while (!block->done) m_condition.wait(&m_mutex);
+
+    if (block->taken) {
+        errMsg = "Parsed events taken twice";
+        return false;
+    }
+    block->taken = true;
+
+    if (!block->errMsg.isEmpty()) {
+        errMsg = block->errMsg;
+        return false;
+    }
+
+    events.swap(block->events);
+    groupedEvents.swap(block->groupedEvents);
+    endTime = block->endTime;
+    return true;
+}
+
+}
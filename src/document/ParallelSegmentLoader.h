@@ -0,0 +1,128 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_PARALLELSEGMENTLOADER_H
+#define RG_PARALLELSEGMENTLOADER_H
+
+#include "base/Event.h"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <vector>
+
+namespace Rosegarden
+{
+
+/**
+ * Parses the events of a document's segments on several threads at
+ * once, for RoseXmlHandler to pick up as it reaches each segment.
+ *
+ * start() scans the text of the document for segments.  In each one,
+ * the events directly after the segment's start tag (event, chord,
+ * property and nproperty elements only -- nearly always all of them)
+ * are cut out and parsed into events on a thread pool.  In their place
+ * the rest of the document, the skeleton, has a <parsedevents
+ * block="n"/> element, for which RoseXmlHandler takes the parsed
+ * events with takeEvents(), waiting for them if need be.  Anything
+ * else in a segment is left in the skeleton and parsed as usual.
+ *
+ * Events are built just as RoseXmlHandler builds them, except that
+ * group ids stored in old-style event attributes are left as they are
+ * and the events listed, as they must be remapped on the segment in
+ * document order.  So the document loaded is the same as it would be
+ * if it were parsed serially.
+ */
+class ParallelSegmentLoader
+{
+public:
+    ParallelSegmentLoader();
+
+    /**
+     * Wait for any parsing still under way, and delete any events
+     * that were not taken
+     */
+    ~ParallelSegmentLoader();
+
+    /**
+     * Split the given document, which must be UTF-8 encoded XML, and
+     * start parsing its segments' events.  Returns the number of
+     * blocks of events split off, which may be none.
+     */
+    int start(const QByteArray &document);
+
+    /// Return the document without the events being parsed
+    const QByteArray &getSkeleton() const { return m_skeleton; }
+
+    /**
+     * An event with a group id attribute, which RoseXmlHandler must
+     * remap to a new id from the segment
+     */
+    struct GroupedEvent
+    {
+        size_t index;  // in the block's events
+        long storedId; // as found in the file
+        bool keep;     // a property of the event has replaced the id since
+    };
+
+    /**
+     * Wait for the given block of events to be parsed, and hand them
+     * over to the caller, with any whose group ids are to be remapped.
+     * endTime receives the time at which the next event in the
+     * segment would start if it had no time of its own.  Returns
+     * false, and sets errMsg, if the events could not be parsed.
+     */
+    bool takeEvents(int block,
+                    std::vector<Event *> &events,
+                    std::vector<GroupedEvent> &groupedEvents,
+                    timeT &endTime,
+                    QString &errMsg);
+
+    /**
+     * Parse one block.  Called on the thread pool.
+     */
+    void parseBlock(int block);
+
+private:
+    ParallelSegmentLoader(const ParallelSegmentLoader &);
+    ParallelSegmentLoader &operator=(const ParallelSegmentLoader &);
+
+    struct Block
+    {
+        int begin;  // offset of the segment's start tag in the document
+        int end;    // offset just past the last of its events
+        bool done;
+        bool taken;
+        std::vector<Event *> events;
+        std::vector<GroupedEvent> groupedEvents;
+        timeT endTime;
+        QString errMsg;
+    };
+
+    QByteArray m_document;
+    QByteArray m_skeleton;
+    std::vector<Block *> m_blocks;
+
+    QThreadPool m_pool;
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+};
+
+}
+
+#endif
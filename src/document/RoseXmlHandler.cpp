@@ -18,6 +18,9 @@
 #define RG_MODULE_STRING "[RoseXmlHandler]"
 
 #include "RoseXmlHandler.h"
+#include "GzipDevice.h"
+#include "DocumentCache.h"
+#include "ParallelSegmentLoader.h"
 
 #include "sound/Midi.h"
 #include "misc/Debug.h"
@@ -201,7 +204,7 @@ ConfigurationXmlSubHandler::endElement(const QString&,
 
 
 RoseXmlHandler::RoseXmlHandler(RosegardenDocument *doc,
-                               unsigned int elementCount,
+                               const QIODevice *source,
                                bool createNewDevicesWhenNeeded) :
     ProgressReporter(0),
     m_doc(doc),
@@ -230,7 +233,9 @@ RoseXmlHandler::RoseXmlHandler(RosegardenDocument *doc,
     m_colourMap(0),
     m_keyMapping(0),
     m_pluginId(0),
-    m_totalElements(elementCount),
+    m_source(source),
+    m_eventCache(0),
+    m_segmentLoader(0),
     m_elementsSoFar(0),
     m_subHandler(0),
     m_deprecation(false),
@@ -338,12 +343,8 @@ RoseXmlHandler::startElement(const QString& namespaceURI,
             long storedId = m_currentEvent->get
                             <Int>(BEAMED_GROUP_ID);
 
-            if (m_groupIdMap.find(storedId) == m_groupIdMap.end()) {
-                m_groupIdMap[storedId] = m_currentSegment->getNextId();
-            }
-
             m_currentEvent->set
-            <Int>(BEAMED_GROUP_ID, m_groupIdMap[storedId]);
+            <Int>(BEAMED_GROUP_ID, remapGroupId(storedId));
 
         } else if (m_inGroup) {
             m_currentEvent->set
@@ -382,6 +383,77 @@ RoseXmlHandler::startElement(const QString& namespaceURI,
             }
         }
 
+    } else if (lcName == "eventcache") {
+
+        // All the events of the current segment at once, already
+        // loaded from a DocumentCache
+
+        if (!m_currentSegment || !m_eventCache) {
+            m_errorString = "Got cached events outside of a segment";
+            return false;
+        }
+
+        std::vector<Event *> events;
+        if (!m_eventCache->readEvents(atts.value("block").toInt(), events)) {
+            m_errorString = "Document cache is damaged";
+            return false;
+        }
+
+        // The cache holds the ids the events had when saved, so remap
+        // them as we would if reading them from the XML
+        for (size_t i = 0; i < events.size(); ++i) {
+            if (events[i]->has(BEAMED_GROUP_ID)) {
+                long storedId = events[i]->get<Int>(BEAMED_GROUP_ID);
+                events[i]->set<Int>(BEAMED_GROUP_ID, remapGroupId(storedId));
+            }
+            m_currentSegment->insert(events[i]);
+        }
+
+    } else if (lcName == "parsedevents") {
+
+        // The events at the start of the current segment, already
+        // parsed on another thread by a ParallelSegmentLoader
+
+        if (!m_segmentLoader) {
+            m_errorString = "Got parsed events without a segment loader";
+            return false;
+        }
+
+        std::vector<Event *> events;
+        std::vector<ParallelSegmentLoader::GroupedEvent> groupedEvents;
+        timeT endTime = m_currentTime;
+        QString errMsg;
+
+        if (!m_segmentLoader->takeEvents(atts.value("block").toInt(),
+                                         events, groupedEvents,
+                                         endTime, errMsg)) {
+            m_errorString = errMsg;
+            return false;
+        }
+
+        if (!m_currentSegment) {
+            for (size_t i = 0; i < events.size(); ++i) delete events[i];
+            m_errorString = "Got event outside of a Segment";
+            return false;
+        }
+
+        // Remap group ids in document order, just as for events
+        // parsed here
+        for (size_t i = 0; i < groupedEvents.size(); ++i) {
+            const ParallelSegmentLoader::GroupedEvent &grouped =
+                groupedEvents[i];
+            long id = remapGroupId(grouped.storedId);
+            if (!grouped.keep) {
+                events[grouped.index]->set<Int>(BEAMED_GROUP_ID, id);
+            }
+        }
+
+        for (size_t i = 0; i < events.size(); ++i) {
+            m_currentSegment->insert(events[i]);
+        }
+
+        m_currentTime = endTime;
+
     } else if (lcName == "property") {
 
         if (!m_currentEvent) {
@@ -448,12 +520,18 @@ RoseXmlHandler::startElement(const QString& namespaceURI,
             if (major == RosegardenDocument::FILE_FORMAT_VERSION_MAJOR &&
                     minor > RosegardenDocument::FILE_FORMAT_VERSION_MINOR) {
 
-                CurrentProgressDialog::freeze();
-                StartupLogo::hideIfStillThere();
+                QString msg(tr("This file was written by Rosegarden %1, which is more recent than this version.\nThere may be some incompatibilities with the file format.").arg(version));
 
-                QMessageBox::information(0, tr("Rosegarden"), tr("This file was written by Rosegarden %1, which is more recent than this version.\nThere may be some incompatibilities with the file format.").arg(version));
+                if (m_doc->isHeadless()) {
+                    std::cerr << qStrToStrLocal8(msg) << std::endl;
+                } else {
+                    CurrentProgressDialog::freeze();
+                    StartupLogo::hideIfStillThere();
 
-                CurrentProgressDialog::thaw();
+                    QMessageBox::information(0, tr("Rosegarden"), msg);
+
+                    CurrentProgressDialog::thaw();
+                }
             }
         }
 
@@ -1099,8 +1177,16 @@ RoseXmlHandler::startElement(const QString& namespaceURI,
             RG_DEBUG << "Attempting to find audio file " << file
                      << " in path " << dirPath << endl;
 
-            if (getAudioFileManager().insertFile(qstrtostr(label),
-                                                 file, id.toInt()) == false) {
+            bool found = getAudioFileManager().insertFile(qstrtostr(label),
+                                                          file, id.toInt());
+
+            if (!found && m_doc->isHeadless()) {
+
+                // There is nobody to ask where it is
+                std::cerr << "Audio file " << file << " not found in path "
+                          << dirPath << std::endl;
+
+            } else if (!found) {
 
                 // Freeze the progress dialog
                 CurrentProgressDialog::freeze();
@@ -2231,14 +2317,17 @@ RoseXmlHandler::endElement(const QString& namespaceURI,
 
     // Set percentage done
     //
-    if ((m_totalElements > m_elementsSoFar) &&
-        (++m_elementsSoFar % 300 == 0)) {
+    if (m_source && (++m_elementsSoFar % 300 == 0)) {
 
         Profiler profiler("RoseXmlHandler::endElement: emit progress");
 
-//        std::cout << "emitting setValue(" << int(double(m_elementsSoFar) / double(m_totalElements) * 100.0) << ")" << std::endl;
-
-        emit setValue(int(double(m_elementsSoFar) / double(m_totalElements) * 100.0));
+        // A compressed file knows how far through it we are
+        const GzipDevice *file = dynamic_cast<const GzipDevice *>(m_source);
+        if (file) {
+            emit setValue(file->getPercentRead());
+        } else if (m_source->size() > 0) {
+            emit setValue(int(m_source->pos() * 100 / m_source->size()));
+        }
         qApp->processEvents(QEventLoop::AllEvents, 100);
     }
 
@@ -2628,4 +2717,18 @@ RoseXmlHandler::setMIDIDeviceName(QString name)
         (md->getId(), name);
 }
 
+long
+RoseXmlHandler::remapGroupId(long storedId)
+{
+    // We want to ensure that the segment's nextId is always used (and
+    // incremented) in preference to the stored id
+
+    std::map<long, long>::iterator i = m_groupIdMap.find(storedId);
+    if (i != m_groupIdMap.end()) return i->second;
+
+    long id = m_currentSegment->getNextId();
+    m_groupIdMap[storedId] = id;
+    return id;
+}
+
 }
@@ -30,6 +30,7 @@
 #include <QtCore/QSharedPointer>
 
 
+class QIODevice;
 class QXmlParseException;
 class QXmlAttributes;
 
@@ -51,6 +52,8 @@ class Buss;
 class AudioPluginManager;
 class AudioPluginInstance;
 class AudioFileManager;
+class DocumentCache;
+class ParallelSegmentLoader;
 
 
 /**
@@ -76,10 +79,11 @@ public:
 
     /**
      * Construct a new RoseXmlHandler which will put the data extracted
-     * from the XML file into the specified composition
+     * from the XML file into the specified composition.  Progress is
+     * reported from how much of \a source has been read, if given.
      */
     RoseXmlHandler(RosegardenDocument *doc,
-                   unsigned int elementCount,
+                   const QIODevice *source,
                    bool createNewDevicesWhenNeeded);
 
     virtual ~RoseXmlHandler();
@@ -99,6 +103,21 @@ public:
 
     virtual bool endDocument (); // [rwb] - for tempo element catch
 
+    /**
+     * Take the segments' events from the given cache, where the XML
+     * refers to it with <eventcache> elements in place of the events.
+     */
+    void setEventCache(const DocumentCache *cache) { m_eventCache = cache; }
+
+    /**
+     * Take the leading events of segments from the given loader,
+     * where the XML refers to it with <parsedevents> elements in
+     * place of the events.
+     */
+    void setSegmentLoader(ParallelSegmentLoader *loader) {
+        m_segmentLoader = loader;
+    }
+
     bool isDeprecated() { return m_deprecation; }
 
     bool isCancelled() { return m_cancelled; }
@@ -131,6 +150,9 @@ protected:
     void skipToNextPlayDevice();
     InstrumentId mapToActualInstrument(InstrumentId id);
 
+    /// Map a group id stored in the file to a new one from the current segment
+    long remapGroupId(long storedId);
+
     //--------------- Data members ---------------------------------
 
     RosegardenDocument    *m_doc;
@@ -179,7 +201,9 @@ protected:
     MidiKeyMapping                   *m_keyMapping;
     MidiKeyMapping::KeyNameMap        m_keyNameMap;
     unsigned int                      m_pluginId;
-    unsigned int                      m_totalElements;
+    const QIODevice                  *m_source;
+    const DocumentCache              *m_eventCache;
+    ParallelSegmentLoader            *m_segmentLoader;
     unsigned int                      m_elementsSoFar;
 
     XmlSubHandler                    *m_subHandler;
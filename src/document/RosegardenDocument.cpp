@@ -20,7 +20,11 @@
 
 #include "CommandHistory.h"
 #include "RoseXmlHandler.h"
-#include "GzipFile.h"
+#include "GzipDevice.h"
+#include "DocumentCache.h"
+#include "ParallelSegmentLoader.h"
+#include "DocumentSnapshot.h"
+#include "AutoSaveThread.h"
 
 #include "base/AudioDevice.h"
 #include "base/AudioPluginInstance.h"
@@ -92,6 +96,7 @@
 #include <QMessageBox>
 #include <QProcess>
 #include <QTemporaryFile>
+#include <QBuffer>
 #include <QByteArray>
 #include <QDataStream>
 #include <QDialog>
@@ -102,6 +107,7 @@
 #include <QString>
 #include <QStringList>
 #include <QTextStream>
+#include <QThread>
 #include <QWidget>
 #include <QPointer>
 
@@ -123,8 +129,11 @@ RosegardenDocument::RosegardenDocument(QWidget *parent,
         m_audioRecordLatency(0, 0),
         m_quickMarkerTime(-1),
         m_autoSavePeriod(0),
+        m_autoSaveThread(0),
         m_beingDestroyed(false),
-        m_clearCommandHistory(clearCommandHistory)
+        m_clearCommandHistory(clearCommandHistory),
+        m_headless(false),
+        m_loadedFromCache(false)
 {
     checkSequencerTimer();
 
@@ -150,6 +159,8 @@ RosegardenDocument::~RosegardenDocument()
     RG_DEBUG << "~RosegardenDocument()\n";
     m_beingDestroyed = true;
 
+    waitForAutoSave();
+
     m_audioPreviewThread.finish();
     m_audioPreviewThread.wait();
 
@@ -160,6 +171,40 @@ RosegardenDocument::~RosegardenDocument()
     if (m_clearCommandHistory) CommandHistory::getInstance()->clear(); // before Composition is deleted
 }
 
+// Whether to write a DocumentCache beside each document saved, and
+// load documents from their caches where they have them
+
+static bool
+useFastLoadCache()
+{
+    QSettings settings;
+    settings.beginGroup( GeneralOptionsConfigGroup );
+
+    bool use = settings.value("fastloadcache", false).toBool();
+
+    settings.endGroup();
+    return use;
+}
+
+// Whether to parse the events of a document's segments on several
+// threads while loading it.  This needs the whole decompressed file in
+// memory at once, where the usual load streams it through the parser,
+// so it is off unless asked for.
+
+static bool
+useParallelLoad()
+{
+    if (QThread::idealThreadCount() < 2) return false;
+
+    QSettings settings;
+    settings.beginGroup( GeneralOptionsConfigGroup );
+
+    bool use = settings.value("parallelsegmentload", false).toBool();
+
+    settings.endGroup();
+    return use;
+}
+
 unsigned int
 RosegardenDocument::getAutoSavePeriod() const
 {
@@ -314,16 +359,62 @@ void RosegardenDocument::slotAutoSave()
     if (isAutoSaved() || !isModified())
         return ;
 
+    // Still writing the last one: try again next time
+    if (m_autoSaveThread)
+        return ;
+
     QString autoSaveFileName = getAutoSaveFileName();
 
     RG_DEBUG << "RosegardenDocument::slotAutoSave() - doc modified - saving '"
     << getAbsFilePath() << "' as "
     << autoSaveFileName << endl;
 
-    QString errMsg;
+    // Only taking the snapshot holds up the GUI; the events are
+    // copied cheaply, sharing their data with ours until we change
+    // them
+    DocumentSnapshot *snapshot = new DocumentSnapshot(true);
+    snapshotDocument(*snapshot, 0);
+
+    m_autoSaveThread = new AutoSaveThread(snapshot, autoSaveFileName);
+    connect(m_autoSaveThread, SIGNAL(finished()),
+            this, SLOT(slotAutoSaveFinished()));
 
-    saveDocument(autoSaveFileName, errMsg, true);
+    // Any change from here on clears this again, so the next period
+    // saves it
+    setAutoSaved(true);
 
+    m_autoSaveThread->start(QThread::LowPriority);
+}
+
+void RosegardenDocument::slotAutoSaveFinished()
+{
+    // We may have dealt with it already, in waitForAutoSave()
+    if (!m_autoSaveThread || !m_autoSaveThread->isDone())
+        return ;
+
+    // it has only to return from run() now
+    m_autoSaveThread->wait();
+
+    if (m_autoSaveThread->isOK()) {
+        RG_DEBUG << "RosegardenDocument::slotAutoSaveFinished() - saved "
+                 << m_autoSaveThread->getFileName() << endl;
+    } else {
+        RG_DEBUG << "RosegardenDocument::slotAutoSaveFinished() - failed: "
+                 << m_autoSaveThread->getErrorMessage() << endl;
+        setAutoSaved(false);
+    }
+
+    delete m_autoSaveThread;
+    m_autoSaveThread = 0;
+}
+
+void RosegardenDocument::waitForAutoSave()
+{
+    if (!m_autoSaveThread)
+        return ;
+
+    m_autoSaveThread->wait();
+    slotAutoSaveFinished();
 }
 
 bool RosegardenDocument::isRegularDotRGFile()
@@ -375,6 +466,7 @@ bool RosegardenDocument::saveIfModified()
     case QMessageBox::No:
         // delete the autosave file so it won't annoy
         // the user when reloading the file.
+        waitForAutoSave();
         QFile::remove
             (getAutoSaveFileName());
         completed = true;
@@ -578,6 +670,8 @@ bool RosegardenDocument::openDocument(const QString& filename,
 {
     RG_DEBUG << "RosegardenDocument::openDocument(" << filename << ")" << endl;
 
+    m_loadedFromCache = false;
+
     if ( filename.isEmpty() )
         return false;
 
@@ -590,7 +684,8 @@ bool RosegardenDocument::openDocument(const QString& filename,
     if (!fileInfo.isReadable() || fileInfo.isDir()) {
         StartupLogo::hideIfStillThere();
         QString msg(tr("Can't open file '%1'").arg(filename));
-        QMessageBox::warning(dynamic_cast<QWidget *>(parent()), tr("Rosegarden"), msg);
+        if (m_headless) std::cerr << qStrToStrLocal8(msg) << std::endl;
+        else QMessageBox::warning(dynamic_cast<QWidget *>(parent()), tr("Rosegarden"), msg);
         return false;
     }
 
@@ -611,21 +706,96 @@ bool RosegardenDocument::openDocument(const QString& filename,
     setAbsFilePath(fileInfo.absoluteFilePath());
 
     QString errMsg;
-    QString fileContents;
     bool cancelled = false;
+    bool okay = false;
 
-    bool okay = GzipFile::readFromFile(filename, fileContents);
-    
     if (progressDlg)
         progressDlg->show();
-    
-    if (!okay) errMsg = tr("Could not open Rosegarden file");
-    else {
-        okay = xmlParse(fileContents,
+
+    // If there is a fast-load cache beside the file that still
+    // matches it, read the document from that instead
+    DocumentCache cache;
+
+    if (useFastLoadCache() && cache.open(filename)) {
+
+        QByteArray skeleton = cache.getSkeleton();
+        QBuffer buffer(&skeleton);
+        buffer.open(QIODevice::ReadOnly);
+
+        okay = xmlParse(buffer,
                         errMsg,
                         progressDlg,
                         permanent,
-                        cancelled);
+                        cancelled,
+                        &cache);
+
+        if (okay) {
+            m_loadedFromCache = true;
+            RG_DEBUG << "RosegardenDocument::openDocument: loaded "
+                     << cache.getEventCount() << " events from cache" << endl;
+        } else {
+            RG_DEBUG << "RosegardenDocument::openDocument: failed to load "
+                     << "from cache (" << errMsg << "), reading file instead"
+                     << endl;
+            newDocument();
+            setTitle(fileInfo.fileName());
+            setAbsFilePath(fileInfo.absoluteFilePath());
+            errMsg = QString();
+        }
+
+        cache.close();
+    }
+
+    if (!m_loadedFromCache) {
+
+        GzipDevice file(filename);
+
+        okay = file.open(QIODevice::ReadOnly);
+
+        if (!okay) errMsg = tr("Could not open Rosegarden file");
+        else if (useParallelLoad()) {
+
+            // Decompress the whole file, so that the segments' events
+            // can be parsed on other threads while the rest of the
+            // document is parsed here.  This trades the memory of the
+            // streaming load below for time on a machine with cores
+            // to spare.
+            QByteArray data = file.readAll();
+
+            if (file.hasReadError() || !file.isComplete()) {
+                errMsg = file.errorString();
+                okay = false;
+            } else {
+                ParallelSegmentLoader loader;
+                int blocks = loader.start(data);
+                data = QByteArray();
+
+                RG_DEBUG << "RosegardenDocument::openDocument: parsing "
+                         << blocks << " blocks of events in parallel" << endl;
+
+                QByteArray skeleton = loader.getSkeleton();
+                QBuffer buffer(&skeleton);
+                buffer.open(QIODevice::ReadOnly);
+
+                okay = xmlParse(buffer,
+                                errMsg,
+                                progressDlg,
+                                permanent,
+                                cancelled,
+                                0,
+                                &loader);
+            }
+
+        } else {
+
+            // The file is decompressed as the parser reads it, rather
+            // than all at once up front
+            okay = xmlParse(file,
+                            errMsg,
+                            progressDlg,
+                            permanent,
+                            cancelled);
+        }
     }
 
     if (!okay) {
@@ -635,7 +805,8 @@ bool RosegardenDocument::openDocument(const QString& filename,
                      .arg(errMsg));
 
         if (progressDlg) CurrentProgressDialog::freeze();
-        QMessageBox::warning(dynamic_cast<QWidget *>(parent()), tr("Rosegarden"), msg);
+        if (m_headless) std::cerr << qStrToStrLocal8(msg) << std::endl;
+        else QMessageBox::warning(dynamic_cast<QWidget *>(parent()), tr("Rosegarden"), msg);
         if (progressDlg) {
             CurrentProgressDialog::thaw();
             progressDlg->close();
@@ -677,7 +848,8 @@ bool RosegardenDocument::openDocument(const QString& filename,
     } catch (Exception e) {
         StartupLogo::hideIfStillThere();
         if (progressDlg) CurrentProgressDialog::freeze();
-        QMessageBox::critical(dynamic_cast<QWidget *>(parent()), tr("Rosegarden"), strtoqstr(e.getMessage()));
+        if (m_headless) std::cerr << e.getMessage() << std::endl;
+        else QMessageBox::critical(dynamic_cast<QWidget *>(parent()), tr("Rosegarden"), strtoqstr(e.getMessage()));
         if (progressDlg) CurrentProgressDialog::thaw();
     }
 
@@ -1147,7 +1319,11 @@ void RosegardenDocument::initialiseStudio()
 SequenceManager *
 RosegardenDocument::getSequenceManager()
 {
-    return (dynamic_cast<RosegardenMainWindow*>(parent()))->getSequenceManager();
+    RosegardenMainWindow *mainWindow =
+        dynamic_cast<RosegardenMainWindow *>(parent());
+
+    // There is none for a document with no main window
+    return mainWindow ? mainWindow->getSequenceManager() : 0;
 }
 
 
@@ -1186,8 +1362,13 @@ bool RosegardenDocument::saveDocument(const QString& filename,
                                     QString& errMsg,
                                     bool autosave)
 {
+    QString cacheFileName;
+    if (!autosave && useFastLoadCache()) {
+        cacheFileName = DocumentCache::getCacheFileName(filename);
+    }
+
     if (!QFileInfo(filename).exists()) { // safe to write directly
-        return saveDocumentActual(filename, errMsg, autosave);
+        return saveDocumentActual(filename, errMsg, autosave, cacheFileName);
     }
 
     QTemporaryFile temp(filename + ".");
@@ -1214,7 +1395,10 @@ bool RosegardenDocument::saveDocument(const QString& filename,
         return false;
     }
 
-    bool success = saveDocumentActual(tempFileName, errMsg, autosave);
+    // If the rename below fails, the cache will not match the file
+    // left behind, and so will not be used
+    bool success = saveDocumentActual(tempFileName, errMsg, autosave,
+                                      cacheFileName);
 
     if (!success) {
         // errMsg should be already set
@@ -1237,26 +1421,12 @@ bool RosegardenDocument::saveDocument(const QString& filename,
 
 bool RosegardenDocument::saveDocumentActual(const QString& filename,
                                           QString& errMsg,
-                                          bool autosave)
+                                          bool autosave,
+                                          QString cacheFileName)
 {
     Profiler profiler("RosegardenDocument::saveDocumentActual");
     RG_DEBUG << "RosegardenDocument::saveDocumentActual(" << filename << ")\n";
 
-    QString outText;
-    QTextStream outStream(&outText, QIODevice::WriteOnly);
-//    outStream.setEncoding(QTextStream::UnicodeUTF8); qt3
-    outStream.setCodec("UTF-8");
-
-    // output XML header
-    //
-    outStream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-    << "<!DOCTYPE rosegarden-data>\n"
-    << "<rosegarden-data version=\"" << VERSION
-    << "\" format-version-major=\"" << FILE_FORMAT_VERSION_MAJOR
-    << "\" format-version-minor=\"" << FILE_FORMAT_VERSION_MINOR
-    << "\" format-version-point=\"" << FILE_FORMAT_VERSION_POINT
-    << "\">\n";
-
     ProgressDialog *progress = 0;
 
 // Disable the progress dialog on saving in all cases, because the alternative
@@ -1269,6 +1439,63 @@ bool RosegardenDocument::saveDocumentActual(const QString& filename,
 //
 //    }
 
+    // Nothing changes the document while we save it here, so the
+    // snapshot can refer to our own events rather than copying them
+    DocumentSnapshot snapshot(false);
+    snapshotDocument(snapshot, progress);
+
+    if (!snapshot.writeToFile(filename, errMsg)) {
+        return false;
+    }
+
+    // The document is saved whether or not the cache can be written;
+    // without one it is just loaded from the file as usual
+    if (!cacheFileName.isEmpty()) {
+        QString cacheErrMsg;
+        if (!DocumentCache::write(cacheFileName, filename, snapshot,
+                                  cacheErrMsg)) {
+            RG_DEBUG << "RosegardenDocument::saveDocumentActual: "
+                     << "failed to write cache: " << cacheErrMsg << endl;
+            QFile::remove(cacheFileName);
+        }
+    }
+
+    if (progress) {
+        progress->setValue(100);
+    }
+
+    RG_DEBUG << endl << "RosegardenDocument::saveDocument() finished\n";
+
+    if (!autosave) {
+        emit documentModified(false);
+        setModified(false);
+        if (!m_headless) CommandHistory::getInstance()->documentSaved();
+        }
+    if (progress) {
+        progress->close();     // is deleteOnClose
+        progress = 0;
+    }
+
+    setAutoSaved(true);
+
+    return true;
+}
+
+void RosegardenDocument::snapshotDocument(DocumentSnapshot &snapshot,
+                                          ProgressDialog *progress)
+{
+    QTextStream &outStream = snapshot.getStream();
+
+    // output XML header
+    //
+    outStream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    << "<!DOCTYPE rosegarden-data>\n"
+    << "<rosegarden-data version=\"" << VERSION
+    << "\" format-version-major=\"" << FILE_FORMAT_VERSION_MAJOR
+    << "\" format-version-minor=\"" << FILE_FORMAT_VERSION_MINOR
+    << "\" format-version-point=\"" << FILE_FORMAT_VERSION_POINT
+    << "\">\n";
+
     // First make sure all MIDI devices know their current connections
     //
     m_studio.resyncDeviceConnections();
@@ -1350,10 +1577,10 @@ bool RosegardenDocument::saveDocumentActual(const QString& filename,
               .arg(segment->getLinkTransposeParams().m_transposeSegmentBack
                                                          ? "true" : "false");
 
-            saveSegment(outStream, segment, progress, totalEvents, 
+            saveSegment(snapshot, segment, progress, totalEvents, 
                                             eventCount, linkedSegAtts);
         } else {
-            saveSegment(outStream, segment, progress, totalEvents, eventCount);
+            saveSegment(snapshot, segment, progress, totalEvents, eventCount);
         }
 
     }
@@ -1379,7 +1606,7 @@ bool RosegardenDocument::saveDocumentActual(const QString& filename,
                               .arg(strtoqstr((*ci)->getDefaultTimeAdjust()));
 
         Segment *segment = (*ci)->getSegment();
-        saveSegment(outStream, segment, progress, totalEvents, eventCount, triggerAtts);
+        saveSegment(snapshot, segment, progress, totalEvents, eventCount, triggerAtts);
     }
 
     if (progress) {
@@ -1411,32 +1638,6 @@ bool RosegardenDocument::saveDocumentActual(const QString& filename,
     // close the top-level XML tag
     //
     outStream << "</rosegarden-data>\n";
-
-    bool okay = GzipFile::writeToFile(filename, outText);
-    if (!okay) {
-        errMsg = tr("Error while writing on '%1'").arg(filename);
-        return false;
-    }
-
-    if (progress) {
-        progress->setValue(100);
-    }
-
-    RG_DEBUG << endl << "RosegardenDocument::saveDocument() finished\n";
-
-    if (!autosave) {
-        emit documentModified(false);
-        setModified(false);
-        CommandHistory::getInstance()->documentSaved();
-        }
-    if (progress) {
-        progress->close();     // is deleteOnClose
-        progress = 0;
-    }
-
-    setAutoSaved(true);
-
-    return true;
 }
 
 bool RosegardenDocument::exportStudio(const QString& filename,
@@ -1447,8 +1648,13 @@ bool RosegardenDocument::exportStudio(const QString& filename,
     RG_DEBUG << "RosegardenDocument::exportStudio("
     << filename << ")\n";
 
-    QString outText;
-    QTextStream outStream(&outText, QIODevice::WriteOnly);
+    GzipDevice file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        errMsg = tr("Could not open file '%1' for writing").arg(filename);
+        return false;
+    }
+
+    QTextStream outStream(&file);
 //    outStream.setEncoding(QTextStream::UnicodeUTF8); qt3
     outStream.setCodec("UTF-8");
 
@@ -1466,9 +1672,12 @@ bool RosegardenDocument::exportStudio(const QString& filename,
     //
     outStream << "</rosegarden-data>\n";
 
-    bool okay = GzipFile::writeToFile(filename, outText);
-    if (!okay) {
-        errMsg = tr("Could not open file '%1' for writing").arg(filename);
+    outStream.flush();
+    bool okay = (outStream.status() == QTextStream::Ok);
+    file.close();
+
+    if (!okay || file.hasWriteError()) {
+        errMsg = tr("Error while writing on '%1'").arg(filename);
         return false;
     }
 
@@ -1476,10 +1685,11 @@ bool RosegardenDocument::exportStudio(const QString& filename,
     return true;
 }
 
-void RosegardenDocument::saveSegment(QTextStream& outStream, Segment *segment,
+void RosegardenDocument::saveSegment(DocumentSnapshot &snapshot, Segment *segment,
                                    ProgressDialog* progress, long totalEvents, long &count,
                                    QString extraAttributes)
 {
+    QTextStream &outStream = snapshot.getStream();
     QString time;
 
     outStream << QString("<%1 track=\"%2\" start=\"%3\" ")
@@ -1581,54 +1791,13 @@ void RosegardenDocument::saveSegment(QTextStream& outStream, Segment *segment,
     {
         outStream << "\">\n";
 
-        bool inChord = false;
-        timeT chordStart = 0, chordDuration = 0;
-        timeT expectedTime = segment->getStartTime();
-
-        for (Segment::iterator i = segment->begin();
-                i != segment->end(); ++i) {
-
-            timeT absTime = (*i)->getAbsoluteTime();
-
-            Segment::iterator nextEl = i;
-            ++nextEl;
-
-            if (nextEl != segment->end() &&
-                    (*nextEl)->getAbsoluteTime() == absTime &&
-                    (*i)->getDuration() != 0 &&
-                    !inChord) {
-                outStream << "<chord>" << endl;
-                inChord = true;
-                chordStart = absTime;
-                chordDuration = 0;
-            }
-
-            if (inChord && (*i)->getDuration() > 0)
-                if (chordDuration == 0 || (*i)->getDuration() < chordDuration)
-                    chordDuration = (*i)->getDuration();
-
-            outStream << '\t'
-            << strtoqstr((*i)->toXmlString(expectedTime)) << endl;
-
-            if (nextEl != segment->end() &&
-                    (*nextEl)->getAbsoluteTime() != absTime &&
-                    inChord) {
-                outStream << "</chord>\n";
-                inChord = false;
-                expectedTime = chordStart + chordDuration;
-            } else if (inChord) {
-                expectedTime = absTime;
-            } else {
-                expectedTime = absTime + (*i)->getDuration();
-            }
+        // The events go in as they are, to be written out between
+        // this and what follows
+        snapshot.addEvents(*segment);
 
-            if ((++count % 500 == 0) && progress) {
-                progress->setValue(count * 100 / totalEvents);
-            }
-        }
-
-        if (inChord) {
-            outStream << "</chord>\n";
+        count += long(segment->size());
+        if (progress && totalEvents > 0) {
+            progress->setValue(count * 100 / totalEvents);
         }
 
         // Add EventRulers to segment - we call them controllers because of
@@ -1670,25 +1839,25 @@ bool RosegardenDocument::isSequencerRunning()
 }
 
 bool
-RosegardenDocument::xmlParse(QString fileContents, QString &errMsg,
+RosegardenDocument::xmlParse(QIODevice &file, QString &errMsg,
                            ProgressDialog *progress,
                            bool permanent,
-                           bool &cancelled)
+                           bool &cancelled,
+                           const DocumentCache *cache,
+                           ParallelSegmentLoader *segmentLoader)
 {
     Profiler profiler("RosegardenDocument::xmlParse");
 
     cancelled = false;
 
-    unsigned int elementCount = 0;
-    for (int i = 0; i < fileContents.length() - 1; ++i) {
-        if (fileContents[i] == '<' && fileContents[i+1] != '/') {
-            ++elementCount;
-        }
-    }
-
     if (permanent) RosegardenSequencer::getInstance()->removeAllDevices();
 
-    RoseXmlHandler handler(this, elementCount, permanent);
+    RoseXmlHandler handler(this, &file, permanent);
+    handler.setEventCache(cache);
+    handler.setSegmentLoader(segmentLoader);
+
+    // Read errors are only known for a compressed file
+    GzipDevice *gzipFile = dynamic_cast<GzipDevice *>(&file);
 
     if (progress) {
         RG_DEBUG << "RosegardenDocument::xmlParse(), have progress dialog.";
@@ -1700,14 +1869,22 @@ RosegardenDocument::xmlParse(QString fileContents, QString &errMsg,
                 &handler, SLOT(slotCancel()));                
     }
 
-    QXmlInputSource source;
-    source.setData(fileContents);
+    // The input source pulls the document from the file in small
+    // chunks as the reader needs them
+    QXmlInputSource source(&file);
     QXmlSimpleReader reader;
     reader.setContentHandler(&handler);
     reader.setErrorHandler(&handler);
 
     bool ok = reader.parse(source);
 
+    // A truncated or corrupt file shows up as a parse error, but
+    // the file's own error says more about it
+    if (gzipFile && gzipFile->hasReadError()) {
+        errMsg = gzipFile->errorString();
+        return false;
+    }
+
     if (!ok) {
 
         if (handler.isCancelled()) {
@@ -39,6 +39,7 @@
 
 class QWidget;
 class QTextStream;
+class QIODevice;
 class NoteOnRecSet;
 
 
@@ -48,6 +49,10 @@ namespace Rosegarden
 class SequenceManager;
 class RosegardenMainViewWidget;
 class ProgressDialog;
+class DocumentCache;
+class ParallelSegmentLoader;
+class DocumentSnapshot;
+class AutoSaveThread;
 class MappedEventList;
 class Event;
 class EditViewBase;
@@ -444,6 +449,21 @@ public:
 
     bool isBeingDestroyed() { return m_beingDestroyed; }
 
+    /**
+     * A headless document is loaded and saved with no user interface
+     * at all, as by the batch converter: problems are written to
+     * stderr rather than shown in dialogs, and it leaves the shared
+     * command history alone.
+     */
+    void setHeadless(bool headless) { m_headless = headless; }
+    bool isHeadless() const { return m_headless; }
+
+    /**
+     * Whether the last openDocument() took the document from the
+     * fast-load cache beside the file, rather than from the file.
+     */
+    bool isLoadedFromCache() const { return m_loadedFromCache; }
+
     static const unsigned int MinNbOfTracks; // 64
 
     /// Verify that the audio path exists and can be written to.
@@ -468,10 +488,17 @@ public slots:
     void slotDocumentRestored();
 
     /**
-     * saves the document to a suitably-named backup file
+     * saves the document to a suitably-named backup file.  The
+     * document is snapshotted here and written out in the background
+     * by an AutoSaveThread, so editing can go on meanwhile.
      */
     void slotAutoSave();
 
+    /**
+     * called when the AutoSaveThread started by slotAutoSave() is done
+     */
+    void slotAutoSaveFinished();
+
     void slotSetPointerPosition(timeT);
 
     void slotSetLoop(timeT s, timeT e) {setLoop(s,e);}
@@ -533,7 +560,10 @@ protected:
     void performAutoload();
 
     /**
-     * Parse the Rosegarden file in \a file
+     * Parse the Rosegarden XML in \a file, which must be open.  If
+     * \a cache is given, the XML is that of the cache, whose events
+     * are read from it.  Likewise if \a segmentLoader is given, the
+     * XML is its skeleton, and the events are taken from it.
      *
      * \a errMsg will contains the error messages
      * if parsing failed.
@@ -541,10 +571,12 @@ protected:
      * @return false if parsing failed
      * @see RoseXmlHandler
      */
-    bool xmlParse(QString fileContents, QString &errMsg,
+    bool xmlParse(QIODevice &file, QString &errMsg,
                   ProgressDialog *progress,
                   bool permanent,
-                  bool &cancelled);
+                  bool &cancelled,
+                  const DocumentCache *cache = 0,
+                  ParallelSegmentLoader *segmentLoader = 0);
 
     /**
      * Set the "auto saved" status of the document
@@ -568,18 +600,31 @@ protected:
      * save of the file to the given filename; saveDocument() wraps
      * this, saving to a temporary file and then renaming to the
      * required file, so as not to lose the original if a failure
-     * occurs during overwriting.
+     * occurs during overwriting.  If cacheFileName is given, a
+     * DocumentCache is written there too.
      */
     bool saveDocumentActual(const QString &filename, QString& errMsg,
-                            bool autosave = false);
+                            bool autosave = false,
+                            QString cacheFileName = QString::null);
+
+    /**
+     * Write the whole document into the given snapshot, ready to be
+     * written out to a file
+     */
+    void snapshotDocument(DocumentSnapshot &, ProgressDialog *);
 
     /**
-     * Save one segment to the given text stream
+     * Save one segment to the given snapshot
      */
-    void saveSegment(QTextStream&, Segment*, ProgressDialog*,
+    void saveSegment(DocumentSnapshot &, Segment*, ProgressDialog*,
                      long totalNbOfEvents, long &count,
                      QString extraAttributes = QString::null);
 
+    /**
+     * If an autosave is under way, wait for it to finish
+     */
+    void waitForAutoSave();
+
     bool deleteOrphanedAudioFiles(bool documentWillNotBeSaved);
 
 
@@ -738,6 +783,11 @@ protected:
      */
     int m_autoSavePeriod;
 
+    /**
+     * The autosave being written, if any
+     */
+    AutoSaveThread *m_autoSaveThread;
+
     // Set to true when the dtor starts
     bool m_beingDestroyed;
 
@@ -746,6 +796,10 @@ protected:
      * construction.  Usually true.
      */
     bool m_clearCommandHistory;
+
+    bool m_headless;
+
+    bool m_loadedFromCache;
 };
 
 
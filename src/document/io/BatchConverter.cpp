@@ -0,0 +1,409 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+
+#include "BatchConverter.h"
+
+#include "LilyPondExporter.h"
+#include "MusicXmlExporter.h"
+#include "base/AnalysisTypes.h"
+#include "base/BaseProperties.h"
+#include "base/Composition.h"
+#include "base/CompositionTimeSliceAdapter.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "base/SegmentNotationHelper.h"
+#include "commands/edit/EventQuantizeCommand.h"
+#include "document/CommandHistory.h"
+#include "document/RosegardenDocument.h"
+#include "gui/general/ResourceFinder.h"
+#include "misc/ConfigGroups.h"
+#include "misc/Strings.h"
+#include "sound/MidiFile.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMap>
+#include <QSet>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTime>
+
+#include <iostream>
+#include <cstdio>
+
+
+namespace Rosegarden
+{
+
+namespace
+{
+
+class ConvertTask : public QRunnable
+{
+public:
+    ConvertTask(BatchConverter *converter, int input) :
+        m_converter(converter), m_input(input) { }
+
+    virtual void run() { m_converter->convert(m_input); }
+
+private:
+    BatchConverter *m_converter;
+    int m_input;
+};
+
+bool
+isMIDIFile(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    return (suffix == "mid" || suffix == "midi");
+}
+
+}
+
+bool
+BatchConverter::getFormat(const QString &name, Format &format)
+{
+    QString lcName = name.toLower();
+
+    if (lcName == "rg") format = RosegardenFormat;
+    else if (lcName == "ly") format = LilyPondFormat;
+    else if (lcName == "xml") format = MusicXmlFormat;
+    else return false;
+
+    return true;
+}
+
+BatchConverter::BatchConverter(Format format, const QString &outputDir,
+                               int threads) :
+    m_format(format),
+    m_outputDir(outputDir),
+    m_threads(threads),
+    m_failures(0),
+    m_bytes(0)
+{
+}
+
+bool
+BatchConverter::addInput(const QString &path)
+{
+    QFileInfo info(path);
+
+    if (info.isDir()) {
+        QStringList filters;
+        filters << "*.mid" << "*.midi" << "*.MID" << "*.MIDI" << "*.rg";
+        QStringList files = QDir(path).entryList(filters, QDir::Files,
+                                                 QDir::Name);
+        for (int i = 0; i < files.size(); ++i) {
+            m_inputs.push_back(QDir(path).filePath(files[i]));
+        }
+        return true;
+    }
+
+    if (!info.isFile()) return false;
+
+    m_inputs.push_back(path);
+    return true;
+}
+
+int
+BatchConverter::run()
+{
+    // Create the shared command history here rather than racing to do
+    // so on the worker threads.  Headless documents don't otherwise
+    // use it.
+    (void)CommandHistory::getInstance();
+
+    // The same goes for these, which fill in tables of their own on
+    // first use, and are used by the MIDI import and the exporters
+    (void)BaseProperties::getMarkPropertyName(0);
+    (void)Accidentals::getStandardAccidentals();
+    (void)Marks::getStandardMarks();
+
+    m_failures = 0;
+    m_bytes = 0;
+
+    QTime timer;
+    timer.start();
+
+    QThreadPool pool;
+    if (m_threads > 0) pool.setMaxThreadCount(m_threads);
+
+    std::cout << "Converting " << m_inputs.size() << " files on "
+              << pool.maxThreadCount() << " threads" << std::endl;
+
+    // Work out every output before starting, as the jobs run at the
+    // same time: none may write a file that another is reading, or
+    // that another is also writing
+    QSet<QString> inputPaths;
+    QMap<QString, int> outputCounts;
+    m_outputs.clear();
+
+    for (int i = 0; i < m_inputs.size(); ++i) {
+        inputPaths.insert(QFileInfo(m_inputs[i]).absoluteFilePath());
+        m_outputs.push_back(getOutputFileName(m_inputs[i]));
+        ++outputCounts[QFileInfo(m_outputs[i]).absoluteFilePath()];
+    }
+
+    for (int i = 0; i < m_inputs.size(); ++i) {
+
+        QString outputPath = QFileInfo(m_outputs[i]).absoluteFilePath();
+        QString errMsg;
+
+        if (inputPaths.contains(outputPath)) {
+            errMsg = QObject::tr("The output file %1 would overwrite an input")
+                .arg(m_outputs[i]);
+        } else if (outputCounts[outputPath] > 1) {
+            errMsg = QObject::tr("The output file %1 would also be written "
+                                 "from another input").arg(m_outputs[i]);
+        }
+
+        if (errMsg != "") {
+            ++m_failures;
+            std::cout << "   skipped  " << m_inputs[i] << ": FAILED: "
+                      << errMsg << std::endl;
+            continue;
+        }
+
+        pool.start(new ConvertTask(this, i));
+    }
+
+    pool.waitForDone();
+
+    double secs = timer.elapsed() / 1000.0;
+    if (secs <= 0) secs = 0.001;
+
+    char line[200];
+    sprintf(line, "Converted %d of %d files in %.3f s: "
+            "%.2f files/s, %.2f MB/s read",
+            m_inputs.size() - m_failures, m_inputs.size(), secs,
+            m_inputs.size() / secs, m_bytes / secs / 1048576.0);
+    std::cout << line << std::endl;
+
+    return m_failures;
+}
+
+void
+BatchConverter::convert(int input)
+{
+    QString inputFileName = m_inputs[input];
+    QString outputFileName = m_outputs[input];
+    qint64 bytes = QFileInfo(inputFileName).size();
+
+    QTime timer;
+    timer.start();
+
+    QString errMsg;
+
+    // A document of our own, with no main window, no autoload and no
+    // claim on the command history
+    RosegardenDocument doc(0, 0, true, false);
+    doc.setHeadless(true);
+
+    bool ok = (load(&doc, inputFileName, errMsg) &&
+               save(&doc, outputFileName, errMsg));
+
+    double secs = timer.elapsed() / 1000.0;
+
+    QMutexLocker locker(&m_mutex);
+
+    char time[20];
+    sprintf(time, "%8.3f s  ", secs);
+
+    if (ok) {
+        m_bytes += bytes;
+        std::cout << time << inputFileName << " -> " << outputFileName
+                  << std::endl;
+    } else {
+        ++m_failures;
+        std::cout << time << inputFileName << ": FAILED: " << errMsg
+                  << std::endl;
+    }
+}
+
+bool
+BatchConverter::load(RosegardenDocument *doc, const QString &fileName,
+                     QString &errMsg)
+{
+    if (isMIDIFile(fileName)) return importMIDI(doc, fileName, errMsg);
+
+    // Errors are written to stderr by the document
+    if (!doc->openDocument(fileName, false, true)) {
+        errMsg = QObject::tr("Could not read Rosegarden file");
+        return false;
+    }
+
+    return true;
+}
+
+bool
+BatchConverter::importMIDI(RosegardenDocument *doc, const QString &fileName,
+                           QString &errMsg)
+{
+    // The autoload document supplies the studio, as it does when
+    // importing from the GUI, but is not allowed near the sequencer
+    QString autoloadFile = ResourceFinder().getAutoloadPath();
+    if (autoloadFile != "" && QFileInfo(autoloadFile).isReadable()) {
+        doc->openDocument(autoloadFile, false, true);
+    }
+
+    MidiFile midiFile(fileName, &doc->getStudio());
+
+    if (!midiFile.open()) {
+        errMsg = strtoqstr(midiFile.getError());
+        return false;
+    }
+
+    Composition *comp = &doc->getComposition();
+
+    if (!midiFile.convertToRosegarden(*comp, MidiFile::CONVERT_REPLACE)) {
+        errMsg = QObject::tr("Could not convert MIDI file");
+        return false;
+    }
+
+    doc->setTitle(QFileInfo(fileName).fileName());
+    doc->setAbsFilePath(QFileInfo(fileName).absoluteFilePath());
+
+    // The same clean-ups for notation as RosegardenMainWindow makes
+    // when importing a MIDI file, but applied directly rather than
+    // through the command history
+
+    for (Composition::iterator i = comp->begin(); i != comp->end(); ++i) {
+
+        Segment &segment = **i;
+        SegmentNotationHelper helper(segment);
+        segment.insert(helper.guessClef(segment.begin(),
+                                        segment.getEndMarker())
+                       .getAsEvent(segment.getStartTime()));
+    }
+
+    for (Composition::iterator i = comp->begin(); i != comp->end(); ++i) {
+
+        // find first key event in each segment (we'd have done the
+        // same for clefs, except there is no MIDI clef event)
+
+        Segment &segment = **i;
+        timeT firstKeyTime = segment.getEndMarkerTime();
+
+        for (Segment::iterator si = segment.begin();
+             segment.isBeforeEndMarker(si); ++si) {
+            if ((*si)->isa(Rosegarden::Key::EventType)) {
+                firstKeyTime = (*si)->getAbsoluteTime();
+                break;
+            }
+        }
+
+        if (firstKeyTime > segment.getStartTime()) {
+            CompositionTimeSliceAdapter adapter
+                (comp, timeT(0), firstKeyTime);
+            AnalysisHelper helper;
+            segment.insert(helper.guessKey(adapter).getAsEvent
+                           (segment.getStartTime()));
+        }
+    }
+
+    for (Composition::iterator i = comp->begin(); i != comp->end(); ++i) {
+
+        Segment &segment = **i;
+
+        EventQuantizeCommand command
+            (segment, segment.getStartTime(), segment.getEndMarkerTime(),
+             NotationOptionsConfigGroup,
+             EventQuantizeCommand::QUANTIZE_NOTATION_ONLY);
+
+        command.execute();
+    }
+
+    if (comp->getTimeSignatureCount() == 0) {
+        CompositionTimeSliceAdapter adapter(comp);
+        AnalysisHelper analysisHelper;
+        TimeSignature timeSig =
+            analysisHelper.guessTimeSignature(adapter);
+        comp->addTimeSignature(0, timeSig);
+    }
+
+    return true;
+}
+
+bool
+BatchConverter::save(RosegardenDocument *doc, const QString &fileName,
+                     QString &errMsg)
+{
+    switch (m_format) {
+
+    case RosegardenFormat:
+        return doc->saveDocument(fileName, errMsg);
+
+    case LilyPondFormat:
+    {
+        LilyPondExporter exporter((RosegardenMainWindow *)0, doc,
+                                  std::string(fileName.toLocal8Bit()));
+        if (!exporter.write()) {
+            errMsg = exporter.getMessage();
+            return false;
+        }
+        return true;
+    }
+
+    case MusicXmlFormat:
+    {
+        MusicXmlExporter exporter((RosegardenMainWindow *)0, doc,
+                                  std::string(fileName.toLocal8Bit()));
+        if (!exporter.write()) {
+            errMsg = QObject::tr("Could not write MusicXML file");
+            return false;
+        }
+        return true;
+    }
+    }
+
+    return false;
+}
+
+QString
+BatchConverter::getOutputFileName(const QString &inputFileName) const
+{
+    QFileInfo info(inputFileName);
+    QString baseName = info.completeBaseName();
+
+    QString suffix;
+    switch (m_format) {
+    case RosegardenFormat: suffix = "rg"; break;
+    case LilyPondFormat:
+        // LilyPond doesn't allow these, and the exporter would
+        // otherwise stop to ask about them
+        baseName.replace(' ', '_');
+        baseName.replace('\\', '_');
+        suffix = "ly";
+        break;
+    case MusicXmlFormat: suffix = "xml"; break;
+    }
+
+    QDir dir(m_outputDir.isEmpty() ? info.absolutePath() : m_outputDir);
+    QString fileName = dir.filePath(baseName + "." + suffix);
+
+    // The LilyPond exporter drops some other characters from the name
+    // itself, so report the file it will really write
+    if (m_format == LilyPondFormat) {
+        fileName = LilyPondExporter::getLegalFileName(fileName);
+    }
+
+    return fileName;
+}
+
+
+}
@@ -0,0 +1,112 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_BATCHCONVERTER_H
+#define RG_BATCHCONVERTER_H
+
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+
+namespace Rosegarden
+{
+
+class RosegardenDocument;
+
+
+/**
+ * Converts many files at once, from the command line and with no user
+ * interface: MIDI files to Rosegarden documents, and either of those
+ * to LilyPond or MusicXML.
+ *
+ * Each file is a separate job with a document of its own, and the jobs
+ * run on a pool of worker threads.  The documents are headless (see
+ * RosegardenDocument::setHeadless()) and are never shown, and the
+ * sequencer is not involved at all.  The time taken for each file is
+ * printed as it is done, and the overall throughput at the end.
+ */
+
+class BatchConverter
+{
+public:
+    enum Format {
+        RosegardenFormat,
+        LilyPondFormat,
+        MusicXmlFormat
+    };
+
+    /**
+     * Find the output format with the given name (rg, ly or xml).
+     * Returns false if there is none.
+     */
+    static bool getFormat(const QString &name, Format &format);
+
+    /**
+     * Converted files are written to outputDir, or if that is empty,
+     * beside the files they were converted from.
+     */
+    BatchConverter(Format format, const QString &outputDir, int threads);
+
+    /**
+     * Add a file to be converted, or all the MIDI and Rosegarden files
+     * in a directory.  Returns false if there is no such file or
+     * directory.
+     */
+    bool addInput(const QString &path);
+
+    int getInputCount() const { return m_inputs.size(); }
+
+    /**
+     * Convert all the inputs, and return the number that failed.
+     * An input whose output would overwrite any of the inputs, or
+     * would also be written from another input, is not converted
+     * and counts as failed.
+     */
+    int run();
+
+    /**
+     * Convert one input to its output, as worked out by run().
+     * Called on the worker threads.
+     */
+    void convert(int input);
+
+private:
+    bool load(RosegardenDocument *doc, const QString &fileName,
+              QString &errMsg);
+    bool importMIDI(RosegardenDocument *doc, const QString &fileName,
+                    QString &errMsg);
+    bool save(RosegardenDocument *doc, const QString &fileName,
+              QString &errMsg);
+    QString getOutputFileName(const QString &inputFileName) const;
+
+    Format m_format;
+    QString m_outputDir;
+    int m_threads;
+    QStringList m_inputs;
+    QStringList m_outputs;      // one for each input, set by run()
+
+    // Guards the output and the totals
+    QMutex m_mutex;
+    int m_failures;
+    qint64 m_bytes;
+};
+
+
+}
+
+#endif
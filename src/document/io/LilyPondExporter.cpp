@@ -90,7 +90,8 @@ LilyPondExporter::LilyPondExporter(RosegardenMainWindow *parent,
 {
     m_composition = &m_doc->getComposition();
     m_studio = &m_doc->getStudio();
-    m_view = ((RosegardenMainWindow *)parent)->getView();
+    // There is no main window when exporting from the command line
+    m_view = (parent ? parent->getView() : NULL);
     m_notationView = NULL;
 
     readConfigVariables();
@@ -598,29 +599,38 @@ struct MarkerComp {
     }
 };
 
-bool
-LilyPondExporter::write()
+QString
+LilyPondExporter::getLegalFileName(const QString &fileName)
 {
-    m_warningMessage = "";
-    QString tmpName = strtoqstr(m_fileName);
-
     // dmm - modified to act upon the filename itself, rather than the whole
     // path; fixes bug #855349
 
     // split name into parts:
-    QFileInfo nfo(tmpName);
+    QFileInfo nfo(fileName);
     QString dirName = nfo.path();
     QString baseName = nfo.fileName();
 
     // sed LilyPond-choking chars out of the filename proper
-    bool illegalFilename = (baseName.contains(' ') || baseName.contains("\\"));
     baseName.replace(QRegExp(" "), "");
     baseName.replace(QRegExp("\\\\"), "");
     baseName.replace(QRegExp("'"), "");
     baseName.replace(QRegExp("\""), "");
 
     // cat back together
-    tmpName = dirName + '/' + baseName;
+    return dirName + '/' + baseName;
+}
+
+bool
+LilyPondExporter::write()
+{
+    m_warningMessage = "";
+    QString tmpName = strtoqstr(m_fileName);
+
+    QString baseName = QFileInfo(tmpName).fileName();
+    bool illegalFilename = (baseName.contains(' ') || baseName.contains("\\"));
+
+    tmpName = getLegalFileName(tmpName);
+    baseName = QFileInfo(tmpName).fileName();
 
     if (illegalFilename) {
         CurrentProgressDialog::freeze();
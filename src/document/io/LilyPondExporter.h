@@ -99,6 +99,13 @@ public:
     */
     QString getMessage() { return m_warningMessage; }
 
+   /**
+    * @return the name of the file that write() actually writes when
+    * asked for the given one, which leaves out any characters
+    * LilyPond does not allow in a filename.
+    */
+    static QString getLegalFileName(const QString &fileName);
+
 protected:
     RosegardenMainViewWidget *m_view;
     NotationView *m_notationView;
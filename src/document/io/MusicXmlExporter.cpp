@@ -53,7 +53,8 @@ MusicXmlExporter::MusicXmlExporter(RosegardenMainWindow *parent,
         m_fileName(fileName)
 {
     m_composition = &m_doc->getComposition();
-    m_view = parent->getView();
+    // There is no main window when exporting from the command line
+    m_view = (parent ? parent->getView() : 0);
     readConfigVariables();
 }
 
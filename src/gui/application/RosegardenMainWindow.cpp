@@ -272,6 +272,7 @@ RosegardenMainWindow::RosegardenMainWindow(bool useSequencer,
     m_jackProcess(0),
 #endif
     m_cpuBar(0),
+    m_undoMemoryLabel(0),
     m_zoomSlider(0),
     m_zoomLabel(0),
     m_statusBarLabel1(0),
@@ -1083,6 +1084,14 @@ RosegardenMainWindow::initStatusBar()
     m_cpuBar->setTextVisible(false);
     statusBar()->addPermanentWidget(m_cpuBar);
 
+    m_undoMemoryLabel = new QLabel(statusBar());
+    m_undoMemoryLabel->setFont(font);
+    statusBar()->addPermanentWidget(m_undoMemoryLabel);
+
+    CommandHistory *history = CommandHistory::getInstance();
+    connect(history, SIGNAL(memoryUseChanged(qint64, qint64)),
+            this, SLOT(slotUpdateUndoMemory(qint64, qint64)));
+
     // status warning widget replaces a glob of annoying startup dialogs
     m_warningWidget = new WarningWidget(this);
 
@@ -1101,8 +1110,15 @@ RosegardenMainWindow::initStatusBar()
     QSettings settings;
     settings.beginGroup(GeneralOptionsConfigGroup);
     bool safeGraphics = (settings.value("graphics_system", Native).toInt() == Native);
+
+    // Megabytes the undo history may use, 0 for no limit, and whether
+    // to spill old commands to disk rather than discard them
+    history->setMemoryLimit(size_t(settings.value("undo_memory_limit_mb", 256).toUInt()) * 1024 * 1024);
+    history->setSpillEnabled(settings.value("undo_spill", true).toBool());
     settings.endGroup();
+
     m_warningWidget->setGraphicsAdvisory(safeGraphics);
+    slotUpdateUndoMemory(history->getMemoryUse(), history->getSpilledBytes());
 
     statusBar()->addPermanentWidget(m_warningWidget);
     statusBar()->setContentsMargins(0, 0, 0, 0);
@@ -1797,6 +1813,8 @@ RosegardenMainWindow::saveGlobalProperties()
 
         QString tempname = AutoSaveFinder().getAutoSavePath(filename);
         if (tempname != "") {
+            // an autosave in progress would be writing to the same file
+            m_doc->waitForAutoSave();
             QString errMsg;
             bool res = m_doc->saveDocument(tempname, errMsg);
             if (!res) {
@@ -5041,6 +5059,26 @@ RosegardenMainWindow::slotUpdateCPUMeter()
     }
 }
 
+void
+RosegardenMainWindow::slotUpdateUndoMemory(qint64 inMemory, qint64 onDisk)
+{
+    if (!m_undoMemoryLabel) return;
+
+    qint64 limit = qint64(CommandHistory::getInstance()->getMemoryLimit());
+
+    QString text = tr("Undo: %1K").arg(inMemory / 1024);
+    if (onDisk > 0) text += tr(" + %1K on disk").arg(onDisk / 1024);
+    m_undoMemoryLabel->setText(text);
+
+    if (limit > 0) {
+        m_undoMemoryLabel->setToolTip
+            (tr("Memory used by the undo history, of a limit of %1K")
+             .arg(limit / 1024));
+    } else {
+        m_undoMemoryLabel->setToolTip(tr("Memory used by the undo history"));
+    }
+}
+
 void
 RosegardenMainWindow::slotUpdateMonitoring()
 {
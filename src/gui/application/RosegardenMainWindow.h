@@ -1659,6 +1659,9 @@ private:
      * now private.
      */
     ProgressBar *m_cpuBar;
+
+    /// Memory used by the undo history, in the status bar
+    QLabel *m_undoMemoryLabel;
     
     ZoomSlider<double> *m_zoomSlider;
     QLabel             *m_zoomLabel;
@@ -1777,6 +1780,11 @@ private slots:
      */
     void slotUpdateCPUMeter();
 
+    /**
+     * Show the memory used by the undo history
+     */
+    void slotUpdateUndoMemory(qint64 inMemory, qint64 onDisk);
+
     /// Toggles mute state of the currently selected track.
     void slotToggleMute();
     void slotMuteAllTracks();
@@ -22,6 +22,7 @@
 #include "gui/widgets/ProgressDialog.h"
 #include "gui/widgets/CurrentProgressDialog.h"
 #include "document/RosegardenDocument.h"
+#include "document/io/BatchConverter.h"
 #include "gui/widgets/StartupLogo.h"
 #include "gui/general/ResourceFinder.h"
 #include "gui/general/IconLoader.h"
@@ -353,9 +354,64 @@ void usage()
     std::cerr << "Rosegarden: A sequencer and musical notation editor" << std::endl;
     std::cerr << "Usage: rosegarden [--nosplash] [--nosequencer] [file.rg]" << std::endl;
     std::cerr << "       rosegarden --version" << std::endl;
+    std::cerr << "       rosegarden --convert <rg|ly|xml> [--threads N] [--output dir] file-or-dir..." << std::endl;
     exit(2);
 }
 
+// Convert files with no user interface: see BatchConverter.
+// Arguments are those following --convert.
+
+int convertFiles(int argc, char *argv[], int first)
+{
+    if (first >= argc) usage();
+
+    BatchConverter::Format format;
+    if (!BatchConverter::getFormat(argv[first], format)) usage();
+
+    int threads = 0;
+    QString outputDir;
+    QStringList inputs;
+
+    for (int i = first + 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--threads")) {
+            if (++i >= argc) usage();
+            threads = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "--output")) {
+            if (++i >= argc) usage();
+            outputDir = QString::fromLocal8Bit(argv[i]);
+        } else {
+            inputs << QString::fromLocal8Bit(argv[i]);
+        }
+    }
+
+    if (inputs.empty()) usage();
+
+    // No windows, but the same settings as the GUI
+    QApplication app(argc, argv, false);
+    app.setOrganizationName("rosegardenmusic");
+    app.setOrganizationDomain("rosegardenmusic.com");
+    app.setApplicationName(QObject::tr("Rosegarden"));
+
+    if (outputDir != "" && !QDir(outputDir).exists() &&
+        !QDir().mkpath(outputDir)) {
+        std::cerr << "Cannot create output directory " << outputDir
+                  << std::endl;
+        return 2;
+    }
+
+    BatchConverter converter(format, outputDir, threads);
+
+    for (int i = 0; i < inputs.size(); ++i) {
+        if (!converter.addInput(inputs[i])) {
+            std::cerr << "No such file or directory: " << inputs[i]
+                      << std::endl;
+            return 2;
+        }
+    }
+
+    return (converter.run() == 0 ? 0 : 1);
+}
+
 int main(int argc, char *argv[])
 {
     for (int i = 1; i < argc; ++i) {
@@ -365,6 +421,9 @@ int main(int argc, char *argv[])
             std::cout << "Built against Qt version: " << QT_VERSION_STR << std::endl;
             return 0;
         }
+        if (!strcmp(argv[i], "--convert")) {
+            return convertFiles(argc, argv, i + 1);
+        }
     }
 
 #ifdef DEBUG
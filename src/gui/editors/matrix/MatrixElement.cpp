@@ -179,7 +179,7 @@ MatrixElement::reconfigure(timeT time, timeT duration, int pitch, int velocity)
 bool
 MatrixElement::isNote() const
 {
-    return event()->isa(Note::EventType);
+    return event()->isa(Note::TypeName);
 }
 
 void
@@ -742,7 +742,7 @@ MatrixScene::selectAll()
     EventSelection *selection = new EventSelection(*segment);
 
     for (; segment->isBeforeEndMarker(it); ++it) {
-        if ((*it)->isa(Note::EventType)) {
+        if ((*it)->isa(Note::TypeName)) {
             selection->addEvent(*it);
         }
     }
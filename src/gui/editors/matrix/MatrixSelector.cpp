@@ -208,7 +208,7 @@ MatrixSelector::handleMouseDoubleClick(const MatrixMouseEvent *e)
 
     if (element) {
 
-        if (element->event()->isa(Note::EventType) &&
+        if (element->event()->isa(Note::TypeName) &&
             element->event()->has(BaseProperties::TRIGGER_SEGMENT_ID)) {
 
             int id = element->event()->get<Int>(BaseProperties::TRIGGER_SEGMENT_ID);
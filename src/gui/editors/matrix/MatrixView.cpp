@@ -2088,7 +2088,7 @@ MatrixView::slotExtendSelectionBackward(bool bar)
             // Note that here in the matrix, we still wouldn't want to orphan
             // indications, etc., even though they're not visible from here.
             
-            if ((*extendFrom)->event()->isa(Note::EventType)) {
+            if ((*extendFrom)->event()->isa(Note::TypeName)) {
                 es->addEvent((*extendFrom)->event());
             }
         }
@@ -2157,7 +2157,7 @@ MatrixView::slotExtendSelectionForward(bool bar)
 
         while (extendFrom != vel->end() &&
                 (*extendFrom)->getViewAbsoluteTime() < newTime)  {
-            if ((*extendFrom)->event()->isa(Note::EventType)) {
+            if ((*extendFrom)->event()->isa(Note::TypeName)) {
                 es->addEvent((*extendFrom)->event());
             }
             ++extendFrom;
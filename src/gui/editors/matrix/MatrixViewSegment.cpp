@@ -60,7 +60,7 @@ MatrixViewSegment::resetRefreshStatus()
 bool
 MatrixViewSegment::wrapEvent(Event* e)
 {
-    return e->isa(Note::EventType) && ViewSegment::wrapEvent(e);
+    return e->isa(Note::TypeName) && ViewSegment::wrapEvent(e);
 }
 
 void
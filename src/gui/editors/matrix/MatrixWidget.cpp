@@ -1413,7 +1413,7 @@ void MatrixWidget::slotKeySelected(unsigned int y, bool repeating)
     for (Segment::iterator i = current->getSegment().begin();
             current->getSegment().isBeforeEndMarker(i); ++i) {
 
-        if ((*i)->isa(Note::EventType) &&
+        if ((*i)->isa(Note::TypeName) &&
                 (*i)->has(BaseProperties::PITCH)) {
 
             MidiByte p = (*i)->get
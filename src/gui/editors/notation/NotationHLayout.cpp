@@ -21,6 +21,7 @@
 #include "NotationHLayout.h"
 
 #include "base/Composition.h"
+#include "base/Exception.h"
 #include "base/LayoutEngine.h"
 #include "base/NotationQuantizer.h"
 #include "base/NotationTypes.h"
@@ -49,9 +50,16 @@
 #include <QApplication>
 #include <QSettings>
 #include <QObject>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
 
+#include <algorithm>
 #include <cmath>
+#include <exception>
 #include <limits>
+#include <set>
+#include <string>
 
 namespace Rosegarden
 {
@@ -64,6 +72,15 @@ NotationHLayout::NotationHLayout(Composition *c, NotePixmapFactory *npf,
                                  QObject* parent) :
     ProgressReporter(parent),
     HorizontalLayoutEngine(c),
+    m_dirtyStartBar(0),
+    m_dirtyEndBar(-1),
+    m_reconciledPageMode(false),
+    m_reconciledPageWidth(0.),
+    m_reconciledSpacing(0),
+    m_reconciledFirstBar(0),
+    m_reconciledLastBar(0),
+    m_reconciledNameWidth(0.),
+    m_relaidStartTime(0),
     m_totalWidth(0.),
     m_pageMode(false),
     m_pageWidth(0.),
@@ -75,6 +92,7 @@ NotationHLayout::NotationHLayout(Composition *c, NotePixmapFactory *npf,
     m_notationQuantizer(c->getNotationQuantizer()),
     m_properties(properties),
     m_timePerProgressIncrement(0),
+    m_scanningInParallel(false),
     m_staffCount(0),
     m_scene(static_cast<NotationScene *>(parent))
 {
@@ -180,7 +198,7 @@ void
 NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
                                  timeT endTime, bool full)
 {
-    throwIfCancelled();
+    if (!m_scanningInParallel) throwIfCancelled();
     Profiler profiler("NotationHLayout::scanViewSegment");
 
     Segment &segment(staff.getSegment());
@@ -256,7 +274,7 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
 
         Segment::iterator i = segment.findTime(startTime);
         while (1) {
-            if ((*i)->isa(Indication::EventType)) {
+            if ((*i)->isa(Indication::TypeName)) {
                 try {
                     Indication indication(**i);
                     if (indication.isOttavaType()) {
@@ -303,6 +321,16 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
 
     AccidentalTable accTable(key, clef, octaveType, barResetType);
 
+    if (!full) {
+        if (m_dirtyEndBar < m_dirtyStartBar) {
+            m_dirtyStartBar = startBarNo;
+            m_dirtyEndBar = endBarNo;
+        } else {
+            if (startBarNo < m_dirtyStartBar) m_dirtyStartBar = startBarNo;
+            if (endBarNo > m_dirtyEndBar) m_dirtyEndBar = endBarNo;
+        }
+    }
+
     for (int barNo = startBarNo; barNo <= endBarNo; ++barNo) {
 
         std::pair<timeT, timeT> barTimes =
@@ -380,10 +408,10 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
             // when they are invisible) as the way other elements are displayed
             // may depend from them.
             Key oldKey;
-            if (el->event()->isa(Clef::EventType)) {
+            if (el->event()->isa(Clef::TypeName)) {
                 clef = Clef(*el->event());
                 accTable.newClef(clef);
-            } else if (el->event()->isa(::Rosegarden::Key::EventType)) {
+            } else if (el->event()->isa(::Rosegarden::Key::TypeName)) {
                 oldKey = key;
                 key = ::Rosegarden::Key(*el->event());
                 accTable = AccidentalTable
@@ -414,19 +442,19 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
                 }
             }
 
-            if (el->event()->isa(Clef::EventType)) {
+            if (el->event()->isa(Clef::TypeName)) {
 
                 //              RG_DEBUG << "Found clef" << endl;
                 chunks.push_back(Chunk(el->event()->getSubOrdering(),
                                        getLayoutWidth(*el, npf, key)));
 
-            } else if (el->event()->isa(::Rosegarden::Key::EventType)) {
+            } else if (el->event()->isa(::Rosegarden::Key::TypeName)) {
 
                 //              RG_DEBUG << "Found key" << endl;
                 chunks.push_back(Chunk(el->event()->getSubOrdering(),
                                        getLayoutWidth(*el, npf, oldKey)));
 
-            } else if (el->event()->isa(Text::EventType)) {
+            } else if (el->event()->isa(Text::TypeName)) {
 
                 bool isLyric = el->event()->has(Text::TextTypePropertyName) &&
                     el->event()->get<String>(Text::TextTypePropertyName) ==
@@ -462,7 +490,7 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
                                        0,
                                        getLayoutWidth(*el, npf, key)));
 
-            } else if (el->event()->isa(Indication::EventType)) {
+            } else if (el->event()->isa(Indication::TypeName)) {
 
                 //              RG_DEBUG << "Found indication" << endl;
 
@@ -491,7 +519,7 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
             // ignore it when calculating actualBarEnd.  This fixes a very old
             // bug whereby inserting a controller into an empty bar would turn
             // the barline red.
-            if (!(el->event()->isa(Controller::EventType)) && !(el->event()->isa(PitchBend::EventType))) {
+            if (!(el->event()->isa(Controller::TypeName)) && !(el->event()->isa(PitchBend::TypeName))) {
                 actualBarEnd = el->getViewAbsoluteTime() + el->getViewDuration();
             }
         }
@@ -502,6 +530,8 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
         setBarSizeData(staff, barNo, 0.0,
                        timeSigWidth, actualBarEnd - barTimes.first);
 
+        if (m_scanningInParallel) continue;
+
         if ((endTime > startTime) && (barNo % 20 == 0)) {
             emit setValue((barTimes.second - startTime) * 95 /
                              (endTime - startTime));
@@ -519,6 +549,166 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
     */
 }
 
+namespace
+{
+
+// Scans one staff on a worker thread, noting any failure for the
+// calling thread to report once all the staffs are done
+
+class ScanTask : public QRunnable
+{
+public:
+    struct Result {
+        Result() : failed(false) { }
+        bool failed;
+        std::string message;
+    };
+
+    ScanTask(NotationHLayout *layout, ViewSegment *staff,
+             timeT startTime, timeT endTime, Result *result) :
+        m_layout(layout), m_staff(staff),
+        m_startTime(startTime), m_endTime(endTime), m_result(result) { }
+
+    virtual void run() {
+        try {
+            m_layout->scanViewSegment(*m_staff, m_startTime, m_endTime, true);
+        } catch (const Exception &e) {
+            m_result->failed = true;
+            m_result->message = e.getMessage();
+        } catch (const std::exception &e) {
+            m_result->failed = true;
+            m_result->message = e.what();
+        } catch (...) {
+            m_result->failed = true;
+            m_result->message = "Unknown error in notation layout";
+        }
+    }
+
+private:
+    NotationHLayout *m_layout;
+    ViewSegment *m_staff;
+    timeT m_startTime;
+    timeT m_endTime;
+    Result *m_result;
+};
+
+}
+
+void
+NotationHLayout::scanViewSegments(const std::vector<ViewSegment *> &staffs,
+                                  timeT startTime, timeT endTime, bool full)
+{
+    int threads = QThread::idealThreadCount();
+
+    // A partial scan is of a bar or two at most, and is over before
+    // a thread could be started
+    if (!full || staffs.size() < 2 || threads < 2) {
+        for (size_t i = 0; i < staffs.size(); ++i) {
+            scanViewSegment(*staffs[i], startTime, endTime, full);
+        }
+        return;
+    }
+
+    throwIfCancelled();
+    Profiler profiler("NotationHLayout::scanViewSegments");
+
+    prepareParallelScan(staffs);
+    int unmeasured = getUnmeasuredCount(staffs);
+
+    std::vector<ScanTask::Result> results(staffs.size());
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::min(threads, int(staffs.size())));
+
+    m_scanningInParallel = true;
+    for (size_t i = 0; i < staffs.size(); ++i) {
+        pool.start(new ScanTask(this, staffs[i], startTime, endTime,
+                                &results[i]));
+    }
+    pool.waitForDone();
+    m_scanningInParallel = false;
+
+    emit setValue(95);
+    throwIfCancelled();
+
+    // Report the failure of the first staff that failed, as a serial
+    // scan would have
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (results[i].failed) throw Exception(results[i].message);
+    }
+
+    // A character that prepareParallelScan() didn't measure was taken
+    // to be of no size by the scan threads, which would lay the staffs
+    // out differently from a serial scan.  Scan them again here, where
+    // it can be measured.
+    if (getUnmeasuredCount(staffs) != unmeasured) {
+        RG_DEBUG << "NotationHLayout::scanViewSegments: a character was "
+                 << "not measured before the parallel scan, rescanning "
+                 << "serially" << endl;
+        for (size_t i = 0; i < staffs.size(); ++i) {
+            scanViewSegment(*staffs[i], startTime, endTime, full);
+        }
+    }
+}
+
+void
+NotationHLayout::prepareParallelScan(const std::vector<ViewSegment *> &staffs)
+{
+    // The maps may not be modified while the scan threads are looking
+    // things up in them, so every staff's entries must exist already
+
+    std::set<NotePixmapFactory *> factories;
+    if (m_npf) factories.insert(m_npf);
+
+    for (size_t i = 0; i < staffs.size(); ++i) {
+        ViewSegment *staff = staffs[i];
+        (void)getBarData(*staff);
+        m_staffNameWidths[staff] = 0;
+        m_haveOttavaSomewhere[staff] = false;
+        factories.insert(getNotePixmapFactory(*staff));
+        factories.insert(getGraceNotePixmapFactory(*staff));
+    }
+
+    // Glyphs can only be rendered on the GUI thread, so measure them
+    // all here, and the scan threads will find their sizes cached
+
+    factories.erase(0);
+    for (std::set<NotePixmapFactory *>::iterator i = factories.begin();
+         i != factories.end(); ++i) {
+        (*i)->measureCharacters();
+    }
+
+    // Both of these update their caches lazily on first use
+
+    (void)getComposition()->getBarNumber(0);
+
+    if (m_hideRedundance && !staffs.empty()) {
+        TrackId track = staffs[0]->getSegment().getTrack();
+        (void)m_scene->getClefKeyContext()->getClefFromContext(track, 0);
+    }
+}
+
+int
+NotationHLayout::getUnmeasuredCount(const std::vector<ViewSegment *> &staffs)
+{
+    std::set<NotePixmapFactory *> factories;
+    if (m_npf) factories.insert(m_npf);
+
+    for (size_t i = 0; i < staffs.size(); ++i) {
+        factories.insert(getNotePixmapFactory(*staffs[i]));
+        factories.insert(getGraceNotePixmapFactory(*staffs[i]));
+    }
+
+    factories.erase(0);
+
+    int count = 0;
+    for (std::set<NotePixmapFactory *>::iterator i = factories.begin();
+         i != factories.end(); ++i) {
+        count += (*i)->getUnmeasuredCount();
+    }
+    return count;
+}
+
 void
 NotationHLayout::clearBarList(ViewSegment &staff)
 {
@@ -1034,6 +1224,20 @@ NotationHLayout::getMaxRepeatedClefAndKeyWidth(int barNo)
         return 0;
 }
 
+double
+NotationHLayout::getMaxViewSegmentNameWidth() const
+{
+    double width = 0.0;
+
+    for (ViewSegmentIntMap::const_iterator i = m_staffNameWidths.begin();
+            i != m_staffNameWidths.end(); ++i) {
+        if (i->second > width)
+            width = double(i->second);
+    }
+
+    return width;
+}
+
 void
 NotationHLayout::reconcileBarsLinear()
 {
@@ -1047,12 +1251,7 @@ NotationHLayout::reconcileBarsLinear()
 
     int barNo = getFirstVisibleBar();
 
-    m_totalWidth = 0.0;
-    for (ViewSegmentIntMap::iterator i = m_staffNameWidths.begin();
-            i != m_staffNameWidths.end(); ++i) {
-        if (i->second > m_totalWidth)
-            m_totalWidth = double(i->second);
-    }
+    m_totalWidth = getMaxViewSegmentNameWidth();
 
     for (;;) {
 
@@ -1073,46 +1272,130 @@ NotationHLayout::reconcileBarsLinear()
             }
         }
 
-        float maxWidth = m_barData[widest].find(barNo)->second.sizeData.idealWidth;
-        if (m_pageWidth > 0.1 && maxWidth > m_pageWidth) {
-            maxWidth = m_pageWidth;
-        }
-
         RG_DEBUG << "Setting bar position for bar " << barNo
         << " to " << m_totalWidth << endl;
 
         m_barPositions[barNo] = m_totalWidth;
-        m_totalWidth += maxWidth;
+        m_totalWidth += reconcileBarLinear(barNo, widest);
 
-        // Now apply width to this bar on all staffs
+        ++barNo;
+    }
 
-        for (BarDataMap::iterator i = m_barData.begin();
-                i != m_barData.end(); ++i) {
+    RG_DEBUG << "Setting bar position for bar " << barNo
+    << " to " << m_totalWidth << endl;
+
+    m_barPositions[barNo] = m_totalWidth;
+}
+
+double
+NotationHLayout::reconcileBarLinear(int barNo, ViewSegment *widest)
+{
+    float maxWidth = m_barData[widest].find(barNo)->second.sizeData.idealWidth;
+    if (m_pageWidth > 0.1 && maxWidth > m_pageWidth) {
+        maxWidth = m_pageWidth;
+    }
 
-            BarDataList &list = i->second;
-            BarDataList::iterator bdli = list.find(barNo);
-            if (bdli != list.end()) {
+    // Now apply width to this bar on all staffs
 
-                BarData::SizeData &bd(bdli->second.sizeData);
+    for (BarDataMap::iterator i = m_barData.begin();
+            i != m_barData.end(); ++i) {
 
-                RG_DEBUG << "Changing width from " << bd.reconciledWidth << " to " << maxWidth << endl;
+        BarDataList &list = i->second;
+        BarDataList::iterator bdli = list.find(barNo);
+        if (bdli != list.end()) {
 
-                double diff = maxWidth - bd.reconciledWidth;
-                if (diff < -0.1 || diff > 0.1) {
-                    RG_DEBUG << "(So needsLayout becomes true)" << endl;
-                    bdli->second.layoutData.needsLayout = true;
-                }
-                bd.reconciledWidth = maxWidth;
+            BarData::SizeData &bd(bdli->second.sizeData);
+
+            RG_DEBUG << "Changing width from " << bd.reconciledWidth << " to " << maxWidth << endl;
+
+            double diff = maxWidth - bd.reconciledWidth;
+            if (diff < -0.1 || diff > 0.1) {
+                RG_DEBUG << "(So needsLayout becomes true)" << endl;
+                bdli->second.layoutData.needsLayout = true;
             }
+            bd.reconciledWidth = maxWidth;
         }
+    }
 
-        ++barNo;
+    return maxWidth;
+}
+
+bool
+NotationHLayout::reconcileBarsLinearPartially(int &fromBar)
+{
+    Profiler profiler("NotationHLayout::reconcileBarsLinearPartially");
+
+    int firstBar = getFirstVisibleBar();
+    int lastBar = getLastVisibleBar();
+
+    int startBar = std::max(m_dirtyStartBar, firstBar);
+    int endBar = std::min(m_dirtyEndBar, lastBar - 1);
+
+    fromBar = startBar;
+    if (startBar > endBar) return true;
+
+    if (m_barPositions.find(startBar) == m_barPositions.end() ||
+        m_barPositions.find(endBar + 1) == m_barPositions.end()) {
+        return false;
     }
 
-    RG_DEBUG << "Setting bar position for bar " << barNo
-    << " to " << m_totalWidth << endl;
+    // The bars before the rescanned ones haven't changed, so nor has
+    // the width up to the first of them.  The bar just before it is
+    // either degenerate, with no width of its own, or has the same
+    // reconciled width on every staff it appears on.
 
-    m_barPositions[barNo] = m_totalWidth;
+    double totalWidth = getMaxViewSegmentNameWidth();
+
+    if (startBar > firstBar) {
+        totalWidth = m_barPositions[startBar - 1];
+        for (BarDataMap::iterator i = m_barData.begin();
+             i != m_barData.end(); ++i) {
+            BarDataList::iterator bdli = i->second.find(startBar - 1);
+            if (bdli != i->second.end()) {
+                totalWidth += bdli->second.sizeData.reconciledWidth;
+                break;
+            }
+        }
+    }
+
+    for (int barNo = startBar; barNo <= endBar; ++barNo) {
+
+        ViewSegment *widest = getViewSegmentWithWidestBar(barNo);
+
+        if (!widest) {
+            totalWidth += m_spacing / 3;
+            m_barPositions[barNo] = totalWidth;
+        } else {
+            m_barPositions[barNo] = totalWidth;
+            totalWidth += reconcileBarLinear(barNo, widest);
+        }
+    }
+
+    // Everything after the rescanned bars moves along by however much
+    // they have grown or shrunk.  A degenerate bar is positioned after
+    // its own spacing, so that has to be left out of the comparison.
+
+    BarPositionList::iterator bpi = m_barPositions.find(endBar + 1);
+
+    double oldWidth = bpi->second;
+    if (endBar + 1 < lastBar && !getViewSegmentWithWidestBar(endBar + 1)) {
+        oldWidth -= m_spacing / 3;
+    }
+
+    double shift = totalWidth - oldWidth;
+
+    RG_DEBUG << "reconcileBarsLinearPartially: bars " << startBar << " to "
+             << endBar << " of " << firstBar << " to " << lastBar
+             << ", shifting the rest by " << shift << endl;
+
+    if (shift < -0.001 || shift > 0.001) {
+        for (; bpi != m_barPositions.end(); ++bpi) {
+            bpi->second += shift;
+        }
+        m_totalWidth += shift;
+    }
+
+    return true;
 }
 
 void
@@ -1120,27 +1403,116 @@ NotationHLayout::reconcileBarsPage()
 {
     Profiler profiler("NotationHLayout::reconcileBarsPage");
 
-    int barNo = getFirstVisibleBar();
-    int barNoThisRow = 0;
+    m_totalWidth = getMaxViewSegmentNameWidth() + getPreBarMargin();
 
-    // pair of the recommended number of bars with those bars'
-    // original total width, for each row
-    std::vector<std::pair<int, double> > rowData;
+    RowDataList rowData;
+    breakRows(getFirstVisibleBar(), rowData, -1);
 
-    double stretchFactor = 10.0;
-    double maxViewSegmentNameWidth = 0.0;
+    m_rowStarts.clear();
+    for (unsigned int row = 0; row < rowData.size(); ++row) {
+        m_rowStarts.push_back(rowData[row].firstBar);
+    }
 
-    for (ViewSegmentIntMap::iterator i = m_staffNameWidths.begin();
-            i != m_staffNameWidths.end(); ++i) {
-        if (i->second > maxViewSegmentNameWidth) {
-            maxViewSegmentNameWidth = double(i->second);
-        }
+    // Now we need to actually apply the widths
+
+    applyRowWidths(rowData, true);
+}
+
+bool
+NotationHLayout::reconcileBarsPagePartially(int &fromBar)
+{
+    Profiler profiler("NotationHLayout::reconcileBarsPagePartially");
+
+    if (m_rowStarts.empty()) return false;
+
+    int firstBar = getFirstVisibleBar();
+    int lastBar = getLastVisibleBar();
+
+    int startBar = std::max(m_dirtyStartBar, firstBar);
+    int endBar = std::min(m_dirtyEndBar, lastBar - 1);
+
+    fromBar = startBar;
+    if (startBar > endBar) return true;
+
+    // Start again from the row containing the first rescanned bar, or
+    // from the row before if the bar starts its row, as it might now
+    // fit at the end of that one
+
+    std::vector<int>::iterator ri =
+        std::upper_bound(m_rowStarts.begin(), m_rowStarts.end(), startBar);
+    if (ri != m_rowStarts.begin()) --ri;
+    if (*ri == startBar && ri != m_rowStarts.begin()) --ri;
+
+    int rowStart = *ri;
+
+    BarPositionList::iterator bpi = m_barPositions.find(rowStart);
+    if (bpi == m_barPositions.end()) return false;
+
+    fromBar = rowStart;
+
+    double oldTotalWidth = m_totalWidth;
+    m_totalWidth = bpi->second;
+
+    RowDataList rowData;
+    int resumeBar = breakRows(rowStart, rowData, endBar);
+
+    applyRowWidths(rowData, resumeBar < 0);
+
+    // Record the new row starts in place of the ones they replace
+
+    std::vector<int>::iterator rj = m_rowStarts.end();
+    if (resumeBar >= 0) {
+        rj = std::lower_bound(ri, m_rowStarts.end(), resumeBar);
     }
+    ri = m_rowStarts.erase(ri, rj);
+
+    std::vector<int> starts;
+    for (unsigned int row = 0; row < rowData.size(); ++row) {
+        starts.push_back(rowData[row].firstBar);
+    }
+    m_rowStarts.insert(ri, starts.begin(), starts.end());
+
+    RG_DEBUG << "reconcileBarsPagePartially: bars " << startBar << " to "
+             << endBar << " of " << firstBar << " to " << lastBar
+             << ", relaid " << rowData.size() << " rows from bar "
+             << rowStart << endl;
+
+    if (resumeBar < 0) return true;
 
-    double pageWidthSoFar = maxViewSegmentNameWidth;
-    m_totalWidth = maxViewSegmentNameWidth + getPreBarMargin();
+    // The rows from resumeBar on are as they were, but may start at a
+    // different position
 
-    RG_DEBUG << "reconcileBarsPage: pageWidthSoFar is " << pageWidthSoFar << endl;
+    bpi = m_barPositions.find(resumeBar);
+    double shift = m_totalWidth - bpi->second;
+
+    for (; bpi != m_barPositions.end(); ++bpi) {
+        bpi->second += shift;
+    }
+    m_totalWidth = oldTotalWidth + shift;
+
+    return true;
+}
+
+int
+NotationHLayout::breakRows(int barNo, RowDataList &rowData, int dirtyEndBar)
+{
+    int rowStart = barNo;
+    int barNoThisRow = 0;
+
+    double stretchFactor = 10.0;
+    double pageWidthSoFar = 0.0;
+
+    if (barNo == getFirstVisibleBar()) {
+        pageWidthSoFar = getMaxViewSegmentNameWidth();
+        setClefKeyWidth(barNo, 0);
+    } else {
+        // Every row but the first starts with a repeated clef and key
+        int maxClefKeyWidth = getMaxRepeatedClefAndKeyWidth(barNo);
+        setClefKeyWidth(barNo, maxClefKeyWidth);
+        pageWidthSoFar = maxClefKeyWidth;
+    }
+
+    RG_DEBUG << "breakRows: pageWidthSoFar is " << pageWidthSoFar << endl;
 
     for (;;) {
 
@@ -1205,28 +1577,30 @@ NotationHLayout::reconcileBarsPage()
         }
 
         if (tooFar) {
-            rowData.push_back(std::pair<int, double>(barNoThisRow,
-                              pageWidthSoFar));
+            rowData.push_back(RowData(rowStart, barNoThisRow,
+                                      pageWidthSoFar));
+
+            // Past the rescanned bars, once a row starts where one
+            // started before, so will all the rows after it
+            if (dirtyEndBar >= 0 && barNo > dirtyEndBar &&
+                std::binary_search(m_rowStarts.begin(), m_rowStarts.end(),
+                                   barNo)) {
+                return barNo;
+            }
+
+            rowStart = barNo;
             barNoThisRow = 1;
 
             // When we start a new row, we always need to allow for the
             // repeated clef and key at the start of it.
             int maxClefKeyWidth = getMaxRepeatedClefAndKeyWidth(barNo);
-
-            for (BarDataMap::iterator i = m_barData.begin();
-                    i != m_barData.end(); ++i) {
-
-                BarDataList &list = i->second;
-                BarDataList::iterator bdli = list.find(barNo);
-
-                if (bdli != list.end()) {
-                    bdli->second.sizeData.clefKeyWidth = maxClefKeyWidth;
-                }
-            }
+            setClefKeyWidth(barNo, maxClefKeyWidth);
 
             pageWidthSoFar = maxWidth + maxClefKeyWidth;
             stretchFactor = m_pageWidth / pageWidthSoFar;
         } else {
+            // Only the first bar in a row repeats the clef and key
+            if (barNoThisRow > 0) setClefKeyWidth(barNo, 0);
             ++barNoThisRow;
             pageWidthSoFar = nextPageWidth;
             stretchFactor = nextStretchFactor;
@@ -1236,25 +1610,35 @@ NotationHLayout::reconcileBarsPage()
     }
 
     if (barNoThisRow > 0) {
-        rowData.push_back(std::pair<int, double>(barNoThisRow,
-                          pageWidthSoFar));
+        rowData.push_back(RowData(rowStart, barNoThisRow, pageWidthSoFar));
     }
 
-    // Now we need to actually apply the widths
+    return -1;
+}
+
+void
+NotationHLayout::applyRowWidths(const RowDataList &rowData,
+                                bool includesFinalRow)
+{
+    if (rowData.empty()) return;
 
-    barNo = getFirstVisibleBar();
+    int barNo = rowData[0].firstBar;
+    int firstBar = getFirstVisibleBar();
+    double maxViewSegmentNameWidth = getMaxViewSegmentNameWidth();
 
     for (unsigned int row = 0; row < rowData.size(); ++row) {
 
-        barNoThisRow = barNo;
-        int finalBarThisRow = barNo + rowData[row].first - 1;
+        int barNoThisRow = barNo;
+        int finalBarThisRow = barNo + rowData[row].barCount - 1;
 
-        pageWidthSoFar = (row > 0 ? 0 : maxViewSegmentNameWidth + getPreBarMargin());
-        stretchFactor = m_pageWidth / rowData[row].second;
+        double pageWidthSoFar =
+            (rowData[row].firstBar != firstBar ? 0 :
+             maxViewSegmentNameWidth + getPreBarMargin());
+        double stretchFactor = m_pageWidth / rowData[row].width;
 
         for (; barNoThisRow <= finalBarThisRow; ++barNoThisRow, ++barNo) {
 
-            bool finalRow = (row == rowData.size() - 1);
+            bool finalRow = (includesFinalRow && row == rowData.size() - 1);
 
             ViewSegment *widest = getViewSegmentWithWidestBar(barNo);
             if (finalRow && (stretchFactor > 1.0))
@@ -1304,17 +1688,88 @@ NotationHLayout::reconcileBarsPage()
         }
     }
 
-    m_barPositions[barNo] = m_totalWidth;
+    if (includesFinalRow) m_barPositions[barNo] = m_totalWidth;
+}
+
+void
+NotationHLayout::setClefKeyWidth(int barNo, int width)
+{
+    for (BarDataMap::iterator i = m_barData.begin();
+         i != m_barData.end(); ++i) {
+
+        BarDataList &list = i->second;
+        BarDataList::iterator bdli = list.find(barNo);
+
+        if (bdli != list.end()) {
+            if (bdli->second.sizeData.clefKeyWidth != width) {
+                bdli->second.layoutData.needsLayout = true;
+            }
+            bdli->second.sizeData.clefKeyWidth = width;
+        }
+    }
+}
+
+bool
+NotationHLayout::canReconcilePartially() const
+{
+    bool pageMode = (m_pageMode && (m_pageWidth > 0.1));
+
+    return !m_barPositions.empty() &&
+        pageMode == m_reconciledPageMode &&
+        m_pageWidth == m_reconciledPageWidth &&
+        m_spacing == m_reconciledSpacing &&
+        getFirstVisibleBar() == m_reconciledFirstBar &&
+        getLastVisibleBar() == m_reconciledLastBar &&
+        getMaxViewSegmentNameWidth() == m_reconciledNameWidth;
 }
 
 void
 NotationHLayout::finishLayout(timeT startTime, timeT endTime, bool full)
 {
     Profiler profiler("NotationHLayout::finishLayout");
-    m_barPositions.clear();
 
-    if (m_pageMode && (m_pageWidth > 0.1)) reconcileBarsPage();
-    else reconcileBarsLinear();
+    bool pageMode = (m_pageMode && (m_pageWidth > 0.1));
+
+    // After an edit, only the bars that were rescanned need to be
+    // reconciled again -- unless the bars have been rearranged
+    // since the last time, in which case everything does
+
+    bool partial = !full && canReconcilePartially();
+    int fromBar = 0;
+
+    if (partial) {
+        if (pageMode) partial = reconcileBarsPagePartially(fromBar);
+        else partial = reconcileBarsLinearPartially(fromBar);
+    }
+
+    if (!partial) {
+        m_barPositions.clear();
+        if (pageMode) reconcileBarsPage();
+        else reconcileBarsLinear();
+    }
+
+    // Bars before the rescanned ones may have been moved, if they
+    // share a row with them, and must be laid out again too
+
+    if (partial) {
+        timeT fromTime = getComposition()->getBarStart(fromBar);
+        if (fromTime < startTime) startTime = fromTime;
+    }
+    m_relaidStartTime = startTime;
+
+    RG_DEBUG << "finishLayout: " << (partial ? "partial" : "full")
+             << " reconciliation, bars " << m_dirtyStartBar << " to "
+             << m_dirtyEndBar << " rescanned" << endl;
+
+    m_dirtyStartBar = 0;
+    m_dirtyEndBar = -1;
+
+    m_reconciledPageMode = pageMode;
+    m_reconciledPageWidth = m_pageWidth;
+    m_reconciledSpacing = m_spacing;
+    m_reconciledFirstBar = getFirstVisibleBar();
+    m_reconciledLastBar = getLastVisibleBar();
+    m_reconciledNameWidth = getMaxViewSegmentNameWidth();
 
     int staffNo = 0;
 
@@ -1506,7 +1961,7 @@ NotationHLayout::layout(BarDataMap::iterator i, timeT startTime, timeT endTime,
             delta = 0;
             float fixed = 0;
 
-            if (el->event()->isa(Note::EventType)) {
+            if (el->event()->isa(Note::TypeName)) {
                 long pitch = 0;
                 el->event()->get<Int>(PITCH, pitch);
                 RG_DEBUG << "element is a " << el->event()->getType() << " (pitch " << pitch << ")" << endl;
@@ -1533,8 +1988,8 @@ NotationHLayout::layout(BarDataMap::iterator i, timeT startTime, timeT endTime,
                 RG_DEBUG << "adjusted x is " << x << ", fixed is " << fixed << endl;
 
                 if (timeSigToPlace) {
-                    if (el->event()->isa(Clef::EventType) ||
-                        el->event()->isa(Rosegarden::Key::EventType)) {
+                    if (el->event()->isa(Clef::TypeName) ||
+                        el->event()->isa(Rosegarden::Key::TypeName)) {
                         sigx = x + (*chunkitr).fixed + (*chunkitr).stretchy;
                     }
                 }
@@ -1556,8 +2011,8 @@ NotationHLayout::layout(BarDataMap::iterator i, timeT startTime, timeT endTime,
             }
 
             if (timeSigToPlace &&
-                !el->event()->isa(Clef::EventType) &&
-                !el->event()->isa(::Rosegarden::Key::EventType)) {
+                !el->event()->isa(Clef::TypeName) &&
+                !el->event()->isa(::Rosegarden::Key::TypeName)) {
 
                 if (sigx == 0.f) {
                     sigx = barX + offset;
@@ -1576,8 +2031,8 @@ NotationHLayout::layout(BarDataMap::iterator i, timeT startTime, timeT endTime,
             }
 
             if (barInset >= 1.0) {
-                if (el->event()->isa(Clef::EventType) ||
-                        el->event()->isa(::Rosegarden::Key::EventType)) {
+                if (el->event()->isa(Clef::TypeName) ||
+                        el->event()->isa(::Rosegarden::Key::TypeName)) {
                     RG_DEBUG << "Pulling clef/key back by " << getPreBarMargin() << endl;
                     x -= getPostBarMargin() * 2 / 3;
                 } else {
@@ -1611,15 +2066,15 @@ NotationHLayout::layout(BarDataMap::iterator i, timeT startTime, timeT endTime,
 
                 // nothing to do
 
-            } else if (el->event()->isa(Clef::EventType)) {
+            } else if (el->event()->isa(Clef::TypeName)) {
 
                 clef = Clef(*el->event());
 
-            } else if (el->event()->isa(::Rosegarden::Key::EventType)) {
+            } else if (el->event()->isa(::Rosegarden::Key::TypeName)) {
 
                 key = ::Rosegarden::Key(*el->event());
 
-            } else if (el->event()->isa(Text::EventType)) {
+            } else if (el->event()->isa(Text::TypeName)) {
 
                 // if it's a dynamic, make a note of it in case a
                 // hairpin immediately follows it
@@ -1630,7 +2085,7 @@ NotationHLayout::layout(BarDataMap::iterator i, timeT startTime, timeT endTime,
                     lastDynamicText = el;
                 }
 
-            } else if (el->event()->isa(Indication::EventType)) {
+            } else if (el->event()->isa(Indication::TypeName)) {
 
                 std::string type;
                 double ix = x;
@@ -1949,11 +2404,11 @@ NotationHLayout::getLayoutWidth(ViewElement &ve,
 
         double w = getFixedItemSpacing();
 
-        if (e.event()->isa(Clef::EventType)) {
+        if (e.event()->isa(Clef::TypeName)) {
 
             w += m_npf->getClefWidth(Clef(*e.event()));
 
-        } else if (e.event()->isa(::Rosegarden::Key::EventType)) {
+        } else if (e.event()->isa(::Rosegarden::Key::TypeName)) {
 
             ::Rosegarden::Key key(*e.event());
 
@@ -1977,8 +2432,8 @@ NotationHLayout::getLayoutWidth(ViewElement &ve,
 
             w += m_npf->getKeyWidth(key, cancelKey);
 
-        } else if (e.event()->isa(Indication::EventType) ||
-                   e.event()->isa(Text::EventType)) {
+        } else if (e.event()->isa(Indication::TypeName) ||
+                   e.event()->isa(Text::TypeName)) {
 
             w = 0;
 
@@ -2021,6 +2476,9 @@ NotationHLayout::reset()
 
     m_barData.clear();
     m_barPositions.clear();
+    m_rowStarts.clear();
+    m_dirtyStartBar = 0;
+    m_dirtyEndBar = -1;
     m_totalWidth = 0;
 }
 
@@ -81,6 +81,18 @@ public:
                                  timeT endTime,
                                  bool full);
 
+    /**
+     * Precomputes layout data for several staffs, as if by calling
+     * scanViewSegment() for each in turn.  A full scan of more than
+     * one staff is shared out across a pool of threads, as no staff's
+     * scan depends on any other's; the results are the same either
+     * way.
+     */
+    void scanViewSegments(const std::vector<ViewSegment *> &staffs,
+                          timeT startTime,
+                          timeT endTime,
+                          bool full);
+
     /**
      * Resets internal data stores, notably the BarDataMap that is
      * used to retain the data computed by scanViewSegment().
@@ -88,12 +100,22 @@ public:
     virtual void reset();
 
     /**
-     * Lays out all staffs that have been scanned
+     * Lays out all staffs that have been scanned.  If this is not a
+     * full layout, only the bars rescanned since the last one have
+     * their widths reconciled again (together with the rest of their
+     * row, in page mode) and the bars after them are moved along.
      */
     virtual void finishLayout(timeT startTime,
                               timeT endTime,
                               bool full);
 
+    /**
+     * Returns the time from which elements were laid out by the last
+     * call to finishLayout().  This may be earlier than the start
+     * time it was given, if bars before that had to move as well.
+     */
+    timeT getRelaidStartTime() const { return m_relaidStartTime; }
+
     /**
      * Set page mode
      */
@@ -379,12 +401,56 @@ protected:
     /// For a single bar, makes sure synchronisation points align in all staves
     void preSquishBar(int barNo);
 
+    /// Find the width of the widest staff name
+    double getMaxViewSegmentNameWidth() const;
+
     /// Tries to harmonize the bar positions for all the staves (linear mode)
     void reconcileBarsLinear();
 
+    /// Set the width of one bar on all staves (linear mode), and return it
+    double reconcileBarLinear(int barNo, ViewSegment *widest);
+
     /// Tries to harmonize the bar positions for all the staves (page mode)
     void reconcileBarsPage();
 
+    /**
+     * Harmonize only the bars rescanned since the last reconciliation,
+     * moving the bars after them along as necessary, and leave the
+     * rest as they were.  Returns false if the last reconciliation
+     * can't be built on, in which case a full one is needed.
+     * Otherwise sets fromBar to the first bar that may have moved.
+     */
+    bool reconcileBarsLinearPartially(int &fromBar);
+    bool reconcileBarsPagePartially(int &fromBar);
+
+    /// True if the bars are laid out as they were at the last reconciliation
+    bool canReconcilePartially() const;
+
+    struct RowData {
+        int firstBar;
+        int barCount;
+        double width; // total ideal width of the bars, with clef & key
+        RowData(int first, int count, double w) :
+            firstBar(first), barCount(count), width(w) { }
+    };
+    typedef std::vector<RowData> RowDataList;
+
+    /**
+     * Break the bars starting at barNo, which starts a row, into
+     * rows (page mode).  If dirtyEndBar is not negative, stop as soon
+     * as a row after that bar starts where a row started at the last
+     * reconciliation, since the rows from there on won't have
+     * changed, and return the bar at which it starts.  Otherwise
+     * return -1.
+     */
+    int breakRows(int barNo, RowDataList &rows, int dirtyEndBar);
+
+    /// Apply the widths of the given rows to their bars (page mode)
+    void applyRowWidths(const RowDataList &rows, bool includesFinalRow);
+
+    /// Set the width of the repeated clef and key in a bar on all staves
+    void setClefKeyWidth(int barNo, int width);
+
     void layout(BarDataMap::iterator,
                 timeT startTime,
                 timeT endTime,
@@ -436,11 +502,41 @@ protected:
     NotePixmapFactory *getNotePixmapFactory(ViewSegment &);
     NotePixmapFactory *getGraceNotePixmapFactory(ViewSegment &);
 
+    /**
+     * Get everything ready for the given staffs to be scanned on
+     * threads other than this one: create their entries in the maps
+     * the scan fills in, measure the characters the scan may ask for,
+     * and bring the composition's and scene's caches up to date
+     */
+    void prepareParallelScan(const std::vector<ViewSegment *> &staffs);
+
+    /**
+     * Total the unmeasured character lookups of the staffs' note
+     * pixmap factories (see NotePixmapFactory::getUnmeasuredCount())
+     */
+    int getUnmeasuredCount(const std::vector<ViewSegment *> &staffs);
+
     //--------------- Data members ---------------------------------
 
     BarDataMap m_barData;
     ViewSegmentIntMap m_staffNameWidths;
     BarPositionList m_barPositions;
+
+    // Bars rescanned since the last reconciliation, if m_dirtyEndBar
+    // is not less than m_dirtyStartBar
+    int m_dirtyStartBar;
+    int m_dirtyEndBar;
+
+    // The first bar of each row, and the parameters the bars were
+    // reconciled with, as of the last reconciliation
+    std::vector<int> m_rowStarts;
+    bool m_reconciledPageMode;
+    double m_reconciledPageWidth;
+    int m_reconciledSpacing;
+    int m_reconciledFirstBar;
+    int m_reconciledLastBar;
+    double m_reconciledNameWidth;
+    timeT m_relaidStartTime;
     NotationGroupMap m_groupsExtant;
 
     double m_totalWidth;
@@ -465,6 +561,7 @@ protected:
     const NotationProperties &m_properties;
 
     int m_timePerProgressIncrement;
+    bool m_scanningInParallel; // no progress reports from scan threads
     std::map<ViewSegment *, bool> m_haveOttavaSomewhere;
     int m_staffCount; // purely for value() reporting
 
@@ -1628,11 +1628,13 @@ void
 NotationScene::layout(NotationStaff *singleStaff,
                       timeT startTime, timeT endTime)
 {
-    Profiler profiler("NotationScene::layout", true);
-    NOTATION_DEBUG << "NotationScene::layout: from " << startTime << " to " << endTime << endl;
-
     bool full = (singleStaff == 0 && startTime == endTime);
 
+    // Time full layouts and those following edits separately
+    Profiler profiler(full ? "NotationScene::layout" :
+                      "NotationScene::layout: after edit", true);
+    NOTATION_DEBUG << "NotationScene::layout: from " << startTime << " to " << endTime << endl;
+
     m_hlayout->setViewSegmentCount(m_staffs.size());
 
     if (full) {
@@ -1665,20 +1667,34 @@ NotationScene::layout(NotationStaff *singleStaff,
 
     {
         Profiler profiler("NotationScene::layout: Scan layouts", true);
+    std::vector<ViewSegment *> staffs;
     for (unsigned int i = 0; i < m_staffs.size(); ++i) {
 
         NotationStaff *staff = m_staffs[i];
 
         if (singleStaff && staff != singleStaff) continue;
 
-        m_hlayout->scanViewSegment(*staff, startTime, endTime, full);
-        m_vlayout->scanViewSegment(*staff, startTime, endTime, full);
+        staffs.push_back(staff);
+    }
+
+    // The horizontal scans may run in parallel, but each staff's must
+    // still be done before its vertical one
+    m_hlayout->scanViewSegments(staffs, startTime, endTime, full);
+
+    for (unsigned int i = 0; i < staffs.size(); ++i) {
+        m_vlayout->scanViewSegment(*staffs[i], startTime, endTime, full);
     }
     }
 
     m_hlayout->finishLayout(startTime, endTime, full);
     m_vlayout->finishLayout(startTime, endTime, full);
 
+    // The horizontal layout may have had to move bars before the
+    // ones that changed, and those need repositioning too
+    if (!full && m_hlayout->getRelaidStartTime() < startTime) {
+        startTime = m_hlayout->getRelaidStartTime();
+    }
+
     double maxWidth = 0.0;
     int maxHeight = 0;
 
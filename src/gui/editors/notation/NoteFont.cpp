@@ -27,12 +27,14 @@
 #include "NoteFontMap.h"
 #include "SystemFont.h"
 #include <QBitmap>
+#include <QCoreApplication>
 #include <QImage>
 #include <QPainter>
 #include <QPixmap>
 #include <QPoint>
 #include <QString>
 #include <QStringList>
+#include <QThread>
 
 //#include <qgarray.h>
 
@@ -46,7 +48,8 @@ QPixmap *NoteFont::m_blankPixmap = 0;
 
 
 NoteFont::NoteFont(QString fontName, int size) :
-    m_fontMap(fontName)
+    m_fontMap(fontName),
+    m_unmeasuredCount(0)
 {
     // Do the size checks first, to avoid doing the extra work if they fail
 
@@ -433,13 +436,48 @@ NoteFont::getNameShaded(CharName base) const
 bool
 NoteFont::getDimensions(CharName charName, int &x, int &y, bool inverted) const
 {
+    QMutexLocker locker(&m_dimensionsMutex);
+
+    std::pair<CharName, bool> key(charName, inverted);
+    DimensionMap::const_iterator i = m_dimensions.find(key);
+
+    if (i != m_dimensions.end()) {
+        x = i->second.x;
+        y = i->second.y;
+        return i->second.ok;
+    }
+
+    if (QCoreApplication::instance() &&
+        QThread::currentThread() != QCoreApplication::instance()->thread()) {
+        NOTATION_DEBUG << "NoteFont::getDimensions: Warning: Character \""
+                       << charName << "\" has not been measured on the GUI thread"
+                       << endl;
+        ++m_unmeasuredCount;
+        x = y = 0;
+        return false;
+    }
+
     QPixmap pixmap;
     bool ok = getPixmap(charName, pixmap, inverted);
     x = pixmap.width();
     y = pixmap.height();
+
+    Dimensions dimensions;
+    dimensions.x = x;
+    dimensions.y = y;
+    dimensions.ok = ok;
+    m_dimensions[key] = dimensions;
+
     return ok;
 }
 
+int
+NoteFont::getUnmeasuredCount() const
+{
+    QMutexLocker locker(&m_dimensionsMutex);
+    return m_unmeasuredCount;
+}
+
 int
 NoteFont::getWidth(CharName charName) const
 {
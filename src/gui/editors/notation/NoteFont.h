@@ -23,6 +23,7 @@
 #include "NoteCharacter.h"
 #include "NoteFontMap.h"
 #include <set>
+#include <QMutex>
 #include <QString>
 #include <QPoint>
 #include <utility>
@@ -111,10 +112,26 @@ public:
                                      CharacterType type = Screen,
                                      bool inverted = false);
 
-    /// Returns false + dimensions of blank pixmap if none found
+    /**
+     * Returns false + dimensions of blank pixmap if none found.
+     *
+     * The dimensions of each character are remembered once known,
+     * and may then be looked up from any thread.  A character must
+     * first be measured on the GUI thread, as that is the only one
+     * its pixmap can be rendered on; until it has been, this returns
+     * false and zero dimensions on any other thread.
+     */
     bool getDimensions(CharName charName, int &x, int &y,
                        bool inverted = false) const;
 
+    /**
+     * Return the number of times getDimensions() has been asked on
+     * another thread for a character that had not been measured.
+     * A caller can compare this before and after work on other
+     * threads to tell whether any of it saw wrong dimensions.
+     */
+    int getUnmeasuredCount() const;
+
     /// Ignores problems, returning dimension of blank pixmap if necessary
     int getWidth(CharName charName) const;
 
@@ -161,6 +178,13 @@ private:
 
     typedef std::map<QPixmap *, NoteCharacterDrawRep *> DrawRepMap;
 
+    struct Dimensions {
+        int x;
+        int y;
+        bool ok;
+    };
+    typedef std::map<std::pair<CharName, bool>, Dimensions> DimensionMap;
+
     //--------------- Data members ---------------------------------
 
     int m_size;
@@ -168,6 +192,10 @@ private:
 
     mutable PixmapMap *m_map; // pointer at a member of m_fontPixmapMap
 
+    mutable DimensionMap m_dimensions;
+    mutable int m_unmeasuredCount;
+    mutable QMutex m_dimensionsMutex; // guards both of the above
+
     static FontPixmapMap *m_fontPixmapMap;
     static DrawRepMap *m_drawRepMap;
 
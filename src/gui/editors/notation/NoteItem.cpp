@@ -98,7 +98,15 @@ NoteItem::paint(QPainter *painter,
     m_factory->setNoteStyle(m_style);
     m_factory->setSelected(m_selected);
     m_factory->setShaded(m_shaded);
-    m_factory->drawNoteForItem(m_parameters, m_dimensions, mode, painter);
+    if (mode == DrawNormal) {
+        // At the size the factory renders at, the same note drawn
+        // elsewhere will already have left a pixmap in the cache
+        QPoint hotspot;
+        QPixmap pixmap = m_factory->makeNotePixmap(m_parameters, hotspot);
+        painter->drawPixmap(-hotspot, pixmap);
+    } else {
+        m_factory->drawNoteForItem(m_parameters, m_dimensions, mode, painter);
+    }
     painter->restore();
 }
 
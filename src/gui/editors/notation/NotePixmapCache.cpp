@@ -0,0 +1,136 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+
+#include "NotePixmapCache.h"
+
+
+namespace Rosegarden
+{
+
+NotePixmapCache *
+NotePixmapCache::getInstance()
+{
+    static NotePixmapCache *instance = 0;
+    if (!instance) instance = new NotePixmapCache();
+    return instance;
+}
+
+NotePixmapCache::NotePixmapCache() :
+    m_maxBytes(32 * 1024 * 1024),
+    m_bytes(0),
+    m_hits(0),
+    m_misses(0),
+    m_evictions(0)
+{
+}
+
+bool
+NotePixmapCache::find(const std::string &key, QPixmap &pixmap, QPoint &hotspot)
+{
+    EntryMap::iterator i = m_index.find(key);
+
+    if (i == m_index.end()) {
+        ++m_misses;
+        return false;
+    }
+
+    ++m_hits;
+
+    // move to the front, as the most recently used
+    m_entries.splice(m_entries.begin(), m_entries, i->second);
+
+    pixmap = i->second->pixmap;
+    hotspot = i->second->hotspot;
+    return true;
+}
+
+void
+NotePixmapCache::insert(const std::string &key,
+                        const QPixmap &pixmap, const QPoint &hotspot)
+{
+    size_t bytes = size_t(pixmap.width()) * pixmap.height() *
+        pixmap.depth() / 8;
+    if (bytes == 0) bytes = 1;
+
+    if (bytes > m_maxBytes) return;
+
+    EntryMap::iterator i = m_index.find(key);
+    if (i != m_index.end()) {
+        m_bytes -= i->second->bytes;
+        m_entries.erase(i->second);
+        m_index.erase(i);
+    }
+
+    evict(m_maxBytes - bytes);
+
+    Entry entry;
+    entry.key = key;
+    entry.pixmap = pixmap;
+    entry.hotspot = hotspot;
+    entry.bytes = bytes;
+
+    m_entries.push_front(entry);
+    m_index[key] = m_entries.begin();
+    m_bytes += bytes;
+}
+
+void
+NotePixmapCache::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+void
+NotePixmapCache::setMaxBytes(size_t bytes)
+{
+    m_maxBytes = bytes;
+    evict(m_maxBytes);
+}
+
+void
+NotePixmapCache::evict(size_t maxBytes)
+{
+    while (m_bytes > maxBytes && !m_entries.empty()) {
+        Entry &entry = m_entries.back();
+        m_bytes -= entry.bytes;
+        m_index.erase(entry.key);
+        m_entries.pop_back();
+        ++m_evictions;
+    }
+}
+
+void
+NotePixmapCache::dumpStats(std::ostream &s) const
+{
+    int lookups = m_hits + m_misses;
+
+    s << "NotePixmapCache: " << m_entries.size() << " pixmaps, "
+      << (m_bytes / 1024) << "K of " << (m_maxBytes / 1024) << "K; "
+      << m_hits << " hits, " << m_misses << " misses";
+
+    if (lookups > 0) {
+        s << " (" << int(m_hits * 100.0 / lookups) << "% hit rate)";
+    }
+
+    s << ", " << m_evictions << " evicted" << std::endl;
+}
+
+
+}
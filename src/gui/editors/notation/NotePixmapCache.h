@@ -0,0 +1,110 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_NOTEPIXMAPCACHE_H
+#define RG_NOTEPIXMAPCACHE_H
+
+#include <QPixmap>
+#include <QPoint>
+
+#include <list>
+#include <map>
+#include <string>
+#include <iostream>
+
+
+namespace Rosegarden
+{
+
+/**
+ * A cache of the pixmaps NotePixmapFactory renders for notes, rests,
+ * clefs, keys and time signatures, shared by all the factories.  A
+ * page of notation draws the same few symbols again and again, and
+ * each one after the first is then a copy of the pixmap rendered for
+ * it before (QPixmap is implicitly shared, so this costs no more than
+ * a reference).
+ *
+ * Entries are keyed by a string describing everything that went into
+ * rendering them: the font and its size, the colour and selection
+ * state, and the symbol's own parameters.  The cache holds at most a
+ * given number of bytes of pixmap, and when full it discards the
+ * entries least recently used.
+ *
+ * Pixmaps may only be used on the GUI thread, and so may this.
+ */
+
+class NotePixmapCache
+{
+public:
+    static NotePixmapCache *getInstance();
+
+    /**
+     * Look up the pixmap and hotspot rendered for the given key.
+     * Returns false if there are none.
+     */
+    bool find(const std::string &key, QPixmap &pixmap, QPoint &hotspot);
+
+    /**
+     * Store a pixmap and its hotspot under the given key, discarding
+     * older entries if the cache would otherwise be too large
+     */
+    void insert(const std::string &key,
+                const QPixmap &pixmap, const QPoint &hotspot);
+
+    void clear();
+
+    void setMaxBytes(size_t bytes);
+    size_t getMaxBytes() const { return m_maxBytes; }
+    size_t getBytes() const { return m_bytes; }
+
+    int getHits() const { return m_hits; }
+    int getMisses() const { return m_misses; }
+    int getEvictions() const { return m_evictions; }
+
+    void dumpStats(std::ostream &) const;
+
+private:
+    NotePixmapCache();
+
+    void evict(size_t maxBytes);
+
+    struct Entry {
+        std::string key;
+        QPixmap pixmap;
+        QPoint hotspot;
+        size_t bytes;
+    };
+
+    // Most recently used first
+    typedef std::list<Entry> EntryList;
+    typedef std::map<std::string, EntryList::iterator> EntryMap;
+
+    EntryList m_entries;
+    EntryMap m_index;
+
+    size_t m_maxBytes;
+    size_t m_bytes;
+
+    int m_hits;
+    int m_misses;
+    int m_evictions;
+};
+
+
+}
+
+#endif
@@ -40,6 +40,7 @@
 #include "NoteCharacterNames.h"
 #include "NoteFontFactory.h"
 #include "NoteFont.h"
+#include "NotePixmapCache.h"
 #include "NotePixmapParameters.h"
 #include "NotePixmapPainter.h"
 #include "NoteStyleFactory.h"
@@ -64,6 +65,7 @@
 #include <QMatrix>
 
 #include <cmath>
+#include <cstdio>
 
 
 namespace Rosegarden
@@ -302,6 +304,7 @@ NotePixmapFactory::dumpStats(std::ostream &s)
   drawBeamsCount = 0;
   drawBeamsBeamCount = 0;
 */
+    NotePixmapCache::getInstance()->dumpStats(s);
 #endif
 
     (void)s; // avoid warnings
@@ -348,12 +351,32 @@ NotePixmapFactory::drawNoteForItem(const NotePixmapParameters &params,
 QGraphicsPixmapItem *
 NotePixmapFactory::makeNotePixmapItem(const NotePixmapParameters &params)
 {
-    Profiler profiler("NotePixmapFactory::makeNotePixmapItem");
+    QPoint hotspot;
+    QPixmap pixmap = makeNotePixmap(params, hotspot);
+
+    QGraphicsPixmapItem *p = new QGraphicsPixmapItem;
+    p->setPixmap(pixmap);
+    p->setOffset(QPointF(-hotspot.x(), -hotspot.y()));
+    return p;
+}
+
+QPixmap
+NotePixmapFactory::makeNotePixmap(const NotePixmapParameters &params,
+                                  QPoint &hotspot)
+{
+    std::string cacheKey = getCacheKey("note/" + params.getCacheKey());
+
+    QPixmap pixmap;
+    if (NotePixmapCache::getInstance()->find(cacheKey, pixmap, hotspot)) {
+        return pixmap;
+    }
+
+    Profiler profiler("NotePixmapFactory::makeNotePixmap");
 
     calculateNoteDimensions(params);
     drawNoteAux(params, 0, 0, 0);
 
-    QPoint hotspot(m_nd.left, m_nd.above + m_nd.noteBodyHeight / 2);
+    hotspot = QPoint(m_nd.left, m_nd.above + m_nd.noteBodyHeight / 2);
 
     //#define ROSE_DEBUG_NOTE_PIXMAP_FACTORY
 #ifdef ROSE_DEBUG_NOTE_PIXMAP_FACTORY
@@ -374,7 +397,9 @@ NotePixmapFactory::makeNotePixmapItem(const NotePixmapParameters &params)
     }
 #endif
 
-    return makeItem(hotspot);
+    pixmap = makePixmap();
+    NotePixmapCache::getInstance()->insert(cacheKey, pixmap, hotspot);
+    return pixmap;
 }
 
 void
@@ -1704,10 +1729,14 @@ NotePixmapFactory::makeRest(const NotePixmapParameters &params)
         }
     }
 
+    std::string cacheKey = getCacheKey("rest/" + params.getCacheKey());
+    QGraphicsPixmapItem *cached = findCachedItem(cacheKey);
+    if (cached) return cached;
+
     QPoint hotspot(m_font->getHotspot(charName));
     drawRestAux(params, hotspot, 0, 0, 0);
 
-    QGraphicsPixmapItem *canvasMap = makeItem(hotspot);
+    QGraphicsPixmapItem *canvasMap = makeItem(hotspot, cacheKey);
     return canvasMap;
 }
 
@@ -1818,6 +1847,12 @@ NotePixmapFactory::makeClef(const Clef &clef, const ColourType colourType)
     int oct = clef.getOctaveOffset();
     if (oct == 0) return plain.makeItem();
 
+    char symbol[100];
+    sprintf(symbol, "/%d/%d", oct, int(colourType));
+    std::string cacheKey = getCacheKey("clef/" + clef.getClefType() + symbol);
+    QGraphicsPixmapItem *cached = findCachedItem(cacheKey);
+    if (cached) return cached;
+
     // Since there was an offset, we have additional bits to draw, and must
     // match up the colour.  This bit is rather hacky, but I decided not to
     // embark on a little refactoring project to unify all of this colour
@@ -1884,7 +1919,7 @@ NotePixmapFactory::makeClef(const Clef &clef, const ColourType colourType)
 
     QPoint hotspot(plain.getHotspot());
     if (oct > 0) hotspot.setY(hotspot.y() + th);
-    return makeItem(hotspot);
+    return makeItem(hotspot, cacheKey);
 }
 
 
@@ -1989,6 +2024,14 @@ NotePixmapFactory::makeKey(const Key &key,
 
     Profiler profiler("NotePixmapFactory::makeKey");
 
+    char symbol[100];
+    sprintf(symbol, "/%d/%d", clef.getOctaveOffset(), int(colourType));
+    std::string cacheKey = getCacheKey("key/" + key.getName() + "/" +
+                                       previousKey.getName() + "/" +
+                                       clef.getClefType() + symbol);
+    QGraphicsPixmapItem *cached = findCachedItem(cacheKey);
+    if (cached) return cached;
+
     std::vector<int> ah0 = previousKey.getAccidentalHeights(clef);
     std::vector<int> ah1 = key.getAccidentalHeights(clef);
 
@@ -2073,7 +2116,7 @@ NotePixmapFactory::makeKey(const Key &key,
         }
     }
 
-    return makeItem(m_pointZero);
+    return makeItem(m_pointZero, cacheKey);
 }
 
 QPixmap
@@ -3022,6 +3065,13 @@ NotePixmapFactory::makeTimeSig(const TimeSignature& sig)
 {
     Profiler profiler("NotePixmapFactory::makeTimeSig");
 
+    char symbol[100];
+    sprintf(symbol, "timesig/%d/%d/%d", sig.getNumerator(),
+            sig.getDenominator(), sig.isCommon());
+    std::string cacheKey = getCacheKey(symbol);
+    QGraphicsPixmapItem *cached = findCachedItem(cacheKey);
+    if (cached) return cached;
+
     if (sig.isCommon()) {
 
         NoteCharacter character;
@@ -3036,7 +3086,7 @@ NotePixmapFactory::makeTimeSig(const TimeSignature& sig)
         if (getCharacter(charName, character, PlainColour, false)) {
             createPixmap(character.getWidth(), character.getHeight());
             m_p->drawNoteCharacter(0, 0, character);
-            return makeItem(QPoint(0, character.getHeight() / 2));
+            return makeItem(QPoint(0, character.getHeight() / 2), cacheKey);
         }
 
         QString c("c");
@@ -3067,7 +3117,7 @@ NotePixmapFactory::makeTimeSig(const TimeSignature& sig)
         }
 
         m_p->painter().setPen(QColor(Qt::black));
-        return makeItem(QPoint(0, r.height() / 2 + dy));
+        return makeItem(QPoint(0, r.height() / 2 + dy), cacheKey);
 
     } else {
 
@@ -3114,7 +3164,7 @@ NotePixmapFactory::makeTimeSig(const TimeSignature& sig)
                 denominator /= 10;
             }
 
-            return makeItem(QPoint(0, height / 2));
+            return makeItem(QPoint(0, height / 2), cacheKey);
         }
 
         QRect numR = m_timeSigFontMetrics.boundingRect(numS);
@@ -3143,12 +3193,14 @@ NotePixmapFactory::makeTimeSig(const TimeSignature& sig)
         m_p->painter().setPen(QColor(Qt::black));
 
         return makeItem(QPoint(0, denomR.height() +
-                               (getNoteBodyHeight() / 4) - 1));
+                               (getNoteBodyHeight() / 4) - 1), cacheKey);
     }
 }
 
 int NotePixmapFactory::getTimeSigWidth(const TimeSignature &sig) const
 {
+    QMutexLocker locker(&m_textMutex);
+
     if (sig.isCommon()) {
 
         QRect r(m_bigTimeSigFontMetrics.boundingRect("c"));
@@ -3175,6 +3227,8 @@ int NotePixmapFactory::getTimeSigWidth(const TimeSignature &sig) const
 QFont
 NotePixmapFactory::getTextFont(const Text &text) const
 {
+    QMutexLocker locker(&m_textMutex);
+
     std::string type(text.getTextType());
     TextFontCache::iterator i = m_textFontCache.find(type.c_str());
     if (i != m_textFontCache.end())
@@ -3499,6 +3553,44 @@ NotePixmapFactory::makePixmap()
     return p;
 }
 
+QGraphicsPixmapItem *
+NotePixmapFactory::makeItem(QPoint hotspot, const std::string &cacheKey)
+{
+    QGraphicsPixmapItem *p = makeItem(hotspot);
+    NotePixmapCache::getInstance()->insert(cacheKey, p->pixmap(), hotspot);
+    return p;
+}
+
+QGraphicsPixmapItem *
+NotePixmapFactory::findCachedItem(const std::string &cacheKey)
+{
+    QPixmap pixmap;
+    QPoint hotspot;
+    if (!NotePixmapCache::getInstance()->find(cacheKey, pixmap, hotspot)) {
+        return 0;
+    }
+
+    QGraphicsPixmapItem *p = new QGraphicsPixmapItem;
+    p->setPixmap(pixmap);
+    p->setOffset(QPointF(-hotspot.x(), -hotspot.y()));
+    return p;
+}
+
+std::string
+NotePixmapFactory::getCacheKey(const std::string &symbol) const
+{
+    // Everything besides the symbol itself that affects how it is
+    // drawn: the fonts, the note style, and the colour
+
+    char state[100];
+    sprintf(state, "/%d/%d/%d%d%d/", m_font->getSize(),
+            (m_haveGrace ? m_graceSize : 0),
+            m_selected, m_shaded, m_inPrinterMethod);
+
+    return qstrtostr(m_font->getName()) + "/" +
+        qstrtostr(m_style->getName()) + state + symbol;
+}
+
 NoteCharacter
 NotePixmapFactory::getCharacter(CharName name, ColourType type, bool inverted)
 {
@@ -3734,27 +3826,82 @@ int NotePixmapFactory::getKeyWidth(const Key &key,
     else
         keyCharName = NoteCharacterNames::FLAT;
 
-    NoteCharacter keyCharacter;
-    NoteCharacter cancelCharacter;
+    // Only the dimensions of the characters are needed, and unlike
+    // the characters themselves those can be had on any thread
+
+    int keyWidth = 0, keyHotspotX = 0, height = 0;
+    if (m_font->getDimensions(keyCharName, keyWidth, height)) {
+        keyHotspotX = m_font->getHotspot(keyCharName).x();
+    } else {
+        keyWidth = 0;
+    }
 
-    keyCharacter = m_font->getCharacter(keyCharName);
+    int cancelWidth = 0;
     if (cancelCount > 0) {
-        cancelCharacter = m_font->getCharacter(NoteCharacterNames::NATURAL);
+        if (!m_font->getDimensions(NoteCharacterNames::NATURAL,
+                                   cancelWidth, height)) {
+            cancelWidth = 0;
+        }
     }
 
     //int x = 0;
     //int lw = getLineSpacing();
-    int keyDelta = keyCharacter.getWidth() - keyCharacter.getHotspot().x();
+    int keyDelta = keyWidth - keyHotspotX;
 
     int cancelDelta = 0;
     int between = 0;
     if (cancelCount > 0) {
-        cancelDelta = cancelCharacter.getWidth() + cancelCharacter.getWidth() / 3;
-        between = cancelCharacter.getWidth();
+        cancelDelta = cancelWidth + cancelWidth / 3;
+        between = cancelWidth;
     }
 
     return (keyDelta * ah1.size() + cancelDelta * cancelCount + between +
-            keyCharacter.getWidth() / 4);
+            keyWidth / 4);
+}
+
+void NotePixmapFactory::measureCharacters() const
+{
+    for (Note::Type type = Note::Shortest; type <= Note::Longest; ++type) {
+        (void)getNoteBodyWidth(type);
+        (void)getRestWidth(Note(type));
+    }
+
+    (void)getDotWidth();
+
+    Accidentals::AccidentalList accidentals =
+        Accidentals::getStandardAccidentals();
+    for (Accidentals::AccidentalList::iterator i = accidentals.begin();
+         i != accidentals.end(); ++i) {
+        (void)getAccidentalWidth(*i, 1, true);
+    }
+
+    // These have no characters of their own in any of our styles, and
+    // are drawn as the unknown character, but measure them through the
+    // style in case one maps them
+    const Accidental quarterTones[] = {
+        Accidentals::QuarterFlat, Accidentals::ThreeQuarterFlat,
+        Accidentals::QuarterSharp, Accidentals::ThreeQuarterSharp
+    };
+    for (size_t i = 0; i < sizeof(quarterTones)/sizeof(quarterTones[0]); ++i) {
+        (void)getAccidentalWidth(quarterTones[i], 1, true);
+    }
+
+    Clef::ClefList clefs = Clef::getClefs();
+    for (Clef::ClefList::iterator i = clefs.begin(); i != clefs.end(); ++i) {
+        (void)getClefWidth(*i);
+    }
+
+    (void)m_font->getHotspot(NoteCharacterNames::SHARP);
+    (void)m_font->getHotspot(NoteCharacterNames::FLAT);
+    (void)m_font->getHotspot(NoteCharacterNames::NATURAL);
+
+    // What the style falls back on for anything it has no name for
+    (void)m_font->getHotspot(NoteCharacterNames::UNKNOWN);
+}
+
+int NotePixmapFactory::getUnmeasuredCount() const
+{
+    return m_font->getUnmeasuredCount();
 }
 
 int NotePixmapFactory::getTextWidth(const Text &text) const
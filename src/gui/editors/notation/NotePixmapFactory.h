@@ -30,6 +30,7 @@
 
 #include <QFont>
 #include <QFontMetrics>
+#include <QMutex>
 #include <QPixmap>
 #include <QPoint>
 
@@ -127,6 +128,12 @@ public:
 
     QGraphicsPixmapItem *makeNotePixmapItem(const NotePixmapParameters &parameters);
 
+    /** Return a pixmap of the note, and its hotspot, from the shared
+     * NotePixmapCache, rendering it first if it isn't there already
+     */
+    QPixmap makeNotePixmap(const NotePixmapParameters &parameters,
+                           QPoint &hotspot);
+
     void getNoteDimensions(const NotePixmapParameters &parameters,
                            NoteItemDimensions &dimensions);
 
@@ -230,6 +237,22 @@ public:
                     Key previousKey = Key::DefaultKey) const;
     int getTextWidth(const Text &text) const;
 
+    /**
+     * Measure all the characters the width methods above depend on,
+     * so that getNoteBodyWidth, getAccidentalWidth, getDotWidth,
+     * getClefWidth, getTimeSigWidth, getRestWidth, getKeyWidth and
+     * getTextWidth may afterwards be called from threads other than
+     * the GUI thread.  Call this on the GUI thread.
+     */
+    void measureCharacters() const;
+
+    /**
+     * Return the number of lookups of characters that had not been
+     * measured, made on threads other than the GUI thread.  See
+     * NoteFont::getUnmeasuredCount().
+     */
+    int getUnmeasuredCount() const;
+
     /**
      * Returns the width of clef and key signature drawn in a track header.
      */
@@ -343,6 +366,15 @@ protected:
     QGraphicsPixmapItem *makeItem(QPoint hotspot);
     QPixmap makePixmap();
 
+    /// as makeItem, also storing the pixmap in the NotePixmapCache:
+    QGraphicsPixmapItem *makeItem(QPoint hotspot, const std::string &cacheKey);
+
+    /// returns 0 if there is nothing in the NotePixmapCache for this key:
+    QGraphicsPixmapItem *findCachedItem(const std::string &cacheKey);
+
+    /// the symbol's description, qualified by our font, style and colours:
+    std::string getCacheKey(const std::string &symbol) const;
+
     /// draws selected/shaded status from m_selected/m_shaded:
     NoteCharacter getCharacter(CharName name, ColourType type, bool inverted);
 
@@ -402,6 +434,10 @@ protected:
     typedef std::map<const char *, QFont> TextFontCache;
     mutable TextFontCache m_textFontCache;
 
+    // Guards the text font cache and the time signature font metrics,
+    // which may be used on layout threads
+    mutable QMutex m_textMutex;
+
     static QPoint m_pointZero;
 };
 
@@ -20,6 +20,8 @@
 
 #include "base/NotationTypes.h"
 
+#include <cstdio>
+
 
 namespace Rosegarden
 {
@@ -34,6 +36,7 @@ NotePixmapParameters::NotePixmapParameters(Note::Type noteType,
         m_shifted(false),
         m_dotShifted(false),
         m_accidentalShift(0),
+        m_accidentalExtra(false),
         m_drawFlag(true),
         m_drawStem(true),
         m_stemGoesUp(true),
@@ -57,6 +60,7 @@ NotePixmapParameters::NotePixmapParameters(Note::Type noteType,
         m_tuplingLineY(0),
         m_tuplingLineWidth(0),
         m_tuplingLineGradient(0.0),
+        m_tuplingLineFollowsBeam(false),
         m_tied(false),
         m_tieLength(0),
         m_tiePositionExplicit(false),
@@ -155,4 +159,35 @@ NotePixmapParameters::getAboveMarks() const
     return marks;
 }
 
+std::string
+NotePixmapParameters::getCacheKey() const
+{
+    // Everything operator== compares.  The gradients are written
+    // exactly, as operator== lets them differ a little and a pixmap
+    // drawn for one must not be reused for another
+
+    char buffer[512];
+    sprintf(buffer, "%d/%d/%d%d%d%d%d%d%d/%d/%d/%d/%d/%d%d%d%d%d/%d/%d/"
+            "%d/%d%d%d/%d/%a/%d/%d/%d/%a/%d/%d%d%d%d/%d",
+            int(m_noteType), m_dots,
+            m_cautionary, m_shifted, m_dotShifted, m_accidentalExtra,
+            m_drawFlag, m_drawStem, m_stemGoesUp,
+            m_accidentalShift, m_stemLength, m_legerLines, m_slashes,
+            m_selected, m_highlighted, m_quantized, m_onLine,
+            m_restOutsideStave, int(m_trigger), m_safeVertDistance,
+            m_nextBeamCount, m_beamed, m_thisPartialBeams, m_nextPartialBeams,
+            m_width, m_gradient,
+            m_tupletCount, m_tuplingLineY, m_tuplingLineWidth,
+            m_tuplingLineGradient, m_tuplingLineFollowsBeam,
+            m_tied, m_tiePositionExplicit, m_tieAbove, m_inRange,
+            m_tieLength);
+
+    std::string key(buffer);
+    key += "/" + m_accidental;
+    for (unsigned int i = 0; i < m_marks.size(); ++i) {
+        key += "/" + m_marks[i];
+    }
+    return key;
+}
+
 }
@@ -21,6 +21,7 @@
 
 #include "base/NotationTypes.h"
 #include <vector>
+#include <string>
 #include <cmath>
 
 
@@ -107,6 +108,14 @@ public:
     // always be drawn *below* the note, and we get it wrong, and/or there are
     // some things we treat as normal marks and shouldn't.  Hrm.
 
+    /** Return a string for use as a key in the NotePixmapCache.  Two
+     * sets of parameters have the same key only if they would draw the
+     * same pixmap, and so compare equal.  The gradients are keyed on
+     * their exact values, so parameters whose gradients differ by less
+     * than operator== allows still have different keys.
+     */
+    std::string getCacheKey() const;
+
     bool operator==(const NotePixmapParameters &p) {
 	return (m_noteType == p.m_noteType &&
 		m_dots == p.m_dots &&
@@ -554,7 +554,7 @@ void CompositionModelImpl::eventAdded(const Segment *s, Event *)
     //RG_DEBUG << "CompositionModelImpl::eventAdded()";
     Profiler profiler("CompositionModelImpl::eventAdded()");
     removePreviewCache(s);
-    emit needContentUpdate(computeSegmentRect(*s));
+    segmentNeedsUpdate(s);
 }
 
 void CompositionModelImpl::eventRemoved(const Segment *s, Event *)
@@ -562,21 +562,21 @@ void CompositionModelImpl::eventRemoved(const Segment *s, Event *)
     //RG_DEBUG << "CompositionModelImpl::eventRemoved";
     Profiler profiler("CompositionModelImpl::eventRemoved()");
     removePreviewCache(s);
-    emit needContentUpdate(computeSegmentRect(*s));
+    segmentNeedsUpdate(s);
 }
 
 void CompositionModelImpl::AllEventsChanged(const Segment *s)
 {
      Profiler profiler("CompositionModelImpl::AllEventsChanged()");
     removePreviewCache(s);
-    emit needContentUpdate(computeSegmentRect(*s));
+    segmentNeedsUpdate(s);
 }
 
 void CompositionModelImpl::appearanceChanged(const Segment *s)
 {
     //RG_DEBUG << "CompositionModelImpl::appearanceChanged";
     clearInCache(s, true);
-    emit needContentUpdate(computeSegmentRect(*s));
+    segmentNeedsUpdate(s);
 }
 
 void CompositionModelImpl::endMarkerTimeChanged(const Segment *s, bool shorten)
@@ -584,11 +584,9 @@ void CompositionModelImpl::endMarkerTimeChanged(const Segment *s, bool shorten)
     Profiler profiler("CompositionModelImpl::endMarkerTimeChanged(Segment *, bool)");
     //RG_DEBUG << "CompositionModelImpl::endMarkerTimeChanged(" << shorten << ")";
     clearInCache(s, true);
-    if (shorten) {
-        emit needContentUpdate(); // no longer know former segment dimension
-    } else {
-        emit needContentUpdate(computeSegmentRect(*s));
-    }
+    // segmentNeedsUpdate() knows the former segment dimension, if the
+    // segment has been drawn
+    segmentNeedsUpdate(s);
 }
 
 void CompositionModelImpl::makePreviewCache(const Segment *s)
@@ -618,25 +616,35 @@ void CompositionModelImpl::removePreviewCache(const Segment *s)
 void CompositionModelImpl::segmentAdded(const Composition *, Segment *s)
 {
     RG_DEBUG << "CompositionModelImpl::segmentAdded: segment " << s << " on track " << s->getTrack() << ": calling setTrackHeights";
-    setTrackHeights(s);
+    bool heightsChanged = setTrackHeights(s);
 
     makePreviewCache(s);
     s->addObserver(this);
-    emit needContentUpdate();
+
+    if (heightsChanged) emit needContentUpdate();
+    else segmentNeedsUpdate(s);
 }
 
 void CompositionModelImpl::segmentRemoved(const Composition *, Segment *s)
 {
-    setTrackHeights();
+    bool heightsChanged = setTrackHeights();
 
     QRect r = computeSegmentRect(*s);
 
+    std::map<const Segment *, QRect>::iterator i = m_drawnSegmentRects.find(s);
+    if (i != m_drawnSegmentRects.end()) {
+        r |= i->second;
+        m_drawnSegmentRects.erase(i);
+    }
+
     m_selectedSegments.erase(s);
 
     clearInCache(s, true);
     s->removeObserver(this);
     m_recordingSegments.erase(s); // this could be a recording segment
-    emit needContentUpdate(r);
+
+    if (heightsChanged) emit needContentUpdate();
+    else emit needContentUpdate(r);
 }
 
 void CompositionModelImpl::segmentTrackChanged(const Composition *, Segment *s, TrackId tid)
@@ -649,13 +657,22 @@ void CompositionModelImpl::segmentTrackChanged(const Composition *, Segment *s,
     if (setTrackHeights()) {
         RG_DEBUG << "... changed, updating";
         emit needContentUpdate();
+    } else {
+        segmentNeedsUpdate(s);
     }
 }
 
 void CompositionModelImpl::segmentStartChanged(const Composition *, Segment *s, timeT)
 {
 //    RG_DEBUG << "CompositionModelImpl::segmentStartChanged: segment " << s << " on track " << s->getTrack() << ": calling setTrackHeights";
-    if (setTrackHeights(s)) emit needContentUpdate();
+    if (setTrackHeights(s)) {
+        emit needContentUpdate();
+    } else {
+        segmentNeedsUpdate(s);
+        // an earlier repeating segment on the track may now repeat
+        // for more or less time
+        repeatingSegmentsNeedUpdate(s->getTrack());
+    }
 }
 
 void CompositionModelImpl::segmentEndMarkerChanged(const Composition *, Segment *s, bool)
@@ -665,14 +682,21 @@ void CompositionModelImpl::segmentEndMarkerChanged(const Composition *, Segment
     if (setTrackHeights(s)) {
 //        RG_DEBUG << "... changed, updating";
         emit needContentUpdate();
+    } else {
+        segmentNeedsUpdate(s);
     }
 }
 
 void CompositionModelImpl::segmentRepeatChanged(const Composition *, Segment *s, bool)
 {
     clearInCache(s);
-    setTrackHeights(s);
-    emit needContentUpdate();
+    if (setTrackHeights(s)) emit needContentUpdate();
+    else segmentNeedsUpdate(s);
+}
+
+void CompositionModelImpl::segmentRepeatEndChanged(const Composition *, Segment *s, timeT)
+{
+    segmentNeedsUpdate(s);
 }
 
 void CompositionModelImpl::endMarkerTimeChanged(const Composition *, bool)
@@ -680,6 +704,78 @@ void CompositionModelImpl::endMarkerTimeChanged(const Composition *, bool)
     emit needSizeUpdate();
 }
 
+void CompositionModelImpl::trackChanged(const Composition *, Track *t)
+{
+    // Only this track's segments can look different.  If the track
+    // has moved, whichever track it changed places with is notified
+    // too, and segmentNeedsUpdate() covers where they were drawn.
+    if (setTrackHeights() || !t) emit needContentUpdate();
+    else trackSegmentsNeedUpdate(t->getId());
+}
+
+void CompositionModelImpl::tracksDeleted(const Composition *, std::vector<TrackId> &)
+{
+    setTrackHeights();
+    emit needContentUpdate();
+}
+
+void CompositionModelImpl::tracksAdded(const Composition *, std::vector<TrackId> &)
+{
+    setTrackHeights();
+    emit needContentUpdate();
+}
+
+void CompositionModelImpl::tempoChanged(const Composition *)
+{
+    // An audio segment lasts for a fixed real time, so its width and
+    // its preview depend on the tempo.  Other segments are laid out
+    // in musical time and are unaffected.
+    const segmentcontainer &segments = m_composition.getSegments();
+
+    for (segmentcontainer::const_iterator i = segments.begin();
+         i != segments.end(); ++i) {
+        if ((*i)->getType() == Segment::Audio) {
+            clearInCache(*i, true);
+            segmentNeedsUpdate(*i);
+        }
+    }
+}
+
+void CompositionModelImpl::segmentNeedsUpdate(const Segment *s)
+{
+    QRect r = computeSegmentRect(*s);
+
+    std::map<const Segment *, QRect>::iterator i = m_drawnSegmentRects.find(s);
+    if (i != m_drawnSegmentRects.end()) {
+        r |= i->second;
+        m_drawnSegmentRects.erase(i);
+    }
+
+    emit needContentUpdate(r);
+}
+
+void CompositionModelImpl::repeatingSegmentsNeedUpdate(TrackId track)
+{
+    const segmentcontainer &segments = m_composition.getSegments();
+
+    for (segmentcontainer::const_iterator i = segments.begin();
+         i != segments.end(); ++i) {
+        if ((*i)->getTrack() == track && (*i)->isRepeating()) {
+            segmentNeedsUpdate(*i);
+        }
+    }
+}
+
+void CompositionModelImpl::trackSegmentsNeedUpdate(TrackId track)
+{
+    const segmentcontainer &segments = m_composition.getSegments();
+
+    for (segmentcontainer::const_iterator i = segments.begin();
+         i != segments.end(); ++i) {
+        if ((*i)->getTrack() == track) segmentNeedsUpdate(*i);
+    }
+}
+
 void CompositionModelImpl::setSelectionRect(const QRect &rect)
 {
     m_selectionRect = rect.normalized();
@@ -1288,6 +1384,9 @@ CompositionModelImpl::getSegmentRects(
             }
 
             m_segmentRects.push_back(segmentRect);
+
+            // The caller may be about to draw it there
+            m_drawnSegmentRects[s] |= segmentRect;
         } else {
             //RG_DEBUG << "CompositionModelImpl::getSegmentRects(): - segment out of rect";
         }
@@ -278,10 +278,15 @@ private:
     virtual void segmentAdded(const Composition *, Segment *);
     virtual void segmentRemoved(const Composition *, Segment *);
     virtual void segmentRepeatChanged(const Composition *, Segment *, bool);
+    virtual void segmentRepeatEndChanged(const Composition *, Segment *, timeT);
     virtual void segmentStartChanged(const Composition *, Segment *, timeT);
     virtual void segmentEndMarkerChanged(const Composition *, Segment *, bool);
     virtual void segmentTrackChanged(const Composition *, Segment *, TrackId);
     virtual void endMarkerTimeChanged(const Composition *, bool /*shorten*/);
+    virtual void trackChanged(const Composition *, Track *);
+    virtual void tracksDeleted(const Composition *, std::vector<TrackId> &);
+    virtual void tracksAdded(const Composition *, std::vector<TrackId> &);
+    virtual void tempoChanged(const Composition *);
 
     // SegmentObserver Interface
     virtual void eventAdded(const Segment *, Event *);
@@ -295,6 +300,19 @@ private:
 
     bool setTrackHeights(Segment *changed = 0); // true if something changed
 
+    /**
+     * Emit needContentUpdate() for the area the segment covers now,
+     * together with anywhere getSegmentRects() has returned it since
+     * it last changed, so that the view only needs to redraw that.
+     */
+    void segmentNeedsUpdate(const Segment *);
+
+    /// segmentNeedsUpdate() for the repeating segments on a track.
+    void repeatingSegmentsNeedUpdate(TrackId);
+
+    /// segmentNeedsUpdate() for all the segments on a track.
+    void trackSegmentsNeedUpdate(TrackId);
+
     bool isTmpSelected(const Segment*) const;
     bool wasTmpSelected(const Segment*) const;
     bool isMoving(const Segment*) const;
@@ -382,6 +400,8 @@ private:
 
     std::map<const Segment*, CompositionRect> m_segmentRectMap;
     std::map<const Segment*, timeT> m_segmentEndTimeMap;
+    /// Where each segment may have been drawn.  See segmentNeedsUpdate().
+    std::map<const Segment*, QRect> m_drawnSegmentRects;
     std::map<const Segment*, PixmapArray> m_audioSegmentPreviewMap;
     std::map<TrackId, int> m_trackHeights;
 
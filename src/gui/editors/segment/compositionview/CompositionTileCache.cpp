@@ -0,0 +1,178 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+
+#include "CompositionTileCache.h"
+
+#include <cmath>
+
+
+namespace Rosegarden
+{
+
+const int CompositionTileCache::TileSize;
+
+CompositionTileCache::CompositionTileCache() :
+    m_zoom(0),
+    m_origin(0),
+    m_maxBytes(64 * 1024 * 1024),
+    m_bytes(0),
+    m_hits(0),
+    m_draws(0),
+    m_evictions(0)
+{
+}
+
+QPixmap &
+CompositionTileCache::getTile(int column, int row, bool &needsDrawing)
+{
+    TileKey key(column, row);
+    TileMap::iterator i = m_index.find(key);
+
+    if (i != m_index.end()) {
+
+        // move to the front, as the most recently used
+        m_tiles.splice(m_tiles.begin(), m_tiles, i->second);
+
+        Tile &tile = *i->second;
+        needsDrawing = !tile.valid;
+        if (needsDrawing) ++m_draws;
+        else ++m_hits;
+        tile.valid = true;
+        return tile.pixmap;
+    }
+
+    size_t bytes = tileBytes();
+
+    // always keep room for the tile we're returning, even if the
+    // limit is smaller than that
+    evict(m_maxBytes > bytes ? m_maxBytes - bytes : 0);
+
+    Tile tile;
+    tile.key = key;
+    tile.pixmap = QPixmap(TileSize, TileSize);
+    tile.valid = true;
+
+    m_tiles.push_front(tile);
+    m_index[key] = m_tiles.begin();
+    m_bytes += bytes;
+
+    needsDrawing = true;
+    ++m_draws;
+    return m_tiles.front().pixmap;
+}
+
+void
+CompositionTileCache::invalidate(const QRect &rect)
+{
+    if (!rect.isValid()) return;
+
+    int firstColumn = int(floor(double(rect.left()) / TileSize));
+    int lastColumn = int(floor(double(rect.right()) / TileSize));
+    int firstRow = int(floor(double(rect.top()) / TileSize));
+    int lastRow = int(floor(double(rect.bottom()) / TileSize));
+
+    // A small rect touches few tiles, so look them up; a large one
+    // may cover many more tiles than we have, so walk the cache
+    if ((lastColumn - firstColumn + 1) * (lastRow - firstRow + 1) <
+        int(m_index.size())) {
+
+        for (int row = firstRow; row <= lastRow; ++row) {
+            for (int column = firstColumn; column <= lastColumn; ++column) {
+                TileMap::iterator i = m_index.find(TileKey(column, row));
+                if (i != m_index.end()) i->second->valid = false;
+            }
+        }
+
+    } else {
+
+        for (TileList::iterator i = m_tiles.begin(); i != m_tiles.end(); ++i) {
+            if (i->key.first >= firstColumn && i->key.first <= lastColumn &&
+                i->key.second >= firstRow && i->key.second <= lastRow) {
+                i->valid = false;
+            }
+        }
+    }
+}
+
+void
+CompositionTileCache::invalidateAll()
+{
+    for (TileList::iterator i = m_tiles.begin(); i != m_tiles.end(); ++i) {
+        i->valid = false;
+    }
+}
+
+void
+CompositionTileCache::setZoom(double zoom, double origin)
+{
+    if (zoom == m_zoom && origin == m_origin) return;
+    m_zoom = zoom;
+    m_origin = origin;
+    clear();
+}
+
+void
+CompositionTileCache::clear()
+{
+    m_tiles.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+void
+CompositionTileCache::setMaxBytes(size_t bytes)
+{
+    m_maxBytes = bytes;
+    evict(m_maxBytes);
+}
+
+void
+CompositionTileCache::evict(size_t maxBytes)
+{
+    while (m_bytes > maxBytes && !m_tiles.empty()) {
+        m_index.erase(m_tiles.back().key);
+        m_tiles.pop_back();
+        m_bytes -= tileBytes();
+        ++m_evictions;
+    }
+}
+
+size_t
+CompositionTileCache::tileBytes()
+{
+    return size_t(TileSize) * TileSize * QPixmap::defaultDepth() / 8;
+}
+
+void
+CompositionTileCache::dumpStats(std::ostream &s) const
+{
+    int lookups = m_hits + m_draws;
+
+    s << "CompositionTileCache: " << m_tiles.size() << " tiles, "
+      << (m_bytes / 1024) << "K of " << (m_maxBytes / 1024) << "K; "
+      << m_hits << " hits, " << m_draws << " drawn";
+
+    if (lookups > 0) {
+        s << " (" << int(m_hits * 100.0 / lookups) << "% hit rate)";
+    }
+
+    s << ", " << m_evictions << " evicted" << std::endl;
+}
+
+
+}
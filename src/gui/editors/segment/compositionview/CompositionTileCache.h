@@ -0,0 +1,122 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_COMPOSITIONTILECACHE_H
+#define RG_COMPOSITIONTILECACHE_H
+
+#include <QPixmap>
+#include <QRect>
+
+#include <list>
+#include <map>
+#include <utility>
+#include <iostream>
+
+
+namespace Rosegarden
+{
+
+/**
+ * A cache of the segment layer of CompositionView, in square tiles of
+ * a fixed size laid out over the contents from its origin.  Scrolling
+ * the view then only copies tiles that are already drawn, and a change
+ * to the composition only needs the tiles it touches to be drawn again.
+ *
+ * A tile is drawn by the view when it asks for it, if it's new or has
+ * been invalidated since it was last drawn.  The tiles are drawn for
+ * one zoom level, and are all forgotten if the zoom changes.  The cache
+ * holds at most a given number of bytes of tiles, and when full it
+ * discards the tiles least recently used.
+ */
+
+class CompositionTileCache
+{
+public:
+    static const int TileSize = 256;
+
+    CompositionTileCache();
+
+    /**
+     * Return the tile at the given column and row, creating it if
+     * there isn't one.  needsDrawing is set if the tile is new or has
+     * been invalidated, in which case the caller must draw it now.
+     */
+    QPixmap &getTile(int column, int row, bool &needsDrawing);
+
+    /// The area of the contents covered by the given tile
+    static QRect getTileRect(int column, int row) {
+        return QRect(column * TileSize, row * TileSize, TileSize, TileSize);
+    }
+
+    /// Mark the tiles overlapping the given contents rect to be drawn again
+    void invalidate(const QRect &rect);
+
+    /// Mark all the tiles to be drawn again
+    void invalidateAll();
+
+    /**
+     * Set the zoom level and the origin of the ruler that the tiles are
+     * being drawn with, forgetting them all if either has changed.
+     */
+    void setZoom(double zoom, double origin);
+
+    void clear();
+
+    void setMaxBytes(size_t bytes);
+    size_t getMaxBytes() const { return m_maxBytes; }
+    size_t getBytes() const { return m_bytes; }
+
+    int getHits() const { return m_hits; }
+    int getDraws() const { return m_draws; }
+    int getEvictions() const { return m_evictions; }
+
+    void dumpStats(std::ostream &) const;
+
+private:
+    void evict(size_t maxBytes);
+    static size_t tileBytes();
+
+    typedef std::pair<int, int> TileKey; // column, row
+
+    struct Tile {
+        TileKey key;
+        QPixmap pixmap;
+        bool valid;
+    };
+
+    // Most recently used first
+    typedef std::list<Tile> TileList;
+    typedef std::map<TileKey, TileList::iterator> TileMap;
+
+    TileList m_tiles;
+    TileMap m_index;
+
+    double m_zoom;
+    double m_origin;
+
+    size_t m_maxBytes;
+    size_t m_bytes;
+
+    int m_hits;
+    int m_draws;
+    int m_evictions;
+};
+
+
+}
+
+#endif
@@ -57,6 +57,7 @@
 #include <QMouseEvent>
 
 #include <algorithm>
+#include <cmath>
 
 
 namespace Rosegarden
@@ -93,7 +94,6 @@ CompositionView::CompositionView(RosegardenDocument* doc,
     m_foreGuidePos(0),
     m_drawSelectionRect(false),
     m_drawTextFloat(false),
-    m_segmentsLayer(visibleWidth(), visibleHeight()),
     m_doubleBuffer(visibleWidth(), visibleHeight()),
     m_segmentsRefresh(0, 0, visibleWidth(), visibleHeight()),
     m_artifactsRefresh(0, 0, visibleWidth(), visibleHeight()),
@@ -200,6 +200,7 @@ void CompositionView::setBackgroundPixmap(const QPixmap &m)
 {
     m_backgroundPixmap = m;
     //     viewport()->setErasePixmap(m_backgroundPixmap);
+    segmentsNeedRefresh();
 }
 
 #if 0
@@ -460,6 +461,13 @@ void CompositionView::slotUpdateAll()
 //    update();
 }
 
+void CompositionView::slotUpdateView()
+{
+    m_segmentsRefresh =
+        QRect(contentsX(), contentsY(), visibleWidth(), visibleHeight());
+    updateContents();
+}
+
 void CompositionView::slotUpdateTimer()
 {
     //RG_DEBUG << "CompositionView::slotUpdateTimer()";
@@ -492,9 +500,12 @@ void CompositionView::updateAll(const QRect& rect)
 
 void CompositionView::slotUpdateAll(const QRect& rect)
 {
-    // Bail if drawing is turned off in the settings.
-    if (!m_enableDrawing)
+    // Bail if drawing is turned off in the settings.  The tiles we have
+    // under the rect are out of date, though, and mustn't be shown again.
+    if (!m_enableDrawing) {
+        m_tileCache.invalidate(rect.normalized());
         return;
+    }
 
     // This one gets hit pretty hard while recording.
     Profiler profiler("CompositionView::slotUpdateAll(const QRect& rect)");
@@ -560,14 +571,18 @@ void CompositionView::resizeEvent(QResizeEvent* e)
     RosegardenScrollView::resizeEvent(e);
     slotUpdateSize();
 
-    int w = std::max(m_segmentsLayer.width(), visibleWidth());
-    int h = std::max(m_segmentsLayer.height(), visibleHeight());
+    int w = std::max(m_doubleBuffer.width(), visibleWidth());
+    int h = std::max(m_doubleBuffer.height(), visibleHeight());
 
-    m_segmentsLayer = QPixmap(w, h);
     m_doubleBuffer = QPixmap(w, h);
-    allNeedRefresh();
 
-    RG_DEBUG << "CompositionView::resizeEvent() : segments layer size = " << m_segmentsLayer.size() << endl;
+    // The segments haven't changed, so the tiles we have are still good:
+    // they just need copying to the new double buffer
+    m_segmentsRefresh =
+        QRect(contentsX(), contentsY(), visibleWidth(), visibleHeight());
+    slotArtifactsNeedRefresh();
+
+    RG_DEBUG << "CompositionView::resizeEvent() : double buffer size = " << m_doubleBuffer.size() << endl;
 }
 
 void CompositionView::viewportPaintEvent(QPaintEvent* e)
@@ -599,8 +614,8 @@ void CompositionView::viewportPaintRect(QRect r)
 
     bool scroll = false;
 
-    // Scroll and refresh the segments layer.
-    bool changed = scrollSegmentsLayer(r, scroll);
+    // Find out how much of the segments layer we need.
+    bool changed = checkSegmentsRefresh(r, scroll);
 
     // r is now the combination of the requested refresh rect and the refresh
     // needed by any scrolling.
@@ -608,18 +623,12 @@ void CompositionView::viewportPaintRect(QRect r)
     if (changed || m_artifactsRefresh.isValid()) {
 
         QRect copyRect(r | m_artifactsRefresh);
-        copyRect.translate(-contentsX(), -contentsY());
 
 //        std::cerr << "changed = " << changed << ", artrefresh " << m_artifactsRefresh.x() << "," << m_artifactsRefresh.y() << " " << m_artifactsRefresh.width() << "x" << m_artifactsRefresh.height() << ": copying from segment to artifacts buffer: " << copyRect.width() << "x" << copyRect.height() << std::endl;
 
-        // Copy the segments to the double buffer.
-        QPainter ap;
-        ap.begin(&m_doubleBuffer);
-        ap.drawPixmap(copyRect.x(), copyRect.y(),
-                      m_segmentsLayer,
-                      copyRect.x(), copyRect.y(),
-                      copyRect.width(), copyRect.height());
-        ap.end();
+        // Copy the segments to the double buffer, drawing any tiles
+        // that have changed.
+        refreshSegments(copyRect);
 
         m_artifactsRefresh |= r;
     }
@@ -658,11 +667,10 @@ void CompositionView::viewportPaintRect(QRect r)
 
 }
 
-bool CompositionView::scrollSegmentsLayer(QRect &rect, bool& scroll)
+bool CompositionView::checkSegmentsRefresh(QRect &rect, bool& scroll)
 {
-    Profiler profiler("CompositionView::scrollSegmentsLayer");
+    Profiler profiler("CompositionView::checkSegmentsRefresh");
 
-    bool all = false;
     QRect refreshRect = m_segmentsRefresh;
 
     int w = visibleWidth(), h = visibleHeight();
@@ -670,159 +678,97 @@ bool CompositionView::scrollSegmentsLayer(QRect &rect, bool& scroll)
 
     scroll = (cx != m_lastBufferRefreshX || cy != m_lastBufferRefreshY);
 
+    // The segments layer is kept in tiles over the whole contents
+    // rather than in a pixmap the size of the viewport, so scrolling
+    // doesn't need any drawing: the tiles that come into view are
+    // copied, and only those not yet drawn (or changed since) are
+    // drawn by refreshSegments().
+
     if (scroll) {
+        refreshRect.setRect(cx, cy, w, h);
+    }
 
-        //RG_DEBUG << "scrollSegmentsLayer: scrolling by ("
-        //         << cx - m_lastBufferRefreshX << "," << cy - m_lastBufferRefreshY << ")" << endl;
+    m_segmentsRefresh = QRect();
+    m_lastBufferRefreshX = cx;
+    m_lastBufferRefreshY = cy;
 
-        if (refreshRect.isValid()) {
+    // Compute the final rect for the caller.
 
-            // If we've scrolled and there was an existing refresh
-            // rect, we can't be sure whether the refresh rect
-            // predated or postdated the internal update of scroll
-            // location.  Cut our losses and refresh everything.
+    rect |= refreshRect;
 
-            refreshRect.setRect(cx, cy, w, h);
+    return refreshRect.isValid();
+}
 
-        } else {
+void CompositionView::refreshSegments(const QRect& rect)
+{
+    Profiler profiler("CompositionView::refreshSegments");
 
-            // No existing refresh rect: we only need to handle the
-            // scroll.  Formerly we dealt with this by copying part of
-            // the pixmap to itself, but that only worked by accident,
-            // and it fails with the raster renderer or on non-X11
-            // platforms.  Use a temporary pixmap instead
+    //RG_DEBUG << "CompositionView::refreshSegments() r = "
+    //         << rect << endl;
 
-            static QPixmap map;
-            if (map.size() != m_segmentsLayer.size()) {
-                map = QPixmap(m_segmentsLayer.size());
-            }
+    if (!rect.isValid()) return;
 
-            // If we're scrolling sideways
-            if (cx != m_lastBufferRefreshX) {
+    // Segment rects scale with the ruler, so tiles drawn at one zoom
+    // level are no use at another.  The width of any fixed duration
+    // will tell us whether the zoom has changed, and the position of
+    // time zero whether the start of the composition has moved.
+    const RulerScale *ruler = grid().getRulerScale();
+    m_tileCache.setZoom(ruler->getWidthForDuration(0, 1000000),
+                        ruler->getXForTime(0));
 
-                // compute the delta
-                int dx = m_lastBufferRefreshX - cx;
+    const int tileSize = CompositionTileCache::TileSize;
 
-                // If we're scrolling less than the entire viewport
-                if (dx > -w && dx < w) {
+    int firstColumn = int(floor(double(rect.left()) / tileSize));
+    int lastColumn = int(floor(double(rect.right()) / tileSize));
+    int firstRow = int(floor(double(rect.top()) / tileSize));
+    int lastRow = int(floor(double(rect.bottom()) / tileSize));
 
-                    // Scroll the segments layer sideways
-                    QPainter cp;
-                    cp.begin(&map);
-                    cp.drawPixmap(0, 0, m_segmentsLayer);
-                    cp.end();
-                    cp.begin(&m_segmentsLayer);
-                    cp.drawPixmap(dx, 0, map);
-                    cp.end();
+    QPainter p(&m_doubleBuffer);
+    p.translate( -contentsX(), -contentsY());
 
-                    // Add the part that was exposed to the refreshRect
-                    if (dx < 0) {
-                        refreshRect |= QRect(cx + w + dx, cy, -dx, h);
-                    } else {
-                        refreshRect |= QRect(cx, cy, dx, h);
-                    }
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
 
-                } else {  // We've scrolled more than the entire viewport
+            QRect tileRect = CompositionTileCache::getTileRect(column, row);
 
-                    // Refresh everything
-                    refreshRect.setRect(cx, cy, w, h);
-                    all = true;
-                }
-            }
+            bool needsDrawing = false;
+            QPixmap &tile = m_tileCache.getTile(column, row, needsDrawing);
+            if (needsDrawing) refreshTile(tile, tileRect);
 
-            // If we're scrolling vertically and the sideways scroll didn't
-            // result in a need to refresh everything,
-            if (cy != m_lastBufferRefreshY && !all) {
-
-                // compute the delta
-                int dy = m_lastBufferRefreshY - cy;
-
-                // If we're scrolling less than the entire viewport
-                if (dy > -h && dy < h) {
-
-                    // Scroll the segments layer vertically
-                    QPainter cp;
-                    cp.begin(&map);
-                    cp.drawPixmap(0, 0, m_segmentsLayer);
-                    cp.end();
-                    cp.begin(&m_segmentsLayer);
-                    cp.drawPixmap(0, dy, map);
-                    cp.end();
-
-                    // Add the part that was exposed to the refreshRect
-                    if (dy < 0) {
-                        refreshRect |= QRect(cx, cy + h + dy, w, -dy);
-                    } else {
-                        refreshRect |= QRect(cx, cy, w, dy);
-                    }
-
-                } else {  // We've scrolled more than the entire viewport
-
-                    // Refresh everything
-                    refreshRect.setRect(cx, cy, w, h);
-                    all = true;
-                }
-            }
+            QRect copyRect = tileRect & rect;
+            p.drawPixmap(copyRect.topLeft(), tile,
+                         copyRect.translated(-tileRect.topLeft()));
         }
     }
-
-    // Refresh the segments layer for the exposed portion.
-
-    bool needRefresh = false;
-
-    if (refreshRect.isValid()) {
-        needRefresh = true;
-    }
-
-    if (needRefresh)
-        refreshSegments(refreshRect);
-
-    // ??? Move these lines to the end of refreshSegments()?
-    //     Or do they still need to run even when needRefresh is false?
-    m_segmentsRefresh = QRect();
-    m_lastBufferRefreshX = cx;
-    m_lastBufferRefreshY = cy;
-
-    // Compute the final rect for the caller.
-
-    rect |= refreshRect;
-    if (scroll)
-        rect.setRect(cx, cy, w, h);  // everything
-
-    return needRefresh;
 }
 
-void CompositionView::refreshSegments(const QRect& rect)
+void CompositionView::refreshTile(QPixmap &tile, const QRect &tileRect)
 {
-    Profiler profiler("CompositionView::refreshSegments");
-
-    //RG_DEBUG << "CompositionView::refreshSegments() r = "
-    //         << rect << endl;
+    Profiler profiler("CompositionView::refreshTile");
 
 //### This constructor used to mean "start painting on the segments layer, taking your default paint configuration from the viewport".  I don't think it's supported any more -- I had to look it up (I'd never known it was possible to do this in the first place!)
-//@@@    QPainter p(&m_segmentsLayer, viewport());
+//@@@    QPainter p(&tile, viewport());
 // Let's see how we get on with:
-    QPainter p(&m_segmentsLayer);
+    QPainter p(&tile);
 
     p.setRenderHint(QPainter::Antialiasing, false);
 
-    p.translate( -contentsX(), -contentsY());
+    p.translate( -tileRect.x(), -tileRect.y());
 
     if (!m_backgroundPixmap.isNull()) {
-        QPoint pp(rect.x() % m_backgroundPixmap.height(), rect.y() % m_backgroundPixmap.width());
-        p.drawTiledPixmap(rect, m_backgroundPixmap, pp);
+        QPoint pp(tileRect.x() % m_backgroundPixmap.width(),
+                  tileRect.y() % m_backgroundPixmap.height());
+        p.drawTiledPixmap(tileRect, m_backgroundPixmap, pp);
     } else {
-        p.eraseRect(rect);
+        p.eraseRect(tileRect);
     }
 
-    drawSegments(&p, rect);
+    drawSegments(&p, tileRect);
 
     // DEBUG - show what's updated
     //    QPen framePen(QColor(Qt::red), 1);
     //    p.setPen(framePen);
-    //    p.drawRect(rect);
-
-    //    m_segmentsNeedRefresh = false;
+    //    p.drawRect(tileRect);
 }
 
 void CompositionView::refreshArtifacts(const QRect& rect)
@@ -21,6 +21,7 @@
 
 #include "CompositionModelImpl.h"
 #include "CompositionItem.h"
+#include "CompositionTileCache.h"
 #include "gui/general/RosegardenScrollView.h"
 #include <QBrush>
 #include <QColor>
@@ -288,6 +289,15 @@ public slots:
      */
     void slotUpdateAll(const QRect &rect);
 
+    /// Redraw the viewport without marking any segments out of date.
+    /**
+     * The model reports where segments have changed through
+     * needContentUpdate(), so this is all that's needed after a
+     * command: only the tiles of the segments layer under those changes
+     * are drawn again, and the rest are just copied.
+     */
+    void slotUpdateView();
+
     /// Handles a view size change.
     /**
      * @see RosegardenScrollView::resizeContents().
@@ -407,34 +417,39 @@ protected:
 
     /// Draw the segments and artifacts on the viewport (screen).
     /**
-     * First, the appropriate portion of the segments layer (m_segmentsLayer)
-     * is copied to the double-buffer (m_doubleBuffer).  Then the artifacts
+     * First, the tiles of the segments layer (m_tileCache) covering the
+     * area are copied to the double-buffer (m_doubleBuffer), drawing any
+     * that aren't up to date on the way.  Then the artifacts
      * are drawn over top of the segments in the double-buffer by
      * refreshArtifacts().  Finally, the double-buffer is copied to
      * the display (QAbstractScrollArea::viewport()).
      */
     virtual void viewportPaintRect(QRect);
     
-    /// Scrolls and refreshes the segment layer (m_segmentsLayer) if needed.
+    /// Works out how much of the viewport needs the segments copying again.
     /**
-     * Returns enough information to determine how much additional work
-     * needs to be done to update the viewport.
+     * Adds the segments refresh rect (m_segmentsRefresh) to the given
+     * rect, or the whole viewport if we have scrolled since the last
+     * call, and returns whether anything needs copying.
      * Used by viewportPaintRect().
-     *
-     * This routine appears to mainly refresh the segments layer.  Scrolling
-     * only happens if needed.  Having "scroll" in the name might be
-     * misleading.  However, calling this refreshSegmentsLayer() confuses
-     * it with refreshSegments().  Need to dig a bit more.
      */
-    bool scrollSegmentsLayer(QRect &rect, bool& scroll);
+    bool checkSegmentsRefresh(QRect &rect, bool& scroll);
 
-    /// Draw the segments on the segment layer (m_segmentsLayer).
+    /// Copy the segments layer tiles to the double-buffer (m_doubleBuffer).
     /**
-     * Draws the background then calls drawSegments() to draw the segments on the
-     * segments layer (m_segmentsLayer).  Used by
-     * scrollSegmentsLayer().
+     * Draws any of the tiles covering the given contents rect that are
+     * new or out of date with refreshTile() first.  Used by
+     * viewportPaintRect().
      */
     void refreshSegments(const QRect&);
+
+    /// Draw the segments on a tile of the segments layer.
+    /**
+     * Draws the background then calls drawSegments() to draw the
+     * segments on the tile covering the given contents rect.  Used by
+     * refreshSegments().
+     */
+    void refreshTile(QPixmap &tile, const QRect &tileRect);
     /// Draw the artifacts on the double-buffer (m_doubleBuffer).
     /*
      * Calls drawArtifacts() to draw the artifacts on the double-buffer
@@ -442,14 +457,14 @@ protected:
      */
     void refreshArtifacts(const QRect&);
 
-    /// Draws the segments on the segments layer (m_segmentsLayer).
+    /// Draws the segments on the segments layer.
     /**
      * Also draws the track dividers.
      *
-     * Used by refreshSegments().
+     * Used by refreshTile().
      */
     void drawSegments(QPainter *segmentLayerPainter, const QRect& rect);
-    /// Draw the previews for audio segments on the segments layer (m_segmentsLayer).
+    /// Draw the previews for audio segments on the segments layer.
     /**
      * Used by drawSegments().
      */
@@ -507,22 +522,25 @@ protected:
 
     /// Adds the entire viewport to the segments refresh rect.
     /**
-     * This will cause scrollSegmentsLayer() to refresh the entire
-     * segments layer (m_segmentsLayer) the next time it is called.
-     * This in turn will cause viewportPaintRect() to redraw the entire
-     * viewport the next time it is called.
+     * This marks every tile of the segments layer (m_tileCache) to be
+     * drawn again, and will cause viewportPaintRect() to redraw the
+     * entire viewport the next time it is called.
      */
     void segmentsNeedRefresh() {
+        m_tileCache.invalidateAll();
         m_segmentsRefresh =
             QRect(contentsX(), contentsY(), visibleWidth(), visibleHeight());
     }
 
     /// Adds the specified rect to the segments refresh rect.
     /**
-     * This will cause the given portion of the viewport to be refreshed
-     * the next time viewportPaintRect() is called.
+     * This marks the tiles of the segments layer under the rect to be
+     * drawn again, whether they're in view or not, and will cause the
+     * given portion of the viewport to be refreshed the next time
+     * viewportPaintRect() is called.
      */
     void segmentsNeedRefresh(QRect r) {
+        m_tileCache.invalidate(r);
         m_segmentsRefresh |=
             (QRect(contentsX(), contentsY(), visibleWidth(), visibleHeight())
              & r);
@@ -661,11 +679,15 @@ protected:
     QString      m_textFloatText;
     QPoint       m_textFloatPos;
 
-    /// Layer that contains the segment rectangles.
+    /// Layer that contains the segment rectangles, in tiles.
     /**
+     * The tiles cover the whole contents, not just the viewport, so
+     * scrolling back over segments already drawn only needs them
+     * copying again.
+     *
      * @see viewportPaintRect() and drawSegments()
      */
-    QPixmap      m_segmentsLayer;
+    CompositionTileCache m_tileCache;
 
     /// The display double-buffer.
     /**
@@ -678,7 +700,7 @@ protected:
 
     /// Portion of the viewport that needs segments refreshed.
     /**
-     * Used only by scrollSegmentsLayer() to limit work done redrawing
+     * Used only by checkSegmentsRefresh() to limit work done copying
      * the segment rectangles.
      */
     QRect        m_segmentsRefresh;
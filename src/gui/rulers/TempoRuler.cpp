@@ -25,6 +25,7 @@
 #include "base/RealTime.h"
 #include "base/RulerScale.h"
 #include "base/SnapGrid.h"
+#include "base/TempoMap.h"
 #include "document/RosegardenDocument.h"
 #include "document/CommandHistory.h"
 #include "gui/application/RosegardenMainWindow.h"
@@ -667,6 +668,10 @@ TempoRuler::paintEvent(QPaintEvent* e)
     // bmp text aligns better in temporuler now - is this font dependent?
     int textY = fontHeight - 3;
 
+    // Look tempos up in the precalculated map, rather than through
+    // the composition's tempo segment, as we ask a lot of them
+    const TempoMap &tempoMap = m_composition->getTempoMap();
+
     double prevEndX = -1000.0;
     double prevTempo = 0.0;
     long prevBpm = 0;
@@ -676,8 +681,8 @@ TempoRuler::paintEvent(QPaintEvent* e)
     int timeSigChangeHere = 2;
     TimePoints timePoints;
 
-    for (int tempoNo = m_composition->getTempoChangeNumberAt(from);
-            tempoNo <= m_composition->getTempoChangeNumberAt(to) + 1; ++tempoNo) {
+    for (int tempoNo = tempoMap.getChangeNumberAt(from);
+            tempoNo <= tempoMap.getChangeNumberAt(to) + 1; ++tempoNo) {
 
         if (tempoNo >= 0 && tempoNo < m_composition->getTempoChangeCount()) {
             timePoints.insert
@@ -707,7 +712,7 @@ TempoRuler::paintEvent(QPaintEvent* e)
     bool illuminate = false;
 
     if (m_illuminate >= 0) {
-        int tcn = m_composition->getTempoChangeNumberAt(from);
+        int tcn = tempoMap.getChangeNumberAt(from);
         illuminate = (m_illuminate == tcn);
     }
 
@@ -732,8 +737,8 @@ TempoRuler::paintEvent(QPaintEvent* e)
         if (t1 <= t0)
             t1 = to;
 
-        int tcn = m_composition->getTempoChangeNumberAt(t0);
-        tempoT tempo = m_composition->getTempoAtTime(t0);
+        int tcn = tempoMap.getChangeNumberAt(t0);
+        tempoT tempo = tempoMap.getTempoAtTime(t0);
 
         std::pair<bool, tempoT> ramping(false, tempo);
         if (tcn > 0 && tcn < m_composition->getTempoChangeCount() + 1) {
@@ -835,7 +840,7 @@ TempoRuler::paintEvent(QPaintEvent* e)
         paint.setPen(illuminateLine ? QColor(Qt::white) : QColor(Qt::black));
         paint.drawLine(lastx + 1, lasty, width(), lasty);
     } else if (!m_refreshLinesOnly) {
-        tempoT tempo = m_composition->getTempoAtTime(from);
+        tempoT tempo = tempoMap.getTempoAtTime(from);
         QColor colour = TempoColour::getColour(m_composition->getTempoQpm(tempo));
         paint.setPen(colour);
         paint.setBrush(colour);
@@ -875,7 +880,7 @@ TempoRuler::paintEvent(QPaintEvent* e)
 
         if ((i->second & tempoChangeHere) && !m_refreshLinesOnly) {
 
-            double tempo = m_composition->getTempoQpm(m_composition->getTempoAtTime(time));
+            double tempo = m_composition->getTempoQpm(tempoMap.getTempoAtTime(time));
             long bpm = long(tempo);
             //        long frac = long(tempo * 100 + 0.001) - 100 * bpm;
 
@@ -78,6 +78,21 @@ CompositionMapper::segmentModified(Segment *segment)
     return mapper->refresh();
 }
 
+bool
+CompositionMapper::segmentModified(Segment *segment, timeT from, timeT to)
+{
+    if (m_segmentMappers.find(segment) == m_segmentMappers.end()) return false;
+
+    SegmentMapper *mapper = m_segmentMappers[segment];
+
+    if (!mapper) return false; // as above
+
+    SEQMAN_DEBUG << "CompositionMapper::segmentModified(" << segment << ", "
+                 << from << ", " << to << ") - mapper = " << mapper << endl;
+
+    return mapper->refresh(from, to);
+}
+
 void
 CompositionMapper::segmentAdded(Segment *segment)
 {
@@ -18,6 +18,8 @@
 #ifndef RG_COMPOSITIONMAPPER_H
 #define RG_COMPOSITIONMAPPER_H
 
+#include "base/Event.h"
+
 #include <map>
 
 namespace Rosegarden
@@ -47,6 +49,9 @@ public:
     MappedEventBuffer *getMappedEventBuffer(Segment *);
 
     bool segmentModified(Segment *);
+
+    /// As above, for a change confined to the given time range.
+    bool segmentModified(Segment *, timeT from, timeT to);
     void segmentAdded(Segment *);
     void segmentDeleted(Segment *);
 
@@ -46,7 +46,8 @@ InternalSegmentMapper::InternalSegmentMapper(RosegardenDocument *doc,
                                              Segment *segment)
     : SegmentMapper(doc, segment),
       m_channelManager(doc->getInstrument(segment)),
-      m_triggeredEvents(new Segment)
+      m_triggeredEvents(new Segment),
+      m_hasTriggers(false)
 {}
 
 InternalSegmentMapper::
@@ -102,6 +103,8 @@ void InternalSegmentMapper::fillBuffer()
     m_triggeredEvents->clear(); 
     m_controllerCache.clear();
     m_noteOffs = NoteoffContainer();
+    m_checkpoints.clear();
+    m_hasTriggers = false;
 
     for (int repeatNo = 0; repeatNo <= repeatCount; ++repeatNo) {
 
@@ -114,6 +117,9 @@ void InternalSegmentMapper::fillBuffer()
         // on.  Eg, on the second time thru we play everything one
         // segment duration later and so forth.
         timeT timeForRepeats = repeatNo * segmentDuration;
+
+        // Time of the last normal event, for spotting checkpoints
+        timeT lastTime = std::numeric_limits<timeT>::min();
         
         for (Segment::iterator j = m_segment->begin();
              m_segment->isBeforeEndMarker(j) ||
@@ -154,6 +160,15 @@ void InternalSegmentMapper::fillBuffer()
                 continue;
             }
 
+            // If no notes are sounding as we reach the first event at
+            // this time, a later refresh could restart mapping here.
+            if (repeatNo == 0 && !usingImplied && bestBaseTime != lastTime) {
+                if (m_noteOffs.empty()) {
+                    m_checkpoints.push_back(Checkpoint(bestBaseTime, size()));
+                }
+                lastTime = bestBaseTime;
+            }
+
             // We handle nested ornament expansion elsewhere, so
             // trigger events won't be found in implied.
             if (!usingImplied) { 
@@ -163,6 +178,8 @@ void InternalSegmentMapper::fillBuffer()
 
                 if (triggerId >= 0) {
 
+                    m_hasTriggers = true;
+
                     TriggerSegmentRec *rec =
                         comp.getTriggerSegmentRec(triggerId);
                     // We will invalidate `implied' so we arrange to
@@ -206,71 +223,10 @@ void InternalSegmentMapper::fillBuffer()
                 }
             }
 
-            // Ignore rests
-            //
-            if (!(**k)->isa(Note::EventRestType)) {
-
-                SegmentPerformanceHelper helper
-                (usingImplied ? *m_triggeredEvents : *m_segment);
-
-                timeT playTime =
-                    helper.getSoundingAbsoluteTime(*k) + timeForRepeats;
-                if (playTime >= repeatEndTime) break;
-
-                timeT playDuration = helper.getSoundingDuration(*k);
-
-                // Ignore notes without duration -- they're probably in a tied
-                // series but not as first note
-                //
-                if (playDuration > 0 || !(**k)->isa(Note::EventType)) {
-
-                    if (playTime + playDuration > repeatEndTime)
-                        playDuration = repeatEndTime - playTime;
-
-                    playTime = playTime + m_segment->getDelay();
-                    const RealTime eventTime = toRealTime(comp, playTime);
-
-                    // slightly quicker than calling helper.getRealSoundingDuration()
-                    RealTime endTime =
-                        toRealTime(comp, playTime + playDuration);
-                    const RealTime duration = endTime - eventTime;
-
-                    try {
-                        // Create mapped event and put it in buffer.
-                        // The instrument will be set later by
-                        // ChannelManager, so we set it to zero here.
-                        MappedEvent e(0,
-                                      ***k,  // three stars! what an accolade
-                                      eventTime,
-                                      duration);
-
-                        // Somewhat hacky: The MappedEvent ctor makes
-                        // events that needn't be inserted invalid.
-                        if (e.isValid()) {
-                            e.setTrackId(track->getId());
-
-                            if ((**k)->isa(Controller::EventType) ||
-                                (**k)->isa(PitchBend::EventType)) {
-                                m_controllerCache.storeLatestValue((**k));
-                            }
-                            
-                            if ((**k)->isa(Note::EventType)) {
-                                if (m_segment->getTranspose() != 0) {
-                                    e.setPitch(e.getPitch() +
-                                               m_segment->getTranspose());
-                                }
-                                enqueueNoteoff(playTime + playDuration,
-                                               e.getPitch());
-                            }
-                            mapAnEvent(&e); 
-                        } else {}
-                        
-                    } catch (...) {
-#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
-                        SEQMAN_DEBUG << "SegmentMapper::fillBuffer - caught exception while trying to create MappedEvent\n";
-#endif
-                    }
-                }
+            if (!mapEvent(usingImplied ? *m_triggeredEvents : *m_segment,
+                          *k, timeForRepeats, repeatEndTime,
+                          track->getId(), comp)) {
+                break;
             }
 
             ++*k; // increment either i or j, whichever one we just used
@@ -282,6 +238,271 @@ void InternalSegmentMapper::fillBuffer()
         popInsertNoteoff(track->getId(), comp);
     }
 
+    finishMapping(track);
+}
+
+bool
+InternalSegmentMapper::mapEvent(Segment &segment, Segment::iterator i,
+                                timeT timeForRepeats, timeT repeatEndTime,
+                                TrackId trackId, Composition &comp)
+{
+    // Ignore rests
+    //
+    if ((*i)->isa(Note::RestTypeName)) return true;
+
+    SegmentPerformanceHelper helper(segment);
+
+    timeT playTime =
+        helper.getSoundingAbsoluteTime(i) + timeForRepeats;
+    if (playTime >= repeatEndTime) return false;
+
+    timeT playDuration = helper.getSoundingDuration(i);
+
+    // Ignore notes without duration -- they're probably in a tied
+    // series but not as first note
+    //
+    if (playDuration > 0 || !(*i)->isa(Note::TypeName)) {
+
+        if (playTime + playDuration > repeatEndTime)
+            playDuration = repeatEndTime - playTime;
+
+        playTime = playTime + m_segment->getDelay();
+        const RealTime eventTime = toRealTime(comp, playTime);
+
+        // slightly quicker than calling helper.getRealSoundingDuration()
+        RealTime endTime =
+            toRealTime(comp, playTime + playDuration);
+        const RealTime duration = endTime - eventTime;
+
+        try {
+            // Create mapped event and put it in buffer.
+            // The instrument will be set later by
+            // ChannelManager, so we set it to zero here.
+            MappedEvent e(0,
+                          **i,
+                          eventTime,
+                          duration);
+
+            // Somewhat hacky: The MappedEvent ctor makes
+            // events that needn't be inserted invalid.
+            if (e.isValid()) {
+                e.setTrackId(trackId);
+
+                if ((*i)->isa(Controller::TypeName) ||
+                    (*i)->isa(PitchBend::TypeName)) {
+                    m_controllerCache.storeLatestValue(*i);
+                }
+
+                if ((*i)->isa(Note::TypeName)) {
+                    if (m_segment->getTranspose() != 0) {
+                        e.setPitch(e.getPitch() +
+                                   m_segment->getTranspose());
+                    }
+                    enqueueNoteoff(playTime + playDuration,
+                                   e.getPitch());
+                }
+                mapAnEvent(&e); 
+            } else {}
+
+        } catch (...) {
+#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
+            SEQMAN_DEBUG << "SegmentMapper::fillBuffer - caught exception while trying to create MappedEvent\n";
+#endif
+        }
+    }
+
+    return true;
+}
+
+bool
+InternalSegmentMapper::refresh(timeT from, timeT to)
+{
+    Profiler profiler("InternalSegmentMapper::refresh(from, to)");
+
+    // as in MappedEventBuffer::refresh()
+    getScavenger().scavenge();
+
+    if (!m_bufferPublished || m_hasTriggers || m_checkpoints.empty() ||
+        getMappingParameters() != m_mappedParameters ||
+        m_mappedParameters.m_repeatCount != 0) {
+        return refresh();
+    }
+
+    Composition &comp = m_doc->getComposition();
+    Track *track = comp.getTrackById(m_segment->getTrack());
+    if (!track) return refresh();
+
+    timeT segmentEndTime = m_segment->getEndMarkerTime();
+
+    // Restart from the last checkpoint strictly before the change.
+    // Nothing that was sounding there could have been affected by it
+    // (not even through a tie, since that would have kept a note
+    // sounding).  If there isn't one, start from the beginning.
+    CheckpointList::iterator restart =
+        std::lower_bound(m_checkpoints.begin(), m_checkpoints.end(),
+                         Checkpoint(from, std::numeric_limits<int>::min()));
+
+    int prefixSize = 0;
+    Segment::iterator j = m_segment->begin();
+    if (restart != m_checkpoints.begin()) {
+        --restart;
+        prefixSize = restart->second;
+        j = m_segment->findTime(restart->first);
+    }
+
+    // The previous buffer stays valid while we work, as it belongs to
+    // the published snapshot until we publish a new one
+    MappedEvent *oldEvents = getBuffer();
+    int oldSize = size();
+    int oldCapacity = capacity();
+
+    CheckpointList oldCheckpoints;
+    oldCheckpoints.swap(m_checkpoints);
+    m_checkpoints.assign(oldCheckpoints.begin(), restart);
+
+    detach(oldCapacity);
+    for (int i = 0; i < prefixSize; ++i) {
+        mapAnEvent(&oldEvents[i]);
+    }
+
+    m_noteOffs = NoteoffContainer();
+
+    // Map until we reach the end, or a point after the change where
+    // nothing is sounding and the old mapping was also at a
+    // checkpoint; from there on the old and new mappings must be the
+    // same, so we can take the rest from the old buffer.
+    CheckpointList::iterator resume = oldCheckpoints.end();
+    timeT lastTime = std::numeric_limits<timeT>::min();
+
+    while (true) {
+
+        bool more = m_segment->isBeforeEndMarker(j);
+        timeT t = (more ? (*j)->getAbsoluteTime() :
+                   std::numeric_limits<int>::max());
+
+        if (haveEarlierNoteoff(t)) {
+            popInsertNoteoff(track->getId(), comp);
+            continue;
+        }
+
+        if (!more) break;
+
+        if (t != lastTime) {
+            if (m_noteOffs.empty()) {
+                if (t > to) {
+                    resume = std::lower_bound
+                        (oldCheckpoints.begin(), oldCheckpoints.end(),
+                         Checkpoint(t, std::numeric_limits<int>::min()));
+                    if (resume != oldCheckpoints.end() &&
+                        resume->first == t) {
+                        break;
+                    }
+                    resume = oldCheckpoints.end();
+                }
+                m_checkpoints.push_back(Checkpoint(t, size()));
+            }
+            lastTime = t;
+        }
+
+        // A newly added ornament needs the full treatment.  We have
+        // already detached, and may have grown the new buffer, so
+        // refresh() can't tell on its own whether the buffer is now
+        // bigger than the published one.
+        long triggerId = -1;
+        (*j)->get<Int>(BaseProperties::TRIGGER_SEGMENT_ID, triggerId);
+        if (triggerId >= 0) {
+            bool resized = refresh();
+            return resized || capacity() > oldCapacity;
+        }
+
+        if (!mapEvent(*m_segment, j, 0, segmentEndTime,
+                      track->getId(), comp)) {
+            // Past the end marker: flush the noteoffs and stop
+            while (!m_noteOffs.empty()) {
+                popInsertNoteoff(track->getId(), comp);
+            }
+            break;
+        }
+
+        ++j;
+    }
+
+    if (resume != oldCheckpoints.end()) {
+        int resumeIndex = resume->second;
+        int delta = size() - resumeIndex;
+        reserve(size() + (oldSize - resumeIndex));
+        for (int i = resumeIndex; i < oldSize; ++i) {
+            mapAnEvent(&oldEvents[i]);
+        }
+        for (CheckpointList::iterator k = resume;
+             k != oldCheckpoints.end(); ++k) {
+            m_checkpoints.push_back(Checkpoint(k->first, k->second + delta));
+        }
+    }
+
+#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
+    SEQMAN_DEBUG << "InternalSegmentMapper::refresh(" << from << ", " << to
+                 << "): kept" << prefixSize << "events before and"
+                 << (resume != oldCheckpoints.end() ?
+                     oldSize - resume->second : 0)
+                 << "after, of" << size() << endl;
+#endif
+
+    // The controller cache holds the latest value of each controller
+    // in the segment, which may have been anywhere, so rebuild it
+    m_controllerCache.clear();
+    for (Segment::iterator i = m_segment->begin();
+         m_segment->isBeforeEndMarker(i); ++i) {
+        if ((*i)->isa(Controller::TypeName) ||
+            (*i)->isa(PitchBend::TypeName)) {
+            m_controllerCache.storeLatestValue(*i);
+        }
+    }
+
+    finishMapping(track);
+    publish();
+
+    return capacity() > oldCapacity;
+}
+
+InternalSegmentMapper::MappingParameters
+InternalSegmentMapper::getMappingParameters()
+{
+    Composition &comp = m_doc->getComposition();
+
+    MappingParameters p;
+    p.m_startTime = m_segment->getStartTime();
+    p.m_endMarkerTime = m_segment->getEndMarkerTime();
+    p.m_delay = m_segment->getDelay();
+    p.m_realTimeDelay = m_segment->getRealTimeDelay();
+    // catches most tempo changes, though those normally cause a full
+    // refresh of every segment anyway
+    p.m_startRealTime = comp.getElapsedRealTime(p.m_startTime);
+    p.m_endRealTime = comp.getElapsedRealTime(p.m_endMarkerTime);
+    p.m_transpose = m_segment->getTranspose();
+    p.m_track = m_segment->getTrack();
+    p.m_repeatCount = getSegmentRepeatCount();
+    return p;
+}
+
+bool
+InternalSegmentMapper::MappingParameters::operator==
+    (const MappingParameters &p) const
+{
+    return m_startTime == p.m_startTime &&
+        m_endMarkerTime == p.m_endMarkerTime &&
+        m_delay == p.m_delay &&
+        m_realTimeDelay == p.m_realTimeDelay &&
+        m_startRealTime == p.m_startRealTime &&
+        m_endRealTime == p.m_endRealTime &&
+        m_transpose == p.m_transpose &&
+        m_track == p.m_track &&
+        m_repeatCount == p.m_repeatCount;
+}
+
+void
+InternalSegmentMapper::finishMapping(Track *track)
+{
     bool anything = (size() != 0);
 
     RealTime minRealTime;
@@ -321,6 +542,8 @@ void InternalSegmentMapper::fillBuffer()
     // may have changed.
     m_channelManager.setDirty();
     setStartEnd(minRealTime, maxRealTime);
+
+    m_mappedParameters = getMappingParameters();
 }
 
     /** Functions about the noteoff queue **/
@@ -22,15 +22,18 @@
 #include "gui/seqmanager/MappedEventBuffer.h"
 #include "gui/seqmanager/SegmentMapper.h"
 #include "gui/seqmanager/ChannelManager.h"
+#include "base/RealTime.h"
+#include "base/Segment.h"
+#include "base/Track.h"
 
 #include <set>
+#include <vector>
 
 namespace Rosegarden
 {
 
 class TriggerSegmentRec;
 class Composition;
-class RealTime;
  
 /// Converts (maps) Event objects into MappedEvent objects for a Segment
 /**
@@ -90,6 +93,37 @@ class InternalSegmentMapper : public SegmentMapper
     typedef std::multiset<Noteoff, NoteoffCmp>
         NoteoffContainer;
 
+    // A segment time at which the mapping had no notes sounding when
+    // it reached the first event at that time, and the buffer index
+    // it had reached.  Mapping can restart from any of these.
+    typedef std::pair<timeT, int> Checkpoint;
+    typedef std::vector<Checkpoint> CheckpointList;
+
+    // Everything other than the events themselves that affects what
+    // fillBuffer() produces.  If any of it has changed since the last
+    // mapping, we can't remap incrementally.
+    struct MappingParameters
+    {
+        MappingParameters() :
+            m_startTime(0), m_endMarkerTime(0), m_delay(0),
+            m_transpose(0), m_track(0), m_repeatCount(0) { }
+
+        bool operator==(const MappingParameters &p) const;
+        bool operator!=(const MappingParameters &p) const {
+            return !operator==(p);
+        }
+
+        timeT m_startTime;
+        timeT m_endMarkerTime;
+        timeT m_delay;
+        RealTime m_realTimeDelay;
+        RealTime m_startRealTime;
+        RealTime m_endRealTime;
+        int m_transpose;
+        TrackId m_track;
+        int m_repeatCount;
+    };
+
     InternalSegmentMapper(RosegardenDocument *doc, Segment *segment);
     ~InternalSegmentMapper(void);
 
@@ -110,6 +144,31 @@ class InternalSegmentMapper : public SegmentMapper
     /// dump all segment data in the file
     virtual void fillBuffer();
 
+    /// Remap only the part of the buffer affected by a change.
+    /**
+     * Finds the last checkpoint before from, remaps the segment from
+     * there until it reaches a checkpoint after to that the previous
+     * mapping also passed through, and splices the old buffer
+     * contents either side of it.  Falls back to a full refresh() for
+     * repeating segments, segments that use triggered ornaments, or
+     * if anything other than the events has changed.
+     */
+    virtual bool refresh(timeT from, timeT to);
+
+    using SegmentMapper::refresh;
+
+    // Map one event from segment (which is either m_segment or
+    // m_triggeredEvents) into the buffer.  Returns false if the event
+    // is beyond the end of the repeat and mapping should stop.
+    bool mapEvent(Segment &segment, Segment::iterator i,
+                  timeT timeForRepeats, timeT repeatEndTime,
+                  TrackId trackId, Composition &comp);
+
+    // Work common to the end of full and incremental mapping
+    void finishMapping(Track *track);
+
+    MappingParameters getMappingParameters();
+
     Instrument *getInstrument(void)
     { return m_channelManager.m_instrument; }
 
@@ -135,6 +194,16 @@ class InternalSegmentMapper : public SegmentMapper
 
     // Queue of noteoffs.
     NoteoffContainer       m_noteOffs;
+
+    // Places the last mapping could be restarted from, in time order.
+    // Only kept for the first time through.
+    CheckpointList         m_checkpoints;
+
+    // Whether the last full mapping expanded any triggered segments
+    bool                   m_hasTriggers;
+
+    // The parameters as of the last mapping
+    MappingParameters      m_mappedParameters;
 };
   
 }
@@ -27,10 +27,18 @@
 namespace Rosegarden
 {
 
+MappedEventBuffer::Snapshot::~Snapshot()
+{
+    // Safe even if NULL.
+    delete[] m_events;
+}
+
 MappedEventBuffer::MappedEventBuffer(RosegardenDocument *doc) :
     m_buffer(0),
+    m_bufferPublished(false),
     m_capacity(0),
     m_size(0),
+    m_snapshot(0),
     m_doc(doc),
     m_start(RealTime::zeroTime),
     m_end(RealTime::beforeMaxTime),
@@ -40,8 +48,20 @@ MappedEventBuffer::MappedEventBuffer(RosegardenDocument *doc) :
 
 MappedEventBuffer::~MappedEventBuffer()
 {
-    // Safe even if NULL.
-    delete[] m_buffer;
+    // No iterators remain, so nothing can be reading the snapshot.
+    // If the buffer was published, the snapshot owns it.
+    if (!m_bufferPublished) delete[] m_buffer;
+    delete m_snapshot.fetchAndStoreOrdered(0);
+}
+
+Scavenger<MappedEventBuffer::Snapshot> &
+MappedEventBuffer::getScavenger()
+{
+    // Enough slots for every segment to be remapped a few times
+    // within the scavenger's delay without falling back to its
+    // locked overflow list.
+    static Scavenger<Snapshot> scavenger(2, 2000);
+    return scavenger;
 }
 
 void
@@ -57,6 +77,7 @@ MappedEventBuffer::init()
 
         initSpecial();
         fillBuffer();
+        publish();
     } else {
         SEQMAN_DEBUG << "SegmentMapper::init : mmap size = 0 - skipping mmapping for now\n";
     }
@@ -65,6 +86,11 @@ MappedEventBuffer::init()
 bool
 MappedEventBuffer::refresh()
 {
+    // Refresh is always called from the GUI thread, which is also the
+    // one that claims the old snapshots, so this is a safe place to
+    // dispose of any that have had their time.
+    getScavenger().scavenge();
+
     bool resized = false;
 
     int newFill = calculateSize();
@@ -78,14 +104,15 @@ MappedEventBuffer::refresh()
                  << endl;
 #endif
 
-    // If we need to expand the buffer to hold the events
     if (newFill > oldSize) {
         resized = true;
-        reserve(newFill);
     }
 
-    // Ask the deriver to fill the buffer from the document
+    // Fill a new buffer off to the side while the sequencer carries on
+    // reading the published one, then swap the new one in
+    detach(resized ? newFill : oldSize);
     fillBuffer();
+    publish();
 
     return resized;
 }
@@ -93,46 +120,86 @@ MappedEventBuffer::refresh()
 int
 MappedEventBuffer::capacity() const
 {
-    return m_capacity.fetchAndAddRelaxed(0);
+    return m_capacity;
 }
 
 int
 MappedEventBuffer::size() const
 {
-    return m_size.fetchAndAddRelaxed(0);
+    return m_size;
 }
 
 void
 MappedEventBuffer::reserve(int newSize)
 {
-    if (newSize <= capacity())  return;
+    if (newSize <= m_capacity)  return;
 
     MappedEvent *oldBuffer = m_buffer;
     MappedEvent *newBuffer = new MappedEvent[newSize];
 
-    if (oldBuffer) {
-        for (int i = 0; i < m_size; ++i) {
-            newBuffer[i] = m_buffer[i];
-        }
+    for (int i = 0; i < m_size; ++i) {
+        newBuffer[i] = oldBuffer[i];
     }
 
-    {
-        QWriteLocker locker(&m_lock);
-        m_buffer = newBuffer;
-        m_capacity.fetchAndStoreRelease(newSize);
-    }
+    m_buffer = newBuffer;
+    m_capacity = newSize;
 
 #ifdef DEBUG_MAPPED_EVENT_BUFFER
     SEQUENCER_DEBUG << "MappedEventBuffer::reserve: Resized to " << newSize << " events" << endl;
 #endif
 
-    delete[] oldBuffer;
+    // A published buffer belongs to its snapshot
+    if (!m_bufferPublished) delete[] oldBuffer;
+    m_bufferPublished = false;
 }
 
 void
 MappedEventBuffer::resize(int newFill)
 {
-    m_size.fetchAndStoreRelaxed(newFill);
+    m_size = newFill;
+}
+
+void
+MappedEventBuffer::detach(int newCapacity)
+{
+    if (!m_bufferPublished) delete[] m_buffer;
+
+    m_buffer = (newCapacity > 0 ? new MappedEvent[newCapacity] : 0);
+    m_bufferPublished = false;
+    m_capacity = newCapacity;
+    m_size = 0;
+}
+
+void
+MappedEventBuffer::publish()
+{
+    Snapshot *snapshot = new Snapshot(m_buffer, m_size, m_start, m_end);
+    m_bufferPublished = true;
+
+    Snapshot *old = m_snapshot.fetchAndStoreOrdered(snapshot);
+
+    // The sequencer may be part way through reading the old one
+    if (old) getScavenger().claim(old);
+
+#ifdef DEBUG_MAPPED_EVENT_BUFFER
+    SEQUENCER_DEBUG << "MappedEventBuffer::publish:" << (void *)this
+                    << "published" << m_size << "events" << endl;
+#endif
+}
+
+void
+MappedEventBuffer::getStartEnd(RealTime &start, RealTime &end) const
+{
+    const Snapshot *snapshot = getSnapshot();
+
+    if (snapshot) {
+        start = snapshot->m_start;
+        end = snapshot->m_end;
+    } else {
+        // Nothing mapped yet; these are the values we start with
+        start = RealTime::zeroTime;
+        end = RealTime::beforeMaxTime;
+    }
 }
 
 void
@@ -250,11 +317,21 @@ MappedEventBuffer::iterator::operator=(const iterator& rhs)
     return *this;
 }
 
+// The iterator methods all look at the published snapshot, not at the
+// buffer that may be being filled.
+
+int
+MappedEventBuffer::iterator::publishedSize() const
+{
+    const Snapshot *snapshot = m_s->getSnapshot();
+    return snapshot ? snapshot->m_size : 0;
+}
+
 // ++prefix
 MappedEventBuffer::iterator &
 MappedEventBuffer::iterator::operator++()
 {
-    int fill = m_s->size();
+    int fill = publishedSize();
     if (m_index < fill)  ++m_index;
     return *this;
 }
@@ -265,7 +342,7 @@ MappedEventBuffer::iterator::operator++(int)
 {
     // This line is the main reason we need a copy ctor.
     iterator r = *this;
-    int fill = m_s->size();
+    int fill = publishedSize();
     if (m_index < fill)  ++m_index;
     return r;
 }
@@ -273,7 +350,7 @@ MappedEventBuffer::iterator::operator++(int)
 MappedEventBuffer::iterator &
 MappedEventBuffer::iterator::operator+=(int offset)
 {
-    int fill = m_s->size();
+    int fill = publishedSize();
     if (m_index + offset <= fill) {
         m_index += offset;
     } else {
@@ -317,21 +394,20 @@ MappedEventBuffer::iterator::operator*()
 MappedEvent *
 MappedEventBuffer::iterator::peek() const
 {
-    // The lock formerly here has moved out to callers.
+    const Snapshot *snapshot = m_s->getSnapshot();
 
     // If we're at the end, return NULL
-    if (m_index >= m_s->size())
+    if (!snapshot || m_index >= snapshot->m_size)
         return 0;
 
-    // Otherwise return a pointer into the buffer.
-    return &m_s->m_buffer[m_index];
+    // Otherwise return a pointer into the snapshot.
+    return &snapshot->m_events[m_index];
 }
 
 bool
 MappedEventBuffer::iterator::atEnd() const
 {
-    int size = m_s->size();
-    return (m_index >= size);
+    return (m_index >= publishedSize());
 }
 
 void
@@ -19,8 +19,8 @@
 #define RG_MAPPEDEVENTBUFFER_H
 
 #include "base/RealTime.h"
-#include <QReadWriteLock>
-#include <QAtomicInt>
+#include "sound/Scavenger.h"
+#include <QAtomicPointer>
 
 namespace Rosegarden
 {
@@ -44,13 +44,14 @@ class RosegardenDocument;
  * The mapping logic is handled by mappers derived from this class; this
  * class provides the basic container and the reading logic.
  *
- * Reading and writing may take place simultaneously without locks (we are
- * prepared to accept the lossage from individual mangled MappedEvent
- * reads) but a read/write lock (m_lock) on the buffer space guards
- * against bad
- * access caused by resizes.  [Actually, it doesn't at all since the
- * caller of peek() has a pointer they can access after the lock has
- * been released.  See comments on m_lock below and in iterator::peek().]
+ * Reading and writing take place simultaneously without locks.  The
+ * mapper fills a private buffer (see getBuffer()) and, once it is
+ * complete, publishes it by atomically swapping in a new Snapshot.
+ * The sequencer's iterators only ever read the published Snapshot,
+ * which is never modified, so they never wait for the GUI thread and
+ * never see a half-written event.  A replaced Snapshot is handed to a
+ * Scavenger, which deletes it a couple of seconds later, by which
+ * time no reader can still be holding a pointer into it.
  *
  * MappedEventBuffer only concerns itself with the state of the
  * composition, as opposed to the state of performance.  No matter how
@@ -81,16 +82,17 @@ public:
      */
     virtual void initSpecial(void)  { }
 
-    /// Access to the internal buffer of events.  NOT LOCKED
+    /// Access to the buffer being filled.
     /**
-     * un-locked, use only from write/resize thread
+     * This is the writer's private buffer, not the one the sequencer
+     * is reading.  Use only from fillBuffer() and its helpers.
      */
     MappedEvent *getBuffer() { return m_buffer; }
 
-    /// Capacity of the buffer in MappedEvent's.  (STL's capacity().)
+    /// Capacity of the buffer being filled in MappedEvent's.  (STL's capacity().)
     /* Was getBufferSize() */
     int capacity() const;
-    /// Number of MappedEvent's in the buffer.  (STL's size().)
+    /// Number of MappedEvent's in the buffer being filled.  (STL's size().)
     /* Was getBufferFill() */
     int size() const;
 
@@ -114,8 +116,9 @@ public:
 
     /// Refresh the buffer
     /**
-     * Called after the segment has been modified.  Resizes the buffer if
-     * needed, then calls fillBuffer() to fill it from the segment.
+     * Called after the segment has been modified.  Starts a new buffer,
+     * calls fillBuffer() to fill it from the segment, and then publishes
+     * it in place of the one the sequencer has been reading.
      *
      * Returns true if buffer size changed (and thus the sequencer
      * needs to be told about it).
@@ -220,15 +223,14 @@ public:
 
     /// Get the earliest and latest sounding times.
     /**
+     * Returns the times as of the last published fill.
+     *
      * Called by MappedBufMetaIterator::fetchEvents() and
      * MappedBufMetaIterator::fetchEventsNoncompeting().
      *
      * @see setStartEnd()
      */
-    void getStartEnd(RealTime &start, RealTime &end) const {
-        start = m_start;
-        end   = m_end;
-    }
+    void getStartEnd(RealTime &start, RealTime &end) const;
 
     class iterator 
     {
@@ -313,8 +315,10 @@ public:
          *
          * Returns 0 if atEnd().
          *
-         * Callers should lock getLock() with QReadLocker for as long
-         * as they are holding the pointer.
+         * The pointer is into the published Snapshot, which stays
+         * valid for a few seconds even if a refresh replaces it, so
+         * callers may use it without locking for the rest of the
+         * current slice.
          *
          * @see operator*()
          */
@@ -393,11 +397,10 @@ public:
         bool shouldPlay(MappedEvent *evt, RealTime startTime)
         { return m_s->shouldPlay(evt, startTime); }
 
-        // Get a pointer to the MappedEventBuffer's lock.
-        QReadWriteLock* getLock(void) const
-        { return &m_s->m_lock; }
-
     protected:
+        /// Number of events in the buffer's published Snapshot.
+        int publishedSize() const;
+
         /// The buffer this iterator points into.
         MappedEventBuffer *m_s;
 
@@ -435,27 +438,59 @@ public:
 protected:
     friend class iterator;
 
-    /// The Mapped Event Buffer
-    MappedEvent *m_buffer;
-
-    /// Capacity of the buffer.
-    mutable QAtomicInt m_capacity;
+    /// A complete, published fill of the buffer.
+    /**
+     * Never modified once published.  Owns its events.
+     */
+    struct Snapshot
+    {
+        Snapshot(MappedEvent *events, int size,
+                 const RealTime &start, const RealTime &end) :
+            m_events(events), m_size(size), m_start(start), m_end(end) { }
+        ~Snapshot();
+
+        MappedEvent *m_events;
+        int m_size;
+        RealTime m_start;
+        RealTime m_end;
+
+    private:
+        Snapshot(const Snapshot &);
+        Snapshot &operator=(const Snapshot &);
+    };
 
-    /// Number of events in the buffer.
-    mutable QAtomicInt m_size;
+    /// The buffer being filled.  Only touched by the GUI thread.
+    MappedEvent *m_buffer;
 
-    /// Lock for reserve() and callers to iterator::peek()
+    /// Whether m_buffer belongs to the published Snapshot.
     /**
-     * Used by reserve() to lock the swapping of the old for the new
-     * and the changing of the buffer capacity.
-     *
-     * Used by callers to MappedEventBuffer::iterator::peek() to
-     * ensure that buffer isn't reallocated while the caller is
-     * holding the current item.  Doing so avoids the scenario where
-     * peek() gets a pointer to the element and then reserve() swaps
-     * the entire buffer out from under it.
+     * If so, it must not be written to, and the next refresh() starts
+     * a new buffer.
      */
-    QReadWriteLock m_lock;
+    bool m_bufferPublished;
+
+    /// Capacity of the buffer being filled.
+    int m_capacity;
+
+    /// Number of events in the buffer being filled.
+    int m_size;
+
+    /// What the sequencer reads.  May be 0 if nothing was ever mapped.
+    mutable QAtomicPointer<Snapshot> m_snapshot;
+
+    /// Return the current published Snapshot.  Safe from any thread.
+    const Snapshot *getSnapshot() const {
+        return m_snapshot.fetchAndAddAcquire(0);
+    }
+
+    /// Publish the buffer just filled as the new Snapshot.
+    void publish();
+
+    /// Start a new buffer for refilling, leaving the published one alone.
+    void detach(int newCapacity);
+
+    /// Deletes replaced Snapshots once readers are done with them.
+    static Scavenger<Snapshot> &getScavenger();
 
     /// Not used here.  Convenience for derivers.
     /**
@@ -464,7 +499,7 @@ protected:
      */
     RosegardenDocument *m_doc;
 
-    /// Earliest sounding time.
+    /// Earliest sounding time, as being filled.
     /**
      * It is the responsibility of "fillBuffer()" to keep this field
      * up to date.
@@ -473,7 +508,7 @@ protected:
      */
     RealTime m_start;
 
-    /// Latest sounding time.
+    /// Latest sounding time, as being filled.
     /**
      * It is the responsibility of "fillBuffer()" to keep this field
      * up to date.
@@ -150,6 +150,15 @@ void MetronomeMapper::fillBuffer()
     SEQMAN_DEBUG << "MetronomeMapper::fillBuffer: instrument is "
                  << m_metronome->getInstrument() << endl;
 
+    // The ticks are sorted, so convert them all in one pass
+    std::vector<timeT> tickTimes;
+    tickTimes.reserve(m_ticks.size());
+    for (TickContainer::iterator i = m_ticks.begin(); i != m_ticks.end(); ++i) {
+        tickTimes.push_back(i->first);
+    }
+    std::vector<RealTime> tickRealTimes;
+    comp.getTempoMap().getElapsedRealTimes(tickTimes, tickRealTimes);
+
     int index = 0;
 
     for (TickContainer::iterator i = m_ticks.begin(); i != m_ticks.end(); ++i) {
@@ -159,7 +168,7 @@ void MetronomeMapper::fillBuffer()
                      << int(velocity) << endl;
                      */
 
-        eventTime = comp.getElapsedRealTime(i->first);
+        eventTime = tickRealTimes[index];
 
         MappedEvent e;
 
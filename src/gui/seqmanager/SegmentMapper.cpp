@@ -53,6 +53,12 @@ SegmentMapper::~SegmentMapper()
     SEQMAN_DEBUG << "~SegmentMapper : " << this << endl;
 }
 
+bool
+SegmentMapper::refresh(timeT /* from */, timeT /* to */)
+{
+    return refresh();
+}
+
 int
 SegmentMapper::getSegmentRepeatCount()
 {
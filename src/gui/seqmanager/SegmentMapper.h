@@ -38,6 +38,17 @@ public:
 
     virtual void initSpecial(void);
 
+    /// Refresh after a change confined to part of the segment.
+    /**
+     * The segment's events have changed only in the range from to to
+     * (as reported by its SegmentRefreshStatus).  Mappers that can
+     * remap just that part of the buffer override this; the default
+     * is a full refresh().
+     */
+    virtual bool refresh(timeT from, timeT to);
+
+    using MappedEventBuffer::refresh;
+
 protected:
     SegmentMapper(RosegardenDocument *, Segment *);
 
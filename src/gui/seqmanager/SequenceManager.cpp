@@ -1615,10 +1615,16 @@ void SequenceManager::checkRefreshStatus()
     // then the ones which are still there
     for (SegmentRefreshMap::iterator i = m_segments.begin();
             i != m_segments.end(); ++i) {
-        if (i->first->getRefreshStatus(i->second).needsRefresh() ||
-                ridset.find(i->first->getRuntimeId()) != ridset.end()) {
+        SegmentRefreshStatus &status =
+            i->first->getRefreshStatus(i->second);
+        if (ridset.find(i->first->getRuntimeId()) != ridset.end()) {
+            // A trigger segment it uses has changed, so the change
+            // may be anywhere
             segmentModified(i->first);
-            i->first->getRefreshStatus(i->second).setNeedsRefresh(false);
+            status.setNeedsRefresh(false);
+        } else if (status.needsRefresh()) {
+            segmentModified(i->first, status.from(), status.to());
+            status.setNeedsRefresh(false);
         }
     }
 
@@ -1643,6 +1649,18 @@ SequenceManager::segmentModified(Segment* s)
         (m_compositionMapper->getMappedEventBuffer(s));
 }
 
+void
+SequenceManager::segmentModified(Segment* s, timeT from, timeT to)
+{
+    SEQMAN_DEBUG << "SequenceManager::segmentModified(" << s << ", "
+                 << from << ", " << to << ")";
+
+    m_compositionMapper->segmentModified(s, from, to);
+
+    RosegardenSequencer::getInstance()->segmentModified
+        (m_compositionMapper->getMappedEventBuffer(s));
+}
+
 void SequenceManager::segmentAdded(const Composition*, Segment* s)
 {
     SEQMAN_DEBUG << "SequenceManager::segmentAdded(" << s
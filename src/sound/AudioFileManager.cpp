@@ -905,14 +905,17 @@ AudioFileManager::generatePreviews()
 #endif
 
 
-    // Generate peaks if we need to
+    // Generate peaks if we need to, for all the files at once
     //
+    std::vector<AudioFile*> files;
     std::vector<AudioFile*>::iterator it;
     for (it = m_audioFiles.begin(); it != m_audioFiles.end(); ++it) {
         if (!m_peakManager.hasValidPeaks(*it))
-            m_peakManager.generatePeaks(*it, 1);
+            files.push_back(*it);
     }
 
+    m_peakManager.generatePeaks(files, 1);
+
     // if we didn't do anything, at least emit a 100% to reset the progress
     // dialog
     std::cout << "audio file manager emitting fake setValue(100)" << std::endl;
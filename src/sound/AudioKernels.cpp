@@ -0,0 +1,776 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "AudioKernels.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// The vector versions are compiled with per-function target
+// attributes, so the rest of the build needs no special flags and
+// still runs on CPUs without them.
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || \
+     (defined(__GNUC__) && (__GNUC__ > 4 || \
+                            (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define RG_AUDIO_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Rosegarden
+{
+
+struct KernelTable
+{
+    void (*add)(float *, const float *, size_t);
+    void (*gain)(float *, float, size_t);
+    void (*panGain)(const float *, float *, float *, float, float, size_t);
+    float (*peak)(const float *, float, size_t);
+    void (*range)(const float *, float &, float &, size_t);
+    bool (*isSilent)(const float *, size_t);
+    void (*flushDenormals)(float *, size_t);
+    void (*decode8)(const unsigned char *, size_t, size_t, float *, size_t);
+    void (*decode16)(const unsigned char *, size_t, size_t, float *, size_t);
+    void (*decode24)(const unsigned char *, size_t, size_t, float *, size_t);
+    void (*decodeFloat)(const unsigned char *, size_t, size_t,
+                        float *, size_t);
+    AudioKernels::Implementation implementation;
+};
+
+
+// Plain C++ versions, also used for the odd samples at the end of a
+// block by the vector versions
+
+static void
+scalarAdd(float *dst, const float *src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) dst[i] += src[i];
+}
+
+static void
+scalarGain(float *buf, float gain, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) buf[i] *= gain;
+}
+
+static void
+scalarPanGain(const float *src, float *left, float *right,
+              float leftGain, float rightGain, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        float sample = src[i];
+        left[i] = sample * leftGain;
+        right[i] = sample * rightGain;
+    }
+}
+
+static float
+scalarPeak(const float *src, float current, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (src[i] > current) current = src[i];
+    }
+    return current;
+}
+
+static void
+scalarRange(const float *src, float &hi, float &lo, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (src[i] > hi) hi = src[i];
+        if (src[i] < lo) lo = src[i];
+    }
+}
+
+static bool
+scalarIsSilent(const float *buf, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (buf[i] != 0.0f) return false;
+    }
+    return true;
+}
+
+static void
+scalarFlushDenormals(float *buf, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (fabsf(buf[i]) < FLT_MIN) buf[i] = 0.0f;
+    }
+}
+
+// The decoders take frames of interleaved samples starting at src and
+// write the given channel of n of them to dst.  The scaling is that of
+// RIFFAudioFile::convertBytesToSample(), and as the scale factors are
+// all powers of two and every sample converts to float exactly, so is
+// the result.
+
+static const float scale8 = 1.0f / 128.0f;
+static const float scale16 = 1.0f / 32768.0f;
+static const float scale24 = 1.0f / 2147483648.0f;
+
+static void
+scalarDecode8(const unsigned char *src, size_t channels, size_t channel,
+              float *dst, size_t n)
+{
+    src += channel;
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = float(int(src[i * channels]) - 128) * scale8;
+    }
+}
+
+static void
+scalarDecode16(const unsigned char *src, size_t channels, size_t channel,
+               float *dst, size_t n)
+{
+    src += channel * 2;
+    for (size_t i = 0; i < n; ++i) {
+        const unsigned char *p = src + i * channels * 2;
+        dst[i] = float(short(p[0] | (p[1] << 8))) * scale16;
+    }
+}
+
+static void
+scalarDecode24(const unsigned char *src, size_t channels, size_t channel,
+               float *dst, size_t n)
+{
+    src += channel * 3;
+    for (size_t i = 0; i < n; ++i) {
+        const unsigned char *p = src + i * channels * 3;
+        // in the top three bytes, so as to get the sign right
+        unsigned int bits = (p[2] << 24) | (p[1] << 16) | (p[0] << 8);
+        dst[i] = float(int(bits)) * scale24;
+    }
+}
+
+static void
+scalarDecodeFloat(const unsigned char *src, size_t channels, size_t channel,
+                  float *dst, size_t n)
+{
+    src += channel * 4;
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(dst + i, src + i * channels * 4, 4);
+    }
+}
+
+static const KernelTable scalarKernels = {
+    scalarAdd, scalarGain, scalarPanGain, scalarPeak, scalarRange,
+    scalarIsSilent, scalarFlushDenormals,
+    scalarDecode8, scalarDecode16, scalarDecode24, scalarDecodeFloat,
+    AudioKernels::Scalar
+};
+
+
+#ifdef RG_AUDIO_KERNELS_X86
+
+#define RG_SSE2 __attribute__((target("sse2")))
+#define RG_AVX2 __attribute__((target("avx2")))
+
+RG_SSE2 static void
+sse2Add(float *dst, const float *src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+                                          _mm_loadu_ps(src + i)));
+    }
+    scalarAdd(dst + i, src + i, n - i);
+}
+
+RG_SSE2 static void
+sse2Gain(float *buf, float gain, size_t n)
+{
+    __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(buf + i, _mm_mul_ps(_mm_loadu_ps(buf + i), g));
+    }
+    scalarGain(buf + i, gain, n - i);
+}
+
+RG_SSE2 static void
+sse2PanGain(const float *src, float *left, float *right,
+            float leftGain, float rightGain, size_t n)
+{
+    __m128 gl = _mm_set1_ps(leftGain);
+    __m128 gr = _mm_set1_ps(rightGain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(src + i);
+        _mm_storeu_ps(left + i, _mm_mul_ps(x, gl));
+        _mm_storeu_ps(right + i, _mm_mul_ps(x, gr));
+    }
+    scalarPanGain(src + i, left + i, right + i, leftGain, rightGain, n - i);
+}
+
+RG_SSE2 static float
+sse2Peak(const float *src, float current, size_t n)
+{
+    size_t i = 0;
+    if (n >= 4) {
+        // max_ps(x, m) is (x > m ? x : m), as in the scalar loop
+        __m128 m = _mm_set1_ps(current);
+        for (; i + 4 <= n; i += 4) {
+            m = _mm_max_ps(_mm_loadu_ps(src + i), m);
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, m);
+        current = scalarPeak(lanes, current, 4);
+    }
+    return scalarPeak(src + i, current, n - i);
+}
+
+RG_SSE2 static void
+sse2Range(const float *src, float &hi, float &lo, size_t n)
+{
+    size_t i = 0;
+    if (n >= 4) {
+        // max_ps(x, m) is (x > m ? x : m) and min_ps(x, m) is
+        // (x < m ? x : m), so with the sample first a NaN sample is
+        // skipped, as it is by scalarRange
+        __m128 h = _mm_set1_ps(hi);
+        __m128 l = _mm_set1_ps(lo);
+        for (; i + 4 <= n; i += 4) {
+            __m128 x = _mm_loadu_ps(src + i);
+            h = _mm_max_ps(x, h);
+            l = _mm_min_ps(x, l);
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, h);
+        scalarRange(lanes, hi, lo, 4);
+        _mm_storeu_ps(lanes, l);
+        scalarRange(lanes, hi, lo, 4);
+    }
+    scalarRange(src + i, hi, lo, n - i);
+}
+
+RG_SSE2 static bool
+sse2IsSilent(const float *buf, size_t n)
+{
+    __m128 zero = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        if (_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(buf + i), zero))) {
+            return false;
+        }
+    }
+    return scalarIsSilent(buf + i, n - i);
+}
+
+RG_SSE2 static void
+sse2FlushDenormals(float *buf, size_t n)
+{
+    __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 smallest = _mm_set1_ps(FLT_MIN);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(buf + i);
+        // "not less than" keeps NaNs, as the scalar test does
+        __m128 keep = _mm_cmpnlt_ps(_mm_and_ps(x, absMask), smallest);
+        _mm_storeu_ps(buf + i, _mm_and_ps(x, keep));
+    }
+    scalarFlushDenormals(buf + i, n - i);
+}
+
+// The SSE2 decoders handle mono and stereo files, which are nearly all
+// of them, and leave other channel counts to the scalar ones.  SSE2
+// has no byte shuffle, so 24-bit samples are always decoded in scalar.
+
+RG_SSE2 static void
+sse2Decode8(const unsigned char *src, size_t channels, size_t channel,
+            float *dst, size_t n)
+{
+    if (channels > 2) {
+        scalarDecode8(src, channels, channel, dst, n);
+        return;
+    }
+    __m128i zero = _mm_setzero_si128();
+    __m128i bias = _mm_set1_epi32(128);
+    __m128 scale = _mm_set1_ps(scale8);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x;
+        if (channels == 1) {
+            x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src + i)),
+                                  zero);
+        } else {
+            // eight frames, each a 16-bit word with left in the low byte
+            x = _mm_loadu_si128((const __m128i *)(src + i * 2));
+            x = (channel == 0 ? _mm_and_si128(x, _mm_set1_epi16(0xff)) :
+                 _mm_srli_epi16(x, 8));
+        }
+        __m128i lo = _mm_sub_epi32(_mm_unpacklo_epi16(x, zero), bias);
+        __m128i hi = _mm_sub_epi32(_mm_unpackhi_epi16(x, zero), bias);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    scalarDecode8(src + i * channels, channels, channel, dst + i, n - i);
+}
+
+RG_SSE2 static void
+sse2Decode16(const unsigned char *src, size_t channels, size_t channel,
+             float *dst, size_t n)
+{
+    if (channels > 2) {
+        scalarDecode16(src, channels, channel, dst, n);
+        return;
+    }
+    __m128 scale = _mm_set1_ps(scale16);
+    size_t i = 0;
+    if (channels == 1) {
+        for (; i + 8 <= n; i += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i * 2));
+            // sign-extend by putting each sample in the top half
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+    } else {
+        for (; i + 4 <= n; i += 4) {
+            // four frames, each a 32-bit word with left in the low half
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i * 4));
+            if (channel == 0) x = _mm_slli_epi32(x, 16);
+            x = _mm_srai_epi32(x, 16);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+        }
+    }
+    scalarDecode16(src + i * channels * 2, channels, channel, dst + i, n - i);
+}
+
+RG_SSE2 static void
+sse2DecodeFloat(const unsigned char *src, size_t channels, size_t channel,
+                float *dst, size_t n)
+{
+    if (channels > 2) {
+        scalarDecodeFloat(src, channels, channel, dst, n);
+        return;
+    }
+    const float *fsrc = (const float *)src;
+    size_t i = 0;
+    if (channels == 1) {
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(dst + i, _mm_loadu_ps(fsrc + i));
+        }
+    } else {
+        for (; i + 4 <= n; i += 4) {
+            __m128 a = _mm_loadu_ps(fsrc + i * 2);
+            __m128 b = _mm_loadu_ps(fsrc + i * 2 + 4);
+            _mm_storeu_ps(dst + i, (channel == 0 ?
+                                    _mm_shuffle_ps(a, b, 0x88) :
+                                    _mm_shuffle_ps(a, b, 0xdd)));
+        }
+    }
+    scalarDecodeFloat(src + i * channels * 4, channels, channel,
+                      dst + i, n - i);
+}
+
+static const KernelTable sse2Kernels = {
+    sse2Add, sse2Gain, sse2PanGain, sse2Peak, sse2Range,
+    sse2IsSilent, sse2FlushDenormals,
+    sse2Decode8, sse2Decode16, scalarDecode24, sse2DecodeFloat,
+    AudioKernels::SSE2
+};
+
+RG_AVX2 static void
+avx2Add(float *dst, const float *src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i),
+                                                _mm256_loadu_ps(src + i)));
+    }
+    scalarAdd(dst + i, src + i, n - i);
+}
+
+RG_AVX2 static void
+avx2Gain(float *buf, float gain, size_t n)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(buf + i, _mm256_mul_ps(_mm256_loadu_ps(buf + i), g));
+    }
+    scalarGain(buf + i, gain, n - i);
+}
+
+RG_AVX2 static void
+avx2PanGain(const float *src, float *left, float *right,
+            float leftGain, float rightGain, size_t n)
+{
+    __m256 gl = _mm256_set1_ps(leftGain);
+    __m256 gr = _mm256_set1_ps(rightGain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(src + i);
+        _mm256_storeu_ps(left + i, _mm256_mul_ps(x, gl));
+        _mm256_storeu_ps(right + i, _mm256_mul_ps(x, gr));
+    }
+    scalarPanGain(src + i, left + i, right + i, leftGain, rightGain, n - i);
+}
+
+RG_AVX2 static float
+avx2Peak(const float *src, float current, size_t n)
+{
+    size_t i = 0;
+    if (n >= 8) {
+        __m256 m = _mm256_set1_ps(current);
+        for (; i + 8 <= n; i += 8) {
+            m = _mm256_max_ps(_mm256_loadu_ps(src + i), m);
+        }
+        float lanes[8];
+        _mm256_storeu_ps(lanes, m);
+        current = scalarPeak(lanes, current, 8);
+    }
+    return scalarPeak(src + i, current, n - i);
+}
+
+RG_AVX2 static void
+avx2Range(const float *src, float &hi, float &lo, size_t n)
+{
+    size_t i = 0;
+    if (n >= 8) {
+        __m256 h = _mm256_set1_ps(hi);
+        __m256 l = _mm256_set1_ps(lo);
+        for (; i + 8 <= n; i += 8) {
+            __m256 x = _mm256_loadu_ps(src + i);
+            h = _mm256_max_ps(x, h);
+            l = _mm256_min_ps(x, l);
+        }
+        float lanes[8];
+        _mm256_storeu_ps(lanes, h);
+        scalarRange(lanes, hi, lo, 8);
+        _mm256_storeu_ps(lanes, l);
+        scalarRange(lanes, hi, lo, 8);
+    }
+    scalarRange(src + i, hi, lo, n - i);
+}
+
+RG_AVX2 static bool
+avx2IsSilent(const float *buf, size_t n)
+{
+    __m256 zero = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(buf + i);
+        if (_mm256_movemask_ps(_mm256_cmp_ps(x, zero, _CMP_NEQ_UQ))) {
+            return false;
+        }
+    }
+    return scalarIsSilent(buf + i, n - i);
+}
+
+RG_AVX2 static void
+avx2FlushDenormals(float *buf, size_t n)
+{
+    __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 smallest = _mm256_set1_ps(FLT_MIN);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(buf + i);
+        __m256 keep = _mm256_cmp_ps(_mm256_and_ps(x, absMask), smallest,
+                                    _CMP_NLT_UQ);
+        _mm256_storeu_ps(buf + i, _mm256_and_ps(x, keep));
+    }
+    scalarFlushDenormals(buf + i, n - i);
+}
+
+// The AVX2 decoders gather the samples of any one channel eight at a
+// time, as the 32-bit words ending with each sample's last byte.  The
+// bytes before the sample are then discarded, but they have to be
+// there to read, so the first frame or so is decoded in scalar.
+// Mono files, and stereo 16-bit ones, are simply loaded.
+
+RG_AVX2 static size_t
+avx2FirstGathered(size_t channels, size_t channel, size_t bytes, size_t n)
+{
+    size_t i = 0;
+    while (i < n && i * channels * bytes + channel * bytes < 4 - bytes) ++i;
+    return i;
+}
+
+RG_AVX2 static __m256i
+avx2GatherOffsets(size_t channels, size_t channel, size_t bytes)
+{
+    int stride = int(channels * bytes);
+    int first = int(channel * bytes) - int(4 - bytes);
+    return _mm256_setr_epi32(first, first + stride, first + stride * 2,
+                             first + stride * 3, first + stride * 4,
+                             first + stride * 5, first + stride * 6,
+                             first + stride * 7);
+}
+
+RG_AVX2 static void
+avx2Decode8(const unsigned char *src, size_t channels, size_t channel,
+            float *dst, size_t n)
+{
+    __m256i bias = _mm256_set1_epi32(128);
+    __m256 scale = _mm256_set1_ps(scale8);
+    size_t i = 0;
+    if (channels == 1) {
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_cvtepu8_epi32
+                (_mm_loadl_epi64((const __m128i *)(src + i)));
+            x = _mm256_sub_epi32(x, bias);
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x),
+                                                    scale));
+        }
+    } else {
+        i = avx2FirstGathered(channels, channel, 1, n);
+        scalarDecode8(src, channels, channel, dst, i);
+        __m256i offsets = avx2GatherOffsets(channels, channel, 1);
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_i32gather_epi32
+                ((const int *)(src + i * channels), offsets, 1);
+            x = _mm256_sub_epi32(_mm256_srli_epi32(x, 24), bias);
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x),
+                                                    scale));
+        }
+    }
+    scalarDecode8(src + i * channels, channels, channel, dst + i, n - i);
+}
+
+RG_AVX2 static void
+avx2Decode16(const unsigned char *src, size_t channels, size_t channel,
+             float *dst, size_t n)
+{
+    __m256 scale = _mm256_set1_ps(scale16);
+    size_t i = 0;
+    if (channels == 1) {
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_cvtepi16_epi32
+                (_mm_loadu_si128((const __m128i *)(src + i * 2)));
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x),
+                                                    scale));
+        }
+    } else if (channels == 2) {
+        for (; i + 8 <= n; i += 8) {
+            // eight frames, each a 32-bit word with left in the low half
+            __m256i x = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+            if (channel == 0) x = _mm256_slli_epi32(x, 16);
+            x = _mm256_srai_epi32(x, 16);
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x),
+                                                    scale));
+        }
+    } else {
+        i = avx2FirstGathered(channels, channel, 2, n);
+        scalarDecode16(src, channels, channel, dst, i);
+        __m256i offsets = avx2GatherOffsets(channels, channel, 2);
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_i32gather_epi32
+                ((const int *)(src + i * channels * 2), offsets, 1);
+            x = _mm256_srai_epi32(x, 16);
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x),
+                                                    scale));
+        }
+    }
+    scalarDecode16(src + i * channels * 2, channels, channel, dst + i, n - i);
+}
+
+RG_AVX2 static void
+avx2Decode24(const unsigned char *src, size_t channels, size_t channel,
+             float *dst, size_t n)
+{
+    __m256i mask = _mm256_set1_epi32(int(0xffffff00));
+    __m256 scale = _mm256_set1_ps(scale24);
+    size_t i = avx2FirstGathered(channels, channel, 3, n);
+    scalarDecode24(src, channels, channel, dst, i);
+    __m256i offsets = avx2GatherOffsets(channels, channel, 3);
+    for (; i + 8 <= n; i += 8) {
+        // the sample is already in the top three bytes
+        __m256i x = _mm256_i32gather_epi32
+            ((const int *)(src + i * channels * 3), offsets, 1);
+        x = _mm256_and_si256(x, mask);
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x),
+                                                scale));
+    }
+    scalarDecode24(src + i * channels * 3, channels, channel, dst + i, n - i);
+}
+
+RG_AVX2 static void
+avx2DecodeFloat(const unsigned char *src, size_t channels, size_t channel,
+                float *dst, size_t n)
+{
+    const float *fsrc = (const float *)src;
+    size_t i = 0;
+    if (channels == 1) {
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(dst + i, _mm256_loadu_ps(fsrc + i));
+        }
+    } else {
+        // whole samples, so nothing is read from before the buffer
+        __m256i offsets = avx2GatherOffsets(channels, channel, 4);
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(dst + i, _mm256_i32gather_ps
+                             (fsrc + i * channels, offsets, 1));
+        }
+    }
+    scalarDecodeFloat(src + i * channels * 4, channels, channel,
+                      dst + i, n - i);
+}
+
+static const KernelTable avx2Kernels = {
+    avx2Add, avx2Gain, avx2PanGain, avx2Peak, avx2Range,
+    avx2IsSilent, avx2FlushDenormals,
+    avx2Decode8, avx2Decode16, avx2Decode24, avx2DecodeFloat,
+    AudioKernels::AVX2
+};
+
+#endif // RG_AUDIO_KERNELS_X86
+
+
+// Starts out scalar, so it's usable even before static initialisers
+// have run, and is switched to the best available below
+
+static const KernelTable *kernels = &scalarKernels;
+
+static AudioKernels::Implementation
+bestImplementation()
+{
+    if (AudioKernels::isSupported(AudioKernels::AVX2)) {
+        return AudioKernels::AVX2;
+    }
+    if (AudioKernels::isSupported(AudioKernels::SSE2)) {
+        return AudioKernels::SSE2;
+    }
+    return AudioKernels::Scalar;
+}
+
+static bool chosen = AudioKernels::setImplementation(bestImplementation());
+
+void
+AudioKernels::add(float *dst, const float *src, size_t n)
+{
+    kernels->add(dst, src, n);
+}
+
+void
+AudioKernels::gain(float *buf, float gain, size_t n)
+{
+    kernels->gain(buf, gain, n);
+}
+
+void
+AudioKernels::panGain(const float *src, float *left, float *right,
+                      float leftGain, float rightGain, size_t n)
+{
+    kernels->panGain(src, left, right, leftGain, rightGain, n);
+}
+
+float
+AudioKernels::peak(const float *src, float current, size_t n)
+{
+    return kernels->peak(src, current, n);
+}
+
+void
+AudioKernels::range(const float *src, float &hi, float &lo, size_t n)
+{
+    kernels->range(src, hi, lo, n);
+}
+
+bool
+AudioKernels::isSilent(const float *buf, size_t n)
+{
+    return kernels->isSilent(buf, n);
+}
+
+void
+AudioKernels::flushDenormals(float *buf, size_t n)
+{
+    kernels->flushDenormals(buf, n);
+}
+
+bool
+AudioKernels::decode(const unsigned char *src, int bitsPerSample,
+                     size_t channels, size_t channel, float *dst, size_t n)
+{
+    switch (bitsPerSample) {
+    case 8: kernels->decode8(src, channels, channel, dst, n); return true;
+    case 16: kernels->decode16(src, channels, channel, dst, n); return true;
+    case 24: kernels->decode24(src, channels, channel, dst, n); return true;
+    case 32: kernels->decodeFloat(src, channels, channel, dst, n); return true;
+    }
+    return false;
+}
+
+AudioKernels::Implementation
+AudioKernels::getImplementation()
+{
+    return kernels->implementation;
+}
+
+const char *
+AudioKernels::getImplementationName(Implementation implementation)
+{
+    switch (implementation) {
+    case Scalar: return "scalar";
+    case SSE2: return "SSE2";
+    case AVX2: return "AVX2";
+    }
+    return "unknown";
+}
+
+bool
+AudioKernels::isSupported(Implementation implementation)
+{
+    switch (implementation) {
+
+    case Scalar:
+        return true;
+
+#ifdef RG_AUDIO_KERNELS_X86
+    case SSE2:
+#ifdef __x86_64__
+        return true;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+#endif
+
+    case AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#else
+    case SSE2:
+    case AVX2:
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+bool
+AudioKernels::setImplementation(Implementation implementation)
+{
+    if (!isSupported(implementation)) return false;
+
+    switch (implementation) {
+    case Scalar: kernels = &scalarKernels; break;
+#ifdef RG_AUDIO_KERNELS_X86
+    case SSE2: kernels = &sse2Kernels; break;
+    case AVX2: kernels = &avx2Kernels; break;
+#else
+    default: return false;
+#endif
+    }
+
+    return true;
+}
+
+}
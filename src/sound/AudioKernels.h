@@ -0,0 +1,101 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2014 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_AUDIO_KERNELS_H
+#define RG_AUDIO_KERNELS_H
+
+#include <cstddef>
+
+namespace Rosegarden
+{
+
+/**
+ * The inner loops of the audio mixers: accumulating, gain and pan,
+ * metering and denormal flushing over blocks of float samples.  Also
+ * the extremes of blocks of samples, for peak files, and the decoding
+ * of audio file samples into floats.
+ *
+ * On x86 builds with a capable compiler each kernel has SSE2 and AVX2
+ * versions alongside the plain C++ one, and the best the CPU supports
+ * is chosen once at startup.  All versions give identical results,
+ * sample for sample.  Buffers need not be aligned.
+ *
+ * These are called from the audio threads, and never lock or allocate.
+ */
+class AudioKernels
+{
+public:
+    enum Implementation {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    /// dst[i] += src[i]
+    static void add(float *dst, const float *src, size_t n);
+
+    /// buf[i] *= gain
+    static void gain(float *buf, float gain, size_t n);
+
+    /**
+     * left[i] = src[i] * leftGain, right[i] = src[i] * rightGain.
+     * src may be the same buffer as left or right.
+     */
+    static void panGain(const float *src, float *left, float *right,
+                        float leftGain, float rightGain, size_t n);
+
+    /**
+     * Return the greatest of current and the values in src.  As for
+     * the meters this is the signed maximum, not the absolute one.
+     */
+    static float peak(const float *src, float current, size_t n);
+
+    /**
+     * Widen hi and lo to take in the values in src: hi becomes the
+     * greatest of itself and the values, lo the least.
+     */
+    static void range(const float *src, float &hi, float &lo, size_t n);
+
+    /// Return true if every value in buf is zero
+    static bool isSilent(const float *buf, size_t n);
+
+    /// Replace any denormal values in buf with zero
+    static void flushDenormals(float *buf, size_t n);
+
+    /**
+     * Decode one channel of n frames of interleaved little-endian
+     * samples, as found in WAV files, to floats in dst: 8-bit
+     * unsigned, 16- and 24-bit signed or 32-bit floating point
+     * samples, scaled as RIFFAudioFile::convertBytesToSample() does.
+     * Returns false, and decodes nothing, for other sample sizes.
+     */
+    static bool decode(const unsigned char *src, int bitsPerSample,
+                       size_t channels, size_t channel,
+                       float *dst, size_t n);
+
+    static Implementation getImplementation();
+    static const char *getImplementationName(Implementation);
+    static bool isSupported(Implementation);
+
+    /**
+     * Switch to another implementation, if supported, returning
+     * false if not.  For testing; not safe while audio is running.
+     */
+    static bool setImplementation(Implementation);
+};
+
+}
+
+#endif
@@ -14,6 +14,7 @@
 */
 
 #include "AudioProcess.h"
+#include "AudioKernels.h"
 
 #include "RunnablePluginInstance.h"
 #include "PlayableAudioFile.h"
@@ -48,22 +49,6 @@
 namespace Rosegarden
 {
 
-/* Branch-free optimizer-resistant denormal killer courtesy of Simon
-   Jenkins on LAD: */
-
-static inline float flushToZero(volatile float f)
-{
-    f += 9.8607615E-32f;
-    return f - 9.8607615E-32f;
-}
-
-static inline void denormalKill(float *buffer, int size)
-{
-    for (int i = 0; i < size; ++i) {
-        buffer[i] = flushToZero(buffer[i]);
-    }
-}
-
 AudioThread::AudioThread(std::string name,
                          SoundDriver *driver,
                          unsigned int sampleRate) :
@@ -752,8 +737,8 @@ AudioBussMixer::processBlocks()
 
                     while (ch < 2 && ch < plugin->getAudioOutputCount()) {
 
-                        denormalKill(plugin->getAudioOutputBuffers()[ch],
-                                     m_blockSize);
+                        AudioKernels::flushDenormals
+                            (plugin->getAudioOutputBuffers()[ch], m_blockSize);
 
                         memcpy(m_processBuffers[ch],
                                plugin->getAudioOutputBuffers()[ch],
@@ -768,9 +753,8 @@ AudioBussMixer::processBlocks()
                 if (dormant) {
                     rec.buffers[ch]->zero(m_blockSize);
                 } else {
-                    for (size_t j = 0; j < m_blockSize; ++j) {
-                        m_processBuffers[ch][j] *= gain[ch];
-                    }
+                    AudioKernels::gain(m_processBuffers[ch], gain[ch],
+                                       m_blockSize);
                     rec.buffers[ch]->write(m_processBuffers[ch], m_blockSize);
                 }
             }
@@ -1843,8 +1827,8 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
         unsigned int ch = 0;
 
         while (ch < synth->getAudioOutputCount() && ch < channels) {
-            denormalKill(synth->getAudioOutputBuffers()[ch],
-                         m_blockSize);
+            AudioKernels::flushDenormals(synth->getAudioOutputBuffers()[ch],
+                                         m_blockSize);
             memcpy(m_processBuffers[ch],
                    synth->getAudioOutputBuffers()[ch],
                    m_blockSize * sizeof(sample_t));
@@ -1938,8 +1922,8 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 
         while (ch < plugin->getAudioOutputCount()) {
 
-            denormalKill(plugin->getAudioOutputBuffers()[ch],
-                         m_blockSize);
+            AudioKernels::flushDenormals(plugin->getAudioOutputBuffers()[ch],
+                                         m_blockSize);
 
             if (ch < channels) {
                 memcpy(m_processBuffers[ch],
@@ -1966,16 +1950,11 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 
     if (targetChannels == 2 && channels == 1) {
 
-        for (size_t i = 0; i < m_blockSize; ++i) {
-
-            sample_t sample = m_processBuffers[0][i];
+        allZeros = AudioKernels::isSilent(m_processBuffers[0], m_blockSize);
 
-            m_processBuffers[0][i] = sample * rec.gainLeft;
-            m_processBuffers[1][i] = sample * rec.gainRight;
-
-            if (allZeros && sample != 0.0)
-                allZeros = false;
-        }
+        AudioKernels::panGain(m_processBuffers[0],
+                              m_processBuffers[0], m_processBuffers[1],
+                              rec.gainLeft, rec.gainRight, m_blockSize);
 
         rec.buffers[0]->write(m_processBuffers[0], m_blockSize);
         rec.buffers[1]->write(m_processBuffers[1], m_blockSize);
@@ -1987,14 +1966,12 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
             float gain = ((ch == 0) ? rec.gainLeft :
                           (ch == 1) ? rec.gainRight : rec.volume);
 
-            for (size_t i = 0; i < m_blockSize; ++i) {
-
-                // handle volume and pan
-                m_processBuffers[ch][i] *= gain;
+            // handle volume and pan
+            AudioKernels::gain(m_processBuffers[ch], gain, m_blockSize);
 
-                if (allZeros && m_processBuffers[ch][i] != 0.0)
-                    allZeros = false;
-            }
+            if (allZeros &&
+                !AudioKernels::isSilent(m_processBuffers[ch], m_blockSize))
+                allZeros = false;
 
             rec.buffers[ch]->write(m_processBuffers[ch], m_blockSize);
         }
@@ -17,6 +17,7 @@
 #include "AlsaDriver.h"
 #include "MappedStudio.h"
 #include "AudioProcess.h"
+#include "AudioKernels.h"
 #include "base/Profiler.h"
 #include "base/AudioLevel.h"
 #include "Audit.h"
@@ -1039,12 +1040,8 @@ JackDriver::jackProcess(jack_nframes_t nframes)
                 if (actual < nframes) {
                     reportFailure(MappedEvent::FailureBussMixUnderrun);
                 }
-                for (size_t i = 0; i < nframes; ++i) {
-                    sample_t sample = submaster[ch][i];
-                    if (sample > peak[ch])
-                        peak[ch] = sample;
-                    master[ch][i] += sample;
-                }
+                peak[ch] = AudioKernels::peak(submaster[ch], peak[ch], nframes);
+                AudioKernels::add(master[ch], submaster[ch], nframes);
             }
         }
 
@@ -1155,13 +1152,9 @@ JackDriver::jackProcess(jack_nframes_t nframes)
                     reportFailure(MappedEvent::FailureMixUnderrun);
                 }
 
-                for (size_t f = 0; f < nframes; ++f) {
-                    sample_t sample = instrument[ch][f];
-                    if (sample > peak[ch])
-                        peak[ch] = sample;
-                    if (directToMaster)
-                        master[ch][f] += sample;
-                }
+                peak[ch] = AudioKernels::peak(instrument[ch], peak[ch], nframes);
+                if (directToMaster)
+                    AudioKernels::add(master[ch], instrument[ch], nframes);
             }
 
             // If the instrument is connected straight to master we
@@ -1399,21 +1392,16 @@ JackDriver::jackProcessRecord(InstrumentId id,
         memset(m_tempOutBuffer, 0, nframes * sizeof(sample_t));
 
         if (inputBufferLeft) {
-            for (size_t i = 0; i < nframes; ++i) {
-                sample_t sample = inputBufferLeft[i] * gain;
-                if (sample > peakLeft)
-                    peakLeft = sample;
-                m_tempOutBuffer[i] = sample;
-            }
+            memcpy(m_tempOutBuffer, inputBufferLeft, nframes * sizeof(sample_t));
+            AudioKernels::gain(m_tempOutBuffer, gain, nframes);
+            peakLeft = AudioKernels::peak(m_tempOutBuffer, peakLeft, nframes);
 
             if (!m_outputMonitors.empty()) {
                 sample_t *buf =
                     static_cast<sample_t *>
                     (jack_port_get_buffer(m_outputMonitors[0], nframes));
                 if (buf) {
-                    for (size_t i = 0; i < nframes; ++i) {
-                        buf[i] += m_tempOutBuffer[i];
-                    }
+                    AudioKernels::add(buf, m_tempOutBuffer, nframes);
                 }
             }
 
@@ -1423,20 +1411,17 @@ JackDriver::jackProcessRecord(InstrumentId id,
         if (channels == 2) {
 
             if (inputBufferRight) {
-                for (size_t i = 0; i < nframes; ++i) {
-                    sample_t sample = inputBufferRight[i] * gain;
-                    if (sample > peakRight)
-                        peakRight = sample;
-                    m_tempOutBuffer[i] = sample;
-                }
+                memcpy(m_tempOutBuffer, inputBufferRight,
+                       nframes * sizeof(sample_t));
+                AudioKernels::gain(m_tempOutBuffer, gain, nframes);
+                peakRight = AudioKernels::peak(m_tempOutBuffer, peakRight,
+                                               nframes);
                 if (m_outputMonitors.size() > 1) {
                     sample_t *buf =
                         static_cast<sample_t *>
                         (jack_port_get_buffer(m_outputMonitors[1], nframes));
                     if (buf) {
-                        for (size_t i = 0; i < nframes; ++i) {
-                            buf[i] += m_tempOutBuffer[i];
-                        }
+                        AudioKernels::add(buf, m_tempOutBuffer, nframes);
                     }
                 }
             }
@@ -1462,13 +1447,11 @@ JackDriver::jackProcessRecord(InstrumentId id,
                     (jack_port_get_buffer(m_outputMonitors[0], nframes));
             }
 
-            for (size_t i = 0; i < nframes; ++i) {
-                sample_t sample = inputBufferLeft[i] * gain;
-                if (sample > peakLeft)
-                    peakLeft = sample;
-                if (buf)
-                    buf[i] = sample;
-            }
+            // scale into the monitor, or somewhere to meter it from
+            sample_t *dest = (buf ? buf : m_tempOutBuffer);
+            memcpy(dest, inputBufferLeft, nframes * sizeof(sample_t));
+            AudioKernels::gain(dest, gain, nframes);
+            peakLeft = AudioKernels::peak(dest, peakLeft, nframes);
 
             if (channels == 2 && inputBufferRight) {
 
@@ -1478,13 +1461,10 @@ JackDriver::jackProcessRecord(InstrumentId id,
                         (jack_port_get_buffer(m_outputMonitors[1], nframes));
                 }
 
-                for (size_t i = 0; i < nframes; ++i) {
-                    sample_t sample = inputBufferRight[i] * gain;
-                    if (sample > peakRight)
-                        peakRight = sample;
-                    if (buf)
-                        buf[i] = sample;
-                }
+                dest = (buf ? buf : m_tempOutBuffer);
+                memcpy(dest, inputBufferRight, nframes * sizeof(sample_t));
+                AudioKernels::gain(dest, gain, nframes);
+                peakRight = AudioKernels::peak(dest, peakRight, nframes);
             }
         }
     }
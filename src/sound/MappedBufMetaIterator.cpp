@@ -23,6 +23,7 @@
 #include "sound/MappedInserterBase.h"
 #include "sound/ControlBlock.h"
 
+#include <algorithm>
 #include <queue>
 #include <functional>
 
@@ -32,7 +33,8 @@
 namespace Rosegarden
 {
 
-MappedBufMetaIterator::MappedBufMetaIterator()
+MappedBufMetaIterator::MappedBufMetaIterator() :
+    m_waitingDirty(true)
 {
 }
 
@@ -57,6 +59,7 @@ MappedBufMetaIterator::addSegment(MappedEventBuffer *ms)
     MappedEventBuffer::iterator *iter = new MappedEventBuffer::iterator(ms);
     moveIteratorToTime(*iter, m_currentTime);
     m_iterators.push_back(iter);
+    m_waitingDirty = true;
 }
 
 void
@@ -75,6 +78,7 @@ MappedBufMetaIterator::removeSegment(MappedEventBuffer *ms)
 
     // Remove from m_segments
     m_segments.erase(ms);
+    m_waitingDirty = true;
 }
 
 void
@@ -86,6 +90,7 @@ MappedBufMetaIterator::clear()
 
     m_iterators.clear();
     m_segments.clear();
+    m_waitingDirty = true;
 }
 
 void
@@ -97,6 +102,8 @@ MappedBufMetaIterator::reset()
          i != m_iterators.end(); ++i) {
         (*i)->reset();
     }
+
+    m_waitingDirty = true;
 }
 
 bool
@@ -124,10 +131,6 @@ bool
 MappedBufMetaIterator::moveIteratorToTime(MappedEventBuffer::iterator &iter,
                                                const RealTime &startTime)
 {
-    // Rather than briefly unlock and immediately relock each
-    // iteration, we leave the lock on until we're done.
-    QReadLocker locker(iter.getLock());
-
     while (1) {
 
         if (iter.atEnd()) break;
@@ -148,9 +151,55 @@ MappedBufMetaIterator::moveIteratorToTime(MappedEventBuffer::iterator &iter,
 
     bool res = !iter.atEnd();
     iter.setReady(false);
+    m_waitingDirty = true;
     return res;
 }
 
+void
+MappedBufMetaIterator::wait(size_t index)
+{
+    MappedEventBuffer::iterator *iter = m_iterators[index];
+
+    if (iter->atEnd()) {
+        m_idle.push_back(index);
+        return;
+    }
+
+    RealTime wakeTime;
+
+    if (!iter->isReady()) {
+        // It has to be made ready as soon as its segment starts
+        RealTime end;
+        iter->getSegment()->getStartEnd(wakeTime, end);
+    } else {
+        const MappedEvent *e = iter->peek();
+        // An invalid event holds the iterator up until it is reset,
+        // and a missing one until the buffer is filled further
+        if (!e || !e->isValid()) {
+            m_idle.push_back(index);
+            return;
+        }
+        wakeTime = e->getEventTime();
+    }
+
+    m_waiting.push_back(PendingEvent(wakeTime, index));
+    std::push_heap(m_waiting.begin(), m_waiting.end(),
+                   std::greater<PendingEvent>());
+}
+
+void
+MappedBufMetaIterator::rebuildWaiting()
+{
+    m_waiting.clear();
+    m_idle.clear();
+
+    for (size_t i = 0; i < m_iterators.size(); ++i) {
+        wait(i);
+    }
+
+    m_waitingDirty = false;
+}
+
 
 
 
@@ -173,17 +222,40 @@ fetchEvents(MappedInserterBase &inserter,
     // fetchEventsNoncompeting.  We could re-slice it smarter but this
     // suffices.
 
+    // Take from the waiting heap just the iterators that have
+    // something to do before endTime.  The rest needn't be touched at
+    // all, which matters when there are hundreds of segments and only
+    // a few are playing.
+    if (m_waitingDirty) rebuildWaiting();
+
+    // Idle iterators go back on the heap if their buffers have grown
+    // since the last fetch.  m_due is borrowed for the list to save
+    // allocating one.
+    m_due.clear();
+    m_due.swap(m_idle);
+    for (size_t i = 0; i < m_due.size(); ++i) {
+        wait(m_due[i]);
+    }
+
+    m_due.clear();
+    while (!m_waiting.empty() && m_waiting.front().first < endTime) {
+        std::pop_heap(m_waiting.begin(), m_waiting.end(),
+                      std::greater<PendingEvent>());
+        m_due.push_back(m_waiting.back().second);
+        m_waiting.pop_back();
+    }
+
     // Make a queue of all segment starts that occur during the slice.
+    // A segment that starts later isn't due, and one that started
+    // earlier doesn't matter here.
     std::priority_queue<RealTime,
                         std::vector<RealTime>,
                         std::greater<RealTime> >
         segStarts;
 
-    for (segmentiterators::iterator i = m_iterators.begin();
-         i != m_iterators.end();
-         ++i) {
+    for (size_t i = 0; i < m_due.size(); ++i) {
         RealTime start, end;
-        (*i)->getSegment()->getStartEnd(start, end); 
+        m_iterators[m_due[i]]->getSegment()->getStartEnd(start, end); 
         if ((start >= startTime) && (start < endTime))
             { segStarts.push(start); }
     }
@@ -211,6 +283,11 @@ fetchEvents(MappedInserterBase &inserter,
     // endTime.
     fetchEventsNoncompeting(inserter, innerStart, endTime);
 
+    // Back to waiting until they next have something to do
+    for (size_t i = 0; i < m_due.size(); ++i) {
+        wait(m_due[i]);
+    }
+
     return;
 }
 
@@ -231,128 +308,147 @@ fetchEventsNoncompeting(MappedInserterBase &inserter,
     
     // Activate segments that have anything playing during this
     // slice.  We include segments that end exactly when we start, but
-    // not segments that start exactly when we end.
-    for (segmentiterators::iterator i = m_iterators.begin();
-         i != m_iterators.end();
-         ++i) { 
+    // not segments that start exactly when we end.  Only iterators
+    // taken from the waiting heap by fetchEvents() can be active.
+    for (size_t i = 0; i < m_due.size(); ++i) {
+        MappedEventBuffer::iterator *iter = m_iterators[m_due[i]];
         RealTime start, end;
-        (*i)->getSegment()->getStartEnd(start, end);
+        iter->getSegment()->getStartEnd(start, end);
         bool active = ((start < endTime) && (end >= startTime));
-        (*i)->setActive(active, startTime);
+        iter->setActive(active, startTime);
     }
 
-    // State variable to allow the outer loop to run until the inner
-    // loop has nothing to do.
-    bool innerLoopHasMore = false;
-    do {
-        innerLoopHasMore = false;
+    // Put every active iterator that has an event for us on a heap
+    // ordered by the time of that event, so that each step below only
+    // looks at the segment whose event is due next, however many
+    // segments there are.
+    m_pending.clear();
 
-        for (size_t i = 0; i < m_iterators.size(); ++i) {
-            MappedEventBuffer::iterator *iter = m_iterators[i];
+    for (size_t j = 0; j < m_due.size(); ++j) {
+        size_t i = m_due[j];
+        MappedEventBuffer::iterator *iter = m_iterators[i];
 
-#ifdef DEBUG_META_ITERATOR
-            SEQUENCER_DEBUG << "MBMI::fetchEventsNoncompeting : "
-                            << "checking segment #" << i << endl;
-#endif
+        if (!iter->getActive()) { continue; }
 
-            if (!iter->getActive()) {
-#ifdef DEBUG_META_ITERATOR
-                SEQUENCER_DEBUG << "MBMI::fetchEventsNoncompeting : "
-                                << "no more events to get for this slice"
-                                << "in segment #" << i << endl;
-#endif
+        const MappedEvent *cur = nextEvent(inserter, *iter, startTime, endTime, i);
+        if (cur) {
+            m_pending.push_back(PendingEvent(cur->getEventTime(), i));
+        }
+    }
 
-                continue; // skip this iterator
-            }
+    std::make_heap(m_pending.begin(), m_pending.end(),
+                   std::greater<PendingEvent>());
+
+    while (!m_pending.empty()) {
+
+        std::pop_heap(m_pending.begin(), m_pending.end(),
+                      std::greater<PendingEvent>());
+        size_t i = m_pending.back().second;
+        m_pending.pop_back();
+
+        MappedEventBuffer::iterator *iter = m_iterators[i];
+
+        // No lock is needed here.  The pointer is into the
+        // buffer's published snapshot, which a refresh in the GUI
+        // thread replaces rather than modifies, and the old one
+        // outlives this slice.
+        MappedEvent *cur = iter->peek();
+
+        // Increment the iterator, since we're taking this event.
+        ++(*iter);
 
-            if (iter->atEnd()) {
 #ifdef DEBUG_META_ITERATOR
-                SEQUENCER_DEBUG << "MBMI::fetchEventsNoncompeting : "
-                                << endTime
-                                << " reached end of segment #"
-                                << i << endl;
+        SEQUENCER_DEBUG << "MBMI::fetchEventsNoncompeting : " << endTime
+                        << " seeing evt from segment #"
+                        << i
+                        << " : trackId: " << cur->getTrackId()
+                        << " channel: " << (unsigned int) cur->getRecordedChannel()
+                        << " - inst: " << cur->getInstrument()
+                        << " - type: " << cur->getType()
+                        << " - time: " << cur->getEventTime()
+                        << " - duration: " << cur->getDuration()
+                        << " - data1: " << (unsigned int)cur->getData1()
+                        << " - data2: " << (unsigned int)cur->getData2()
+                        << endl;
 #endif
-                // Make this iterator abort early in future
-                // iterations, since we know it's all done.
-                iter->setInactive();
-                continue;
-            }
 
-            // This locks the iterator's buffer against writes, lest
-            // writing cause reallocating the buffer while we are
-            // holding a pointer into it.  No function we call will
-            // hold the `cur' pointer past its own scope, implying
-            // that nothing holds it past an iteration of this loop,
-            // which is this lock's scope.
-            QReadLocker locker(iter->getLock());
-
-            MappedEvent *cur = iter->peek();
-
-            // We couldn't fetch an event or it failed a sanity check.
-            // So proceed to the next iterator but keep looking at
-            // this one - incrementing it does nothing useful, and it
-            // might get more events.  But don't set innerLoopHasMore,
-            // lest we loop forever waiting for a valid event.
-            if (!cur || !cur->isValid()) { continue; }
-
-            // If we got this far, make the mapper ready.  Do this
-            // even if the note won't play during this slice, because
-            // sometimes/always we prepare channels slightly ahead of
-            // their first notes, to fix bug #1378
-            if (!iter->isReady()) {
-                iter->makeReady(inserter, startTime);
-            }
-            
-            if (cur->getEventTime() < endTime) {
-                // Increment the iterator, since we're taking this
-                // event.  NB, in the other branch it is not yet used
-                // so we leave `iter' where it is.
-                ++(*iter);
-                
-                // If we got this far, we'll want to try the next
-                // iteration, so note it.
-                innerLoopHasMore = true;
-                
+        if(iter->shouldPlay(cur, startTime)) {
+            iter->doInsert(inserter, *cur);
 #ifdef DEBUG_META_ITERATOR
-                SEQUENCER_DEBUG << "MBMI::fetchEventsNoncompeting : " << endTime
-                                << " seeing evt from segment #"
-                                << i
-                                << " : trackId: " << cur->getTrackId()
-                                << " channel: " << (unsigned int) cur->getRecordedChannel()
-                                << " - inst: " << cur->getInstrument()
-                                << " - type: " << cur->getType()
-                                << " - time: " << cur->getEventTime()
-                                << " - duration: " << cur->getDuration()
-                                << " - data1: " << (unsigned int)cur->getData1()
-                                << " - data2: " << (unsigned int)cur->getData2()
-                                << endl;
+            SEQUENCER_DEBUG << "Inserting event" << endl;
 #endif
 
-                if(iter->shouldPlay(cur, startTime)) {
-                    iter->doInsert(inserter, *cur);
+        } else {
 #ifdef DEBUG_META_ITERATOR
-                    SEQUENCER_DEBUG << "Inserting event" << endl;
+            SEQUENCER_DEBUG << "Skipping event" << endl;
 #endif
+        }
+
+        // Back on the heap if it has another event for this slice
+        const MappedEvent *next = nextEvent(inserter, *iter, startTime, endTime, i);
+        if (next) {
+            m_pending.push_back(PendingEvent(next->getEventTime(), i));
+            std::push_heap(m_pending.begin(), m_pending.end(),
+                           std::greater<PendingEvent>());
+        }
+    }
 
-                } else {
+    return;
+}
+
+const MappedEvent *
+MappedBufMetaIterator::
+nextEvent(MappedInserterBase &inserter,
+          MappedEventBuffer::iterator &iter,
+          const RealTime &startTime,
+          const RealTime &endTime,
+          size_t index)
+{
+#ifndef DEBUG_META_ITERATOR
+    (void)index;
+#endif
+
+    if (iter.atEnd()) {
 #ifdef DEBUG_META_ITERATOR
-                    SEQUENCER_DEBUG << "Skipping event" << endl;
+        SEQUENCER_DEBUG << "MBMI::fetchEventsNoncompeting : "
+                        << endTime
+                        << " reached end of segment #"
+                        << index << endl;
 #endif
-                }
-            } else {
-                // This iterator has more events but they only sound
-                // after the end of this slice, so it's done.
-                iter->setInactive();
+        // Make this iterator abort early in future slices, since we
+        // know it's all done.
+        iter.setInactive();
+        return 0;
+    }
+
+    const MappedEvent *cur = iter.peek();
+
+    // We couldn't fetch an event or it failed a sanity check.  Leave
+    // the iterator where it is - incrementing it does nothing useful,
+    // and it might get more events - but take nothing more from it in
+    // this slice.
+    if (!cur || !cur->isValid()) { return 0; }
+
+    // If we got this far, make the mapper ready.  Do this even if the
+    // note won't play during this slice, because sometimes/always we
+    // prepare channels slightly ahead of their first notes, to fix bug
+    // #1378
+    if (!iter.isReady()) {
+        iter.makeReady(inserter, startTime);
+    }
+
+    if (cur->getEventTime() < endTime) return cur;
+
+    // This iterator has more events but they only sound after the
+    // end of this slice, so it's done.
+    iter.setInactive();
 
 #ifdef DEBUG_META_ITERATOR
-                SEQUENCER_DEBUG << "fetchEventsNoncompeting : Event is past end for segment #"
-                                << i << endl;
+    SEQUENCER_DEBUG << "fetchEventsNoncompeting : Event is past end for segment #"
+                    << index << endl;
 #endif
-            }
-        }
-    } while (innerLoopHasMore);
 
-    return;
+    return 0;
 }
 
 // @param immediate means to reset it right away, presumably because
@@ -378,6 +474,8 @@ resetIteratorForSegment(MappedEventBuffer *s, bool immediate)
             } else {
                 iter->setReady(false);
             }
+            // Its segment has changed, so its wake time may have too
+            m_waitingDirty = true;
             break;
         }
     }
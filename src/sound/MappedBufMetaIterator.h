@@ -22,6 +22,8 @@
 #include "sound/MappedEvent.h"
 
 #include <set>
+#include <utility>
+#include <vector>
 
 namespace Rosegarden {
 
@@ -105,6 +107,25 @@ protected:
     bool moveIteratorToTime(MappedEventBuffer::iterator&,
                             const RealTime&);
 
+    /// Put the iterator at index on m_waiting, or on m_idle if it has
+    /// nothing to give for now.
+    void wait(size_t index);
+
+    /// Recalculate m_waiting for all iterators.
+    void rebuildWaiting();
+
+    /// Return iter's next event if it should be fetched in this slice.
+    /**
+     * Readies the iterator's mapper if need be, and makes the
+     * iterator inactive if it has nothing more to give in the slice.
+     * Returns 0 if there is no event to fetch now.
+     */
+    const MappedEvent *nextEvent(MappedInserterBase &inserter,
+                                 MappedEventBuffer::iterator &iter,
+                                 const RealTime &startTime,
+                                 const RealTime &endTime,
+                                 size_t index);
+
     //--------------- Data members ---------------------------------
 
     RealTime m_currentTime;
@@ -115,6 +136,38 @@ protected:
     typedef std::vector<MappedEventBuffer::iterator*> segmentiterators;
     segmentiterators m_iterators;
 
+    /// A time and an index into m_iterators.
+    typedef std::pair<RealTime, size_t> PendingEvent;
+
+    /// Heap of iterators waiting for something to do.
+    /**
+     * Each is keyed on the time it next needs attention from
+     * fetchEvents(): when its segment starts, if it has yet to be
+     * made ready, or else the time of its next event.  Iterators at
+     * the end of their buffers are on m_idle instead.  Rebuilt from
+     * scratch whenever an iterator is added, removed or moved.
+     */
+    std::vector<PendingEvent> m_waiting;
+    bool m_waitingDirty;
+
+    /// Indices of the iterators with nothing to give when last looked at.
+    /**
+     * Events can be appended to a buffer without any notification to
+     * us, when recording or when the metronome or tempo mapper is
+     * refreshed, so these are looked at again on every fetch.
+     */
+    std::vector<size_t> m_idle;
+
+    /// Indices of the iterators taken from m_waiting for this fetch.
+    std::vector<size_t> m_due;
+
+    /// Heap of (next event time, index into m_iterators) for a slice.
+    /**
+     * Only used within fetchEventsNoncompeting(), but kept here so
+     * that it need not be reallocated for every slice.
+     */
+    std::vector<PendingEvent> m_pending;
+
     std::vector<MappedEvent> m_playingAudioSegments;
 };
 
@@ -14,6 +14,13 @@
 */
 
 #include <QApplication>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
 
 #include "Midi.h"
 #include "MidiFile.h"
@@ -49,7 +56,6 @@ namespace Rosegarden
 {
 
 using std::string;
-using std::ifstream;
 using std::stringstream;
 using std::cerr;
 using std::endl;
@@ -65,8 +71,6 @@ MidiFile::MidiFile(Studio *studio):
         m_format(MIDI_FILE_NOT_LOADED),
         m_numberOfTracks(0),
         m_containsTimeChanges(false),
-        m_trackByteCount(0),
-        m_decrementCount(false),
         m_studio(studio)
 {}
 
@@ -80,8 +84,6 @@ MidiFile::MidiFile(const QString &fn,
         m_format(MIDI_FILE_NOT_LOADED),
         m_numberOfTracks(0),
         m_containsTimeChanges(false),
-        m_trackByteCount(0),
-        m_decrementCount(false),
         m_studio(studio)
 {}
 
@@ -93,402 +95,115 @@ MidiFile::~MidiFile()
 }
 
 
-// A couple of convenience functions.   Watch the byte conversions out
-// of the STL strings.
-//
-//
-long
-MidiFile::midiBytesToLong(const string& bytes)
-{
-    if (bytes.length() != 4) {
-#ifdef MIDI_DEBUG
-        std::cerr << "WARNING: Wrong length for long data (" << bytes.length()
-        << ", should be 4)" << endl;
-#endif
-
-        // TRANSLATOR: "long" is a C++ data type
-        throw (Exception(qstrtostr(QObject::tr("Wrong length for long data in MIDI stream"))));
-    }
-
-    long longRet = ((long)(((MidiByte)bytes[0]) << 24)) |
-                   ((long)(((MidiByte)bytes[1]) << 16)) |
-                   ((long)(((MidiByte)bytes[2]) << 8)) |
-                   ((long)((MidiByte)(bytes[3])));
-
-    std::cerr << "midiBytesToLong(" << int((MidiByte)bytes[0]) << "," << int((MidiByte)bytes[1]) << "," << int((MidiByte)bytes[2]) << "," << int((MidiByte)bytes[3]) << ") -> " << longRet << std::endl;
-
-    return longRet;
-}
-
-int
-MidiFile::midiBytesToInt(const string& bytes)
+namespace
 {
-    if (bytes.length() != 2) {
-#ifdef MIDI_DEBUG
-        std::cerr << "WARNING: Wrong length for int data (" << bytes.length()
-        << ", should be 2)" << endl;
-#endif
-
-        // TRANSLATOR: "int" is a C++ data type
-        throw (Exception(qstrtostr(QObject::tr("Wrong length for int data in MIDI stream"))));
-    }
 
-    int intRet = ((int)(((MidiByte)bytes[0]) << 8)) |
-                 ((int)(((MidiByte)bytes[1])));
-    return (intRet);
-}
-
-
-
-// Gets a single byte from the MIDI byte stream.  For each track
-// section we can read only a specified number of bytes held in
-// m_trackByteCount.
+// Reads the bytes of one track chunk, or of the file header, straight
+// from the mapped file.  Reading past the end of the span throws, as
+// the file must be corrupt.
 //
-MidiByte
-MidiFile::getMidiByte(ifstream* midiFile)
+class MidiByteReader
 {
-    static int bytesGot = 0; // purely for progress reporting purposes
-
-    if (midiFile->eof()) {
-        throw(Exception(qstrtostr(QObject::tr("End of MIDI file encountered while reading"))));
-    }
+public:
+    MidiByteReader(const MidiByte *data, unsigned long size) :
+        m_data(data), m_end(data + size) { }
 
-    if (m_decrementCount && m_trackByteCount <= 0) {
-        throw(Exception(qstrtostr(QObject::tr("Attempt to get more bytes than expected on Track"))));
-    }
-
-    char byte;
-    if (midiFile->read(&byte, 1)) {
-
-        --m_trackByteCount;
+    unsigned long remaining() const { return m_end - m_data; }
 
-        // update a progress dialog if we have one
-        //
-        ++bytesGot;
-        if (bytesGot % 2000 == 0) {
-
-            emit setValue((int)(double(midiFile->tellg()) /
-                                   double(m_fileSize) * 20.0));
-			qApp->processEvents( QEventLoop::AllEvents );	// note: was qApp->processEvents(50)
+    MidiByte getByte() {
+        if (m_data >= m_end) {
+            throw(Exception(qstrtostr(QObject::tr("Attempt to get more bytes than expected on Track"))));
         }
-
-        return (MidiByte)byte;
-    }
-
-    throw(Exception(qstrtostr(QObject::tr("Attempt to read past MIDI file end"))));
-}
-
-
-// Gets a specified number of bytes from the MIDI byte stream.  For
-// each track section we can read only a specified number of bytes
-// held in m_trackByteCount.
-//
-string
-MidiFile::getMidiBytes(ifstream* midiFile, unsigned long numberOfBytes)
-{
-    string stringRet;
-    char fileMidiByte;
-	static int bytesGot = 0; // purely for progress reporting purposes
-
-    if (midiFile->eof()) {
-#ifdef MIDI_DEBUG
-        std::cerr << "MIDI file EOF - got "
-        << stringRet.length() << " bytes out of "
-        << numberOfBytes << endl;
-#endif
-
-        throw(Exception(qstrtostr(QObject::tr("End of MIDI file encountered while reading"))));
-
+        return *m_data++;
     }
 
-    if (m_decrementCount && (numberOfBytes > (unsigned long)m_trackByteCount)) {
+    // Return a pointer to the next numberOfBytes bytes, and skip them
+    const MidiByte *getBytes(unsigned long numberOfBytes) {
+        if (numberOfBytes > remaining()) {
 #ifdef MIDI_DEBUG
-        std::cerr << "Attempt to get more bytes than allowed on Track ("
-        << numberOfBytes
-        << " > "
-        << m_trackByteCount << endl;
+            std::cerr << "Attempt to get more bytes than allowed on Track ("
+                      << numberOfBytes << " > " << remaining() << ")"
+                      << endl;
 #endif
-
-        //!!! Investigate -- I'm seeing this on new-notation-quantization
-        // branch: load glazunov.rg, run Interpret on first segment, export
-        // and attempt to import again
-
-        throw(Exception(qstrtostr(QObject::tr("Attempt to get more bytes than expected on Track"))));
-    }
-
-    while (stringRet.length() < numberOfBytes &&
-            midiFile->read(&fileMidiByte, 1)) {
-        stringRet += fileMidiByte;
-    }
-
-    // if we've reached the end of file without fulfilling the
-    // quota then panic as our parsing has performed incorrectly
-    //
-    if (stringRet.length() < numberOfBytes) {
-        stringRet = "";
-#ifdef MIDI_DEBUG
-
-        cerr << "Attempt to read past file end - got "
-        << stringRet.length() << " bytes out of "
-        << numberOfBytes << endl;
-#endif
-
-        throw(Exception(qstrtostr(QObject::tr("Attempt to read past MIDI file end"))));
-
+            throw(Exception(qstrtostr(QObject::tr("Attempt to get more bytes than expected on Track"))));
+        }
+        const MidiByte *bytes = m_data;
+        m_data += numberOfBytes;
+        return bytes;
     }
 
-    // decrement the byte count
-    if (m_decrementCount)
-        m_trackByteCount -= stringRet.length();
-
-    // update a progress dialog if we have one
-    //
-    bytesGot += numberOfBytes;
-    if (bytesGot % 2000 == 0) {
-        emit setValue((int)(double(midiFile->tellg()) /
-                               double(m_fileSize) * 20.0));
-		qApp->processEvents(QEventLoop::AllEvents);
+    // Get a number of variable length, whose first byte may already
+    // have been read
+    unsigned long getNumber(int firstByte = -1) {
+        MidiByte midiByte = (firstByte >= 0 ? (MidiByte)firstByte : getByte());
+        unsigned long number = midiByte;
+        if (midiByte & 0x80) {
+            number &= 0x7F;
+            do {
+                midiByte = getByte();
+                number = (number << 7) + (midiByte & 0x7F);
+            } while (midiByte & 0x80);
+        }
+        return number;
     }
 
-    return stringRet;
-}
-
+private:
+    const MidiByte *m_data;
+    const MidiByte *m_end;
+};
 
-// Get a long number of variable length from the MIDI byte stream.
-//
-//
 long
-MidiFile::getNumberFromMidiBytes(ifstream* midiFile, int firstByte)
+midiBytesToLong(const MidiByte *bytes)
 {
-    long longRet = 0;
-    MidiByte midiByte;
-
-    if (firstByte >= 0) {
-        midiByte = (MidiByte)firstByte;
-    } else if (midiFile->eof()) {
-        return longRet;
-    } else {
-        midiByte = getMidiByte(midiFile);
-    }
-
-    longRet = midiByte;
-    if (midiByte & 0x80 ) {
-        longRet &= 0x7F;
-        do {
-            midiByte = getMidiByte(midiFile);
-            longRet = (longRet << 7) + (midiByte & 0x7F);
-        } while (!midiFile->eof() && (midiByte & 0x80));
-    }
-
-    return longRet;
+    return ((long)bytes[0] << 24) | ((long)bytes[1] << 16) |
+           ((long)bytes[2] << 8) | (long)bytes[3];
 }
 
-
-
-// Seeks to the next track in the midi file and sets the number
-// of bytes to be read in the counter m_trackByteCount.
-//
-bool
-MidiFile::skipToNextTrack(ifstream *midiFile)
+int
+midiBytesToInt(const MidiByte *bytes)
 {
-    string buffer, buffer2;
-    m_trackByteCount = -1;
-    m_decrementCount = false;
-
-    while (!midiFile->eof() && (m_decrementCount == false )) {
-        buffer = getMidiBytes(midiFile, 4);
-
-        if (buffer.compare(0, 4, MIDI_TRACK_HEADER) == 0) {
-            m_trackByteCount = midiBytesToLong(getMidiBytes(midiFile, 4));
-            m_decrementCount = true;
-        }
-
-    }
-
-    if ( m_trackByteCount == -1 ) // we haven't found a track
-        return (false);
-    else
-        return (true);
+    return ((int)bytes[0] << 8) | (int)bytes[1];
 }
 
-
-// Read in a MIDI file.  The parsing process throws string
-// exceptions back up here if we run into trouble which we
-// can then pass back out to whoever called us using a nice
-// bool.
-//
+// One track chunk of the file, and the events parsed from it.  A chunk
+// whose events are on several channels is split into several tracks,
+// which are numbered from zero here and only given their final numbers
+// once all the chunks have been parsed.
 //
-bool
-MidiFile::open()
+struct TrackChunk
 {
-    bool retOK = true;
-    m_error = "";
-
-#ifdef MIDI_DEBUG
-
-    std::cerr << "MidiFile::open() : fileName = " << m_fileName << endl;
-#endif
-
-    clearMidiComposition();
-    // Open the file
-    ifstream *midiFile = new ifstream(m_fileName.toLocal8Bit(), ios::in | ios::binary);
-
-    try {
-        if (*midiFile) {
-
-            // Set file size so we can count it off
-            //
-            midiFile->seekg(0, std::ios::end);
-            m_fileSize = midiFile->tellg();
-            midiFile->seekg(0, std::ios::beg);
-
-            // Parse the MIDI header first.  The first 14 bytes of the file.
-            if (!parseHeader(getMidiBytes(midiFile, 14))) {
-                m_format = MIDI_FILE_NOT_LOADED;
-                m_error = "Not a MIDI file.";
-                return (false);
-            }
-
-            m_containsTimeChanges = false;
-
-            TrackId i = 0;
-
-            for (unsigned int j = 0; j < m_numberOfTracks; ++j) {
-
-//#ifdef MIDI_DEBUG
-                std::cerr << "Parsing Track " << j << endl;
-//#endif
-
-                if (!skipToNextTrack(midiFile)) {
-#ifdef MIDI_DEBUG
-                    cerr << "Couldn't find Track " << j << endl;
-#endif
-
-                    m_error = "File corrupted or in non-standard format?";
-                    m_format = MIDI_FILE_NOT_LOADED;
-                    return (false);
-                }
-
-#ifdef MIDI_DEBUG
-                std::cerr << "Track has " << m_trackByteCount << " bytes" << std::endl;
-#endif
-
-                // Run through the events taking them into our internal
-                // representation.
-                if (!parseTrack(midiFile, i)) {
-//#ifdef MIDI_DEBUG
-                    std::cerr << "Track " << j << " parsing failed" << endl;
-//#endif
-
-                    m_error = "File corrupted or in non-standard format?";
-                    m_format = MIDI_FILE_NOT_LOADED;
-                    return (false);
-                }
-
-                ++i; // j is the source track number, i the destination
-            }
-
-            m_numberOfTracks = i;
-        } else {
-            m_error = "File not found or not readable.";
-            m_format = MIDI_FILE_NOT_LOADED;
-            return (false);
-        }
-
-        // Close the file now
-        midiFile->close();
-    } catch (Exception e) {
-#ifdef MIDI_DEBUG
-        std::cerr << "MidiFile::open() - caught exception - "
-        << e.getMessage() << endl;
-#endif
-
-        m_error = e.getMessage();
-        retOK = false;
-    }
-
-    return (retOK);
-}
-
-// Parse and ensure the MIDI Header is legitimate
-//
+    TrackChunk() :
+        data(0), size(0), trackCount(1), containsTimeChanges(false) { }
+
+    const MidiByte *data;
+    unsigned long size;
+
+    MidiComposition tracks;
+    std::map<int, int> trackChannels;
+    unsigned int trackCount;
+    bool containsTimeChanges;
+    std::string error;
+};
+
+// Extract the events of a track chunk into the chunk's tracks.  This
+// touches nothing but the chunk, so chunks may be parsed on several
+// threads at once.  Throws an Exception if the track is corrupt.
 //
-bool
-MidiFile::parseHeader(const string &midiHeader)
+void
+parseTrack(TrackChunk &chunk)
 {
-    if (midiHeader.size() < 14) {
-#ifdef MIDI_DEBUG
-        std::cerr << "MidiFile::parseHeader() - file header undersized" << endl;
-#endif
-
-        return (false);
-    }
-
-    if (midiHeader.compare(0, 4, MIDI_FILE_HEADER) != 0) {
-#ifdef MIDI_DEBUG
-        std::cerr << "MidiFile::parseHeader()"
-        << "- file header not found or malformed"
-        << endl;
-#endif
-        return (false);
-    }
-
-    if (midiBytesToLong(midiHeader.substr(4, 4)) != 6L) {
-#ifdef MIDI_DEBUG
-        std::cerr << "MidiFile::parseHeader()"
-        << " - header length incorrect"
-        << endl;
-#endif
-
-        return (false);
-    }
-
-    m_format = (FileFormatType)midiBytesToInt(midiHeader.substr(8, 2));
-    m_numberOfTracks = midiBytesToInt(midiHeader.substr(10, 2));
-    m_timingDivision = midiBytesToInt(midiHeader.substr(12, 2));
-    m_timingFormat = MIDI_TIMING_PPQ_TIMEBASE;
-
-    if (m_format == MIDI_SEQUENTIAL_TRACK_FILE) {
-#ifdef MIDI_DEBUG
-        std::cerr << "MidiFile::parseHeader()"
-                  << "- can't load sequential track file"
-                  << endl;
-#endif
-        return (false);
-    }
-
-    if (m_timingDivision > 32767) {
-#ifdef MIDI_DEBUG
-        std::cerr << "MidiFile::parseHeader() - file uses SMPTE timing" << endl;
-#endif
-        m_timingFormat = MIDI_TIMING_SMPTE;
-        m_fps = 256 - (m_timingDivision >> 8);
-        m_subframes = (m_timingDivision & 0xff);
-    }
-
-    return true;
-}
-
+    MidiByteReader reader(chunk.data, chunk.size);
 
-// Extract the contents from a MIDI file track and places it into
-// our local map of MIDI events.
-//
-bool
-MidiFile::parseTrack(ifstream* midiFile, TrackId &lastTrackNum)
-{
     MidiByte midiByte, metaEventCode, data1, data2;
     MidiByte eventCode = 0x80;
-    std::string metaMessage;
     unsigned int messageLength;
     unsigned long deltaTime;
     unsigned long accumulatedTime = 0;
 
-    // The trackNum passed in to this method is the default track for
-    // all events provided they're all on the same channel.  If we find
-    // events on more than one channel, we increment trackNum and record
-    // the mapping from channel to trackNum in this channelTrackMap.
-    // We then return the new trackNum by reference so the calling
-    // method knows we've got more tracks than expected.
+    // The chunk's events go on track 0 provided they're all on the
+    // same channel.  If we find events on more than one channel, we
+    // start a new track for each further channel and record the
+    // mapping from channel to track in this channelTrackMap.
 
     // This would be a vector<TrackId> but TrackId is unsigned
     // and we need -1 to indicate "not yet used"
@@ -502,37 +217,24 @@ MidiFile::parseTrack(ifstream* midiFile, TrackId &lastTrackNum)
 
     // Meta-events don't have a channel, so we place them in a fixed
     // track number instead
-    TrackId metaTrack = lastTrackNum;
+    const TrackId metaTrack = 0;
+    TrackId lastTrackNum = 0;
 
     // Remember the last non-meta status byte (-1 if we haven't seen one)
     int runningStatus = -1;
 
     bool firstTrack = true;
 
-    std::cerr << "Parse track: last track number is " << lastTrackNum << std::endl;
-
     // Since no event and its associated delta time can fit in just one
     // byte, a single remaining byte in the track has to be padding.
     // This obscure and non-standard, but such files do exist; ordinarily
     // there should be no bytes in the track after the last event.
-    while (!midiFile->eof() && ( m_trackByteCount > 1 ) ) {
-        if (eventCode < 0x80) {
-#ifdef MIDI_DEBUG
-            cerr << "WARNING: Invalid event code " << eventCode
-            << " in MIDI file" << endl;
-#endif
+    while (reader.remaining() > 1) {
 
-            throw (Exception(qstrtostr(QObject::tr("Invalid event code found"))));
-        }
-
-        deltaTime = getNumberFromMidiBytes(midiFile);
-
-#ifdef MIDI_DEBUG
-        cerr << "read delta time " << deltaTime << endl;
-#endif
+        deltaTime = reader.getNumber();
 
         // Get a single byte
-        midiByte = getMidiByte(midiFile);
+        midiByte = reader.getByte();
 
         if (!(midiByte & MIDI_STATUS_BYTE_MASK)) {
             if (runningStatus < 0) {
@@ -542,36 +244,22 @@ MidiFile::parseTrack(ifstream* midiFile, TrackId &lastTrackNum)
             eventCode = (MidiByte)runningStatus;
             data1 = midiByte;
 
-#ifdef MIDI_DEBUG
-            std::cerr << "using running status (byte " << int(midiByte) << " found)" << std::endl;
-#endif
-
         } else {
-#ifdef MIDI_DEBUG
-            std::cerr << "have new event code " << int(midiByte) << std::endl;
-#endif
-
             eventCode = midiByte;
-            data1 = getMidiByte(midiFile);
+            data1 = reader.getByte();
         }
 
         if (eventCode == MIDI_FILE_META_EVENT) // meta events
         {
-            //            metaEventCode = getMidiByte(midiFile);
             metaEventCode = data1;
-            messageLength = getNumberFromMidiBytes(midiFile);
-
-#ifdef MIDI_DEBUG
-
-            std::cerr << "Meta event of type " << int(metaEventCode) << " and " << messageLength << " bytes found" << std::endl;
-#endif
+            messageLength = reader.getNumber();
 
-            metaMessage = getMidiBytes(midiFile, messageLength);
+            const MidiByte *message = reader.getBytes(messageLength);
 
             if (metaEventCode == MIDI_TIME_SIGNATURE ||
                     metaEventCode == MIDI_SET_TEMPO)
             {
-                m_containsTimeChanges = true;
+                chunk.containsTimeChanges = true;
             }
 
             long gap = accumulatedTime - trackTimeMap[metaTrack];
@@ -582,9 +270,10 @@ MidiFile::parseTrack(ifstream* midiFile, TrackId &lastTrackNum)
             MidiEvent *e = new MidiEvent(deltaTime,
                                          MIDI_FILE_META_EVENT,
                                          metaEventCode,
-                                         metaMessage);
+                                         string((const char *)message,
+                                                messageLength));
 
-            m_midiComposition[metaTrack].push_back(e);
+            chunk.tracks[metaTrack].push_back(e);
 
         } else // the rest
         {
@@ -596,26 +285,15 @@ MidiFile::parseTrack(ifstream* midiFile, TrackId &lastTrackNum)
             if (channelTrackMap[channel] == -1) {
                 if (!firstTrack) {
                     ++lastTrackNum;
-		} else {
+                } else {
                     firstTrack = false;
-		}
-		std::cerr << "MidiFile: new channel map entry: channel " << channel << " -> track " << lastTrackNum << std::endl;
+                }
                 channelTrackMap[channel] = lastTrackNum;
-		m_trackChannelMap[lastTrackNum] = channel;
+                chunk.trackChannels[lastTrackNum] = channel;
             }
 
             TrackId trackNum = channelTrackMap[channel];
 
-	    {
-		static int prevTrackNum = -1, prevChannel = -1;
-		if (prevTrackNum != (int) trackNum ||
-		    prevChannel != (int) channel) {
-		    std::cerr << "MidiFile: track number for channel " << channel << " is " << trackNum << std::endl;
-		    prevTrackNum = trackNum;
-		    prevChannel = channel;
-		}
-	    }
-
             // accumulatedTime is abs time of last event on any track;
             // trackTimeMap[trackNum] is that of last event on this track
 
@@ -629,49 +307,29 @@ MidiFile::parseTrack(ifstream* midiFile, TrackId &lastTrackNum)
             case MIDI_NOTE_OFF:
             case MIDI_POLY_AFTERTOUCH:
             case MIDI_CTRL_CHANGE:
-                data2 = getMidiByte(midiFile);
-
-                // create and store our event
-                midiEvent = new MidiEvent(deltaTime, eventCode, data1, data2);
-
-#ifdef MIDI_DEBUG
-                std::cerr << "MIDI event for channel " << channel + 1 << " (track "
-                << trackNum << ")" << std::endl;
-                midiEvent->print();
-#endif
-
-
-                m_midiComposition[trackNum].push_back(midiEvent);
-                break;
-
             case MIDI_PITCH_BEND:
-                data2 = getMidiByte(midiFile);
+                data2 = reader.getByte();
 
                 // create and store our event
                 midiEvent = new MidiEvent(deltaTime, eventCode, data1, data2);
-                m_midiComposition[trackNum].push_back(midiEvent);
+                chunk.tracks[trackNum].push_back(midiEvent);
                 break;
 
             case MIDI_PROG_CHANGE:
             case MIDI_CHNL_AFTERTOUCH:
                 // create and store our event
-		std::cerr << "Program change or channel aftertouch: time " << deltaTime << ", code " << (int)eventCode << ", data " << (int) data1  << " going to track " << trackNum << std::endl;
                 midiEvent = new MidiEvent(deltaTime, eventCode, data1);
-                m_midiComposition[trackNum].push_back(midiEvent);
+                chunk.tracks[trackNum].push_back(midiEvent);
                 break;
 
             case MIDI_SYSTEM_EXCLUSIVE:
-                messageLength = getNumberFromMidiBytes(midiFile, data1);
-
-#ifdef MIDI_DEBUG
-
-                std::cerr << "SysEx of " << messageLength << " bytes found" << std::endl;
-#endif
+            {
+                messageLength = reader.getNumber(data1);
 
-                metaMessage = getMidiBytes(midiFile, messageLength);
+                const MidiByte *message = reader.getBytes(messageLength);
 
-                if (MidiByte(metaMessage[metaMessage.length() - 1]) !=
-                        MIDI_END_OF_EXCLUSIVE) {
+                if (messageLength == 0 ||
+                    message[messageLength - 1] != MIDI_END_OF_EXCLUSIVE) {
 #ifdef MIDI_DEBUG
                     std::cerr << "MidiFile::parseTrack() - "
                     << "malformed or unsupported SysEx type"
@@ -684,13 +342,13 @@ MidiFile::parseTrack(ifstream* midiFile, TrackId &lastTrackNum)
                 // chop off the EOX
                 // length fixed by Pedro Lopez-Cabanillas (20030523)
                 //
-                metaMessage = metaMessage.substr(0, metaMessage.length() - 1);
-
                 midiEvent = new MidiEvent(deltaTime,
                                           MIDI_SYSTEM_EXCLUSIVE,
-                                          metaMessage);
-                m_midiComposition[trackNum].push_back(midiEvent);
+                                          string((const char *)message,
+                                                 messageLength - 1));
+                chunk.tracks[trackNum].push_back(midiEvent);
                 break;
+            }
 
             case MIDI_END_OF_EXCLUSIVE:
 #ifdef MIDI_DEBUG
@@ -714,16 +372,295 @@ MidiFile::parseTrack(ifstream* midiFile, TrackId &lastTrackNum)
         }
     }
 
-    // If the track has a padding byte, read and discard it to make sure that
-    // the stream is positioned at the beginning of the following
-    // track (if there is one.)
-    if (m_trackByteCount == 1) {
-        midiFile->ignore();
+    chunk.trackCount = lastTrackNum + 1;
+}
+
+// Parses track chunks on a thread pool, counting them off as they are
+// done so that the main thread can report progress while it waits
+//
+class TrackParser
+{
+public:
+    TrackParser(std::vector<TrackChunk> &chunks) :
+        m_chunks(chunks), m_done(0) { }
+
+    void start() {
+        for (size_t i = 0; i < m_chunks.size(); ++i) {
+            m_pool.start(new Task(this, i));
+        }
+    }
+
+    // Wait for up to the given time for more chunks to be parsed, and
+    // return the number parsed so far
+    size_t wait(unsigned long msecs) {
+        QMutexLocker locker(&m_mutex);
+        if (m_done < m_chunks.size()) m_condition.wait(&m_mutex, msecs);
+        return m_done;
+    }
+
+private:
+    class Task : public QRunnable
+    {
+    public:
+        Task(TrackParser *parser, size_t chunk) :
+            m_parser(parser), m_chunk(chunk) { }
+
+        virtual void run() { m_parser->parse(m_chunk); }
+
+    private:
+        TrackParser *m_parser;
+        size_t m_chunk;
+    };
+
+    void parse(size_t index) {
+        TrackChunk &chunk = m_chunks[index];
+        try {
+            parseTrack(chunk);
+        } catch (Exception e) {
+            chunk.error = e.getMessage();
+        }
+        QMutexLocker locker(&m_mutex);
+        ++m_done;
+        m_condition.wakeAll();
+    }
+
+    std::vector<TrackChunk> &m_chunks;
+    size_t m_done;
+
+    // Declared last, so that the pool is waited for before the rest
+    // is destroyed
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    QThreadPool m_pool;
+};
+
+// Find the next track chunk at or after offset pos in the file's data,
+// and set the chunk's data and size to its contents.  Other chunks
+// are skipped four bytes at a time.
+//
+bool
+findNextTrack(const MidiByte *data, unsigned long size, unsigned long &pos,
+              TrackChunk &chunk)
+{
+    while (pos + 8 <= size) {
+        const MidiByte *header = data + pos;
+        pos += 4;
+        if (MIDI_TRACK_HEADER.compare(0, 4, (const char *)header, 4) == 0) {
+            unsigned long length = (unsigned long)midiBytesToLong(header + 4);
+            pos += 4;
+            if (length > size - pos) {
+                throw(Exception(qstrtostr(QObject::tr("Attempt to read past MIDI file end"))));
+            }
+            chunk.data = data + pos;
+            chunk.size = length;
+            pos += length;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+
+// Read in a MIDI file.  The file is mapped (or failing that, read)
+// into memory, its track chunks found, and then parsed in parallel as
+// they are independent of one another.  The parsing process throws
+// exceptions back up here if we run into trouble which we can then
+// pass back out to whoever called us using a nice bool.
+//
+//
+bool
+MidiFile::open()
+{
+    m_error = "";
+
+#ifdef MIDI_DEBUG
+
+    std::cerr << "MidiFile::open() : fileName = " << m_fileName << endl;
+#endif
+
+    clearMidiComposition();
+
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_error = "File not found or not readable.";
+        m_format = MIDI_FILE_NOT_LOADED;
+        return (false);
+    }
+
+    m_fileSize = file.size();
+
+    QByteArray contents;
+    const MidiByte *data = 0;
+    if (m_fileSize > 0) data = file.map(0, m_fileSize);
+    if (!data) {
+        contents = file.readAll();
+        data = (const MidiByte *)contents.constData();
+    }
+
+    try {
+
+        // Parse the MIDI header first.  The first 14 bytes of the file.
+        if (!parseHeader(data, m_fileSize)) {
+            m_format = MIDI_FILE_NOT_LOADED;
+            m_error = "Not a MIDI file.";
+            return (false);
+        }
+
+        std::vector<TrackChunk> chunks(m_numberOfTracks);
+        unsigned long pos = 14;
+
+        for (unsigned int j = 0; j < m_numberOfTracks; ++j) {
+            if (!findNextTrack(data, m_fileSize, pos, chunks[j])) {
+#ifdef MIDI_DEBUG
+                cerr << "Couldn't find Track " << j << endl;
+#endif
+
+                m_error = "File corrupted or in non-standard format?";
+                m_format = MIDI_FILE_NOT_LOADED;
+                return (false);
+            }
+        }
+
+        // Run through the events taking them into our internal
+        // representation, and keeping the user interface alive
+        if (chunks.size() > 1 && QThread::idealThreadCount() > 1) {
+            TrackParser parser(chunks);
+            parser.start();
+            size_t done = 0;
+            while (done < chunks.size()) {
+                done = parser.wait(100);
+                emit setValue(int(double(done) / chunks.size() * 20.0));
+                qApp->processEvents(QEventLoop::AllEvents);
+            }
+        } else {
+            for (size_t j = 0; j < chunks.size(); ++j) {
+                try {
+                    parseTrack(chunks[j]);
+                } catch (Exception e) {
+                    chunks[j].error = e.getMessage();
+                }
+                emit setValue(int(double(j + 1) / chunks.size() * 20.0));
+                qApp->processEvents(QEventLoop::AllEvents);
+            }
+        }
+
+        // Number the tracks in order through the file.  j is the
+        // source track number, i the destination.
+        m_containsTimeChanges = false;
+        TrackId i = 0;
+        std::string error;
+
+        for (size_t j = 0; j < chunks.size(); ++j) {
+
+            TrackChunk &chunk = chunks[j];
+
+            if (error == "" && chunk.error != "") {
+//#ifdef MIDI_DEBUG
+                std::cerr << "Track " << j << " parsing failed: "
+                          << chunk.error << endl;
+//#endif
+                error = chunk.error;
+            }
+
+#ifdef MIDI_DEBUG
+            std::cerr << "Track " << j << " has " << chunk.size
+                      << " bytes, giving " << chunk.trackCount
+                      << " tracks from " << i << endl;
+#endif
+
+            // Take the events even from a failed chunk, so that they
+            // are deleted with the rest
+            for (MidiComposition::iterator k = chunk.tracks.begin();
+                 k != chunk.tracks.end(); ++k) {
+                m_midiComposition[i + k->first].swap(k->second);
+            }
+            for (std::map<int, int>::iterator k = chunk.trackChannels.begin();
+                 k != chunk.trackChannels.end(); ++k) {
+                m_trackChannelMap[i + k->first] = k->second;
+            }
+            if (chunk.containsTimeChanges) m_containsTimeChanges = true;
+
+            i += chunk.trackCount;
+        }
+
+        if (error != "") throw(Exception(error));
+
+        m_numberOfTracks = i;
+
+    } catch (Exception e) {
+#ifdef MIDI_DEBUG
+        std::cerr << "MidiFile::open() - caught exception - "
+        << e.getMessage() << endl;
+#endif
+
+        m_error = e.getMessage();
+        return (false);
     }
 
     return (true);
 }
 
+// Parse and ensure the MIDI Header is legitimate
+//
+//
+bool
+MidiFile::parseHeader(const MidiByte *midiHeader, unsigned long size)
+{
+    if (size < 14) {
+#ifdef MIDI_DEBUG
+        std::cerr << "MidiFile::parseHeader() - file header undersized" << endl;
+#endif
+
+        return (false);
+    }
+
+    if (MIDI_FILE_HEADER.compare(0, 4, (const char *)midiHeader, 4) != 0) {
+#ifdef MIDI_DEBUG
+        std::cerr << "MidiFile::parseHeader()"
+        << "- file header not found or malformed"
+        << endl;
+#endif
+        return (false);
+    }
+
+    if (midiBytesToLong(midiHeader + 4) != 6L) {
+#ifdef MIDI_DEBUG
+        std::cerr << "MidiFile::parseHeader()"
+        << " - header length incorrect"
+        << endl;
+#endif
+
+        return (false);
+    }
+
+    m_format = (FileFormatType)midiBytesToInt(midiHeader + 8);
+    m_numberOfTracks = midiBytesToInt(midiHeader + 10);
+    m_timingDivision = midiBytesToInt(midiHeader + 12);
+    m_timingFormat = MIDI_TIMING_PPQ_TIMEBASE;
+
+    if (m_format == MIDI_SEQUENTIAL_TRACK_FILE) {
+#ifdef MIDI_DEBUG
+        std::cerr << "MidiFile::parseHeader()"
+                  << "- can't load sequential track file"
+                  << endl;
+#endif
+        return (false);
+    }
+
+    if (m_timingDivision > 32767) {
+#ifdef MIDI_DEBUG
+        std::cerr << "MidiFile::parseHeader() - file uses SMPTE timing" << endl;
+#endif
+        m_timingFormat = MIDI_TIMING_SMPTE;
+        m_fps = 256 - (m_timingDivision >> 8);
+        m_subframes = (m_timingDivision & 0xff);
+    }
+
+    return true;
+}
+
 // borrowed from ALSA pcm_timer.c
 //
 static unsigned long gcd(unsigned long a, unsigned long b)
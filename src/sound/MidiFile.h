@@ -125,11 +125,6 @@ private:
     unsigned int           m_numberOfTracks;
     bool                   m_containsTimeChanges;
 
-    // Internal counters
-    //
-    long                  m_trackByteCount;
-    bool                  m_decrementCount;
-
     // Internal MidiComposition
     //
     MidiComposition       m_midiComposition;
@@ -141,8 +136,7 @@ private:
 
     // Split the tasks up with these top level private methods
     //
-    bool parseHeader(const std::string& midiHeader);
-    bool parseTrack(std::ifstream* midiFile, unsigned int &trackNum);
+    bool parseHeader(const MidiByte *midiHeader, unsigned long size);
     bool writeHeader(std::ofstream* midiFile);
     bool writeTrack(std::ofstream* midiFile, unsigned int trackNum);
 
@@ -150,13 +144,6 @@ private:
 
     // Internal convenience functions
     //
-    int midiBytesToInt(const std::string& bytes);
-    long midiBytesToLong(const std::string& bytes);
-    long getNumberFromMidiBytes(std::ifstream* midiFile, int firstByte = -1);
-    MidiByte getMidiByte(std::ifstream* midiFile);
-    std::string getMidiBytes(std::ifstream* midiFile,
-                                   unsigned long bytes);
-    bool skipToNextTrack(std::ifstream *midiFile);
     void intToMidiBytes(std::ofstream* midiFile, int number);
     void longToMidiBytes(std::ofstream* midiFile, unsigned long number);
     std::string longToVarBuffer(unsigned long number);
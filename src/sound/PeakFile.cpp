@@ -14,14 +14,19 @@
 
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
 
 #include <QDateTime>
+#include <QFile>
 #include <QStringList>
 #include <QPalette>
 #include <QApplication>
+#include <QThread>
 
 #include "PeakFile.h"
 #include "AudioFile.h"
+#include "AudioKernels.h"
 #include "base/Profiler.h"
 #include <misc/Strings.h>
 
@@ -56,11 +61,19 @@ PeakFile::PeakFile(AudioFile *audioFile):
         m_lastPreviewStartTime(0, 0),
         m_lastPreviewEndTime(0, 0),
         m_lastPreviewWidth( -1),
-        m_lastPreviewShowMinima(false)
+        m_lastPreviewShowMinima(false),
+        m_keepProcessing(0),
+        m_progress(0),
+        m_complete(0),
+        m_mapFile(0),
+        m_peakData(0),
+        m_peakDataSize(0)
 {}
 
 PeakFile::~PeakFile()
-{}
+{
+    unmapPeaks();
+}
 
 bool
 PeakFile::open()
@@ -190,11 +203,17 @@ PeakFile::write()
 bool
 PeakFile::write(unsigned short updatePercentage)
 {
+    m_complete = 0;
+
     if (m_outFile) {
         m_outFile->close();
         delete m_outFile;
     }
 
+    // We're about to truncate the file, so let go of the old peaks
+    //
+    unmapPeaks();
+
     // Attempt to open AudioFile so that we can extract sample data
     // for preview file generation
     //
@@ -229,6 +248,8 @@ PeakFile::write(unsigned short updatePercentage)
 void
 PeakFile::close()
 {
+    unmapPeaks();
+
     // Close any input file handle
     //
     if (m_inFile && m_inFile->is_open()) {
@@ -462,13 +483,58 @@ PeakFile::scanForward(int numberOfPeaks)
 }
 
 
+// Decode a block of interleaved sample frames into a run of values
+// for each channel, at the scale of the peak data: 8-bit samples as
+// they are (less the offset), and anything wider as 16-bit, truncated
+// toward zero.  Returns false for an unsupported sample size.
+//
+static bool
+decodePeakBlock(const unsigned char *p, int bytes, int channels,
+                int frames, float *values)
+{
+    for (int ch = 0; ch < channels; ++ch) {
+        if (!AudioKernels::decode(p, bytes * 8, channels, ch,
+                                  values + ch * frames, frames)) {
+            return false;
+        }
+    }
+
+    size_t n = size_t(frames) * channels;
+
+    switch (bytes) {
+
+    case 1:
+        AudioKernels::gain(values, 128.0f, n);
+        break;
+
+    case 2:
+        AudioKernels::gain(values, 32768.0f, n);
+        break;
+
+    case 3:
+        // as the 24-bit sample divided by 256, in integers
+        AudioKernels::gain(values, 32768.0f, n);
+        for (size_t i = 0; i < n; ++i) values[i] = float(int(values[i]));
+        break;
+
+    case 4: // IEEE float (enforced by RIFFAudioFile)
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = float(int(32767.0 * values[i]));
+        }
+        break;
+    }
+
+    return true;
+}
+
 void
 PeakFile::writePeaks(unsigned short /*updatePercentage*/,
                      std::ofstream *file)
 {
     if (!file || !(*file))
         return ;
-    m_keepProcessing = true;
+    m_keepProcessing = 1;
+    m_progress = 0;
 
 #ifdef DEBUG_PEAKFILE
 
@@ -478,16 +544,6 @@ PeakFile::writePeaks(unsigned short /*updatePercentage*/,
     // Scan to beginning of audio data
     m_audioFile->scanTo(RealTime(0, 0));
 
-    // Store our samples
-    //
-    std::vector<std::pair<int, int> > channelPeaks;
-    std::string samples;
-    unsigned char *samplePtr;
-
-    int sampleValue;
-    int sampleMax = 0 ;
-    int sampleFrameCount = 0;
-
     int channels = m_audioFile->getChannels();
     int bytes = m_audioFile->getBitsPerSample() / 8;
 
@@ -495,128 +551,120 @@ PeakFile::writePeaks(unsigned short /*updatePercentage*/,
     if (bytes == 3 || bytes == 4) // 24-bit PCM or 32-bit float
         m_format = 2; // write 16-bit PCM instead
 
-    // for the progress dialog
-    size_t apprxTotalBytes = m_audioFile->getSize();
-    size_t byteCount = 0;
-
-    for (int i = 0; i < channels; i++)
-        channelPeaks.push_back(std::pair<int, int>());
-
     // clear down info
     m_numberOfPeaks = 0;
     m_bodyBytes = 0;
     m_positionPeakOfPeaks = 0;
 
+    size_t blockBytes = m_blockSize * channels * bytes;
+    if (blockBytes == 0)
+        return ;
+
+    // Read many blocks at a time, decode each into a float run per
+    // channel, and find the extremes of each run with AudioKernels.
+    // Only whole blocks are used, as the last part-block never was.
+    //
+    const int blocksPerRead = 64;
+    std::vector<char> samples(blockBytes * blocksPerRead);
+    std::vector<float> values(m_blockSize * channels);
+    std::vector<float> hi(channels), lo(channels);
+    std::string peaks;
+
+    float sampleMax = 0;
+    int sampleFrameCount = 0;
+
+    // only reported to the GUI directly if we're running in its thread
+    bool onGuiThread = (qApp && QThread::currentThread() == qApp->thread());
+    size_t apprxTotalBytes = m_audioFile->getSize();
+    size_t byteCount = 0;
     int ct = 0;
 
     while (m_keepProcessing) {
+        size_t count = 0;
         try {
-            samples = m_audioFile->
-                      getBytes(m_blockSize * channels * bytes);
+            count = m_audioFile->getBytes(&samples[0], samples.size());
         } catch (BadSoundFileException e) {
             std::cerr << "PeakFile::writePeaks: " << e.getMessage()
             << std::endl;
             break;
         }
 
-        // If no bytes or less than the total number of bytes are returned
-        // then break out
-        //
-        if (samples.length() == 0 ||
-            samples.length() < (m_blockSize * m_audioFile->getChannels()
-                                * bytes))
-            break;
+        size_t blocks = count / blockBytes;
+        peaks.clear();
 
-        byteCount += samples.length();
+        for (size_t b = 0; b < blocks; ++b) {
 
-        if (ct % 100 == 0) {
-            emit setValue((int)(double(byteCount) /
-                                double(apprxTotalBytes) * 100.0));
-//        std::cout << "peak file is emitting to file manager is emitting to progress dialog..." << std::endl;
-        
-            qApp->processEvents(QEventLoop::AllEvents);
-        }
-        ++ct;
+            const unsigned char *samplePtr =
+                (const unsigned char *)&samples[b * blockBytes];
 
-        samplePtr = (unsigned char *)samples.c_str();
-
-        for (int i = 0; i < m_blockSize; i++) {
-            for (unsigned int ch = 0; ch < m_audioFile->getChannels(); ch++) {
-                // Single byte format values range from 0-255 and then
-                // shifted down about the x-axis.  Double byte and above
-                // are already centred about x-axis.
-                //
-                if (bytes == 1) {
-                    // get value
-                    sampleValue = int(*samplePtr) - 128;
-                    samplePtr++;
-                } else if (bytes == 2) {
-                    unsigned char b2 = samplePtr[0];
-                    unsigned char b1 = samplePtr[1];
-                    unsigned int bits = (b1 << 8) + b2;
-                    sampleValue = (short)bits;
-                    samplePtr += 2;
-                } else if (bytes == 3) {
-                    unsigned char b3 = samplePtr[0];
-                    unsigned char b2 = samplePtr[1];
-                    unsigned char b1 = samplePtr[2];
-                    unsigned int bits = (b1 << 24) + (b2 << 16) + (b3 << 8);
-
-                    // write out as 16-bit (m_format == 2)
-                    sampleValue = int(bits) / 65536;
-
-                    samplePtr += 3;
-                } else if (bytes == 4)  // IEEE float (enforced by RIFFAudioFile)
-                {
-                    // write out as 16-bit (m_format == 2)
-                    float val = *(float *)samplePtr;
-                    sampleValue = (int)(32767.0 * val);
-                    samplePtr += 4;
-                } else {
-                    throw(BadSoundFileException(m_fileName, "PeakFile::writePeaks - unsupported bit depth"));
-                }
+            if (!decodePeakBlock(samplePtr, bytes, channels, m_blockSize,
+                                 &values[0])) {
+                throw(BadSoundFileException(m_fileName, "PeakFile::writePeaks - unsupported bit depth"));
+            }
 
-                // First time for each channel
-                //
-                if (i == 0) {
-                    channelPeaks[ch].first = sampleValue;
-                    channelPeaks[ch].second = sampleValue;
-                } else {
-                    // Compare and store
-                    //
-                    if (sampleValue > channelPeaks[ch].first)
-                        channelPeaks[ch].first = sampleValue;
-
-                    if (sampleValue < channelPeaks[ch].second)
-                        channelPeaks[ch].second = sampleValue;
-                }
+            float blockMax = 0;
 
-                // Store peak of peaks if it fits
-                //
-                if (abs(sampleValue) > sampleMax) {
-                    sampleMax = abs(sampleValue);
-                    m_positionPeakOfPeaks = sampleFrameCount;
+            for (int ch = 0; ch < channels; ++ch) {
+                const float *v = &values[ch * m_blockSize];
+                hi[ch] = lo[ch] = v[0];
+                AudioKernels::range(v + 1, hi[ch], lo[ch], m_blockSize - 1);
+                blockMax = std::max(blockMax, std::max(hi[ch], -lo[ch]));
+            }
+
+            // The peak of peaks is the first frame reaching the
+            // greatest absolute value, which only needs looking for
+            // in a block that beats the greatest so far
+            //
+            if (blockMax > sampleMax) {
+                sampleMax = blockMax;
+                bool found = false;
+                for (int i = 0; i < m_blockSize && !found; ++i) {
+                    for (int ch = 0; ch < channels; ++ch) {
+                        if (fabsf(values[ch * m_blockSize + i]) == blockMax) {
+                            m_positionPeakOfPeaks = sampleFrameCount + i;
+                            found = true;
+                            break;
+                        }
+                    }
                 }
             }
 
-            // for peak of peaks as well as frame count
-            sampleFrameCount++;
+            sampleFrameCount += m_blockSize;
+
+            // Absolute peak data in channel order
+            //
+            for (int ch = 0; ch < channels; ++ch) {
+                peaks += getLittleEndianFromInteger(int(hi[ch]), m_format);
+                peaks += getLittleEndianFromInteger(int(lo[ch]), m_format);
+                m_bodyBytes += m_format * 2;
+            }
+
+            // increment number of peak frames
+            m_numberOfPeaks++;
         }
 
-        // Write absolute peak data in channel order
-        //
-        for (unsigned int i = 0; i < m_audioFile->getChannels(); i++) {
-            putBytes(file, getLittleEndianFromInteger(channelPeaks[i].first,
-                     m_format));
-            putBytes(file, getLittleEndianFromInteger(channelPeaks[i].second,
-                     m_format));
-            m_bodyBytes += m_format * 2;
+        putBytes(file, peaks);
+
+        byteCount += count;
+        m_progress = (int)(double(byteCount) / double(apprxTotalBytes) * 100.0);
+
+        if (onGuiThread && ct % 2 == 0) {
+            emit setValue(m_progress);
+            qApp->processEvents(QEventLoop::AllEvents);
         }
+        ++ct;
 
-        // increment number of peak frames
-        m_numberOfPeaks++;
+        // If fewer than the bytes asked for were returned then we're
+        // at the end
+        //
+        if (count < samples.size()) {
+            m_complete = 1;
+            break;
+        }
     }
 
+    m_progress = 100;
+
 #ifdef DEBUG_PEAKFILE
     cout << "PeakFile::writePeaks - "
     << "completed peaks" << endl;
@@ -648,40 +696,6 @@ PeakFile::getPreview(const RealTime &startTime,
         return std::vector<float>();
     }
 
-    // Regenerate cache on these conditions
-    //
-    if (!m_peakCache.length()) {
-#ifdef DEBUG_PEAKFILE_CACHE
-        std::cerr << "PeakFile::getPreview - no peak cache" << std::endl;
-#endif
-
-        if (getSize() < (256 *1024)) // if less than 256K PeakFile
-        {
-            // Scan to start of peak data
-            scanToPeak(0);
-            try
-            {
-                m_peakCache = getBytes(m_inFile, getSize() - 128);
-            } catch (BadSoundFileException e)
-            {
-                std::cerr << "PeakFile::getPreview: " << e.getMessage()
-                << std::endl;
-            }
-
-#ifdef DEBUG_PEAKFILE_CACHE
-            std::cout << "PeakFile::getPreview - generated peak cache - "
-            << "size = " << m_peakCache.length() << std::endl;
-#endif
-
-        } else {
-#ifdef DEBUG_PEAKFILE_CACHE
-            std::cout << "PeakFile::getPreview - file size = " << getSize()
-            << ", not generating cache" << std::endl;
-#endif
-
-        }
-    }
-
     // Check to see if we hit the "lastPreview" cache by comparing the last
     // query parameters we used.
     //
@@ -700,10 +714,19 @@ PeakFile::getPreview(const RealTime &startTime,
 
     }
 
+    Profiler profiler("PeakFile::getPreview");
+
     // Clear the cache - we need to regenerate it
     //
     m_lastPreviewCache.clear();
 
+    if (!mapPeaks()) {
+#ifdef DEBUG_PEAKFILE
+        std::cout << "PeakFile::getPreview - no peak data" << std::endl;
+#endif
+        return m_lastPreviewCache;
+    }
+
     int startPeak = getPeak(startTime);
     int endPeak = getPeak(endTime);
 
@@ -714,8 +737,6 @@ PeakFile::getPreview(const RealTime &startTime,
     // Actual possible sample length in RealTime
     //
     double step = double(endPeak - startPeak) / double(width);
-    std::string peakData;
-    int peakNumber;
 
 #ifdef DEBUG_PEAKFILE_BRIEF
 
@@ -746,132 +767,44 @@ PeakFile::getPreview(const RealTime &startTime,
         return m_lastPreviewCache;
     }
 
-    float *hiValues = new float[m_channels];
-    float *loValues = new float[m_channels];
+    // Only worth building the pyramid once we're zoomed out far
+    // enough to use it
+    //
+    if (step >= PyramidFactor && m_pyramid.empty()) {
+        buildPyramid();
+    }
 
-    for (int i = 0; i < width; i++) {
+    int availablePeaks = getAvailablePeaks();
 
-        peakNumber = startPeak + int(double(i) * step);
-        int nextPeakNumber = startPeak + int(double(i + 1) * step);
+    int *hiValues = new int[m_channels];
+    int *loValues = new int[m_channels];
 
-        // Seek to value
-        //
-        if (!m_peakCache.length()) {
+    for (int i = 0; i < width; i++) {
 
-            if (scanToPeak(peakNumber) == false) {
-#ifdef DEBUG_PEAKFILE
-                std::cout << "PeakFile::getPreview: scanToPeak(" << peakNumber << ") failed" << std::endl;
-#endif
+        int peakNumber = startPeak + int(double(i) * step);
+        int nextPeakNumber = startPeak + int(double(i + 1) * step);
 
-                m_lastPreviewCache.push_back(0.0f);
-            }
-        }
 #ifdef DEBUG_PEAKFILE
-        std::cout << "PeakFile::getPreview: step is " << step << ", format * pointsPerValue * chans is " << (m_format * m_pointsPerValue * m_channels) << std::endl;
         std::cout << "i = " << i << ", peakNumber = " << peakNumber << ", nextPeakNumber = " << nextPeakNumber << std::endl;
 #endif
 
-        for (int ch = 0; ch < m_channels; ch++) {
-            hiValues[ch] = 0.0f;
-            loValues[ch] = 0.0f;
-        }
-
-        // Get peak value over channels
+        // We've run off the end of the peak data - return the
+        // results so far
         //
-        for (int k = 0; peakNumber < nextPeakNumber; ++k) {
-
-            for (int ch = 0; ch < m_channels; ch++) {
-
-                if (!m_peakCache.length()) {
-
-                    try {
-                        peakData = getBytes(m_inFile, m_format * m_pointsPerValue);
-                    } catch (BadSoundFileException e) {
-                        // Problem with the get - probably an EOF
-                        // return the results so far.
-                        //
-#ifdef DEBUG_PEAKFILE
-                        std::cout << "PeakFile::getPreview - \"" << e.getMessage() << "\"\n"
-                        << endl;
-#endif
-
-                        goto done;
-                    }
+        if (peakNumber >= availablePeaks) {
 #ifdef DEBUG_PEAKFILE
-                    std::cout << "PeakFile::getPreview - "
-                    << "read from file" << std::endl;
+            std::cout << "PeakFile::getPreview - "
+            << "ran out of peaks at " << peakNumber << endl;
 #endif
+            break;
+        }
 
-                } else {
-
-                    int valueNum = peakNumber * m_channels + ch;
-                    int charNum = valueNum * m_format * m_pointsPerValue;
-                    int charLength = m_format * m_pointsPerValue;
-
-                    // Get peak value from the cached string if
-                    // the value is valid.
-                    //
-                    if (charNum + charLength <= (int)m_peakCache.length()) {
-                        peakData = m_peakCache.substr(charNum, charLength);
-#ifdef DEBUG_PEAKFILE
-
-                        std::cout << "PeakFile::getPreview - "
-                        << "hit peakCache" << std::endl;
-#endif
-
-                    }
-                }
-
-
-                if (peakData.length() != (unsigned int)(m_format *
-                                                        m_pointsPerValue)) {
-                    // We didn't get the whole peak block - return what
-                    // we've got so far
-                    //
-#ifdef DEBUG_PEAKFILE
-                    std::cout << "PeakFile::getPreview - "
-                    << "failed to get complete peak block"
-                    << endl;
-#endif
-
-                    goto done;
-                }
-
-                int intDivisor = int(divisor);
-                int inValue =
-                    getIntegerFromLittleEndian(peakData.substr(0, m_format));
-
-                while (inValue > intDivisor) {
-                    inValue -= (1 << (m_format * 8));
-                }
-
-#ifdef DEBUG_PEAKFILE
-                std::cout << "found potential hivalue " << inValue << std::endl;
-#endif
-
-                if (k == 0 || inValue > hiValues[ch]) {
-                    hiValues[ch] = float(inValue);
-                }
-
-                if (m_pointsPerValue == 2) {
-
-                    inValue =
-                        getIntegerFromLittleEndian(
-                            peakData.substr(m_format, m_format));
-
-                    while (inValue > intDivisor) {
-                        inValue -= (1 << (m_format * 8));
-                    }
-
-                    if (k == 0 || inValue < loValues[ch]) {
-                        loValues[ch] = inValue;
-                    }
-                }
-            }
-
-            ++peakNumber;
+        if (nextPeakNumber > availablePeaks) {
+            nextPeakNumber = availablePeaks;
         }
 
+        getPeakRange(peakNumber, nextPeakNumber, hiValues, loValues);
+
         for (int ch = 0; ch < m_channels; ++ch) {
 
             float value = hiValues[ch] / divisor;
@@ -893,8 +826,6 @@ PeakFile::getPreview(const RealTime &startTime,
         }
     }
 
-done:
-    resetStream();
     delete[] hiValues;
     delete[] loValues;
 
@@ -913,6 +844,206 @@ done:
     return m_lastPreviewCache;
 }
 
+bool
+PeakFile::mapPeaks()
+{
+    if (m_peakData)
+        return true;
+
+    if (m_channels <= 0 || m_format <= 0 || m_pointsPerValue <= 0)
+        return false;
+
+    // The peaks follow the 128 byte header of the peak chunk
+    //
+    qint64 offset = qint64(m_chunkStartPosition) + 128;
+
+    m_mapFile = new QFile(m_fileName);
+
+    if (m_mapFile->open(QIODevice::ReadOnly)) {
+        qint64 size = m_mapFile->size() - offset;
+        if (size > 0) {
+            uchar *data = m_mapFile->map(offset, size);
+            if (data) {
+                m_peakData = data;
+                m_peakDataSize = size_t(size);
+#ifdef DEBUG_PEAKFILE_CACHE
+                std::cout << "PeakFile::mapPeaks - mapped "
+                << m_peakDataSize << " bytes" << std::endl;
+#endif
+                return true;
+            }
+        }
+    }
+
+    delete m_mapFile;
+    m_mapFile = 0;
+
+    // Can't map it, so read it all in instead
+    //
+    if (!m_inFile || !m_inFile->is_open() || getSize() <= size_t(offset))
+        return false;
+
+    scanToPeak(0);
+    try {
+        m_peakCache = getBytes(m_inFile, getSize() - size_t(offset));
+    } catch (BadSoundFileException e) {
+        std::cerr << "PeakFile::mapPeaks: " << e.getMessage()
+        << std::endl;
+    }
+    resetStream();
+
+    if (m_peakCache.empty())
+        return false;
+
+#ifdef DEBUG_PEAKFILE_CACHE
+    std::cout << "PeakFile::mapPeaks - can't map, read "
+    << m_peakCache.length() << " bytes" << std::endl;
+#endif
+
+    m_peakData = (const unsigned char *)m_peakCache.data();
+    m_peakDataSize = m_peakCache.length();
+    return true;
+}
+
+void
+PeakFile::unmapPeaks()
+{
+    m_pyramid.clear();
+
+    if (m_mapFile) {
+        if (m_peakData)
+            m_mapFile->unmap((uchar *)m_peakData);
+        m_mapFile->close();
+        delete m_mapFile;
+        m_mapFile = 0;
+    }
+
+    m_peakData = 0;
+    m_peakDataSize = 0;
+    m_peakCache = "";
+
+    // and any preview made from them
+    m_lastPreviewWidth = -1;
+}
+
+int
+PeakFile::getAvailablePeaks() const
+{
+    if (!m_peakData)
+        return 0;
+
+    return int(m_peakDataSize / (m_format * m_pointsPerValue * m_channels));
+}
+
+int
+PeakFile::decodePeak(const unsigned char *p) const
+{
+    if (m_format == 1)
+        return p[0];
+
+    // 16-bit values are signed
+    int value = p[0] + (p[1] << 8);
+    if (value > int(SAMPLE_MAX_16BIT))
+        value -= (1 << 16);
+    return value;
+}
+
+void
+PeakFile::getPeakValue(int level, int index, int channel,
+                       int &hi, int &lo) const
+{
+    if (level == 0) {
+        const unsigned char *p = m_peakData +
+            (size_t(index) * m_channels + channel) * m_format * m_pointsPerValue;
+        hi = decodePeak(p);
+        lo = (m_pointsPerValue == 2) ? decodePeak(p + m_format) : 0;
+    } else {
+        const std::vector<short> &values = m_pyramid[level - 1];
+        size_t i = (size_t(index) * m_channels + channel) * 2;
+        hi = values[i];
+        lo = values[i + 1];
+    }
+}
+
+void
+PeakFile::buildPyramid()
+{
+    Profiler profiler("PeakFile::buildPyramid");
+
+    m_pyramid.clear();
+
+    int frames = getAvailablePeaks();
+    int level = 0;
+
+    while (frames / PyramidFactor > 0) {
+
+        int reduced = frames / PyramidFactor;
+        std::vector<short> values(size_t(reduced) * m_channels * 2);
+        size_t i = 0;
+
+        for (int frame = 0; frame < reduced; ++frame) {
+            for (int ch = 0; ch < m_channels; ++ch) {
+                int hi = 0, lo = 0;
+                for (int k = 0; k < PyramidFactor; ++k) {
+                    int h, l;
+                    getPeakValue(level, frame * PyramidFactor + k, ch, h, l);
+                    if (k == 0 || h > hi) hi = h;
+                    if (k == 0 || l < lo) lo = l;
+                }
+                values[i++] = short(hi);
+                values[i++] = short(lo);
+            }
+        }
+
+        m_pyramid.push_back(std::vector<short>());
+        m_pyramid.back().swap(values);
+
+        frames = reduced;
+        ++level;
+    }
+
+#ifdef DEBUG_PEAKFILE_CACHE
+    std::cout << "PeakFile::buildPyramid - " << m_pyramid.size()
+    << " levels from " << getAvailablePeaks() << " peaks" << std::endl;
+#endif
+}
+
+void
+PeakFile::getPeakRange(int from, int to, int *hi, int *lo) const
+{
+    for (int ch = 0; ch < m_channels; ++ch) {
+        hi[ch] = 0;
+        lo[ch] = 0;
+    }
+
+    bool first = true;
+
+    while (from < to) {
+
+        // Take the coarsest frame that starts here and doesn't run
+        // past the end of the range
+        //
+        int level = 0;
+        int span = 1;
+        while (level < int(m_pyramid.size()) &&
+               from % (span * PyramidFactor) == 0 &&
+               from + span * PyramidFactor <= to) {
+            span *= PyramidFactor;
+            ++level;
+        }
+
+        for (int ch = 0; ch < m_channels; ++ch) {
+            int h, l;
+            getPeakValue(level, from / span, ch, h, l);
+            if (first || h > hi[ch]) hi[ch] = h;
+            if (m_pointsPerValue == 2 && (first || l < lo[ch])) lo[ch] = l;
+        }
+
+        first = false;
+        from += span;
+    }
+}
+
 int
 PeakFile::getPeak(const RealTime &time)
 {
@@ -939,7 +1070,6 @@ PeakFile::getSplitPoints(const RealTime &startTime,
                          const RealTime &minLength)
 {
     std::vector<SplitPointPair> points;
-    std::string peakData;
 
     int startPeak = getPeak(startTime);
     int endPeak = getPeak(endTime);
@@ -947,7 +1077,10 @@ PeakFile::getSplitPoints(const RealTime &startTime,
     if (endPeak < startPeak)
         return std::vector<SplitPointPair>();
 
-    scanToPeak(startPeak);
+    if (!mapPeaks())
+        return points;
+
+    int lastPeak = std::min(endPeak, getAvailablePeaks());
 
     float divisor = 0.0f;
     switch (m_format) {
@@ -969,25 +1102,13 @@ PeakFile::getSplitPoints(const RealTime &startTime,
     RealTime startSplit = RealTime::zeroTime;
     bool inSplit = false;
 
-    for (int i = startPeak; i < endPeak; i++) {
+    for (int i = startPeak; i < lastPeak; i++) {
         value = 0.0;
 
         for (int ch = 0; ch < m_channels; ch++) {
-            try {
-                peakData = getBytes(m_inFile, m_format * m_pointsPerValue);
-            } catch (BadSoundFileException e) {
-                std::cerr << "PeakFile::getSplitPoints: "
-                << e.getMessage() << std::endl;
-                break;
-            }
-
-            if (peakData.length() == (unsigned int)(m_format *
-                                                    m_pointsPerValue)) {
-                int peakValue =
-                    getIntegerFromLittleEndian(peakData.substr(0, m_format));
-
-                value += fabs(float(peakValue) / divisor);
-            }
+            int hi, lo;
+            getPeakValue(0, i, ch, hi, lo);
+            value += fabs(float(hi) / divisor);
         }
 
         value /= float(m_channels);
@@ -15,11 +15,14 @@
 #include <vector>
 
 #include <QObject>
+#include <QAtomicInt>
 #include <QDateTime>
 
 #include "SoundFile.h"
 #include "base/RealTime.h"
 
+class QFile;
+
 #ifndef RG_PEAKFILE_H
 #define RG_PEAKFILE_H
 
@@ -33,6 +36,13 @@
 // external peak file (write()).  At the moment the only type of file
 // with an embedded peak chunk is the BWF file itself.
 //
+// For previews and split points the peak data are memory-mapped
+// rather than read through the stream, and on first use at a coarse
+// zoom level we build a pyramid of successively reduced copies of the
+// peaks (each value the extremes of PyramidFactor values in the level
+// below).  A preview pixel spanning many peaks is then made up from a
+// few values at the coarsest levels that fit inside it, giving the
+// same result as scanning every peak in the span.
 //
 
 
@@ -66,7 +76,10 @@ public:
     //
     virtual bool write();
 
-    // Write the file, emit value() signal and process app events
+    // Write the file, emit value() signal and process app events.
+    // May also be called on a thread other than the GUI thread, in
+    // which case it does neither, and getProgress() can be polled
+    // from the GUI thread instead.
     //
     virtual bool write(unsigned short updatePercentage);
 
@@ -119,8 +132,17 @@ public:
     std::streampos getChunkStartPosition() const
         { return m_chunkStartPosition; }
 
-    bool isProcessingPeaks() const { return m_keepProcessing; }
-    void setProcessingPeaks(bool value) { m_keepProcessing = value; }
+    bool isProcessingPeaks() const { return m_keepProcessing != 0; }
+    void setProcessingPeaks(bool value) { m_keepProcessing = (value ? 1 : 0); }
+
+    // Percentage of the audio file read so far by write()
+    //
+    int getProgress() const { return m_progress; }
+
+    // Whether the last write() got to the end of the audio file,
+    // rather than being stopped or failing part way
+    //
+    bool isComplete() const { return m_complete != 0; }
 
 signals:
     void setValue(int);
@@ -144,6 +166,35 @@ protected:
     //
     void parseHeader();
 
+    // Map the peak data into memory, or if that fails read it into
+    // m_peakCache.  Returns false if there are no peak data.
+    //
+    bool mapPeaks();
+    void unmapPeaks();
+
+    // Build the reduced levels of the peak pyramid from the peak data
+    //
+    void buildPyramid();
+
+    // Number of whole peak frames in the mapped data
+    //
+    int getAvailablePeaks() const;
+
+    // Decode a single peak value from the mapped data
+    //
+    int decodePeak(const unsigned char *p) const;
+
+    // Get the high and low values of one channel of a peak frame
+    // at the given pyramid level (0 being the peak data themselves)
+    //
+    void getPeakValue(int level, int index, int channel,
+                      int &hi, int &lo) const;
+
+    // Get the high and low values of each channel over a range of
+    // peak frames, into arrays of m_channels values
+    //
+    void getPeakRange(int from, int to, int *hi, int *lo) const;
+
     AudioFile *m_audioFile;
 
     // Some Peak Envelope Chunk parameters
@@ -176,10 +227,24 @@ protected:
     // Do we actually want to keep processing this peakfile?
     // In case we get a cancel.
     //
-    bool               m_keepProcessing;
+    QAtomicInt         m_keepProcessing;
+    QAtomicInt         m_progress;
+    QAtomicInt         m_complete;
 
+    // Peak data read from the file when it can't be mapped
+    //
     std::string        m_peakCache;
-    
+
+    // The mapped peak data (or m_peakCache's) and reduced levels of
+    // it, each holding hi and lo for every channel of every frame.
+    // Level n of the pyramid is PyramidFactor^(n+1) peaks per frame.
+    //
+    enum { PyramidFactor = 4 };
+
+    QFile                            *m_mapFile;
+    const unsigned char              *m_peakData;
+    size_t                            m_peakDataSize;
+    std::vector<std::vector<short> >  m_pyramid;
 };
 
 }
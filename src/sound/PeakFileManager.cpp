@@ -26,7 +26,16 @@
 #include <string>
 #include <vector>
 
+#include <algorithm>
+
 #include <QObject>
+#include <QApplication>
+#include <QFile>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
 
 #include "PeakFileManager.h"
 #include "AudioFile.h"
@@ -36,10 +45,73 @@
 namespace Rosegarden
 {
 
+namespace
+{
+
+// Shared by the jobs of one batch, so that the thread that started
+// them can wait for them while still reporting progress
+struct PeakBatch
+{
+    PeakBatch(int count) : remaining(count) { }
+
+    QMutex mutex;
+    QWaitCondition done;
+    int remaining;
+};
+
+class PeakJob : public QRunnable
+{
+public:
+    PeakJob(PeakFile *peakFile, unsigned short updatePercentage,
+            PeakBatch *batch, QAtomicInt *stopped) :
+        m_peakFile(peakFile),
+        m_updatePercentage(updatePercentage),
+        m_batch(batch),
+        m_stopped(stopped),
+        m_ok(false),
+        m_started(false)
+    {
+        setAutoDelete(false);
+    }
+
+    virtual void run() {
+        if (*m_stopped == 0) {
+            m_started = true;
+            try {
+                m_ok = m_peakFile->write(m_updatePercentage);
+            } catch (Exception &e) {
+                std::cerr << "PeakFileManager: " << e.getMessage()
+                          << std::endl;
+                m_ok = false;
+            }
+        }
+        QMutexLocker locker(&m_batch->mutex);
+        --m_batch->remaining;
+        m_batch->done.wakeAll();
+    }
+
+    PeakFile *getPeakFile() const { return m_peakFile; }
+    bool isOK() const { return m_ok; }
+
+    /// False if the batch was stopped before this job got to run
+    bool wasStarted() const { return m_started; }
+
+private:
+    PeakFile *m_peakFile;
+    unsigned short m_updatePercentage;
+    PeakBatch *m_batch;
+    QAtomicInt *m_stopped;
+    bool m_ok;
+    bool m_started;
+};
+
+}
+
 
 PeakFileManager::PeakFileManager():
         m_updatePercentage(0),
-        m_currentPeakFile(0)
+        m_currentPeakFile(0),
+        m_batchStopped(0)
 {}
 
 PeakFileManager::~PeakFileManager()
@@ -205,6 +277,108 @@ PeakFileManager::generatePeaks(AudioFile *audioFile,
 
 }
 
+void
+PeakFileManager::generatePeaks(const std::vector<AudioFile *> &audioFiles,
+                               unsigned short updatePercentage)
+{
+    std::vector<AudioFile *> wavFiles;
+
+    for (size_t i = 0; i < audioFiles.size(); ++i) {
+        if (audioFiles[i]->getType() == WAV) wavFiles.push_back(audioFiles[i]);
+    }
+
+    int threads = std::min(QThread::idealThreadCount(), int(wavFiles.size()));
+
+    if (threads < 2) {
+        for (size_t i = 0; i < audioFiles.size(); ++i) {
+            generatePeaks(audioFiles[i], updatePercentage);
+        }
+        return;
+    }
+
+    m_batchStopped = 0;
+
+    PeakBatch batch(wavFiles.size());
+    std::vector<PeakJob *> jobs;
+
+    // Find the peak files here, as doing so may add to m_peakFiles
+    for (size_t i = 0; i < wavFiles.size(); ++i) {
+        PeakFile *peakFile = getPeakFile(wavFiles[i]);
+        m_batchPeakFiles.push_back(peakFile);
+        jobs.push_back(new PeakJob(peakFile, updatePercentage,
+                                   &batch, &m_batchStopped));
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    for (size_t i = 0; i < jobs.size(); ++i) pool.start(jobs[i]);
+
+    bool onGuiThread = (qApp && QThread::currentThread() == qApp->thread());
+    int lastProgress = -1;
+
+    batch.mutex.lock();
+    while (batch.remaining > 0) {
+        batch.done.wait(&batch.mutex, 100);
+        batch.mutex.unlock();
+
+        int progress = 0;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            progress += jobs[i]->getPeakFile()->getProgress();
+        }
+        progress /= int(jobs.size());
+
+        if (progress != lastProgress) {
+            emit setValue(progress);
+            lastProgress = progress;
+        }
+
+        // stopPreview() may be called from here
+        if (onGuiThread) qApp->processEvents();
+
+        batch.mutex.lock();
+    }
+    batch.mutex.unlock();
+
+    pool.waitForDone();
+
+    QString failed;
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+
+        PeakFile *peakFile = jobs[i]->getPeakFile();
+
+        if (m_batchStopped) {
+            if (!jobs[i]->wasStarted()) {
+                // never touched, so whatever was there is still there
+            } else if (!jobs[i]->isOK() || !peakFile->isComplete()) {
+                // as in stopPreview(), don't leave part of a peak
+                // file behind
+                QString fileName = peakFile->getFilename();
+                peakFile->close();
+                QFile(fileName).remove();
+            } else {
+                // finished before the stop, so keep it
+                peakFile->close();
+            }
+        } else if (!jobs[i]->isOK()) {
+            std::cerr << "Can't write peak file for " << wavFiles[i]->getFilename() << " - no preview generated" << std::endl;
+            if (failed.isEmpty()) failed = wavFiles[i]->getFilename();
+        } else {
+            // close writes out important things
+            peakFile->close();
+        }
+
+        delete jobs[i];
+    }
+
+    m_batchPeakFiles.clear();
+
+    if (!failed.isEmpty()) {
+        throw BadPeakFileException(failed, __FILE__, __LINE__);
+    }
+}
+
 std::vector<float>
 PeakFileManager::getPreview(AudioFile *audioFile,
                             const RealTime &startTime,
@@ -265,6 +439,7 @@ PeakFileManager::clear()
     m_peakFiles.erase(m_peakFiles.begin(), m_peakFiles.end());
 
     m_currentPeakFile = 0;
+    m_batchPeakFiles.clear();
 }
 
 
@@ -290,6 +465,16 @@ PeakFileManager::getSplitPoints(AudioFile *audioFile,
 void
 PeakFileManager::stopPreview()
 {
+    if (!m_batchPeakFiles.empty()) {
+        // Stop all of a batch; generatePeaks() removes the files when
+        // the threads have finished with them
+        //
+        m_batchStopped = 1;
+        for (size_t i = 0; i < m_batchPeakFiles.size(); ++i) {
+            m_batchPeakFiles[i]->setProcessingPeaks(false);
+        }
+    }
+
     if (m_currentPeakFile) {
         // Stop processing
         //
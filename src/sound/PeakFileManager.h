@@ -30,7 +30,7 @@
 #include <vector>
 
 #include <QObject>
-
+#include <QAtomicInt>
 
 #include "PeakFile.h"
 #include "misc/Strings.h"
@@ -92,6 +92,16 @@ public:
                        unsigned short updatePercentage);
     // throw BadSoundFileException, BadPeakFileException
 
+    // Generate peak files for several audio files at once, each on a
+    // thread of its own (up to the number of cores).  Progress is
+    // the average over all the files and is sent from this thread.
+    // The peaks written are the same as generatePeaks() would write
+    // for each file in turn.
+    //
+    void generatePeaks(const std::vector<AudioFile *> &audioFiles,
+                       unsigned short updatePercentage);
+    // throw BadPeakFileException
+
     // Get a vector of floats as the preview
     //
     std::vector<float> getPreview(AudioFile *audioFile,
@@ -145,6 +155,11 @@ protected:
     //
     PeakFile              *m_currentPeakFile;
 
+    // Whilst processing several at once - all of them
+    //
+    std::vector<PeakFile*> m_batchPeakFiles;
+    QAtomicInt             m_batchStopped;
+
 
 };
 
@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include "Scavenger.h"
+#include "AudioKernels.h"
 
 //#define DEBUG_RINGBUFFER 1
 //#define DEBUG_RINGBUFFER_CREATE_DESTROY 1
@@ -49,6 +50,25 @@ namespace Rosegarden {
  * simple type that can safely be set to zero using memset.
  */
 
+/**
+ * Add n samples from source into destination, as used by
+ * RingBuffer::readAdding.  Float samples use the mixing kernels.
+ */
+template <typename T>
+inline void
+ringBufferAdd(T *destination, const T *source, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        destination[i] += source[i];
+    }
+}
+
+inline void
+ringBufferAdd(float *destination, const float *source, size_t n)
+{
+    AudioKernels::add(destination, source, n);
+}
+
 template <typename T, int N = 1>
 class RingBuffer
 {
@@ -435,16 +455,10 @@ RingBuffer<T, N>::readAdding(T *destination, size_t n, int R)
     size_t here = m_size - m_readers[R];
 
     if (here >= n) {
-        for (size_t i = 0; i < n; ++i) {
-            destination[i] += (m_buffer + m_readers[R])[i];
-        }
+        ringBufferAdd(destination, m_buffer + m_readers[R], n);
     } else {
-        for (size_t i = 0; i < here; ++i) {
-            destination[i] += (m_buffer + m_readers[R])[i];
-        }
-        for (size_t i = 0; i < (n - here); ++i) {
-            destination[i + here] += m_buffer[i];
-        }
+        ringBufferAdd(destination, m_buffer + m_readers[R], here);
+        ringBufferAdd(destination + here, m_buffer, n - here);
     }
 
     m_readers[R] = (m_readers[R] + n) % m_size;
@@ -15,6 +15,9 @@
 #include "SoundFile.h"
 #include "base/Profiler.h"
 
+#include <algorithm>
+#include <cstring>
+
 
 //#define DEBUG_SOUNDFILE 1
 
@@ -209,6 +212,43 @@ SoundFile::getBytes(unsigned int numberOfBytes)
 }
 
 
+size_t
+SoundFile::getBytes(char *buffer, size_t n)
+{
+    if (m_inFile == 0)
+        throw(BadSoundFileException(m_fileName, "SoundFile::getBytes - no open file handle"));
+
+    if (m_loseBuffer) {
+        m_readChunkPtr = -1;
+        m_loseBuffer = false;
+    }
+
+    size_t count = 0;
+
+    // Anything left over from a buffered read comes first
+    //
+    if (m_readChunkPtr != -1) {
+        size_t available = m_readBuffer.length() - m_readChunkPtr;
+        count = std::min(available, n);
+        memcpy(buffer, m_readBuffer.data() + m_readChunkPtr, count);
+        m_readChunkPtr += count;
+        if (count == available) m_readChunkPtr = -1;
+    }
+
+    // and the rest straight from the file
+    //
+    if (count < n && !m_inFile->eof()) {
+        m_inFile->read(buffer + count, n - count);
+        count += m_inFile->gcount();
+    }
+
+    if (m_inFile->eof())
+        m_inFile->clear();
+
+    return count;
+}
+
+
 // Write out a sequence of FileBytes to the stream
 //
 void
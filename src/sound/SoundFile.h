@@ -101,6 +101,12 @@ public:
     //
     std::string getBytes(unsigned int numberOfBytes);
 
+    // Read up to n bytes into buffer, continuing from where the
+    // buffered read left off.  Returns the number read, which is
+    // less than n only at the end of the file.
+    //
+    size_t getBytes(char *buffer, size_t n);
+
     // Return file size
     //
     size_t getSize() const { return m_fileSize; }
@@ -14,9 +14,11 @@
 */
 
 #include "WAVAudioFile.h"
+#include "AudioKernels.h"
 #include "base/RealTime.h"
 
 #include <sstream>
+#include <algorithm>
 
 using std::cout;
 using std::cerr;
@@ -27,6 +29,45 @@ using std::endl;
 namespace Rosegarden
 {
 
+// Decode one channel of the source into a target buffer, replacing or
+// adding to what is there, when no resampling is needed.  Any frames
+// wanted beyond the end of the source repeat its last one.
+//
+static void
+decodeChannel(const unsigned char *ubuf, int bitsPerSample,
+              size_t sourceChannels, size_t ch, size_t fileFrames,
+              float *target, size_t nframes, bool adding)
+{
+    size_t frames = std::min(nframes, fileFrames);
+
+    if (!adding) {
+        AudioKernels::decode(ubuf, bitsPerSample, sourceChannels, ch,
+                             target, frames);
+    } else {
+        // in blocks, so as not to allocate on the disk thread
+        float block[1024];
+        for (size_t i = 0; i < frames; i += 1024) {
+            size_t n = std::min(frames - i, size_t(1024));
+            AudioKernels::decode
+                (ubuf + i * sourceChannels * (bitsPerSample / 8),
+                 bitsPerSample, sourceChannels, ch, block, n);
+            AudioKernels::add(target + i, block, n);
+        }
+    }
+
+    if (frames == 0 || frames == nframes) return;
+
+    float last = 0.0f;
+    AudioKernels::decode
+        (ubuf + (frames - 1) * sourceChannels * (bitsPerSample / 8),
+         bitsPerSample, sourceChannels, ch, &last, 1);
+
+    for (size_t i = frames; i < nframes; ++i) {
+        if (adding) target[i] += last;
+        else target[i] = last;
+    }
+}
+
 WAVAudioFile::WAVAudioFile(const unsigned int &id,
                            const std::string &name,
                            const QString &fileName):
@@ -197,6 +238,13 @@ WAVAudioFile::decode(const unsigned char *ubuf,
             tch = 0;
         }
 
+        if (sourceSampleRate == targetSampleRate) {
+            decodeChannel(ubuf, bitsPerSample, sourceChannels, ch,
+                          fileFrames, target[tch], nframes,
+                          adding || tch != int(ch));
+            continue;
+        }
+
         float ratio = 1.0;
         if (sourceSampleRate != targetSampleRate) {
             ratio = float(sourceSampleRate) / float(targetSampleRate);
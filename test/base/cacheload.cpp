@@ -0,0 +1,70 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Compare loading a document from its XML with loading it from the
+// DocumentCache saved beside it.  Both loads go through
+// RosegardenDocument::openDocument and RoseXmlHandler, as in the
+// application.  Reports the total time and peak memory of each, and
+// checks that the two give the same segments and events.  Each load
+// runs in its own process so the peaks don't mask one another.
+//
+// Usage: cacheload [segments [events per segment]]
+
+#include "document/DocumentCache.h"
+
+#include "documentload.h"
+#include "testutil.h"
+
+#include <QApplication>
+#include <QString>
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Rosegarden;
+
+static unsigned long
+loadXml(const QString &fileName)
+{
+    return loadDocument("xml", fileName, false, false);
+}
+
+static unsigned long
+loadCache(const QString &fileName)
+{
+    return loadDocument("cache", fileName, true, false);
+}
+
+int main(int argc, char **argv)
+{
+    QApplication app(argc, argv, false);
+
+    int segmentCount = (argc > 1 ? atoi(argv[1]) : 100);
+    int eventCount = (argc > 2 ? atoi(argv[2]) : 10000);
+
+    TemporaryDirectory dir("cacheload");
+    useTemporarySettings(dir);
+
+    QString fileName = dir.getFileName("test.rg");
+
+    fprintf(stderr, "writing %d segments of %d events\n",
+            segmentCount, eventCount);
+
+    // Save with a cache beside the document
+    setLoadOptions(true, false);
+    if (!writeSyntheticDocument(fileName, segmentCount, eventCount)) return 2;
+
+    if (!QFile::exists(DocumentCache::getCacheFileName(fileName))) {
+        fprintf(stderr, "ERROR: no cache was written\n");
+        return 1;
+    }
+
+    unsigned long xml = runChild(loadXml, fileName);
+    unsigned long cache = runChild(loadCache, fileName);
+
+    if (xml != cache || xml == 0) {
+        fprintf(stderr, "ERROR: loaded documents differ\n");
+        return 1;
+    }
+
+    return 0;
+}
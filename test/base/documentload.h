@@ -0,0 +1,217 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Helpers for the tests that compare ways of loading a document.  A
+// synthetic document is saved and loaded by RosegardenDocument itself,
+// just as the application does, so every way of loading goes through
+// RoseXmlHandler.  The settings that choose between them are kept in
+// a temporary directory rather than the user's own.
+
+#ifndef RG_TEST_DOCUMENT_LOAD_H
+#define RG_TEST_DOCUMENT_LOAD_H
+
+#include "document/RosegardenDocument.h"
+#include "base/Composition.h"
+#include "base/Segment.h"
+#include "base/Track.h"
+#include "base/Instrument.h"
+#include "base/NotationTypes.h"
+#include "base/BaseProperties.h"
+#include "misc/ConfigGroups.h"
+
+#include "testutil.h"
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QString>
+
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+
+/**
+ * Keep the settings of this process and its children in the given
+ * directory, under the names the application uses.  Call after the
+ * QApplication is made and before anything reads a setting.
+ */
+inline void
+useTemporarySettings(const TemporaryDirectory &dir)
+{
+    QCoreApplication::setOrganizationName("rosegardenmusic");
+    QCoreApplication::setOrganizationDomain("rosegardenmusic.com");
+    QCoreApplication::setApplicationName("Rosegarden");
+    QSettings::setPath(QSettings::NativeFormat, QSettings::UserScope,
+                       dir.getPath());
+    QSettings::setPath(QSettings::IniFormat, QSettings::UserScope,
+                       dir.getPath());
+}
+
+/**
+ * Choose whether documents are saved with, and loaded from, a
+ * DocumentCache, and whether their segments are parsed in parallel.
+ */
+inline void
+setLoadOptions(bool fastLoadCache, bool parallelLoad)
+{
+    QSettings settings;
+    settings.beginGroup(Rosegarden::GeneralOptionsConfigGroup);
+    settings.setValue("fastloadcache", fastLoadCache);
+    settings.setValue("parallelsegmentload", parallelLoad);
+    settings.endGroup();
+    settings.sync();
+}
+
+/**
+ * Save a document of segmentCount segments, each on its own track,
+ * of about eventCount events.  Besides single notes there are clefs
+ * and keys, chords whose notes differ in length, beamed groups with
+ * ids to be remapped on loading, ties and gaps, so that the timing
+ * and grouping of events loaded one way can be told from another.
+ */
+inline bool
+writeSyntheticDocument(const QString &fileName,
+                       int segmentCount, int eventCount)
+{
+    using namespace Rosegarden;
+
+    RosegardenDocument doc(0, 0, true, false);
+    doc.setHeadless(true);
+
+    Composition &comp = doc.getComposition();
+
+    for (int s = 0; s < segmentCount; ++s) {
+
+        comp.addTrack(new Track(s, MidiInstrumentBase + s % 16, s));
+
+        Segment *segment = new Segment;
+        segment->setTrack(s);
+        segment->insert(Clef(s % 2 ? Clef::Bass : Clef::Treble)
+                        .getAsEvent(0));
+        segment->insert(Key("D major").getAsEvent(0));
+
+        timeT t = 0;
+        long groupId = -1;
+
+        for (int i = 0; i < eventCount; ) {
+
+            int pitch = 36 + ((s + i) % 48);
+
+            if (i % 4 == 0) groupId = segment->getNextId();
+
+            if (i % 8 == 7) {
+                // a chord: the next event follows the shortest note
+                for (int n = 0; n < 3; ++n) {
+                    Event *e = new Event(Note::EventType, t, 480 - n * 120);
+                    e->set<Int>(BaseProperties::PITCH, pitch + n * 4);
+                    e->set<Int>(BaseProperties::VELOCITY, 100);
+                    segment->insert(e);
+                }
+                t += 240;
+                i += 3;
+                continue;
+            }
+
+            Event *e = new Event(Note::EventType, t, 240);
+            e->set<Int>(BaseProperties::PITCH, pitch);
+            e->set<Int>(BaseProperties::VELOCITY, 90 + i % 20);
+            e->set<Int>(BaseProperties::BEAMED_GROUP_ID, groupId);
+            e->set<String>(BaseProperties::BEAMED_GROUP_TYPE,
+                           BaseProperties::GROUP_TYPE_BEAMED);
+            if (i % 6 == 0) {
+                e->set<Bool>(BaseProperties::TIED_FORWARD, true);
+            }
+            segment->insert(e);
+
+            // now and then leave a gap, so that the next event needs
+            // an explicit time
+            t += (i % 13 == 0 ? 360 : 240);
+            ++i;
+        }
+
+        comp.addSegment(segment);
+    }
+
+    QString errMsg;
+    if (!doc.saveDocument(fileName, errMsg)) {
+        fprintf(stderr, "ERROR: %s\n", errMsg.toLocal8Bit().data());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Return a checksum over the segments of a document and the XML of
+ * all of their events.
+ */
+inline unsigned long
+getChecksum(const Rosegarden::RosegardenDocument &doc, long &events)
+{
+    using namespace Rosegarden;
+
+    const Composition &comp = doc.getComposition();
+
+    unsigned long crc = crc32(0L, Z_NULL, 0);
+    std::string xml;
+    events = 0;
+
+    for (Composition::const_iterator i = comp.begin(); i != comp.end(); ++i) {
+
+        const Segment *segment = *i;
+
+        char header[100];
+        sprintf(header, "segment %d %ld %ld\n", int(segment->getTrack()),
+                long(segment->getStartTime()),
+                long(segment->getEndMarkerTime()));
+        crc = crc32(crc, (const Bytef *)header, strlen(header));
+
+        for (Segment::const_iterator j = segment->begin();
+             j != segment->end(); ++j) {
+            xml.clear();
+            (*j)->appendXmlString(xml, 0);
+            crc = crc32(crc, (const Bytef *)xml.data(), xml.size());
+            ++events;
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * Open a document as the application does, with the given load
+ * options, and report how long it took and how much memory it used.
+ * Returns the checksum of what was loaded, or 0 if it could not be
+ * loaded, or if it should have come from the cache and didn't.
+ */
+inline unsigned long
+loadDocument(const char *name, const QString &fileName,
+             bool fastLoadCache, bool parallelLoad)
+{
+    using namespace Rosegarden;
+
+    setLoadOptions(fastLoadCache, parallelLoad);
+
+    double start = now();
+
+    RosegardenDocument doc(0, 0, true, false);
+    doc.setHeadless(true);
+
+    bool ok = doc.openDocument(fileName, false, true);
+
+    if (ok && fastLoadCache && !doc.isLoadedFromCache()) {
+        fprintf(stderr, "ERROR: %s: not loaded from the cache\n", name);
+        ok = false;
+    }
+
+    double secs = now() - start;
+
+    long events = 0;
+    unsigned long crc = (ok ? getChecksum(doc, events) : 0);
+
+    fprintf(stderr, "%-8s %s total %8.3f s  peak %7ld KB  %8ld events"
+            "  crc %08lx\n", name, ok ? "ok  " : "FAIL", secs, peakKB(),
+            events, crc);
+
+    return crc;
+}
+
+#endif
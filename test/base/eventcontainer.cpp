@@ -0,0 +1,250 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Compare the two EventContainer backends: the std::multiset that
+// Segment uses by default, and the SortedEventVector that is used
+// when building with RG_FLAT_EVENT_CONTAINER.  Both are exercised
+// directly here, so this doesn't depend on which one the library
+// was built with.
+//
+// Usage: eventcontainer [events-per-segment]
+
+#include "Event.h"
+#include "SortedEventVector.h"
+#include "NotationTypes.h"
+
+#include <set>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+
+using namespace Rosegarden;
+
+typedef std::multiset<Event *, Event::EventCmp> TreeContainer;
+
+static double
+now()
+{
+    struct timeval tv;
+    (void)gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void
+report(const char *backend, const char *what, double secs, long ops)
+{
+    fprintf(stderr, "%-18s %-26s %10.3f ms  %8.1f ns/op\n",
+            backend, what, secs * 1000.0, secs * 1e9 / ops);
+}
+
+template <class C>
+static bool
+run(const char *backend, const std::vector<Event *> &events, bool sorted)
+{
+    C c;
+    long n = events.size();
+
+    double t0 = now();
+    for (long i = 0; i < n; ++i) c.insert(events[i]);
+    report(backend, sorted ? "insert (in order)" : "insert (random order)",
+           now() - t0, n);
+
+    // The access pattern of mapping and layout: repeated full passes
+    t0 = now();
+    timeT total = 0;
+    const int passes = 20;
+    for (int p = 0; p < passes; ++p) {
+        for (typename C::const_iterator i = c.begin(); i != c.end(); ++i) {
+            total += (*i)->getDuration();
+        }
+    }
+    report(backend, "iterate", now() - t0, n * passes);
+
+    // findTime equivalent
+    t0 = now();
+    long found = 0;
+    timeT last = events.empty() ? 0 : (*c.rbegin())->getAbsoluteTime();
+    for (long i = 0; i < n; ++i) {
+        Event dummy("dummy", (i * 7919) % (last + 1), 0, MIN_SUBORDERING);
+        if (c.lower_bound(&dummy) != c.end()) ++found;
+    }
+    report(backend, "lower_bound", now() - t0, n);
+
+    // Erase a tenth of the events, then put them back, clustered as
+    // edits usually are
+    long first = n / 2, count = n / 10;
+    std::vector<Event *> taken;
+    t0 = now();
+    for (long i = 0; i < count; ++i) {
+        typename C::iterator j = c.lower_bound(events[first]);
+        if (j == c.end()) break;
+        taken.push_back(*j);
+        c.erase(j);
+    }
+    for (long i = 0; i < long(taken.size()); ++i) c.insert(taken[i]);
+    report(backend, "local erase + insert", now() - t0, 2 * count);
+
+    // Check the ordering is intact
+    bool ok = (long(c.size()) == n);
+    typename C::const_iterator i = c.begin(), j = c.begin();
+    if (j != c.end()) ++j;
+    for (; ok && j != c.end(); ++i, ++j) {
+        if (**j < **i) ok = false;
+    }
+
+    if (!ok) fprintf(stderr, "ERROR: %s: container is out of order\n", backend);
+    if (total < 0 || found < 0) fprintf(stderr, "(unreachable)\n");
+
+    // Empty it the way Segment::erase(from, to) does, which makes
+    // every iterator step in the flat container follow a change
+    t0 = now();
+    for (typename C::iterator k = c.begin(); k != c.end(); ) c.erase(k++);
+    report(backend, "erase(i++)", now() - t0, n);
+
+    if (!c.empty()) {
+        fprintf(stderr, "ERROR: %s: not empty after erasing\n", backend);
+        ok = false;
+    }
+
+    return ok;
+}
+
+static void
+eraseEvent(TreeContainer &c, Event *e)
+{
+    TreeContainer::iterator i = c.lower_bound(e);
+    while (*i != e) ++i;
+    c.erase(i);
+}
+
+// The iterator idioms that Segment's users rely on: erasing while
+// iterating, and holding iterators across inserts and erases of other
+// events.  Each step is checked against a std::multiset doing the same.
+template <class C>
+static bool
+checkIterators(const char *backend)
+{
+    bool ok = true;
+    std::vector<Event *> events;
+    C c;
+    TreeContainer ref;
+
+    for (int i = 0; i < 1000; ++i) {
+        Event *e = new Event("note", (i * 37) % 211 * 10, 10, 0);
+        events.push_back(e);
+        c.insert(e);
+        ref.insert(e);
+    }
+
+    // Hold iterators to some events across many inserts elsewhere
+    typename C::iterator first = c.begin(), middle = c.find(events[500]);
+    Event *firstEvent = *first, *middleEvent = *middle;
+    for (int i = 0; i < 1000; ++i) {
+        Event *e = new Event("note", (i * 53) % 307 * 10 + 5, 10, 0);
+        events.push_back(e);
+        c.insert(e);
+        ref.insert(e);
+    }
+    if (*first != firstEvent || *middle != middleEvent) {
+        fprintf(stderr, "ERROR: %s: iterator moved by insert\n", backend);
+        ok = false;
+    }
+
+    // erase(i++) over every third event
+    int n = 0;
+    for (typename C::iterator i = c.begin(); i != c.end(); ) {
+        if (n++ % 3 == 0) { eraseEvent(ref, *i); c.erase(i++); }
+        else ++i;
+    }
+
+    // j = i; ++j; erase(i); i = j; over events at odd times
+    for (typename C::iterator i = c.begin(); i != c.end(); ) {
+        typename C::iterator j = i;
+        ++j;
+        if ((*i)->getAbsoluteTime() % 20 == 5) {
+            eraseEvent(ref, *i);
+            c.erase(i);
+        }
+        i = j;
+    }
+
+    // Insert while iterating, holding the iterator we're at
+    for (typename C::iterator i = c.begin(); i != c.end(); ++i) {
+        if ((*i)->getAbsoluteTime() % 70 == 0) {
+            Event *e = new Event("rest", (*i)->getAbsoluteTime() + 1, 1, 0);
+            events.push_back(e);
+            c.insert(e);
+            ref.insert(e);
+        }
+    }
+
+    // Insert with a hint at an equivalent event, which both put
+    // immediately before the hint
+    typename C::iterator h = c.begin();
+    for (int j = 0; j < 10 && h != c.end(); ++j) {
+        for (int step = 0; step < 37 && h != c.end(); ++step) ++h;
+        if (h == c.end()) break;
+        TreeContainer::iterator rh = ref.lower_bound(*h);
+        while (*rh != *h) ++rh;
+        Event *e = new Event("note", (*h)->getAbsoluteTime(),
+                             5, (*h)->getSubOrdering());
+        events.push_back(e);
+        c.insert(h, e);
+        ref.insert(rh, e);
+    }
+
+    // Walk backwards from end()
+    typename C::iterator i = c.end();
+    TreeContainer::iterator k = ref.end();
+    while (ok && i != c.begin()) {
+        --i; --k;
+        if (*i != *k) ok = false;
+    }
+
+    if (!ok || long(c.size()) != long(ref.size())) {
+        fprintf(stderr, "ERROR: %s: differs from std::multiset after edits\n",
+                backend);
+        ok = false;
+    }
+
+    for (int j = 0; j < int(events.size()); ++j) delete events[j];
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    long n = 50000;
+    if (argc > 1) n = atol(argv[1]);
+
+    std::vector<Event *> events;
+    timeT t = 0;
+    for (long i = 0; i < n; ++i) {
+        // chords of up to three notes, mostly quavers
+        Event *e = new Event("note", t, 480, 0);
+        events.push_back(e);
+        if (rand() % 3 == 0) t += 480;
+    }
+
+    fprintf(stderr, "%ld events\n\n", n);
+
+    bool ok = true;
+    ok = run<TreeContainer>("std::multiset", events, true) && ok;
+    ok = run<SortedEventVector>("SortedEventVector", events, true) && ok;
+
+    std::vector<Event *> shuffled(events);
+    for (long i = n - 1; i > 0; --i) {
+        long j = rand() % (i + 1);
+        Event *e = shuffled[i]; shuffled[i] = shuffled[j]; shuffled[j] = e;
+    }
+
+    fprintf(stderr, "\n");
+    ok = run<TreeContainer>("std::multiset", shuffled, false) && ok;
+    ok = run<SortedEventVector>("SortedEventVector", shuffled, false) && ok;
+
+    for (long i = 0; i < n; ++i) delete events[i];
+
+    ok = checkIterators<TreeContainer>("std::multiset") && ok;
+    ok = checkIterators<SortedEventVector>("SortedEventVector") && ok;
+
+    return ok ? 0 : 1;
+}
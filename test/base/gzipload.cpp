@@ -0,0 +1,195 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Compare loading a compressed .rg document the old way (inflate the
+// whole file into a QString, then parse that) with parsing it straight
+// from a GzipDevice.  Reports the time to the first element, the total
+// time and the peak memory of each.  Each load runs in its own process
+// so the peaks don't mask one another.
+//
+// Usage: gzipload [file.rg]
+// With no file, a synthetic document of about 150MB uncompressed is
+// written to a temporary directory and loaded.  A truncated copy of
+// the document is also checked to be reported as incomplete.
+
+#include "document/GzipDevice.h"
+#include "document/GzipFile.h"
+
+#include "testutil.h"
+
+#include <QXmlDefaultHandler>
+#include <QXmlInputSource>
+#include <QXmlSimpleReader>
+#include <QString>
+
+#include <cstdio>
+#include <cstdlib>
+#include <zlib.h>
+
+using namespace Rosegarden;
+
+class CountingHandler : public QXmlDefaultHandler
+{
+public:
+    CountingHandler(double start) :
+        m_start(start), m_first(0), m_elements(0) { }
+
+    virtual bool startElement(const QString &, const QString &,
+                              const QString &, const QXmlAttributes &) {
+        if (m_elements++ == 0) m_first = now() - m_start;
+        return true;
+    }
+
+    double m_start;
+    double m_first;
+    long m_elements;
+};
+
+static void
+report(const char *name, const CountingHandler &handler, bool ok)
+{
+    fprintf(stderr, "%-10s %s %9ld elements  first element %8.3f ms"
+            "  total %8.3f s  peak %7ld KB\n",
+            name, ok ? "ok  " : "FAIL", handler.m_elements,
+            handler.m_first * 1000.0, now() - handler.m_start, peakKB());
+}
+
+// These return the number of elements read, or 0 on failure
+
+static unsigned long
+loadWhole(const QString &fileName)
+{
+    double start = now();
+    CountingHandler handler(start);
+
+    QString text;
+    bool ok = GzipFile::readFromFile(fileName, text);
+
+    QXmlInputSource source;
+    source.setData(text);
+    QXmlSimpleReader reader;
+    reader.setContentHandler(&handler);
+    ok = reader.parse(source) && ok;
+
+    report("whole", handler, ok);
+    return ok ? handler.m_elements : 0;
+}
+
+static unsigned long
+loadStreaming(const QString &fileName)
+{
+    double start = now();
+    CountingHandler handler(start);
+
+    GzipDevice file(fileName);
+    bool ok = file.open(QIODevice::ReadOnly);
+
+    if (ok) {
+        QXmlInputSource source(&file);
+        QXmlSimpleReader reader;
+        reader.setContentHandler(&handler);
+        ok = reader.parse(source) && file.isComplete();
+    }
+
+    report("streaming", handler, ok);
+    return ok ? handler.m_elements : 0;
+}
+
+// Read a file that has been cut short, which must not be mistaken
+// for a complete one
+static bool
+loadTruncated(const QString &fileName)
+{
+    GzipDevice file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QByteArray data = file.readAll();
+    bool ok = (file.hasReadError() && !file.isComplete());
+
+    fprintf(stderr, "%-10s %s %9d bytes read  error \"%s\"\n",
+            "truncated", ok ? "ok  " : "FAIL", data.size(),
+            file.errorString().toLocal8Bit().data());
+    return ok;
+}
+
+static void
+writeTruncated(const char *fileName, const char *truncatedName)
+{
+    FILE *in = fopen(fileName, "rb");
+    FILE *out = fopen(truncatedName, "wb");
+    if (!in || !out) {
+        perror(truncatedName);
+        exit(2);
+    }
+
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+
+    // Keep the first half, as a save cut off by a full disc might
+    char buffer[65536];
+    long left = size / 2;
+    while (left > 0) {
+        size_t n = fread(buffer, 1, left < long(sizeof(buffer)) ?
+                         size_t(left) : sizeof(buffer), in);
+        if (n == 0) break;
+        fwrite(buffer, 1, n, out);
+        left -= n;
+    }
+
+    fclose(in);
+    fclose(out);
+}
+
+static void
+writeSynthetic(const char *fileName)
+{
+    gzFile fd = gzopen(fileName, "wb");
+    if (!fd) {
+        perror(fileName);
+        exit(2);
+    }
+
+    gzprintf(fd, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<!DOCTYPE rosegarden-data>\n<rosegarden-data>\n"
+             "<composition>\n</composition>\n");
+
+    // about 110 bytes per event, 1.4 million events
+    for (int s = 0; s < 140; ++s) {
+        gzprintf(fd, "<segment track=\"%d\" start=\"0\">\n", s);
+        for (int e = 0; e < 10000; ++e) {
+            gzprintf(fd, "<event type=\"note\" duration=\"240\">"
+                     "<property name=\"pitch\" int=\"%d\"/>"
+                     "<property name=\"velocity\" int=\"100\"/></event>\n",
+                     36 + (e % 48));
+        }
+        gzprintf(fd, "</segment>\n");
+    }
+
+    gzprintf(fd, "</rosegarden-data>\n");
+    gzclose(fd);
+}
+
+int main(int argc, char **argv)
+{
+    TemporaryDirectory dir("gzipload");
+
+    QString fileName = dir.getFileName("test.rg");
+    QString truncatedName = dir.getFileName("truncated.rg");
+
+    if (argc > 1) {
+        fileName = QString::fromLocal8Bit(argv[1]);
+    } else {
+        fprintf(stderr, "writing %s\n", fileName.toLocal8Bit().data());
+        writeSynthetic(QFile::encodeName(fileName).data());
+    }
+
+    unsigned long whole = runChild(loadWhole, fileName);
+    unsigned long streaming = runChild(loadStreaming, fileName);
+    bool ok = (whole != 0 && whole == streaming);
+
+    writeTruncated(QFile::encodeName(fileName).data(),
+                   QFile::encodeName(truncatedName).data());
+    ok = loadTruncated(truncatedName) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Time MappedBufMetaIterator::fetchEvents over synthetic compositions
+// of 10, 100 and 1000 segments, fetched in slices of the sequencer's
+// default read-ahead as RosegardenSequencer::keepPlaying does.  Each
+// segment is half a minute of notes placed somewhere in a ten minute
+// composition, so only a few are sounding at any one time.  Also
+// checks that events added to a buffer after its iterator has reached
+// the end are still fetched, as when recording.
+//
+// Usage: metaiterator [segments ...]
+
+#include "sound/MappedBufMetaIterator.h"
+#include "sound/MappedInserterBase.h"
+#include "sound/MappedEvent.h"
+#include "gui/seqmanager/MappedEventBuffer.h"
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+
+using namespace Rosegarden;
+
+static const int compositionSeconds = 600;
+static const int segmentSeconds = 30;
+static const long noteSpacing = 125000000; // ns
+
+static double
+now()
+{
+    struct timeval tv;
+    (void)gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+class SyntheticBuffer : public MappedEventBuffer
+{
+public:
+    SyntheticBuffer(int startSeconds) :
+        MappedEventBuffer(0),
+        m_startSeconds(startSeconds),
+        m_seconds(segmentSeconds) { }
+
+    virtual int getSegmentRepeatCount() { return 1; }
+
+    virtual int calculateSize() {
+        return int(m_seconds * 1000000000LL / noteSpacing);
+    }
+
+    /// Make the segment longer, and refill the buffer
+    void extend(int seconds) {
+        m_seconds += seconds;
+        refresh();
+    }
+
+    virtual void fillBuffer() {
+        int n = calculateSize();
+        RealTime t(m_startSeconds, 0);
+        RealTime step(0, noteSpacing);
+        RealTime duration(0, noteSpacing * 4 / 5);
+        RealTime start = t;
+        for (int i = 0; i < n; ++i) {
+            MappedEvent e(0, MappedEvent::MidiNote, 60 + i % 12, 100,
+                          t, duration, RealTime::zeroTime);
+            mapAnEvent(&e);
+            t = t + step;
+        }
+        RealTime end = t;
+        setStartEnd(start, end);
+    }
+
+    virtual bool shouldPlay(MappedEvent *, RealTime) { return true; }
+
+private:
+    int m_startSeconds;
+    int m_seconds;
+};
+
+class CountingInserter : public MappedInserterBase
+{
+public:
+    CountingInserter() : m_count(0) { }
+    virtual void insertCopy(const MappedEvent &) { ++m_count; }
+    long m_count;
+};
+
+static void
+run(int segments)
+{
+    MappedBufMetaIterator meta;
+
+    for (int i = 0; i < segments; ++i) {
+        int start = (i * 577) % (compositionSeconds - segmentSeconds);
+        SyntheticBuffer *buffer = new SyntheticBuffer(start);
+        buffer->init();
+        // the iterator the meta-iterator makes owns the buffer
+        meta.addSegment(buffer);
+    }
+
+    CountingInserter inserter;
+    RealTime readAhead(0, 80000000);
+    RealTime t = RealTime::zeroTime;
+    RealTime end(compositionSeconds, 0);
+    long slices = 0;
+
+    meta.jumpToTime(t);
+
+    double t0 = now();
+    while (t < end) {
+        meta.fetchEvents(inserter, t, t + readAhead);
+        t = t + readAhead;
+        ++slices;
+    }
+    double secs = now() - t0;
+
+    fprintf(stderr, "%5d segments %8ld events %7ld slices %10.3f ms"
+            "  %8.2f us/slice\n",
+            segments, inserter.m_count, slices, secs * 1000.0,
+            secs * 1e6 / slices);
+
+    meta.clear();
+}
+
+// Play one segment to its end, then extend it and play on
+static bool
+checkAppended()
+{
+    MappedBufMetaIterator meta;
+    SyntheticBuffer *buffer = new SyntheticBuffer(0);
+    buffer->init();
+    meta.addSegment(buffer);
+
+    CountingInserter inserter;
+    RealTime readAhead(0, 80000000);
+    RealTime t = RealTime::zeroTime;
+    meta.jumpToTime(t);
+
+    RealTime end(segmentSeconds + 1, 0);
+    while (t < end) {
+        meta.fetchEvents(inserter, t, t + readAhead);
+        t = t + readAhead;
+    }
+    long before = inserter.m_count;
+
+    buffer->extend(segmentSeconds);
+
+    end = RealTime(2 * segmentSeconds + 1, 0);
+    while (t < end) {
+        meta.fetchEvents(inserter, t, t + readAhead);
+        t = t + readAhead;
+    }
+    long after = inserter.m_count - before;
+
+    meta.clear();
+
+    // The notes in the extension that start after playback had passed
+    // the old end
+    long expected = long((segmentSeconds - 1) * 1000000000LL / noteSpacing);
+    if (before == 0 || after < expected) {
+        fprintf(stderr, "ERROR: %ld events fetched after extending the "
+                "segment, expected at least %ld\n", after, expected);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) run(atoi(argv[i]));
+    } else {
+        run(10);
+        run(100);
+        run(1000);
+    }
+    return checkAppended() ? 0 : 1;
+}
@@ -0,0 +1,399 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Check that a small hand-built standard MIDI file converts to the
+// composition it describes: tempo and time signature changes, a track
+// whose channels are split into separate tracks, running status, note
+// offs given both ways, SysEx (one of them empty) and controllers.
+// Then time MidiFile::open over a corpus of generated files, each
+// with many tracks of notes, controllers and running status, and
+// check that every file reads back with all of its tracks.
+//
+// Usage: midiload [files [tracks per file [notes per track]]]
+
+#include "sound/MidiFile.h"
+#include "base/Composition.h"
+#include "base/Segment.h"
+#include "base/Track.h"
+#include "base/Studio.h"
+#include "base/Instrument.h"
+#include "base/NotationTypes.h"
+#include "base/MidiTypes.h"
+#include "base/BaseProperties.h"
+
+#include "testutil.h"
+
+#include <QCoreApplication>
+#include <QString>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Rosegarden;
+
+static void
+putLong(std::string &s, unsigned long n)
+{
+    s += char(n >> 24);
+    s += char(n >> 16);
+    s += char(n >> 8);
+    s += char(n);
+}
+
+static void
+putNumber(std::string &s, unsigned long n)
+{
+    char bytes[5];
+    int count = 0;
+    bytes[count++] = char(n & 0x7f);
+    while (n >>= 7) bytes[count++] = char(0x80 | (n & 0x7f));
+    while (count) s += bytes[--count];
+}
+
+static void
+putTrack(std::string &file, const unsigned char *data, size_t size)
+{
+    file += "MTrk";
+    putLong(file, size);
+    file += std::string((const char *)data, size);
+}
+
+static bool
+writeFile(const QString &fileName, const std::string &file)
+{
+    FILE *f = fopen(QFile::encodeName(fileName).data(), "wb");
+    if (!f) return false;
+    bool ok = (fwrite(file.data(), 1, file.size(), f) == file.size());
+    if (fclose(f) != 0) ok = false;
+    return ok;
+}
+
+// A conductor track, at 480 pulses per crotchet: 120 qpm in 3/4, then
+// 150 qpm in 4/4 from the second bar
+static const unsigned char conductorTrack[] = {
+    0x00, 0xff, 0x51, 0x03, 0x07, 0xa1, 0x20,
+    0x00, 0xff, 0x58, 0x04, 0x03, 0x02, 0x18, 0x08,
+    0x8b, 0x20, 0xff, 0x51, 0x03, 0x06, 0x1a, 0x80,
+    0x00, 0xff, 0x58, 0x04, 0x04, 0x02, 0x18, 0x08,
+    0x00, 0xff, 0x2f, 0x00
+};
+
+// A track on channels 0 and 3, to be split into one track for each
+static const unsigned char mixedTrack[] = {
+    0x00, 0xff, 0x03, 0x05, 'M', 'i', 'x', 'e', 'd',
+    0x00, 0x90, 0x3c, 0x64,             // 0: ch 0 on 60
+    0x00, 0x3e, 0x64,                   // running status: ch 0 on 62
+    0x00, 0x93, 0x40, 0x50,             // ch 3 on 64
+    0x81, 0x70, 0x80, 0x3c, 0x40,       // 240: ch 0 note off 60
+    0x81, 0x70, 0x90, 0x3e, 0x00,       // 480: ch 0 off 62, as velocity 0
+    0x00, 0x93, 0x40, 0x00,             // ch 3 off 64
+    0x00, 0x43, 0x50,                   // running status: ch 3 on 67
+    0x83, 0x60, 0x43, 0x00,             // 960: running status: ch 3 off 67
+    0x00, 0xf0, 0x05, 0x7e, 0x7f, 0x09, 0x01, 0xf7,
+    0x00, 0xf0, 0x00,                   // empty SysEx, to be skipped
+    0x00, 0xb0, 0x07, 0x64,             // ch 0 volume
+    0x00, 0x0a, 0x40,                   // running status: ch 0 pan
+    0x83, 0x60, 0xff, 0x2f, 0x00        // 1440: end of track
+};
+
+// Describe the events of a segment other than rests, one per string,
+// in an order that doesn't depend on how equal times were sorted
+static std::vector<std::string>
+describe(const Segment &segment)
+{
+    std::vector<std::string> events;
+    char buffer[200];
+
+    for (Segment::const_iterator i = segment.begin();
+         i != segment.end(); ++i) {
+
+        const Event &e = **i;
+
+        if (e.isa(Note::EventType)) {
+            sprintf(buffer, "note %ld %ld %ld %ld",
+                    long(e.getAbsoluteTime()), long(e.getDuration()),
+                    long(e.get<Int>(BaseProperties::PITCH)),
+                    long(e.get<Int>(BaseProperties::VELOCITY)));
+        } else if (e.isa(Controller::EventType)) {
+            sprintf(buffer, "controller %ld %ld %ld",
+                    long(e.getAbsoluteTime()),
+                    long(e.get<Int>(Controller::NUMBER)),
+                    long(e.get<Int>(Controller::VALUE)));
+        } else if (e.isa(SystemExclusive::EventType)) {
+            sprintf(buffer, "sysex %ld %s", long(e.getAbsoluteTime()),
+                    SystemExclusive(e).getHexData().c_str());
+        } else if (e.isa(Note::EventRestType)) {
+            continue;
+        } else {
+            sprintf(buffer, "%s %ld", e.getType().c_str(),
+                    long(e.getAbsoluteTime()));
+        }
+
+        events.push_back(buffer);
+    }
+
+    std::sort(events.begin(), events.end());
+    return events;
+}
+
+static bool
+checkEvents(const Composition &comp, TrackId trackId,
+            const char *const *expected)
+{
+    const Segment *segment = 0;
+    for (Composition::const_iterator i = comp.begin(); i != comp.end(); ++i) {
+        if ((*i)->getTrack() == trackId) segment = *i;
+    }
+    if (!segment) {
+        fprintf(stderr, "ERROR: no segment on track %d\n", int(trackId));
+        return false;
+    }
+
+    std::vector<std::string> want;
+    while (*expected) want.push_back(*expected++);
+    std::sort(want.begin(), want.end());
+
+    std::vector<std::string> got = describe(*segment);
+    if (got == want) return true;
+
+    fprintf(stderr, "ERROR: track %d has events:\n", int(trackId));
+    for (size_t i = 0; i < got.size(); ++i) {
+        fprintf(stderr, "  %s\n", got[i].c_str());
+    }
+    fprintf(stderr, "expected:\n");
+    for (size_t i = 0; i < want.size(); ++i) {
+        fprintf(stderr, "  %s\n", want[i].c_str());
+    }
+    return false;
+}
+
+static bool
+checkTrack(const Composition &comp, TrackId trackId,
+           const std::string &label, int channel)
+{
+    const Track *track = comp.getTrackById(trackId);
+    if (!track) {
+        fprintf(stderr, "ERROR: no track %d\n", int(trackId));
+        return false;
+    }
+    if (track->getLabel() != label ||
+        track->getInstrument() != MidiInstrumentBase + channel) {
+        fprintf(stderr, "ERROR: track %d is \"%s\" on instrument %d, "
+                "expected \"%s\" on %d\n", int(trackId),
+                track->getLabel().c_str(), int(track->getInstrument()),
+                label.c_str(), int(MidiInstrumentBase + channel));
+        return false;
+    }
+    return true;
+}
+
+// Read the hand-built file and check what it converts to.  Rosegarden
+// times have 960 to the crotchet, twice the file's.
+static bool
+checkContent(const QString &fileName)
+{
+    std::string file("MThd");
+    putLong(file, 6);
+    file += char(0); file += char(1);
+    file += char(0); file += char(2);
+    file += char(0x01); file += char(0xe0);
+    putTrack(file, conductorTrack, sizeof(conductorTrack));
+    putTrack(file, mixedTrack, sizeof(mixedTrack));
+
+    if (!writeFile(fileName, file)) {
+        fprintf(stderr, "ERROR: failed to write %s\n",
+                fileName.toLocal8Bit().data());
+        return false;
+    }
+
+    Studio studio;
+    MidiFile midiFile(fileName, &studio);
+
+    if (!midiFile.open()) {
+        fprintf(stderr, "ERROR: %s: %s\n", fileName.toLocal8Bit().data(),
+                midiFile.getError().c_str());
+        return false;
+    }
+
+    bool ok = true;
+
+    // The conductor track, and one for each channel of the other
+    if (midiFile.numberOfTracks() != 3) {
+        fprintf(stderr, "ERROR: read %d tracks, expected 3\n",
+                int(midiFile.numberOfTracks()));
+        ok = false;
+    }
+    if (!midiFile.hasTimeChanges()) {
+        fprintf(stderr, "ERROR: no time changes found\n");
+        ok = false;
+    }
+
+    Composition comp;
+    if (!midiFile.convertToRosegarden(comp, MidiFile::CONVERT_REPLACE)) {
+        fprintf(stderr, "ERROR: conversion failed\n");
+        return false;
+    }
+
+    if (comp.getTempoChangeCount() != 2 ||
+        comp.getTempoChange(0) != std::make_pair
+            (timeT(0), Composition::getTempoForQpm(120.0)) ||
+        comp.getTempoChange(1) != std::make_pair
+            (timeT(2880), Composition::getTempoForQpm(150.0))) {
+        fprintf(stderr, "ERROR: wrong tempo changes (%d of them)\n",
+                comp.getTempoChangeCount());
+        ok = false;
+    }
+
+    if (comp.getTimeSignatureCount() != 2 ||
+        comp.getTimeSignatureChange(0).first != 0 ||
+        comp.getTimeSignatureChange(0).second != TimeSignature(3, 4) ||
+        comp.getTimeSignatureChange(1).first != 2880 ||
+        comp.getTimeSignatureChange(1).second != TimeSignature(4, 4)) {
+        fprintf(stderr, "ERROR: wrong time signatures (%d of them)\n",
+                comp.getTimeSignatureCount());
+        ok = false;
+    }
+
+    // The conductor track has no events of its own and is dropped
+    if (comp.getNbSegments() != 2) {
+        fprintf(stderr, "ERROR: %d segments, expected 2\n",
+                int(comp.getNbSegments()));
+        ok = false;
+    }
+
+    static const char *const channel0[] = {
+        "note 0 480 60 100",
+        "note 0 960 62 100",
+        "sysex 1920 7E 7F 09 01",
+        "controller 1920 7 100",
+        "controller 1920 10 64",
+        0
+    };
+    static const char *const channel3[] = {
+        "note 0 960 64 80",
+        "note 960 960 67 80",
+        0
+    };
+
+    ok = checkTrack(comp, 0, "Mixed", 0) && ok;
+    ok = checkTrack(comp, 1, "Imported MIDI", 3) && ok;
+    ok = checkEvents(comp, 0, channel0) && ok;
+    ok = checkEvents(comp, 1, channel3) && ok;
+
+    fprintf(stderr, "content %s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// Write a format 1 file, each of whose tracks is on its own channel.
+// Returns the number of channel events written.
+static long
+writeSynthetic(const QString &fileName, int trackCount, int noteCount)
+{
+    std::string file("MThd");
+    putLong(file, 6);
+    file += char(0); file += char(1);
+    file += char(trackCount >> 8); file += char(trackCount);
+    file += char(0x01); file += char(0xe0);
+
+    long events = 0;
+
+    for (int t = 0; t < trackCount; ++t) {
+        std::string track;
+        int channel = t % 16;
+
+        putNumber(track, 0);
+        track += char(0xff); track += char(0x03); track += char(5);
+        track += "Track";
+
+        putNumber(track, 0);
+        track += char(0xc0 | channel); track += char(t % 128);
+        ++events;
+
+        for (int i = 0; i < noteCount; ++i) {
+            int pitch = 36 + ((t + i) % 48);
+            putNumber(track, (i % 5 == 0 ? 240 : 120));
+            track += char(0x90 | channel);
+            track += char(pitch); track += char(100);
+            // note off as note on with zero velocity, in running status
+            putNumber(track, 110);
+            track += char(pitch); track += char(0);
+            events += 2;
+            if (i % 16 == 0) {
+                putNumber(track, 0);
+                track += char(0xb0 | channel);
+                track += char(7); track += char(i % 128);
+                ++events;
+            }
+        }
+
+        putNumber(track, 0);
+        track += char(0xff); track += char(0x2f); track += char(0);
+
+        putTrack(file, (const unsigned char *)track.data(), track.size());
+    }
+
+    return writeFile(fileName, file) ? events : -1;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int fileCount = (argc > 1 ? atoi(argv[1]) : 100);
+    int trackCount = (argc > 2 ? atoi(argv[2]) : 32);
+    int noteCount = (argc > 3 ? atoi(argv[3]) : 2000);
+
+    TemporaryDirectory dir("midiload");
+
+    if (!checkContent(dir.getFileName("content.mid"))) return 1;
+
+    std::vector<QString> fileNames;
+    long expected = 0;
+
+    fprintf(stderr, "writing %d files of %d tracks of %d notes\n",
+            fileCount, trackCount, noteCount);
+
+    for (int i = 0; i < fileCount; ++i) {
+        QString fileName = dir.getFileName(QString("test-%1.mid").arg(i));
+        expected = writeSynthetic(fileName, trackCount, noteCount);
+        if (expected < 0) {
+            fprintf(stderr, "ERROR: failed to write %s\n",
+                    fileName.toLocal8Bit().data());
+            return 2;
+        }
+        fileNames.push_back(fileName);
+    }
+
+    double start = now();
+    int failures = 0;
+
+    for (size_t i = 0; i < fileNames.size(); ++i) {
+
+        MidiFile midiFile(fileNames[i], 0);
+
+        if (!midiFile.open()) {
+            fprintf(stderr, "ERROR: %s: %s\n",
+                    fileNames[i].toLocal8Bit().data(),
+                    midiFile.getError().c_str());
+            ++failures;
+            continue;
+        }
+
+        if (int(midiFile.numberOfTracks()) != trackCount) {
+            fprintf(stderr, "ERROR: %s: read %d tracks, expected %d\n",
+                    fileNames[i].toLocal8Bit().data(),
+                    int(midiFile.numberOfTracks()), trackCount);
+            ++failures;
+        }
+    }
+
+    double secs = now() - start;
+
+    fprintf(stderr, "read %d files (%ld channel events each) in %.3f s, "
+            "%.1f ms per file\n", fileCount, expected, secs,
+            secs * 1000.0 / (fileCount ? fileCount : 1));
+
+    return failures ? 1 : 0;
+}
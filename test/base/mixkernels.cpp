@@ -0,0 +1,163 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Time the AudioKernels mixing loops in each implementation the CPU
+// supports, without JACK.  Each period runs the instrument mixer's
+// fader stage (pan for mono tracks, gain for stereo ones, silence
+// check), the buss mixer's accumulation and gain, JackDriver's
+// metering and the extremes PeakFile finds over a number of tracks,
+// and the results are checked to be the same in every implementation.
+//
+// Usage: mixkernels [tracks [frames [periods]]]
+
+#include "sound/AudioKernels.h"
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <sys/time.h>
+
+using namespace Rosegarden;
+
+static double
+now()
+{
+    struct timeval tv;
+    (void)gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+struct Track
+{
+    std::vector<float> input;   // a period's worth, mono or stereo
+    bool stereo;
+    float gainLeft;
+    float gainRight;
+};
+
+static double
+run(AudioKernels::Implementation implementation,
+    std::vector<Track> &tracks, size_t frames, int periods)
+{
+    if (!AudioKernels::setImplementation(implementation)) return 0;
+
+    std::vector<float> left(frames), right(frames);
+    std::vector<float> bussLeft(frames), bussRight(frames);
+    double checksum = 0;
+
+    double t0 = now();
+
+    for (int p = 0; p < periods; ++p) {
+
+        memset(&bussLeft[0], 0, frames * sizeof(float));
+        memset(&bussRight[0], 0, frames * sizeof(float));
+
+        float peakLeft = 0, peakRight = 0;
+        float hi = -1.0f, lo = 1.0f;
+        int silent = 0;
+
+        for (size_t t = 0; t < tracks.size(); ++t) {
+
+            Track &track = tracks[t];
+            const float *in = &track.input[0];
+
+            AudioKernels::range(in, hi, lo, track.input.size());
+
+            if (track.stereo) {
+                memcpy(&left[0], in, frames * sizeof(float));
+                memcpy(&right[0], in + frames, frames * sizeof(float));
+                AudioKernels::flushDenormals(&left[0], frames);
+                AudioKernels::flushDenormals(&right[0], frames);
+                AudioKernels::gain(&left[0], track.gainLeft, frames);
+                AudioKernels::gain(&right[0], track.gainRight, frames);
+                if (AudioKernels::isSilent(&left[0], frames) &&
+                    AudioKernels::isSilent(&right[0], frames)) ++silent;
+            } else {
+                if (AudioKernels::isSilent(in, frames)) ++silent;
+                AudioKernels::panGain(in, &left[0], &right[0],
+                                      track.gainLeft, track.gainRight,
+                                      frames);
+            }
+
+            peakLeft = AudioKernels::peak(&left[0], peakLeft, frames);
+            peakRight = AudioKernels::peak(&right[0], peakRight, frames);
+
+            AudioKernels::add(&bussLeft[0], &left[0], frames);
+            AudioKernels::add(&bussRight[0], &right[0], frames);
+        }
+
+        AudioKernels::gain(&bussLeft[0], 0.5f, frames);
+        AudioKernels::gain(&bussRight[0], 0.5f, frames);
+
+        checksum += bussLeft[p % frames] + bussRight[(p * 7) % frames] +
+            peakLeft + peakRight + hi - lo + silent;
+    }
+
+    double secs = now() - t0;
+
+    fprintf(stderr, "%-8s %4d tracks %5d frames  %9.3f us/period"
+            "  checksum %.6f\n",
+            AudioKernels::getImplementationName(implementation),
+            int(tracks.size()), int(frames),
+            secs * 1e6 / periods, checksum);
+
+    return checksum;
+}
+
+int main(int argc, char **argv)
+{
+    int trackCount = (argc > 1 ? atoi(argv[1]) : 64);
+    size_t frames = (argc > 2 ? atoi(argv[2]) : 64);
+    int periods = (argc > 3 ? atoi(argv[3]) : 20000);
+
+    AudioKernels::Implementation best = AudioKernels::getImplementation();
+    fprintf(stderr, "default implementation: %s\n",
+            AudioKernels::getImplementationName(best));
+
+    srand(1);
+
+    std::vector<Track> tracks(trackCount);
+    for (int t = 0; t < trackCount; ++t) {
+        Track &track = tracks[t];
+        track.stereo = (t % 2 == 1);
+        track.input.resize(frames * (track.stereo ? 2 : 1));
+        for (size_t i = 0; i < track.input.size(); ++i) {
+            float v = float(rand()) / RAND_MAX * 2.0f - 1.0f;
+            // some silent tracks, and a few denormals
+            if (t % 5 == 0) v = 0.0f;
+            else if (i % 61 == 0) v = 1e-40f;
+            track.input[i] = v;
+        }
+        track.gainLeft = float(t % 7) / 7.0f;
+        track.gainRight = 1.0f - track.gainLeft;
+    }
+
+    AudioKernels::Implementation implementations[] = {
+        AudioKernels::Scalar, AudioKernels::SSE2, AudioKernels::AVX2
+    };
+
+    double reference = 0;
+    bool haveReference = false;
+    int result = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        if (!AudioKernels::isSupported(implementations[i])) {
+            fprintf(stderr, "%-8s not supported\n",
+                    AudioKernels::getImplementationName(implementations[i]));
+            continue;
+        }
+        double checksum = run(implementations[i], tracks, frames, periods);
+        if (!haveReference) {
+            reference = checksum;
+            haveReference = true;
+        } else if (checksum != reference) {
+            fprintf(stderr, "ERROR: %s results differ from scalar\n",
+                    AudioKernels::getImplementationName(implementations[i]));
+            result = 1;
+        }
+    }
+
+    AudioKernels::setImplementation(best);
+    return result;
+}
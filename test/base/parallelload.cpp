@@ -0,0 +1,68 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Compare loading a document by streaming its XML through the parser
+// with parsing its segments' events on a thread pool through a
+// ParallelSegmentLoader.  Both loads go through
+// RosegardenDocument::openDocument and RoseXmlHandler, as in the
+// application.  Reports the total time and peak memory of each, and
+// checks that the two give the same segments and events.
+//
+// Usage: parallelload [segments [events per segment]]
+
+#include "documentload.h"
+#include "testutil.h"
+
+#include <QApplication>
+#include <QThread>
+#include <QString>
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Rosegarden;
+
+static unsigned long
+loadSerial(const QString &fileName)
+{
+    return loadDocument("serial", fileName, false, false);
+}
+
+static unsigned long
+loadParallel(const QString &fileName)
+{
+    return loadDocument("parallel", fileName, false, true);
+}
+
+int main(int argc, char **argv)
+{
+    QApplication app(argc, argv, false);
+
+    int segmentCount = (argc > 1 ? atoi(argv[1]) : 100);
+    int eventCount = (argc > 2 ? atoi(argv[2]) : 10000);
+
+    TemporaryDirectory dir("parallelload");
+    useTemporarySettings(dir);
+
+    QString fileName = dir.getFileName("test.rg");
+
+    fprintf(stderr, "writing %d segments of %d events, %d threads\n",
+            segmentCount, eventCount, QThread::idealThreadCount());
+
+    // The parallel load is only used with more than one core
+    if (QThread::idealThreadCount() < 2) {
+        fprintf(stderr, "WARNING: only one core, so both loads are serial\n");
+    }
+
+    setLoadOptions(false, false);
+    if (!writeSyntheticDocument(fileName, segmentCount, eventCount)) return 2;
+
+    unsigned long serial = runChild(loadSerial, fileName);
+    unsigned long parallel = runChild(loadParallel, fileName);
+
+    if (serial != parallel || serial == 0) {
+        fprintf(stderr, "ERROR: loaded documents differ\n");
+        return 1;
+    }
+
+    return 0;
+}
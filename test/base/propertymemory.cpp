@@ -0,0 +1,213 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Report the memory used by event properties, comparing the old
+// PropertyMap representation (a std::map of separately allocated
+// PropertyStores) with the CompactPropertyMap that Event now uses.
+// Only the maps are counted, not the events that would own them.
+//
+// Usage: propertymemory [file.xml]
+//
+// Given an uncompressed Rosegarden document (gunzip -c file.rg >
+// file.xml), the events and persistent properties in it are rebuilt
+// both ways.  Without a file, a synthetic score of notes carrying
+// the usual pitch/velocity/beaming properties is used instead.
+
+#include "PropertyMap.h"
+#include "CompactPropertyMap.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <new>
+
+using namespace Rosegarden;
+
+static size_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+void *operator new(size_t size)
+{
+    ++allocations;
+    allocatedBytes += size;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p)
+{
+    free(p);
+}
+
+struct PropertySpec
+{
+    std::string name;
+    std::string type;
+    std::string value;
+};
+
+typedef std::vector<PropertySpec> EventSpec;
+
+static std::string
+attribute(const std::string &tag, const std::string &name)
+{
+    std::string key = " " + name + "=\"";
+    size_t i = tag.find(key);
+    if (i == std::string::npos) return "";
+    i += key.size();
+    size_t j = tag.find('"', i);
+    if (j == std::string::npos) return "";
+    return tag.substr(i, j - i);
+}
+
+static void
+readDocument(const char *path, std::vector<EventSpec> &events)
+{
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string doc = ss.str();
+
+    size_t i = 0;
+    while ((i = doc.find("<event", i)) != std::string::npos) {
+        size_t end = doc.find("</event>", i);
+        size_t close = doc.find("/>", i);
+        size_t open = doc.find('>', i);
+        EventSpec spec;
+        if (end == std::string::npos || (close != std::string::npos &&
+                                         close + 1 == open)) {
+            // empty element
+            events.push_back(spec);
+            i = open;
+            continue;
+        }
+        size_t p = i;
+        while ((p = doc.find("<property ", p)) != std::string::npos && p < end) {
+            size_t q = doc.find("/>", p);
+            std::string tag = doc.substr(p, q - p);
+            PropertySpec ps;
+            ps.name = attribute(tag, "name");
+            const char *types[] = { "int", "string", "bool", "realtimet" };
+            for (int t = 0; t < 4; ++t) {
+                std::string v = attribute(tag, types[t]);
+                if (v != "" || tag.find(std::string(" ") + types[t] + "=") !=
+                    std::string::npos) {
+                    ps.type = types[t];
+                    ps.value = v;
+                    break;
+                }
+            }
+            if (ps.type != "") spec.push_back(ps);
+            p = q;
+        }
+        events.push_back(spec);
+        i = end;
+    }
+}
+
+static void
+synthesise(std::vector<EventSpec> &events)
+{
+    for (int i = 0; i < 200000; ++i) {
+        EventSpec spec;
+        PropertySpec ps;
+        ps.type = "int";
+        ps.name = "pitch"; ps.value = "60"; spec.push_back(ps);
+        ps.name = "velocity"; ps.value = "100"; spec.push_back(ps);
+        if (i % 2) {
+            ps.name = "BeamedGroupId"; ps.value = "12"; spec.push_back(ps);
+            ps.type = "string";
+            ps.name = "BeamedGroupType"; ps.value = "beamed"; spec.push_back(ps);
+        }
+        if (i % 5 == 0) {
+            ps.type = "bool";
+            ps.name = "tiedforward"; ps.value = "true"; spec.push_back(ps);
+        }
+        events.push_back(spec);
+    }
+}
+
+template <PropertyType P>
+static void
+addOld(PropertyMap &map, const PropertySpec &ps)
+{
+    if (map.find(PropertyName(ps.name)) != map.end()) return;
+    map.insert(PropertyPair(PropertyName(ps.name),
+                            new PropertyStore<P>(PropertyDefn<P>::parse(ps.value))));
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<EventSpec> specs;
+    if (argc > 1) readDocument(argv[1], specs);
+    else synthesise(specs);
+
+    size_t nprops = 0;
+    for (size_t i = 0; i < specs.size(); ++i) nprops += specs[i].size();
+
+    fprintf(stderr, "%lu events, %lu persistent properties\n\n",
+            (unsigned long)specs.size(), (unsigned long)nprops);
+
+    // intern all the names first so the tables aren't counted
+    for (size_t i = 0; i < specs.size(); ++i) {
+        for (size_t j = 0; j < specs[i].size(); ++j) {
+            PropertyName n(specs[i][j].name);
+        }
+    }
+
+    std::vector<PropertyMap *> oldMaps;
+    oldMaps.reserve(specs.size());
+    size_t a1 = allocations, b1 = allocatedBytes;
+    for (size_t i = 0; i < specs.size(); ++i) {
+        PropertyMap *map = new PropertyMap;
+        for (size_t j = 0; j < specs[i].size(); ++j) {
+            const PropertySpec &ps = specs[i][j];
+            if (ps.type == "int") addOld<Int>(*map, ps);
+            else if (ps.type == "string") addOld<String>(*map, ps);
+            else if (ps.type == "bool") addOld<Bool>(*map, ps);
+            else addOld<RealTimeT>(*map, ps);
+        }
+        oldMaps.push_back(map);
+    }
+    size_t oldAllocs = allocations - a1, oldBytes = allocatedBytes - b1;
+
+    std::vector<CompactPropertyMap *> newMaps;
+    newMaps.reserve(specs.size());
+    a1 = allocations; b1 = allocatedBytes;
+    for (size_t i = 0; i < specs.size(); ++i) {
+        CompactPropertyMap *map = new CompactPropertyMap;
+        for (size_t j = 0; j < specs[i].size(); ++j) {
+            const PropertySpec &ps = specs[i][j];
+            PropertyName name(ps.name);
+            if (map->find(name) >= 0) continue;
+            if (ps.type == "int") {
+                map->insert<Int>(name, PropertyDefn<Int>::parse(ps.value));
+            } else if (ps.type == "string") {
+                map->insert<String>(name, PropertyDefn<String>::parse(ps.value));
+            } else if (ps.type == "bool") {
+                map->insert<Bool>(name, PropertyDefn<Bool>::parse(ps.value));
+            } else {
+                map->insert<RealTimeT>(name, PropertyDefn<RealTimeT>::parse(ps.value));
+            }
+        }
+        newMaps.push_back(map);
+    }
+    size_t newAllocs = allocations - a1, newBytes = allocatedBytes - b1;
+
+    fprintf(stderr, "%-20s %12s %14s %12s\n",
+            "", "allocations", "bytes", "bytes/event");
+    fprintf(stderr, "%-20s %12lu %14lu %12.1f\n", "PropertyMap",
+            (unsigned long)oldAllocs, (unsigned long)oldBytes,
+            double(oldBytes) / specs.size());
+    fprintf(stderr, "%-20s %12lu %14lu %12.1f\n", "CompactPropertyMap",
+            (unsigned long)newAllocs, (unsigned long)newBytes,
+            double(newBytes) / specs.size());
+
+    for (size_t i = 0; i < oldMaps.size(); ++i) delete oldMaps[i];
+    for (size_t i = 0; i < newMaps.size(); ++i) delete newMaps[i];
+
+    return 0;
+}
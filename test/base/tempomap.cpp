@@ -0,0 +1,363 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Check the tempo conversions of Composition, which go through its
+// TempoMap, against the way they used to be calculated: a search of
+// the tempo events for each call, with the formulas Composition used
+// before there was a TempoMap.  Flat and ramped tempo maps are run
+// through getElapsedRealTime, getElapsedTimeForRealTime and
+// getTempoAtTime, and TempoMap::getElapsedRealTimes is checked to give
+// the same results as converting one time at a time.
+//
+// Usage: tempomap
+
+#include "base/Composition.h"
+#include "base/TempoMap.h"
+#include "base/NotationTypes.h"
+#include "base/RealTime.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+using namespace Rosegarden;
+
+// The tempo changes as they would be held in the tempo segment: the
+// target is that of the TargetTempoProperty, -1 if there is none and
+// 0 to ramp to the following tempo
+
+struct Tempo
+{
+    Tempo(timeT t, tempoT tp, tempoT tg) : time(t), tempo(tp), target(tg) { }
+    timeT time;
+    tempoT tempo;
+    tempoT target;
+};
+
+class Reference
+{
+public:
+    Reference(tempoT defaultTempo, timeT endMarker,
+              const std::vector<Tempo> &tempos) :
+        m_defaultTempo(defaultTempo),
+        m_endMarker(endMarker),
+        m_tempos(tempos) {
+        calculateTimestamps();
+    }
+
+    tempoT getTempoAtTime(timeT t) const {
+
+        int i = findNearestTime(t);
+
+        if (i < 0) {
+            if (t < 0) return getTempoAtTime(0);
+            else return m_defaultTempo;
+        }
+
+        tempoT tempo = m_tempos[i].tempo;
+        tempoT target = m_tempos[i].target;
+        bool last = (i + 1 == int(m_tempos.size()));
+
+        if (target > 0 || (target == 0 && !last)) {
+
+            timeT t0 = m_tempos[i].time;
+            timeT t1 = (last ? m_endMarker : m_tempos[i + 1].time);
+
+            if (t1 < t0) return tempo;
+
+            if (target == 0) target = m_tempos[i + 1].tempo;
+
+            double s0 = 1.0 / double(tempo);
+            double s1 = 1.0 / double(target);
+            double s = s0 + (t - t0) * ((s1 - s0) / (t1 - t0));
+
+            return tempoT((1.0 / s) + 0.01);
+        }
+
+        return tempo;
+    }
+
+    RealTime getElapsedRealTime(timeT t) const {
+
+        int i = findNearestTime(t);
+        if (i < 0) {
+            i = 0;
+            if (t >= 0 || m_tempos.empty() || m_tempos[0].time > 0) {
+                return time2RealTime(t, m_defaultTempo);
+            }
+        }
+
+        tempoT target = -1;
+        timeT targetTime = t;
+        if (!getTempoTarget(i, target, targetTime)) target = -1;
+
+        if (target > 0) {
+            return m_timestamps[i] +
+                time2RealTime(t - m_tempos[i].time, m_tempos[i].tempo,
+                              targetTime - m_tempos[i].time, target);
+        } else {
+            return m_timestamps[i] +
+                time2RealTime(t - m_tempos[i].time, m_tempos[i].tempo);
+        }
+    }
+
+    timeT getElapsedTimeForRealTime(RealTime t) const {
+
+        int i = findNearestRealTime(t);
+        if (i < 0) {
+            i = 0;
+            if (t >= RealTime::zeroTime ||
+                m_tempos.empty() || m_tempos[0].time > 0) {
+                return realTime2Time(t, m_defaultTempo);
+            }
+        }
+
+        tempoT target = -1;
+        timeT targetTime = 0;
+        if (!getTempoTarget(i, target, targetTime)) target = -1;
+
+        if (target > 0) {
+            return m_tempos[i].time +
+                realTime2Time(t - m_timestamps[i], m_tempos[i].tempo,
+                              targetTime - m_tempos[i].time, target);
+        } else {
+            return m_tempos[i].time +
+                realTime2Time(t - m_timestamps[i], m_tempos[i].tempo);
+        }
+    }
+
+private:
+    int findNearestTime(timeT t) const {
+        int found = -1;
+        for (int i = 0; i < int(m_tempos.size()); ++i) {
+            if (m_tempos[i].time <= t) found = i;
+        }
+        return found;
+    }
+
+    int findNearestRealTime(RealTime t) const {
+        int found = -1;
+        for (int i = 0; i < int(m_tempos.size()); ++i) {
+            if (m_timestamps[i] <= t) found = i;
+        }
+        return found;
+    }
+
+    bool getTempoTarget(int i, tempoT &target, timeT &targetTime) const {
+        target = -1;
+        targetTime = 0;
+        bool have = false;
+        if (m_tempos[i].target >= 0) {
+            target = m_tempos[i].target;
+            if (i + 1 < int(m_tempos.size())) {
+                if (target == 0) target = m_tempos[i + 1].tempo;
+                targetTime = m_tempos[i + 1].time;
+            } else {
+                targetTime = m_endMarker;
+                if (targetTime < m_tempos[i].time) target = -1;
+            }
+            if (target > 0) have = true;
+        }
+        return have;
+    }
+
+    void calculateTimestamps() {
+        timeT lastTimeT = 0;
+        RealTime lastRealTime;
+        tempoT tempo = m_defaultTempo;
+        tempoT target = -1;
+
+        for (int i = 0; i < int(m_tempos.size()); ++i) {
+            RealTime myTime;
+            timeT t = m_tempos[i].time;
+            if (target > 0) {
+                myTime = lastRealTime +
+                    time2RealTime(t - lastTimeT, tempo, t - lastTimeT, target);
+            } else {
+                myTime = lastRealTime + time2RealTime(t - lastTimeT, tempo);
+            }
+            m_timestamps.push_back(myTime);
+            lastRealTime = myTime;
+            lastTimeT = t;
+            tempo = m_tempos[i].tempo;
+            timeT targetTime = 0;
+            if (!getTempoTarget(i, target, targetTime)) target = -1;
+        }
+    }
+
+    static RealTime time2RealTime(timeT t, tempoT tempo) {
+        static timeT cdur = Note(Note::Crotchet).getDuration();
+        double dt = (double(t) * 100000 * 60) / (double(tempo) * cdur);
+        int sec = int(dt);
+        int nsec = int((dt - sec) * 1000000000);
+        return RealTime(sec, nsec);
+    }
+
+    static RealTime time2RealTime(timeT time, tempoT tempo,
+                                  timeT targetTime, tempoT targetTempo) {
+        static timeT cdur = Note(Note::Crotchet).getDuration();
+        if (targetTime == 0 || targetTempo == tempo) {
+            return time2RealTime(time, targetTempo);
+        }
+        double a = (100000 * 60) / (double(tempo) * cdur);
+        double b = (100000 * 60) / (double(targetTempo) * cdur);
+        double t = time;
+        double n = targetTime;
+        double result = (a * t) + (t * t * (b - a)) / (2 * n);
+        int sec = int(result);
+        int nsec = int((result - sec) * 1000000000);
+        return RealTime(sec, nsec);
+    }
+
+    static timeT realTime2Time(RealTime rt, tempoT tempo) {
+        static timeT cdur = Note(Note::Crotchet).getDuration();
+        double tsec = (double(rt.sec) * cdur) * (tempo / (60.0 * 100000.0));
+        double tnsec = (double(rt.nsec) * cdur) * (tempo / 100000.0);
+        double dt = tsec + (tnsec / 60000000000.0);
+        return (timeT)(dt + (dt < 0 ? -1e-6 : 1e-6));
+    }
+
+    static timeT realTime2Time(RealTime rt, tempoT tempo,
+                               timeT targetTime, tempoT targetTempo) {
+        static timeT cdur = Note(Note::Crotchet).getDuration();
+        if (targetTempo == tempo) return realTime2Time(rt, tempo);
+        double a = (100000 * 60) / (double(tempo) * cdur);
+        double b = (100000 * 60) / (double(targetTempo) * cdur);
+        double t = double(rt.sec) + double(rt.nsec) / 1e9;
+        double n = targetTime;
+        double term1 = 2.0 * n * a;
+        double term2 = (2.0 * n * a) * (2.0 * n * a) + 8 * (b - a) * t * n;
+        if (term2 < 0) return realTime2Time(rt, tempo);
+        double term3 = sqrt(term2);
+        if (term3 > 0) term3 = -term3;
+        double result = - (term1 + term3) / (2 * (b - a));
+        return long(result + 0.1);
+    }
+
+    tempoT m_defaultTempo;
+    timeT m_endMarker;
+    std::vector<Tempo> m_tempos;
+    std::vector<RealTime> m_timestamps;
+};
+
+static int
+check(const char *name, tempoT defaultTempo, timeT endMarker,
+      const std::vector<Tempo> &tempos)
+{
+    Composition c;
+    c.setCompositionDefaultTempo(defaultTempo);
+    c.setEndMarker(endMarker);
+    for (size_t i = 0; i < tempos.size(); ++i) {
+        c.addTempoAtTime(tempos[i].time, tempos[i].tempo, tempos[i].target);
+    }
+
+    Reference ref(defaultTempo, endMarker, tempos);
+
+    int failures = 0, checked = 0;
+    std::vector<timeT> times;
+
+    for (timeT t = -3840; t <= endMarker + 3840; t += 37) {
+
+        times.push_back(t);
+        ++checked;
+
+        tempoT tempo = c.getTempoAtTime(t);
+        if (tempo != ref.getTempoAtTime(t)) {
+            std::cerr << name << ": tempo at " << t << " is " << tempo
+                      << ", expected " << ref.getTempoAtTime(t) << std::endl;
+            ++failures;
+        }
+
+        RealTime rt = c.getElapsedRealTime(t);
+        if (rt != ref.getElapsedRealTime(t)) {
+            std::cerr << name << ": real time at " << t << " is " << rt
+                      << ", expected " << ref.getElapsedRealTime(t)
+                      << std::endl;
+            ++failures;
+        }
+
+        timeT back = c.getElapsedTimeForRealTime(rt);
+        if (back != ref.getElapsedTimeForRealTime(rt)) {
+            std::cerr << name << ": time at " << rt << " is " << back
+                      << ", expected " << ref.getElapsedTimeForRealTime(rt)
+                      << std::endl;
+            ++failures;
+        }
+
+        // The round trip is only exact to a tick
+        if (t >= 0 && (back < t - 1 || back > t + 1)) {
+            std::cerr << name << ": " << t << " -> " << rt << " -> "
+                      << back << std::endl;
+            ++failures;
+        }
+    }
+
+    // The batch conversion must give exactly what converting each
+    // time on its own does, whether or not the times are in order
+
+    const TempoMap &map = c.getTempoMap();
+    std::vector<RealTime> realTimes;
+
+    for (int pass = 0; pass < 3; ++pass) {
+        if (pass == 1) std::reverse(times.begin(), times.end());
+        if (pass == 2) {
+            std::sort(times.begin(), times.end());
+            for (size_t i = 0; i + 5 < times.size(); i += 7) {
+                std::swap(times[i], times[i + 5]);
+            }
+        }
+        map.getElapsedRealTimes(times, realTimes);
+        for (size_t i = 0; i < times.size(); ++i) {
+            if (realTimes[i] != c.getElapsedRealTime(times[i])) {
+                std::cerr << name << ": batch pass " << pass << ": "
+                          << times[i] << " -> " << realTimes[i]
+                          << ", expected "
+                          << c.getElapsedRealTime(times[i]) << std::endl;
+                ++failures;
+            }
+        }
+    }
+
+    std::cerr << name << ": " << (failures ? "FAIL" : "ok") << ", "
+              << checked << " times, " << failures << " failures"
+              << std::endl;
+    return failures;
+}
+
+int main(int, char **)
+{
+    const timeT bar = 3840;
+    int failures = 0;
+    std::vector<Tempo> tempos;
+
+    failures += check("default", 12000000, 16 * bar, tempos);
+
+    tempos.push_back(Tempo(0, 9000000, -1));
+    tempos.push_back(Tempo(4 * bar, 14000000, -1));
+    tempos.push_back(Tempo(5 * bar + 960, 6000000, -1));
+    tempos.push_back(Tempo(11 * bar, 20000000, -1));
+    failures += check("flat", 12000000, 16 * bar, tempos);
+
+    tempos.clear();
+    tempos.push_back(Tempo(2 * bar, 9000000, -1));
+    tempos.push_back(Tempo(6 * bar, 15000000, -1));
+    failures += check("flat, late start", 11000000, 16 * bar, tempos);
+
+    // Ramps to an explicit target, to the next tempo (target 0), and
+    // from the last tempo to the end marker
+    tempos.clear();
+    tempos.push_back(Tempo(0, 8000000, 16000000));
+    tempos.push_back(Tempo(4 * bar, 12000000, 0));
+    tempos.push_back(Tempo(7 * bar, 7000000, -1));
+    tempos.push_back(Tempo(9 * bar + 480, 10000000, 0));
+    tempos.push_back(Tempo(10 * bar, 18000000, 6000000));
+    failures += check("ramped", 12000000, 16 * bar, tempos);
+
+    tempos.clear();
+    tempos.push_back(Tempo(bar, 6000000, 0));
+    tempos.push_back(Tempo(3 * bar, 24000000, 9000000));
+    tempos.push_back(Tempo(8 * bar, 12000000, 0));
+    failures += check("ramped, late start", 10000000, 12 * bar, tempos);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Helpers shared by the timing tests in test/base: a clock, the peak
+// memory of the process, running a load or save in a child process
+// so that the peaks of several don't mask one another, and a
+// temporary directory for the files a test writes.
+
+#ifndef RG_TEST_UTIL_H
+#define RG_TEST_UTIL_H
+
+#include <QDir>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+inline double
+now()
+{
+    struct timeval tv;
+    (void)gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+inline long
+peakKB()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+/**
+ * Call f(arg) in a child process and return what it returned, or 0
+ * if the child failed.  The result comes back through a pipe.
+ */
+template <typename T>
+unsigned long
+runChild(unsigned long (*f)(const T &), const T &arg)
+{
+    int fds[2];
+    if (pipe(fds) != 0) return 0;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        unsigned long result = f(arg);
+        ssize_t n = write(fds[1], &result, sizeof(result));
+        _exit(n == sizeof(result) ? 0 : 1);
+    }
+
+    unsigned long result = 0;
+    if (pid < 0 || read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+        result = 0;
+    }
+    if (pid > 0) waitpid(pid, 0, 0);
+    close(fds[0]);
+    close(fds[1]);
+    return result;
+}
+
+/**
+ * A newly made directory under the system's temporary directory,
+ * removed with everything in it when this is destroyed, so that
+ * tests running at the same time don't share files.  Child processes
+ * leave with _exit() and so don't remove it.
+ */
+class TemporaryDirectory
+{
+public:
+    TemporaryDirectory(const char *name) {
+        QByteArray pattern = QFile::encodeName
+            (QDir::tempPath() + "/" + name + "-XXXXXX");
+        if (mkdtemp(pattern.data())) {
+            m_path = QFile::decodeName(pattern);
+        } else {
+            perror(pattern.data());
+            exit(2);
+        }
+    }
+
+    ~TemporaryDirectory() {
+        remove(m_path);
+    }
+
+    QString getPath() const { return m_path; }
+
+    /// Return the full name of a file in the directory.
+    QString getFileName(const QString &name) const {
+        return m_path + "/" + name;
+    }
+
+private:
+    TemporaryDirectory(const TemporaryDirectory &);
+    TemporaryDirectory &operator=(const TemporaryDirectory &);
+
+    static void remove(const QString &path) {
+        QDir dir(path);
+        QStringList dirs = dir.entryList(QDir::Dirs | QDir::Hidden |
+                                         QDir::NoSymLinks |
+                                         QDir::NoDotAndDotDot);
+        for (int i = 0; i < dirs.size(); ++i) {
+            remove(dir.filePath(dirs[i]));
+        }
+        QStringList files = dir.entryList(QDir::Files | QDir::Hidden |
+                                          QDir::System);
+        for (int i = 0; i < files.size(); ++i) dir.remove(files[i]);
+        QDir().rmdir(path);
+    }
+
+    QString m_path;
+};
+
+#endif
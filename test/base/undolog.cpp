@@ -0,0 +1,311 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Run some BasicCommands over a long region of a segment of notes,
+// undoing and redoing each a few times, and check that the segment
+// comes back exactly as it was each time.  Reports the memory each
+// command keeps for undo, against what a copy of its whole region
+// (as BasicCommand used to keep) would take.  Each command is also
+// spilled and restored, as CommandHistory does with old commands, and
+// checked to undo the same way afterwards.  Last, a note of a chord
+// is changed and laid out, and checked to be the one undo takes out.
+//
+// Usage: undolog [notes]
+
+#include "base/Event.h"
+#include "base/NotationTypes.h"
+#include "base/BaseProperties.h"
+#include "base/Segment.h"
+#include "document/BasicCommand.h"
+
+#include <QString>
+#include <QByteArray>
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Rosegarden;
+
+static const timeT noteDuration = 240;
+
+// Change the velocity of a few of the notes in the region
+class VelocityCommand : public BasicCommand
+{
+public:
+    VelocityCommand(Segment &segment, timeT start, timeT end, int every) :
+        BasicCommand("Change Velocity", segment, start, end),
+        m_every(every) { }
+
+protected:
+    virtual void modifySegment() {
+        Segment &segment = getSegment();
+        int n = 0;
+        for (Segment::iterator i = segment.findTime(getStartTime());
+             i != segment.findTime(getEndTime()); ++i) {
+            if (n++ % m_every == 0) {
+                (*i)->set<Int>(BaseProperties::VELOCITY, 64);
+            }
+        }
+    }
+
+private:
+    int m_every;
+};
+
+// Replace every note in the region with one a semitone up, by pointer,
+// so needing a brute force redo
+class TransposeCommand : public BasicCommand
+{
+public:
+    TransposeCommand(Segment &segment, timeT start, timeT end) :
+        BasicCommand("Transpose", segment, start, end, true) { }
+
+protected:
+    virtual void modifySegment() {
+        Segment &segment = getSegment();
+        std::vector<Event *> notes;
+        for (Segment::iterator i = segment.findTime(getStartTime());
+             i != segment.findTime(getEndTime()); ++i) {
+            notes.push_back(*i);
+        }
+        for (size_t i = 0; i < notes.size(); ++i) {
+            Event *e = new Event(*notes[i]);
+            e->set<Int>(BaseProperties::PITCH,
+                        e->get<Int>(BaseProperties::PITCH) + 1);
+            segment.eraseSingle(notes[i]);
+            segment.insert(e);
+        }
+    }
+};
+
+// Add a note and take one away
+class ReplaceCommand : public BasicCommand
+{
+public:
+    ReplaceCommand(Segment &segment, timeT time) :
+        BasicCommand("Replace", segment, time, time + noteDuration * 2) { }
+
+protected:
+    virtual void modifySegment() {
+        Segment &segment = getSegment();
+        segment.erase(segment.findTime(getStartTime()));
+        Event *e = new Event(Note::EventType, getStartTime() + noteDuration,
+                             noteDuration / 2);
+        e->set<Int>(BaseProperties::PITCH, 90);
+        segment.insert(e);
+    }
+};
+
+// Change the pitch of one note of a chord in place
+class ChordNoteCommand : public BasicCommand
+{
+public:
+    ChordNoteCommand(Segment &segment, timeT time, long from, long to) :
+        BasicCommand("Change Chord Note", segment, time, time + noteDuration),
+        m_from(from), m_to(to) { }
+
+protected:
+    virtual void modifySegment() {
+        Segment &segment = getSegment();
+        for (Segment::iterator i = segment.findTime(getStartTime());
+             i != segment.findTime(getEndTime()); ++i) {
+            if ((*i)->get<Int>(BaseProperties::PITCH) == m_from) {
+                (*i)->set<Int>(BaseProperties::PITCH, m_to);
+            }
+        }
+    }
+
+private:
+    long m_from;
+    long m_to;
+};
+
+static std::vector<std::string>
+dump(Segment &segment)
+{
+    std::vector<std::string> events;
+    for (Segment::iterator i = segment.begin(); i != segment.end(); ++i) {
+        events.push_back((*i)->toXmlString());
+    }
+    return events;
+}
+
+static size_t
+regionSize(Segment &segment, timeT start, timeT end)
+{
+    size_t bytes = 0;
+    for (Segment::iterator i = segment.findTime(start);
+         i != segment.findTime(end); ++i) {
+        bytes += (*i)->getStorageSize();
+    }
+    return bytes;
+}
+
+static int
+check(const char *name, BasicCommand &command, Segment &segment)
+{
+    size_t region = regionSize(segment, command.getStartTime(),
+                               command.getEndTime());
+    std::vector<std::string> before = dump(segment);
+
+    command.execute();
+    std::vector<std::string> after = dump(segment);
+
+    int failures = 0;
+
+    if (after == before) {
+        fprintf(stderr, "ERROR: %s: command changed nothing\n", name);
+        ++failures;
+    }
+
+    for (int cycle = 0; cycle < 3; ++cycle) {
+        command.unexecute();
+        if (dump(segment) != before) {
+            fprintf(stderr, "ERROR: %s: undo %d did not restore segment\n",
+                    name, cycle + 1);
+            ++failures;
+        }
+        command.execute();
+        if (dump(segment) != after) {
+            fprintf(stderr, "ERROR: %s: redo %d did not repeat command\n",
+                    name, cycle + 1);
+            ++failures;
+        }
+    }
+
+    fprintf(stderr, "%-16s %6d removed %6d added %10d bytes kept, "
+            "%10d for the region\n", name,
+            int(command.getRemovedCount()), int(command.getAddedCount()),
+            int(command.getMemoryUse()), int(region));
+
+    size_t kept = command.getMemoryUse();
+    size_t removed = command.getRemovedCount();
+    size_t added = command.getAddedCount();
+
+    QByteArray data;
+    if (!command.spill(data)) {
+        fprintf(stderr, "ERROR: %s: command refused to spill\n", name);
+        return failures + 1;
+    }
+    if (command.getMemoryUse() >= kept && removed + added > 0) {
+        fprintf(stderr, "ERROR: %s: spilling freed no memory\n", name);
+        ++failures;
+    }
+    if (!command.restore(data) ||
+        command.getRemovedCount() != removed ||
+        command.getAddedCount() != added) {
+        fprintf(stderr, "ERROR: %s: failed to restore spilled command\n",
+                name);
+        return failures + 1;
+    }
+
+    command.unexecute();
+    if (dump(segment) != before) {
+        fprintf(stderr, "ERROR: %s: undo after restore did not restore "
+                "segment\n", name);
+        ++failures;
+    }
+    command.execute();
+    if (dump(segment) != after) {
+        fprintf(stderr, "ERROR: %s: redo after restore did not repeat "
+                "command\n", name);
+        ++failures;
+    }
+
+    fprintf(stderr, "%-16s %10d bytes spilled\n", name, int(data.size()));
+
+    return failures;
+}
+
+// Edit one note of a chord, then set a non-persistent property on
+// every note as layout does, which unshares them from the command's
+// log, and check that undo takes out the edited note and not another
+
+static int
+checkChord()
+{
+    Segment segment;
+    const long pitches[] = { 60, 61 };
+    for (int i = 0; i < 2; ++i) {
+        Event *e = new Event(Note::EventType, 0, noteDuration);
+        e->set<Int>(BaseProperties::PITCH, pitches[i]);
+        segment.insert(e);
+    }
+
+    ChordNoteCommand command(segment, 0, 61, 62);
+    command.execute();
+
+    const PropertyName layoutProperty("TestLayoutX");
+    for (Segment::iterator i = segment.begin(); i != segment.end(); ++i) {
+        (*i)->setMaybe<Int>(layoutProperty, 10);
+    }
+
+    command.unexecute();
+
+    // The layout property stays on the note that was left alone, so
+    // compare just the pitches
+    std::vector<long> after;
+    for (Segment::iterator i = segment.begin(); i != segment.end(); ++i) {
+        after.push_back((*i)->get<Int>(BaseProperties::PITCH));
+    }
+
+    if (after != std::vector<long>(pitches, pitches + 2)) {
+        fprintf(stderr, "ERROR: chord: undo after layout took out the "
+                "wrong note:");
+        for (size_t i = 0; i < after.size(); ++i) {
+            fprintf(stderr, " %ld", after[i]);
+        }
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int count = (argc > 1 ? atoi(argv[1]) : 10000);
+
+    Segment segment;
+    for (int i = 0; i < count; ++i) {
+        Event *e = new Event(Note::EventType, i * noteDuration, noteDuration);
+        e->set<Int>(BaseProperties::PITCH, 36 + (i % 48));
+        e->set<Int>(BaseProperties::VELOCITY, 100);
+        segment.insert(e);
+    }
+
+    timeT end = count * noteDuration;
+    int failures = 0;
+
+    VelocityCommand few(segment, 0, end, count / 3);
+    failures += check("velocity (few)", few, segment);
+
+    VelocityCommand all(segment, 0, end, 1);
+    failures += check("velocity (all)", all, segment);
+
+    TransposeCommand transpose(segment, end / 4, end / 2);
+    failures += check("transpose", transpose, segment);
+
+    ReplaceCommand replace(segment, end / 2);
+    failures += check("replace", replace, segment);
+
+    failures += checkChord();
+
+    // and all of them undone in turn
+    replace.unexecute();
+    transpose.unexecute();
+    all.unexecute();
+    few.unexecute();
+
+    for (Segment::iterator i = segment.begin(); i != segment.end(); ++i) {
+        if ((*i)->get<Int>(BaseProperties::VELOCITY) != 100) {
+            fprintf(stderr, "ERROR: velocity not restored at %ld\n",
+                    long((*i)->getAbsoluteTime()));
+            ++failures;
+            break;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Time WAVAudioFile::decode over generated WAV files of each sample
+// size, mono and stereo, in each AudioKernels implementation the CPU
+// supports, against a loop over RIFFAudioFile::convertBytesToSample as
+// the decoding used to be done.  Every implementation is checked to
+// give exactly the same samples as convertBytesToSample.
+//
+// Usage: wavdecode [seconds [passes]]
+
+#include "sound/WAVAudioFile.h"
+#include "sound/AudioKernels.h"
+
+#include "testutil.h"
+
+#include <QFile>
+#include <QString>
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+using namespace Rosegarden;
+
+static const unsigned int sampleRate = 48000;
+
+static void
+putSample(std::string &s, float v, int bits)
+{
+    switch (bits) {
+    case 8:
+        s += char(int(lrintf(v * 127.0f)) + 128);
+        break;
+    case 16: {
+        int n = int(lrintf(v * 32767.0f));
+        s += char(n); s += char(n >> 8);
+        break;
+    }
+    case 24: {
+        int n = int(lrint(v * 8388607.0));
+        s += char(n); s += char(n >> 8); s += char(n >> 16);
+        break;
+    }
+    case 32: {
+        char bytes[4];
+        memcpy(bytes, &v, 4);
+        s.append(bytes, 4);
+        break;
+    }
+    }
+}
+
+static void
+putLittleEndian(std::string &s, unsigned int n, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) s += char(n >> (i * 8));
+}
+
+// A tone on each channel, with a full-scale click now and then.  The
+// header is written here, as RIFFAudioFile only writes 16-bit and
+// floating-point files.
+static bool
+writeSynthetic(const QString &fileName, int bits, int channels, int frames)
+{
+    int bytesPerFrame = channels * bits / 8;
+
+    std::string samples;
+    for (int i = 0; i < frames; ++i) {
+        for (int ch = 0; ch < channels; ++ch) {
+            float v = 0.8f * sinf(i * (ch + 1) * 0.0576f);
+            if (i % 4801 == 0) v = (ch ? -1.0f : 1.0f);
+            putSample(samples, v, bits);
+        }
+    }
+
+    std::string file("RIFF");
+    putLittleEndian(file, 36 + samples.size(), 4);
+    file += "WAVEfmt ";
+    putLittleEndian(file, 16, 4);
+    putLittleEndian(file, bits == 32 ? 3 : 1, 2);
+    putLittleEndian(file, channels, 2);
+    putLittleEndian(file, sampleRate, 4);
+    putLittleEndian(file, sampleRate * bytesPerFrame, 4);
+    putLittleEndian(file, bytesPerFrame, 2);
+    putLittleEndian(file, bits, 2);
+    file += "data";
+    putLittleEndian(file, samples.size(), 4);
+    file += samples;
+
+    FILE *f = fopen(QFile::encodeName(fileName).data(), "wb");
+    if (!f) return false;
+    bool ok = (fwrite(file.data(), 1, file.size(), f) == file.size());
+    if (fclose(f) != 0) ok = false;
+    return ok;
+}
+
+static bool
+same(const std::vector<std::vector<float> > &a,
+     const std::vector<std::vector<float> > &b)
+{
+    for (size_t ch = 0; ch < a.size(); ++ch) {
+        if (memcmp(&a[ch][0], &b[ch][0], a[ch].size() * sizeof(float))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = (argc > 1 ? atoi(argv[1]) : 60);
+    int passes = (argc > 2 ? atoi(argv[2]) : 5);
+    int frames = seconds * sampleRate;
+    int failures = 0;
+
+    static const int sizes[] = { 8, 16, 24, 32 };
+
+    TemporaryDirectory dir("wavdecode");
+
+    for (int s = 0; s < 4; ++s) {
+        for (int channels = 1; channels <= 2; ++channels) {
+
+            int bits = sizes[s];
+            QString fileName = dir.getFileName
+                (QString("test-%1-%2.wav").arg(bits).arg(channels));
+
+            if (!writeSynthetic(fileName, bits, channels, frames)) {
+                fprintf(stderr, "ERROR: failed to write %s\n",
+                        fileName.toLocal8Bit().data());
+                return 2;
+            }
+
+            WAVAudioFile file(0, "wavdecode", fileName);
+            if (!file.open()) {
+                fprintf(stderr, "ERROR: failed to read %s\n",
+                        fileName.toLocal8Bit().data());
+                return 2;
+            }
+
+            std::string raw = file.getSampleFrames(frames);
+            const unsigned char *data = (const unsigned char *)raw.data();
+            size_t bytesPerSample = bits / 8;
+            double mb = raw.size() * passes / 1048576.0;
+
+            std::vector<std::vector<float> > reference
+                (channels, std::vector<float>(frames));
+
+            double start = now();
+            for (int p = 0; p < passes; ++p) {
+                for (int i = 0; i < frames; ++i) {
+                    for (int ch = 0; ch < channels; ++ch) {
+                        reference[ch][i] = file.convertBytesToSample
+                            (data + (i * channels + ch) * bytesPerSample);
+                    }
+                }
+            }
+            double secs = now() - start;
+
+            fprintf(stderr, "%2d-bit %s, per sample: %8.1f MB/s\n",
+                    bits, channels == 1 ? "mono  " : "stereo",
+                    mb / (secs > 0 ? secs : 1e-6));
+
+            for (int i = int(AudioKernels::Scalar);
+                 i <= int(AudioKernels::AVX2); ++i) {
+
+                AudioKernels::Implementation implementation =
+                    AudioKernels::Implementation(i);
+                if (!AudioKernels::setImplementation(implementation)) {
+                    continue;
+                }
+
+                std::vector<std::vector<float> > decoded
+                    (channels, std::vector<float>(frames));
+                std::vector<float *> targets;
+                for (int ch = 0; ch < channels; ++ch) {
+                    targets.push_back(&decoded[ch][0]);
+                }
+
+                start = now();
+                for (int p = 0; p < passes; ++p) {
+                    file.decode(data, raw.size(), sampleRate, channels,
+                                frames, targets);
+                }
+                secs = now() - start;
+
+                bool ok = same(reference, decoded);
+                if (!ok) ++failures;
+
+                fprintf(stderr, "%2d-bit %s, %-10s %8.1f MB/s%s\n",
+                        bits, channels == 1 ? "mono  " : "stereo",
+                        (std::string(AudioKernels::getImplementationName
+                                     (implementation)) + ":").c_str(),
+                        mb / (secs > 0 ? secs : 1e-6),
+                        ok ? "" : "  MISMATCH");
+            }
+
+            file.close();
+
+            // Each file is large, so don't keep it until the end
+            QFile::remove(fileName);
+        }
+    }
+
+    return failures ? 1 : 0;
+}
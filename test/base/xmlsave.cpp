@@ -0,0 +1,150 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+// Compare writing the events of a document the old way (a new string
+// from Event::toXmlString for each event, converted to a QString and
+// gathered into one big one, which is then compressed in a single go)
+// with appending each event to one reused buffer that is compressed
+// as it fills, as RosegardenDocument::saveSegment now does.  Reports
+// the uncompressed MB/s and peak memory of each, and checks that the
+// two produce the same text.  Each runs in its own process so the
+// peaks don't mask one another.
+//
+// Usage: xmlsave [events]
+
+#include "base/Event.h"
+#include "base/NotationTypes.h"
+#include "base/BaseProperties.h"
+
+#include "testutil.h"
+
+#include <QString>
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <zlib.h>
+
+using namespace Rosegarden;
+
+// The events to save, and the file to save them to
+struct SaveJob
+{
+    const std::vector<Event *> *events;
+    QString fileName;
+};
+
+static void
+report(const char *name, double start, size_t bytes, unsigned long crc)
+{
+    double secs = now() - start;
+    double mb = double(bytes) / (1024.0 * 1024.0);
+    fprintf(stderr, "%-10s %8.1f MB  %7.3f s  %7.1f MB/s  peak %7ld KB"
+            "  crc %08lx\n",
+            name, mb, secs, mb / secs, peakKB(), crc);
+}
+
+static unsigned long
+saveWhole(const SaveJob &job)
+{
+    double start = now();
+    const std::vector<Event *> &events = *job.events;
+
+    QString text;
+    timeT expectedTime = 0;
+    for (size_t i = 0; i < events.size(); ++i) {
+        text += '\t';
+        text += QString::fromUtf8(events[i]->toXmlString(expectedTime).c_str());
+        text += '\n';
+        expectedTime = events[i]->getAbsoluteTime() +
+            events[i]->getDuration();
+    }
+
+    QByteArray utf8 = text.toUtf8();
+    unsigned long crc = crc32(0L, (const Bytef *)utf8.data(), utf8.size());
+
+    gzFile fd = gzopen(QFile::encodeName(job.fileName).data(), "wb");
+    gzwrite(fd, utf8.data(), utf8.size());
+    gzclose(fd);
+
+    report("whole", start, utf8.size(), crc);
+    return crc;
+}
+
+static unsigned long
+saveStreaming(const SaveJob &job)
+{
+    double start = now();
+    const std::vector<Event *> &events = *job.events;
+
+    gzFile fd = gzopen(QFile::encodeName(job.fileName).data(), "wb");
+    gzbuffer(fd, 128 * 1024);
+
+    const size_t bufferSize = 64 * 1024;
+    std::string xml;
+    xml.reserve(bufferSize + 4096);
+
+    unsigned long crc = crc32(0L, Z_NULL, 0);
+    size_t bytes = 0;
+
+    timeT expectedTime = 0;
+    for (size_t i = 0; i < events.size(); ++i) {
+        xml += '\t';
+        events[i]->appendXmlString(xml, expectedTime);
+        xml += '\n';
+        expectedTime = events[i]->getAbsoluteTime() +
+            events[i]->getDuration();
+        if (xml.size() >= bufferSize || i + 1 == events.size()) {
+            crc = crc32(crc, (const Bytef *)xml.data(), xml.size());
+            gzwrite(fd, xml.data(), xml.size());
+            bytes += xml.size();
+            xml.clear();
+        }
+    }
+
+    gzclose(fd);
+
+    report("streaming", start, bytes, crc);
+    return crc;
+}
+
+int main(int argc, char **argv)
+{
+    int count = (argc > 1 ? atoi(argv[1]) : 1000000);
+
+    std::vector<Event *> events;
+    events.reserve(count);
+
+    timeT t = 0;
+    for (int i = 0; i < count; ++i) {
+        Event *e = new Event(Note::EventType, t, 240);
+        e->set<Int>(BaseProperties::PITCH, 36 + (i % 48));
+        e->set<Int>(BaseProperties::VELOCITY, 100);
+        if (i % 4 == 0) {
+            e->set<Bool>(BaseProperties::TIED_FORWARD, true);
+            e->set<Int>(BaseProperties::BEAMED_GROUP_ID, i / 4);
+            e->set<String>(BaseProperties::BEAMED_GROUP_TYPE,
+                           BaseProperties::GROUP_TYPE_BEAMED);
+        }
+        events.push_back(e);
+        t += (i % 3 == 0 ? 240 : 120);
+    }
+
+    TemporaryDirectory dir("xmlsave");
+
+    SaveJob job;
+    job.events = &events;
+    job.fileName = dir.getFileName("test.rg");
+
+    unsigned long whole = runChild(saveWhole, job);
+    unsigned long streaming = runChild(saveStreaming, job);
+
+    for (size_t i = 0; i < events.size(); ++i) delete events[i];
+
+    if (whole != streaming || whole == 0) {
+        fprintf(stderr, "ERROR: output differs\n");
+        return 1;
+    }
+
+    return 0;
+}